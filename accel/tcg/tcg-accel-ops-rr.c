@@ -24,7 +24,6 @@
  */
 
 #include "qemu/osdep.h"
-#include "qemu/lockable.h"
 #include "sysemu/tcg.h"
 #include "sysemu/replay.h"
 #include "sysemu/cpu-timers.h"
@@ -81,10 +80,46 @@ static void rr_kick_next_cpu(void)
     } while (cpu != qatomic_read(&rr_current_cpu));
 }
 
+/* Whether a vCPU other than the scheduled one has anything to do */
+static bool rr_other_cpu_runnable(void)
+{
+    CPUState *current = qatomic_read(&rr_current_cpu);
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu != current && !cpu_thread_is_idle(cpu)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void rr_kick_thread(void *opaque)
 {
     timer_mod(rr_kick_vcpu_timer, rr_next_kick_time());
-    rr_kick_next_cpu();
+    /*
+     * If the other vCPUs are halted there is nobody to switch to, and
+     * breaking the running vCPU out of its TB chain only costs time.
+     * Waking one of them up kicks the thread anyway.
+     */
+    if (rr_other_cpu_runnable()) {
+        rr_kick_next_cpu();
+    }
+}
+
+/*
+ * Called when the running vCPU raises an interrupt for another vCPU.  They
+ * share this thread, so without a kick the target, typically a core halted
+ * waiting for that very interrupt, would only run once the time slice of
+ * the current vCPU ends.
+ */
+void rr_kick_other_cpu(CPUState *target)
+{
+    CPUState *cpu = qatomic_read(&rr_current_cpu);
+
+    if (cpu && cpu != target) {
+        cpu_exit(cpu);
+    }
 }
 
 static void rr_start_kick_timer(void)
@@ -147,26 +182,21 @@ static void rr_force_rcu(Notifier *notify, void *data)
  * the main CPU thread loop so that we can fairly distribute the instruction
  * count across CPUs.
  *
- * The CPU count is cached based on the CPU list generation ID to avoid
- * iterating the list every time.
+ * Idle CPUs are skipped by the loop, so they get no share of the budget
+ * and a core halted in WAITI or WFI leaves all of it to the busy ones.
  */
 static int rr_cpu_count(void)
 {
-    static unsigned int last_gen_id = ~0;
-    static int cpu_count;
     CPUState *cpu;
+    int cpu_count = 0;
 
-    QEMU_LOCK_GUARD(&qemu_cpu_list_lock);
-
-    if (cpu_list_generation_id_get() != last_gen_id) {
-        cpu_count = 0;
-        CPU_FOREACH(cpu) {
+    CPU_FOREACH(cpu) {
+        if (!cpu_thread_is_idle(cpu)) {
             ++cpu_count;
         }
-        last_gen_id = cpu_list_generation_id_get();
     }
 
-    return cpu_count;
+    return MAX(cpu_count, 1);
 }
 
 /*
@@ -254,6 +284,16 @@ static void *rr_cpu_thread_fn(void *arg)
             if (cpu_can_run(cpu)) {
                 int r;
 
+                /*
+                 * A halted vCPU without pending interrupts would leave
+                 * cpu_exec() at once; skip the round trip.  Raising an
+                 * interrupt for it kicks this thread.
+                 */
+                if (cpu_thread_is_idle(cpu)) {
+                    cpu = CPU_NEXT(cpu);
+                    continue;
+                }
+
                 bql_unlock();
                 if (icount_enabled()) {
                     icount_prepare_for_run(cpu, cpu_budget);
@@ -15,6 +15,9 @@
 /* Kick all RR vCPUs. */
 void rr_kick_vcpu_thread(CPUState *unused);
 
+/* End the time slice of the running vCPU so that target gets to run. */
+void rr_kick_other_cpu(CPUState *target);
+
 /* start the round robin vcpu thread */
 void rr_start_vcpu_thread(CPUState *cpu);
 
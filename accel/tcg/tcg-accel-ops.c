@@ -102,6 +102,10 @@ void tcg_handle_interrupt(CPUState *cpu, int mask)
         qemu_cpu_kick(cpu);
     } else {
         qatomic_set(&cpu->neg.icount_decr.u16.high, -1);
+        /* with a single thread, cpu may not be the one running */
+        if (!qemu_tcg_mttcg_enabled()) {
+            rr_kick_other_cpu(cpu);
+        }
     }
 }
 
@@ -0,0 +1,425 @@
+/*
+ * Stand-in sensor simulator for the esp-cosim devices
+ *
+ * Serves register-file sensors over the shared-memory protocol of
+ * hw/sensor/esp_cosim_proto.h.  I2C devices take the first written byte as
+ * the register pointer and auto-increment; SPI devices take a first byte of
+ * 0x80 | reg for reads and reg for writes.  Registers can be preset, and
+ * driven by sine waveforms evaluated at the guest's virtual time, so a test
+ * sees the same data stream on every run.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "qemu/cutils.h"
+#include "qemu/processor.h"
+#include "hw/sensor/esp_cosim_proto.h"
+#include <math.h>
+#include <sys/mman.h>
+
+#define SIM_DEFAULT_SHM_PATH    "/dev/shm/esp-cosim"
+#define SIM_SPINS               4096
+#define SIM_POLL_US             20
+
+typedef struct SimWave {
+    uint8_t reg;
+    uint8_t width;          /* bytes, stored big endian */
+    double offset;
+    double amplitude;
+    double period_ns;
+} SimWave;
+
+typedef struct SimDevice {
+    uint8_t regs[256];
+    uint8_t ptr;
+    GArray *waves;
+} SimDevice;
+
+typedef struct Sim {
+    EspCosimShared *shm;
+    GHashTable *devices;    /* SimDevice by sim_key() */
+    bool verbose;
+} Sim;
+
+static volatile sig_atomic_t sim_quit;
+
+static void sim_usage(const char *progname)
+{
+    printf("Usage: %s [OPTION]...\n"
+           "  -h: show this help\n"
+           "  -v: verbose mode\n"
+           "  -S <shm-path>: file shared with QEMU, default "
+           SIM_DEFAULT_SHM_PATH "\n"
+           "  -d <dev>: serve a register-file device\n"
+           "  -r <dev>:<reg>=<hex-bytes>: preset registers\n"
+           "  -w <dev>:<reg>:<width>:<offset>:<amplitude>:<period-ms>:\n"
+           "     drive <width> big-endian bytes at <reg> with\n"
+           "     offset + amplitude * sin(2 pi t / period), t in virtual time\n"
+           "  -f <file>: read further options from a file, one per line,\n"
+           "     e.g. \"-d i2c:0:0x76\"; '#' starts a comment\n"
+           "\n"
+           "<dev> is i2c:<bus>:<address> or spi:<host>:<cs>.\n"
+           "QEMU attaches with:\n"
+           "  -M esp32,cosim-shm=<shm-path>,cosim-i2c=0x76,cosim-spi=3.1\n",
+           progname);
+}
+
+static uint32_t sim_key(bool spi, unsigned bus, unsigned dev)
+{
+    return (spi << 24) | (bus << 16) | dev;
+}
+
+/* Parse "<dev>" at the start of str, returns the rest after a ':' */
+static const char *sim_parse_dev(const char *str, uint32_t *key)
+{
+    unsigned int bus, dev;
+    const char *end;
+    bool spi;
+
+    if (g_str_has_prefix(str, "i2c:")) {
+        spi = false;
+    } else if (g_str_has_prefix(str, "spi:")) {
+        spi = true;
+    } else {
+        return NULL;
+    }
+    if (qemu_strtoui(str + 4, &end, 0, &bus) < 0 || *end != ':' ||
+        qemu_strtoui(end + 1, &end, 0, &dev) < 0 || bus > 0xff ||
+        dev > 0xffff || (*end && *end != ':')) {
+        return NULL;
+    }
+    *key = sim_key(spi, bus, dev);
+    return *end ? end + 1 : end;
+}
+
+static SimDevice *sim_device(Sim *sim, uint32_t key)
+{
+    SimDevice *d = g_hash_table_lookup(sim->devices, GUINT_TO_POINTER(key));
+
+    if (!d) {
+        d = g_new0(SimDevice, 1);
+        d->waves = g_array_new(false, false, sizeof(SimWave));
+        g_hash_table_insert(sim->devices, GUINT_TO_POINTER(key), d);
+    }
+    return d;
+}
+
+static bool sim_parse_regs(SimDevice *d, const char *str)
+{
+    unsigned int reg, byte;
+    const char *end;
+
+    if (qemu_strtoui(str, &end, 0, &reg) < 0 || *end != '=' || reg > 0xff) {
+        return false;
+    }
+    for (end++; end[0] && end[1]; end += 2, reg++) {
+        if (sscanf(end, "%2x", &byte) != 1 || reg > 0xff) {
+            return false;
+        }
+        d->regs[reg] = byte;
+    }
+    return !*end;
+}
+
+static bool sim_parse_wave(SimDevice *d, const char *str)
+{
+    g_auto(GStrv) f = g_strsplit(str, ":", -1);
+    unsigned int reg, width;
+    SimWave w;
+
+    if (g_strv_length(f) != 5 ||
+        qemu_strtoui(f[0], NULL, 0, &reg) < 0 ||
+        qemu_strtoui(f[1], NULL, 0, &width) < 0 ||
+        reg > 0xff || width < 1 || width > 4 || reg + width > 0x100) {
+        return false;
+    }
+    w.reg = reg;
+    w.width = width;
+    w.offset = g_ascii_strtod(f[2], NULL);
+    w.amplitude = g_ascii_strtod(f[3], NULL);
+    w.period_ns = g_ascii_strtod(f[4], NULL) * 1e6;
+    if (w.period_ns <= 0) {
+        return false;
+    }
+    g_array_append_val(d->waves, w);
+    return true;
+}
+
+static bool sim_option(Sim *sim, int c, const char *arg, const char **shm_path);
+
+static bool sim_parse_file(Sim *sim, const char *path, const char **shm_path)
+{
+    g_autofree char *contents = NULL;
+    g_auto(GStrv) lines = NULL;
+    g_autoptr(GError) err = NULL;
+
+    if (!g_file_get_contents(path, &contents, NULL, &err)) {
+        fprintf(stderr, "%s\n", err->message);
+        return false;
+    }
+    lines = g_strsplit(contents, "\n", -1);
+    for (char **l = lines; *l; l++) {
+        char *line = g_strstrip(*l);
+
+        if (!*line || *line == '#') {
+            continue;
+        }
+        if (line[0] != '-' || !line[1] || line[2] != ' ' ||
+            !sim_option(sim, line[1], g_strstrip(line + 3), shm_path)) {
+            fprintf(stderr, "%s: cannot parse '%s'\n", path, line);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool sim_option(Sim *sim, int c, const char *arg, const char **shm_path)
+{
+    const char *rest;
+    uint32_t key;
+
+    switch (c) {
+    case 'v':
+        sim->verbose = true;
+        return true;
+    case 'S':
+        *shm_path = g_strdup(arg);
+        return true;
+    case 'f':
+        return sim_parse_file(sim, arg, shm_path);
+    case 'd':
+        rest = sim_parse_dev(arg, &key);
+        if (!rest || *rest) {
+            return false;
+        }
+        sim_device(sim, key);
+        return true;
+    case 'r':
+        rest = sim_parse_dev(arg, &key);
+        return rest && sim_parse_regs(sim_device(sim, key), rest);
+    case 'w':
+        rest = sim_parse_dev(arg, &key);
+        return rest && sim_parse_wave(sim_device(sim, key), rest);
+    default:
+        return false;
+    }
+}
+
+static void sim_update_waves(SimDevice *d, uint64_t time_ns)
+{
+    for (guint i = 0; i < d->waves->len; i++) {
+        SimWave *w = &g_array_index(d->waves, SimWave, i);
+        int64_t v = llround(w->offset + w->amplitude *
+                            sin(2 * M_PI * time_ns / w->period_ns));
+
+        for (int b = w->width - 1; b >= 0; b--, v >>= 8) {
+            d->regs[w->reg + b] = v;
+        }
+    }
+}
+
+static bool sim_wait(Sim *sim, int *spins)
+{
+    if (sim_quit) {
+        return false;
+    }
+    if ((*spins)++ < SIM_SPINS) {
+        cpu_relax();
+    } else {
+        g_usleep(SIM_POLL_US);
+    }
+    return true;
+}
+
+static void sim_respond(Sim *sim, uint32_t seq, const uint8_t *data,
+                        uint32_t size)
+{
+    EspCosimRing *r = &sim->shm->rsp;
+    uint32_t head = le32_to_cpu(r->head);
+    uint32_t rec = esp_cosim_record_size(size);
+    EspCosimMsg msg = {
+        .size = cpu_to_le32(size),
+        .type = ESP_COSIM_RESPONSE,
+        .seq = cpu_to_le32(seq),
+    };
+    int spins = 0;
+
+    while (head - le32_to_cpu(qatomic_load_acquire(&r->tail)) + rec >
+           ESP_COSIM_RING_SIZE) {
+        if (!sim_wait(sim, &spins)) {
+            return;
+        }
+    }
+    esp_cosim_ring_write(r, head, &msg, sizeof(msg));
+    esp_cosim_ring_write(r, head + sizeof(msg), data, size);
+    qatomic_store_release(&r->head, cpu_to_le32(head + rec));
+}
+
+static void sim_handle(Sim *sim, const EspCosimMsg *msg, const uint8_t *data)
+{
+    bool spi = msg->type == ESP_COSIM_SPI_XFER ||
+               msg->type == ESP_COSIM_SPI_END;
+    uint32_t key = sim_key(spi, msg->bus, le16_to_cpu(msg->dev));
+    SimDevice *d = g_hash_table_lookup(sim->devices, GUINT_TO_POINTER(key));
+    uint32_t size = le32_to_cpu(msg->size);
+    uint32_t count = MIN(le32_to_cpu(msg->count), ESP_COSIM_MAX_DATA);
+    uint8_t out[ESP_COSIM_MAX_DATA];
+
+    if (sim->verbose) {
+        printf("%" PRIu64 " ns: %s %u:0x%x type %u size %u count %u\n",
+               (uint64_t)le64_to_cpu(msg->time_ns), spi ? "spi" : "i2c",
+               msg->bus, le16_to_cpu(msg->dev), msg->type, size, count);
+    }
+    memset(out, 0xff, count);
+
+    switch (msg->type) {
+    case ESP_COSIM_I2C_WRITE:
+        if (d && size) {
+            d->ptr = data[0];
+            for (uint32_t i = 1; i < size; i++) {
+                d->regs[d->ptr++] = data[i];
+            }
+        }
+        break;
+    case ESP_COSIM_I2C_READ:
+        if (d) {
+            sim_update_waves(d, le64_to_cpu(msg->time_ns));
+            for (uint32_t i = 0; i < count; i++) {
+                out[i] = d->regs[(uint8_t)(d->ptr + i)];
+            }
+        }
+        sim_respond(sim, le32_to_cpu(msg->seq), out, count);
+        break;
+    case ESP_COSIM_I2C_READ_END:
+        if (d) {
+            d->ptr += count;
+        }
+        break;
+    case ESP_COSIM_SPI_XFER:
+        if (d && size && (data[0] & 0x80)) {
+            sim_update_waves(d, le64_to_cpu(msg->time_ns));
+            for (uint32_t i = 1; i < count; i++) {
+                out[i] = d->regs[(uint8_t)((data[0] & 0x7f) + i - 1)];
+            }
+        }
+        sim_respond(sim, le32_to_cpu(msg->seq), out, count);
+        break;
+    case ESP_COSIM_SPI_END:
+        if (d && size && !(data[0] & 0x80)) {
+            for (uint32_t i = 1; i < size; i++) {
+                d->regs[(uint8_t)(data[0] + i - 1)] = data[i];
+            }
+        }
+        break;
+    }
+}
+
+static EspCosimShared *sim_attach(const char *path)
+{
+    EspCosimShared *shm = NULL;
+    struct stat st;
+    int fd;
+
+    printf("waiting for QEMU on %s\n", path);
+    while (!sim_quit) {
+        if (!shm) {
+            fd = open(path, O_RDWR);
+            if (fd >= 0 && fstat(fd, &st) == 0 &&
+                st.st_size >= sizeof(EspCosimShared)) {
+                shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+                if (shm == MAP_FAILED) {
+                    perror("mmap");
+                    exit(1);
+                }
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        if (shm && le32_to_cpu(qatomic_load_acquire(&shm->magic)) ==
+                   ESP_COSIM_MAGIC) {
+            if (le32_to_cpu(shm->version) != ESP_COSIM_VERSION) {
+                fprintf(stderr, "protocol version %u, expected %u\n",
+                        le32_to_cpu(shm->version), ESP_COSIM_VERSION);
+                exit(1);
+            }
+            return shm;
+        }
+        g_usleep(100 * 1000);
+    }
+    exit(0);
+}
+
+static void sim_signal(int sig)
+{
+    sim_quit = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *shm_path = SIM_DEFAULT_SHM_PATH;
+    uint8_t data[ESP_COSIM_MAX_DATA];
+    Sim sim = {
+        .devices = g_hash_table_new(NULL, NULL),
+    };
+    EspCosimRing *r;
+    int spins = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "hvS:d:r:w:f:")) != -1) {
+        if (c == 'h') {
+            sim_usage(argv[0]);
+            exit(0);
+        }
+        if (c == '?' || !sim_option(&sim, c, optarg, &shm_path)) {
+            if (c != '?') {
+                fprintf(stderr, "cannot parse -%c '%s'\n", c, optarg);
+            }
+            sim_usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    signal(SIGINT, sim_signal);
+    signal(SIGTERM, sim_signal);
+    sim.shm = sim_attach(shm_path);
+    r = &sim.shm->req;
+    printf("attached, serving %u devices\n",
+           g_hash_table_size(sim.devices));
+    fflush(stdout);
+
+    while (!sim_quit) {
+        uint32_t tail = le32_to_cpu(r->tail);
+        EspCosimMsg msg;
+        uint32_t size;
+
+        if (le32_to_cpu(qatomic_load_acquire(&r->head)) == tail) {
+            /* QEMU restarted and reset the rings */
+            if (le32_to_cpu(qatomic_read(&sim.shm->magic)) !=
+                ESP_COSIM_MAGIC) {
+                sim.shm = sim_attach(shm_path);
+                r = &sim.shm->req;
+            }
+            sim_wait(&sim, &spins);
+            continue;
+        }
+        spins = 0;
+        esp_cosim_ring_read(r, tail, &msg, sizeof(msg));
+        size = MIN(le32_to_cpu(msg.size), ESP_COSIM_MAX_DATA);
+        esp_cosim_ring_read(r, tail + sizeof(msg), data, size);
+        msg.size = cpu_to_le32(size);
+        sim_handle(&sim, &msg, data);
+        qatomic_store_release(&r->tail,
+                              cpu_to_le32(tail + esp_cosim_record_size(
+                                          le32_to_cpu(msg.size))));
+    }
+    return 0;
+}
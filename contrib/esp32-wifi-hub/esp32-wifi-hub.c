@@ -0,0 +1,832 @@
+/*
+ * Shared WiFi medium for emulated ESP32 stations
+ *
+ * Every esp32_wifi device started with shared-medium=on and attached to a
+ * dgram netdev becomes a port of this hub.  The hub learns the station MAC
+ * addresses, forwards unicast frames to a single port and floods broadcast
+ * and unknown destinations.  Each link can add latency and loss, and the hub
+ * optionally serves DHCP and ARP for a private /24 network and bridges to a
+ * host TAP device.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/cutils.h"
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/un.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+#define HUB_DEFAULT_SOCK_PATH   "/tmp/esp32-wifi-hub.sock"
+#define HUB_MAX_FRAME           4096
+#define HUB_ETH_HLEN            14
+#define HUB_DHCP_FIRST_HOST     10
+#define HUB_DHCP_LEASE_TIME     86400
+
+/* locally administered address used by the hub's DHCP/ARP responder */
+static const uint8_t hub_mac[6] = { 0x02, 0x00, 0x00, 0xe5, 0x32, 0x01 };
+
+typedef struct HubLink {
+    uint64_t latency_us;
+    double loss;
+} HubLink;
+
+typedef struct HubPort {
+    char *name;
+    struct sockaddr_un addr;
+    socklen_t addrlen;
+    bool is_tap;
+    bool gone;
+    HubLink link;
+    uint64_t rx_frames;
+    uint64_t tx_frames;
+    uint64_t dropped;
+} HubPort;
+
+typedef struct HubPending {
+    int64_t deadline;
+    uint64_t seq;
+    HubPort *dst;
+    GBytes *frame;
+} HubPending;
+
+typedef struct Hub {
+    int sock_fd;
+    int tap_fd;
+    HubPort *tap;
+    GPtrArray *ports;
+    GHashTable *ports_by_name;  /* char * -> HubPort * */
+    GHashTable *ports_by_mac;   /* uint64_t * -> HubPort * */
+    GHashTable *links;          /* char * -> HubLink * */
+    HubLink default_link;
+    GArray *pending;            /* binary min-heap of HubPending */
+    uint64_t seq;
+    GRand *rand;
+    bool verbose;
+    bool ports_gone;
+
+    bool dhcp;
+    uint8_t net[4];
+    GHashTable *leases;         /* uint64_t * -> host number */
+    unsigned next_lease;
+} Hub;
+
+static volatile sig_atomic_t hub_quit;
+static volatile sig_atomic_t hub_dump_stats;
+
+static void hub_usage(const char *progname)
+{
+    printf("Usage: %s [OPTION]...\n"
+           "  -h: show this help\n"
+           "  -v: verbose mode\n"
+           "  -S <unix-socket-path>: datagram socket the stations send to\n"
+           "     default " HUB_DEFAULT_SOCK_PATH "\n"
+           "  -d <usec>: default one-way latency of a station link\n"
+           "  -p <percent>: default frame loss of a station link\n"
+           "  -l <station-socket-path>=<usec>[,<percent>]: latency and loss\n"
+           "     of one station link, may be repeated\n"
+           "  -s <seed>: seed for the loss generator\n"
+           "  -n <a.b.c.0>: serve DHCP and ARP for this /24 network;\n"
+           "     the hub answers as a.b.c.1\n"
+           "  -t <ifname>: bridge the medium to a host TAP interface\n"
+           "\n"
+           "Stations attach with:\n"
+           "  -netdev dgram,id=w,local.type=unix,local.path=<station-socket>,"
+           "remote.type=unix,remote.path=<unix-socket-path>\n"
+           "  -net nic,model=esp32_wifi,netdev=w,mac=<unique-mac>\n"
+           "  -global esp32_wifi.shared-medium=on\n"
+           "SIGUSR1 prints per-port statistics.\n",
+           progname);
+}
+
+static uint64_t hub_mac_key(const uint8_t *mac)
+{
+    uint64_t key = 0;
+
+    for (int i = 0; i < 6; i++) {
+        key = (key << 8) | mac[i];
+    }
+    return key;
+}
+
+static bool hub_parse_link(const char *str, HubLink *link)
+{
+    uint64_t latency;
+    double percent = 0;
+    const char *end;
+
+    if (qemu_strtou64(str, &end, 0, &latency) < 0 ||
+        (*end && *end != ',')) {
+        return false;
+    }
+    if (*end == ',') {
+        if (qemu_strtod_finite(end + 1, NULL, &percent) < 0 ||
+            percent < 0 || percent > 100) {
+            return false;
+        }
+    }
+    link->latency_us = latency;
+    link->loss = percent / 100;
+    return true;
+}
+
+static void hub_parse_args(Hub *hub, const char **sock_path,
+                           const char **tap_name, int argc, char *argv[])
+{
+    uint64_t seed = 0;
+    double percent;
+    HubLink *link;
+    char *eq;
+    int c;
+
+    while ((c = getopt(argc, argv, "hvS:d:p:l:s:n:t:")) != -1) {
+        switch (c) {
+        case 'h':
+            hub_usage(argv[0]);
+            exit(0);
+        case 'v':
+            hub->verbose = true;
+            break;
+        case 'S':
+            *sock_path = optarg;
+            break;
+        case 'd':
+            if (qemu_strtou64(optarg, NULL, 0,
+                              &hub->default_link.latency_us) < 0) {
+                fprintf(stderr, "cannot parse latency '%s'\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'p':
+            if (qemu_strtod_finite(optarg, NULL, &percent) < 0 ||
+                percent < 0 || percent > 100) {
+                fprintf(stderr, "loss must be between 0 and 100 percent\n");
+                exit(1);
+            }
+            hub->default_link.loss = percent / 100;
+            break;
+        case 'l':
+            eq = strrchr(optarg, '=');
+            link = g_new0(HubLink, 1);
+            if (!eq || !hub_parse_link(eq + 1, link)) {
+                fprintf(stderr, "cannot parse link '%s'\n", optarg);
+                exit(1);
+            }
+            g_hash_table_insert(hub->links, g_strndup(optarg, eq - optarg),
+                                link);
+            break;
+        case 's':
+            if (qemu_strtou64(optarg, NULL, 0, &seed) < 0) {
+                fprintf(stderr, "cannot parse seed '%s'\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'n':
+            if (sscanf(optarg, "%hhu.%hhu.%hhu.%hhu", &hub->net[0],
+                       &hub->net[1], &hub->net[2], &hub->net[3]) != 4) {
+                fprintf(stderr, "cannot parse network '%s'\n", optarg);
+                exit(1);
+            }
+            hub->net[3] = 0;
+            hub->dhcp = true;
+            break;
+        case 't':
+            *tap_name = optarg;
+            break;
+        default:
+            hub_usage(argv[0]);
+            exit(1);
+        }
+    }
+    hub->rand = g_rand_new_with_seed(seed);
+}
+
+/* pending deliveries, ordered by deadline and then by arrival */
+
+static bool hub_pending_before(HubPending *a, HubPending *b)
+{
+    return a->deadline < b->deadline ||
+           (a->deadline == b->deadline && a->seq < b->seq);
+}
+
+static void hub_pending_swap(GArray *heap, guint i, guint j)
+{
+    HubPending tmp = g_array_index(heap, HubPending, i);
+
+    g_array_index(heap, HubPending, i) = g_array_index(heap, HubPending, j);
+    g_array_index(heap, HubPending, j) = tmp;
+}
+
+static void hub_pending_push(Hub *hub, HubPending *p)
+{
+    GArray *heap = hub->pending;
+    guint i = heap->len;
+
+    g_array_append_val(heap, *p);
+    while (i > 0) {
+        guint parent = (i - 1) / 2;
+        if (!hub_pending_before(&g_array_index(heap, HubPending, i),
+                                &g_array_index(heap, HubPending, parent))) {
+            break;
+        }
+        hub_pending_swap(heap, i, parent);
+        i = parent;
+    }
+}
+
+static void hub_pending_sift_down(GArray *heap, guint i)
+{
+    for (;;) {
+        guint l = 2 * i + 1, r = l + 1, min = i;
+        if (l < heap->len &&
+            hub_pending_before(&g_array_index(heap, HubPending, l),
+                               &g_array_index(heap, HubPending, min))) {
+            min = l;
+        }
+        if (r < heap->len &&
+            hub_pending_before(&g_array_index(heap, HubPending, r),
+                               &g_array_index(heap, HubPending, min))) {
+            min = r;
+        }
+        if (min == i) {
+            break;
+        }
+        hub_pending_swap(heap, i, min);
+        i = min;
+    }
+}
+
+static HubPending hub_pending_pop(Hub *hub)
+{
+    GArray *heap = hub->pending;
+    HubPending top = g_array_index(heap, HubPending, 0);
+
+    g_array_index(heap, HubPending, 0) =
+        g_array_index(heap, HubPending, heap->len - 1);
+    g_array_set_size(heap, heap->len - 1);
+    hub_pending_sift_down(heap, 0);
+    return top;
+}
+
+/* forget the frames still queued for stations that left */
+static void hub_pending_purge(Hub *hub)
+{
+    GArray *heap = hub->pending;
+    guint n = 0;
+
+    for (guint i = 0; i < heap->len; i++) {
+        HubPending *p = &g_array_index(heap, HubPending, i);
+        if (p->dst->gone) {
+            g_bytes_unref(p->frame);
+        } else {
+            g_array_index(heap, HubPending, n++) = *p;
+        }
+    }
+    if (n == heap->len) {
+        return;
+    }
+    g_array_set_size(heap, n);
+    for (guint i = n / 2; i-- > 0;) {
+        hub_pending_sift_down(heap, i);
+    }
+}
+
+/* ports */
+
+/* drop stations whose socket went away while forwarding */
+static void hub_reap_ports(Hub *hub)
+{
+    GHashTableIter iter;
+    gpointer value;
+    guint i = 0;
+
+    g_hash_table_iter_init(&iter, hub->ports_by_mac);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (((HubPort *)value)->gone) {
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+    hub_pending_purge(hub);
+    while (i < hub->ports->len) {
+        HubPort *port = g_ptr_array_index(hub->ports, i);
+        if (!port->gone) {
+            i++;
+            continue;
+        }
+        if (hub->verbose) {
+            printf("station %s left\n", port->name);
+        }
+        g_hash_table_remove(hub->ports_by_name, port->name);
+        g_ptr_array_remove_index(hub->ports, i);
+        g_free(port->name);
+        g_free(port);
+    }
+    hub->ports_gone = false;
+}
+
+static HubPort *hub_port_lookup(Hub *hub, struct sockaddr_un *addr,
+                                socklen_t addrlen)
+{
+    HubLink *link;
+    HubPort *port;
+
+    if (addrlen <= offsetof(struct sockaddr_un, sun_path) ||
+        !addr->sun_path[0]) {
+        /* unbound sender, replies cannot be routed back */
+        return NULL;
+    }
+    port = g_hash_table_lookup(hub->ports_by_name, addr->sun_path);
+    if (port) {
+        return port;
+    }
+
+    port = g_new0(HubPort, 1);
+    port->name = g_strdup(addr->sun_path);
+    port->addr = *addr;
+    port->addrlen = addrlen;
+    link = g_hash_table_lookup(hub->links, port->name);
+    port->link = link ? *link : hub->default_link;
+    g_ptr_array_add(hub->ports, port);
+    g_hash_table_insert(hub->ports_by_name, port->name, port);
+    if (hub->verbose) {
+        printf("station %s joined (%" PRIu64 " us, %.1f%% loss)\n",
+               port->name, port->link.latency_us, port->link.loss * 100);
+    }
+    return port;
+}
+
+static void hub_learn(Hub *hub, HubPort *port, const uint8_t *mac)
+{
+    uint64_t key = hub_mac_key(mac);
+
+    if (mac[0] & 1 || g_hash_table_lookup(hub->ports_by_mac, &key) == port) {
+        return;
+    }
+    g_hash_table_insert(hub->ports_by_mac, g_memdup2(&key, sizeof(key)), port);
+}
+
+static void hub_send(Hub *hub, HubPort *dst, GBytes *frame)
+{
+    gsize len;
+    const void *data = g_bytes_get_data(frame, &len);
+    ssize_t ret;
+
+    if (dst->is_tap) {
+        ret = write(hub->tap_fd, data, len);
+    } else if (!dst->gone) {
+        ret = sendto(hub->sock_fd, data, len, MSG_DONTWAIT,
+                     (struct sockaddr *)&dst->addr, dst->addrlen);
+        if (ret < 0 && (errno == ECONNREFUSED || errno == ENOENT)) {
+            dst->gone = true;
+            hub->ports_gone = true;
+            return;
+        }
+    } else {
+        return;
+    }
+    if (ret < 0) {
+        dst->dropped++;
+    } else {
+        dst->tx_frames++;
+    }
+}
+
+/* send frame to dst after latency_us, unless it is lost on the way */
+static void hub_schedule(Hub *hub, HubPort *dst, GBytes *frame, double pass,
+                         uint64_t latency_us)
+{
+    HubPending p;
+
+    if (pass < 1 && g_rand_double(hub->rand) >= pass) {
+        dst->dropped++;
+        return;
+    }
+    if (!latency_us) {
+        hub_send(hub, dst, frame);
+        return;
+    }
+    p.deadline = g_get_monotonic_time() + latency_us;
+    p.seq = hub->seq++;
+    p.dst = dst;
+    p.frame = g_bytes_ref(frame);
+    hub_pending_push(hub, &p);
+}
+
+/* a frame from station src crosses both stations' links */
+static void hub_deliver(Hub *hub, HubPort *src, HubPort *dst, GBytes *frame)
+{
+    hub_schedule(hub, dst, frame,
+                 (1 - src->link.loss) * (1 - dst->link.loss),
+                 src->link.latency_us + dst->link.latency_us);
+}
+
+static void hub_run_pending(Hub *hub)
+{
+    int64_t now = g_get_monotonic_time();
+
+    while (hub->pending->len &&
+           g_array_index(hub->pending, HubPending, 0).deadline <= now) {
+        HubPending p = hub_pending_pop(hub);
+        hub_send(hub, p.dst, p.frame);
+        g_bytes_unref(p.frame);
+    }
+}
+
+/* DHCP and ARP responder */
+
+static uint16_t hub_ip_checksum(const uint8_t *data, size_t len)
+{
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += (data[i] << 8) | data[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+static void hub_reply(Hub *hub, HubPort *port, const uint8_t *buf, size_t len)
+{
+    GBytes *frame = g_bytes_new(buf, len);
+
+    /* the responder sits in the hub, only the station's link applies */
+    hub_schedule(hub, port, frame, 1 - port->link.loss, port->link.latency_us);
+    g_bytes_unref(frame);
+}
+
+static bool hub_arp_input(Hub *hub, HubPort *port, const uint8_t *buf,
+                          size_t len)
+{
+    uint8_t reply[HUB_ETH_HLEN + 28];
+    const uint8_t *arp = buf + HUB_ETH_HLEN;
+
+    /* only requests for the hub's own address */
+    if (len < sizeof(reply) || arp[6] != 0 || arp[7] != 1 ||
+        memcmp(arp + 24, hub->net, 3) || arp[27] != 1) {
+        return false;
+    }
+    memcpy(reply, buf + 6, 6);
+    memcpy(reply + 6, hub_mac, 6);
+    memcpy(reply + 12, buf + 12, 2);
+    memcpy(reply + HUB_ETH_HLEN, arp, 6);
+    reply[HUB_ETH_HLEN + 6] = 0;
+    reply[HUB_ETH_HLEN + 7] = 2;
+    memcpy(reply + HUB_ETH_HLEN + 8, hub_mac, 6);
+    memcpy(reply + HUB_ETH_HLEN + 14, arp + 24, 4);
+    memcpy(reply + HUB_ETH_HLEN + 18, arp + 8, 10);
+    hub_reply(hub, port, reply, sizeof(reply));
+    return true;
+}
+
+static const uint8_t *hub_dhcp_option(const uint8_t *opt, const uint8_t *end,
+                                      uint8_t code)
+{
+    while (opt < end && *opt != 0xff) {
+        if (*opt == 0) {
+            opt++;
+            continue;
+        }
+        if (opt + 2 > end || opt + 2 + opt[1] > end) {
+            break;
+        }
+        if (*opt == code) {
+            return opt;
+        }
+        opt += 2 + opt[1];
+    }
+    return NULL;
+}
+
+static bool hub_dhcp_input(Hub *hub, HubPort *port, const uint8_t *buf,
+                           size_t len)
+{
+    const uint8_t *ip = buf + HUB_ETH_HLEN, *udp, *bootp, *type;
+    uint8_t reply[HUB_ETH_HLEN + 20 + 8 + 240 + 32] = { 0 };
+    uint8_t *rip = reply + HUB_ETH_HLEN, *rudp = rip + 20, *rbootp = rudp + 8;
+    uint8_t *opt = rbootp + 240;
+    size_t ip_len, ihl;
+    uint64_t key;
+    gpointer host;
+
+    if (len < HUB_ETH_HLEN + 20 || (ip[0] >> 4) != 4 || ip[9] != 17) {
+        return false;
+    }
+    ihl = (ip[0] & 0xf) * 4;
+    ip_len = (ip[2] << 8) | ip[3];
+    if (ip_len > len - HUB_ETH_HLEN || ip_len < ihl + 8 + 240) {
+        return false;
+    }
+    udp = ip + ihl;
+    bootp = udp + 8;
+    if (udp[2] != 0 || udp[3] != 67 || bootp[0] != 1 ||
+        ldl_be_p(bootp + 236) != 0x63825363) {
+        return false;
+    }
+    type = hub_dhcp_option(bootp + 240, ip + ip_len, 53);
+    if (!type || type[1] != 1 || (type[2] != 1 && type[2] != 3)) {
+        return true;
+    }
+
+    /*
+     * Stations sharing the medium all carry the same chaddr; the Ethernet
+     * source is what tells them apart, and the only address they accept.
+     */
+    key = hub_mac_key(buf + 6);
+    if (!g_hash_table_lookup_extended(hub->leases, &key, NULL, &host)) {
+        if (hub->next_lease > 254) {
+            fprintf(stderr, "DHCP pool exhausted\n");
+            return true;
+        }
+        host = GUINT_TO_POINTER(hub->next_lease++);
+        g_hash_table_insert(hub->leases, g_memdup2(&key, sizeof(key)), host);
+    }
+
+    /* BOOTP reply, echoing the client hardware address */
+    rbootp[0] = 2;
+    memcpy(rbootp + 1, bootp + 1, 3);
+    memcpy(rbootp + 4, bootp + 4, 4);
+    memcpy(rbootp + 10, bootp + 10, 2);
+    memcpy(rbootp + 16, hub->net, 3);
+    rbootp[19] = GPOINTER_TO_UINT(host);
+    memcpy(rbootp + 20, hub->net, 3);
+    rbootp[23] = 1;
+    memcpy(rbootp + 28, bootp + 28, 16);
+    stl_be_p(rbootp + 236, 0x63825363);
+    *opt++ = 53;
+    *opt++ = 1;
+    *opt++ = type[2] == 1 ? 2 : 5;
+    *opt++ = 54;
+    *opt++ = 4;
+    memcpy(opt, rbootp + 20, 4);
+    opt += 4;
+    *opt++ = 51;
+    *opt++ = 4;
+    stl_be_p(opt, HUB_DHCP_LEASE_TIME);
+    opt += 4;
+    *opt++ = 1;
+    *opt++ = 4;
+    stl_be_p(opt, 0xffffff00);
+    opt += 4;
+    *opt++ = 3;
+    *opt++ = 4;
+    memcpy(opt, rbootp + 20, 4);
+    opt += 4;
+    *opt++ = 0xff;
+
+    ip_len = opt - rip;
+    rudp[1] = 67;
+    rudp[3] = 68;
+    stw_be_p(rudp + 4, ip_len - 20);
+    rip[0] = 0x45;
+    stw_be_p(rip + 2, ip_len);
+    rip[8] = 64;
+    rip[9] = 17;
+    memcpy(rip + 12, rbootp + 20, 4);
+    memset(rip + 16, 0xff, 4);
+    stw_be_p(rip + 10, hub_ip_checksum(rip, 20));
+
+    memcpy(reply, buf + 6, 6);
+    memcpy(reply + 6, hub_mac, 6);
+    reply[12] = 0x08;
+    reply[13] = 0x00;
+    hub_reply(hub, port, reply, HUB_ETH_HLEN + ip_len);
+    if (hub->verbose && type[2] == 3) {
+        printf("station %s leased %u.%u.%u.%u\n", port->name, hub->net[0],
+               hub->net[1], hub->net[2], GPOINTER_TO_UINT(host));
+    }
+    return true;
+}
+
+/* forwarding */
+
+static void hub_input(Hub *hub, HubPort *src, const uint8_t *buf, size_t len)
+{
+    uint16_t ethertype;
+    HubPort *dst;
+    GBytes *frame;
+    uint64_t key;
+
+    if (len < HUB_ETH_HLEN) {
+        return;
+    }
+    src->rx_frames++;
+    hub_learn(hub, src, buf + 6);
+
+    ethertype = lduw_be_p(buf + 12);
+    if (hub->dhcp &&
+        ((ethertype == 0x0806 && hub_arp_input(hub, src, buf, len)) ||
+         (ethertype == 0x0800 && hub_dhcp_input(hub, src, buf, len)))) {
+        return;
+    }
+
+    frame = g_bytes_new(buf, len);
+    key = hub_mac_key(buf);
+    dst = (buf[0] & 1) ? NULL : g_hash_table_lookup(hub->ports_by_mac, &key);
+    if (dst) {
+        if (dst != src) {
+            hub_deliver(hub, src, dst, frame);
+        }
+    } else {
+        for (guint i = 0; i < hub->ports->len; i++) {
+            HubPort *port = g_ptr_array_index(hub->ports, i);
+            if (port != src) {
+                hub_deliver(hub, src, port, frame);
+            }
+        }
+    }
+    g_bytes_unref(frame);
+}
+
+static void hub_read_socket(Hub *hub)
+{
+    uint8_t buf[HUB_MAX_FRAME];
+    struct sockaddr_un addr;
+    socklen_t addrlen;
+    HubPort *port;
+    ssize_t len;
+
+    for (;;) {
+        addrlen = sizeof(addr);
+        memset(&addr, 0, sizeof(addr));
+        len = recvfrom(hub->sock_fd, buf, sizeof(buf), MSG_DONTWAIT,
+                       (struct sockaddr *)&addr, &addrlen);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fprintf(stderr, "recvfrom: %s\n", strerror(errno));
+            }
+            return;
+        }
+        port = hub_port_lookup(hub, &addr, addrlen);
+        if (port) {
+            hub_input(hub, port, buf, len);
+        }
+    }
+}
+
+static void hub_read_tap(Hub *hub)
+{
+    uint8_t buf[HUB_MAX_FRAME];
+    ssize_t len;
+
+    while ((len = read(hub->tap_fd, buf, sizeof(buf))) > 0) {
+        hub_input(hub, hub->tap, buf, len);
+    }
+}
+
+static int hub_open_tap(Hub *hub, const char *name)
+{
+    struct ifreq ifr = { 0 };
+    int fd = open("/dev/net/tun", O_RDWR);
+
+    if (fd < 0) {
+        fprintf(stderr, "cannot open /dev/net/tun: %s\n", strerror(errno));
+        return -1;
+    }
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    pstrcpy(ifr.ifr_name, sizeof(ifr.ifr_name), name);
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+        fprintf(stderr, "cannot attach to %s: %s\n", name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    g_unix_set_fd_nonblocking(fd, true, NULL);
+
+    hub->tap_fd = fd;
+    hub->tap = g_new0(HubPort, 1);
+    hub->tap->name = g_strdup(name);
+    hub->tap->is_tap = true;
+    g_ptr_array_add(hub->ports, hub->tap);
+    return 0;
+}
+
+static int hub_open_socket(Hub *hub, const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    pstrcpy(addr.sun_path, sizeof(addr.sun_path), path);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "cannot bind %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    hub->sock_fd = fd;
+    return 0;
+}
+
+static void hub_print_stats(Hub *hub)
+{
+    printf("%-40s %12s %12s %12s\n", "station", "rx", "tx", "dropped");
+    for (guint i = 0; i < hub->ports->len; i++) {
+        HubPort *port = g_ptr_array_index(hub->ports, i);
+        printf("%-40s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+               port->name, port->rx_frames, port->tx_frames, port->dropped);
+    }
+    fflush(stdout);
+}
+
+static void hub_signal(int signum)
+{
+    if (signum == SIGUSR1) {
+        hub_dump_stats = 1;
+    } else {
+        hub_quit = 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *sock_path = HUB_DEFAULT_SOCK_PATH;
+    const char *tap_name = NULL;
+    struct sigaction sa = { .sa_handler = hub_signal };
+    struct pollfd fds[2];
+    Hub hub = {
+        .tap_fd = -1,
+        .next_lease = HUB_DHCP_FIRST_HOST,
+    };
+    int nfds;
+
+    hub.ports = g_ptr_array_new();
+    hub.ports_by_name = g_hash_table_new(g_str_hash, g_str_equal);
+    hub.ports_by_mac = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                             g_free, NULL);
+    hub.links = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    hub.leases = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                       g_free, NULL);
+    hub.pending = g_array_new(false, false, sizeof(HubPending));
+
+    hub_parse_args(&hub, &sock_path, &tap_name, argc, argv);
+
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    if (hub_open_socket(&hub, sock_path) < 0) {
+        return 1;
+    }
+    if (tap_name && hub_open_tap(&hub, tap_name) < 0) {
+        return 1;
+    }
+
+    fds[0] = (struct pollfd) { .fd = hub.sock_fd, .events = POLLIN };
+    fds[1] = (struct pollfd) { .fd = hub.tap_fd, .events = POLLIN };
+    nfds = hub.tap_fd >= 0 ? 2 : 1;
+
+    while (!hub_quit) {
+        struct timespec ts, *timeout = NULL;
+
+        if (hub.pending->len) {
+            int64_t wait = g_array_index(hub.pending, HubPending, 0).deadline -
+                           g_get_monotonic_time();
+            wait = MAX(wait, 0);
+            ts.tv_sec = wait / G_USEC_PER_SEC;
+            ts.tv_nsec = (wait % G_USEC_PER_SEC) * 1000;
+            timeout = &ts;
+        }
+        if (ppoll(fds, nfds, timeout, NULL) < 0 && errno != EINTR) {
+            fprintf(stderr, "ppoll: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            hub_read_socket(&hub);
+        }
+        if (nfds > 1 && fds[1].revents & POLLIN) {
+            hub_read_tap(&hub);
+        }
+        hub_run_pending(&hub);
+        if (hub.ports_gone) {
+            hub_reap_ports(&hub);
+        }
+        if (hub_dump_stats) {
+            hub_dump_stats = 0;
+            hub_print_stats(&hub);
+        }
+    }
+
+    if (hub.verbose) {
+        hub_print_stats(&hub);
+    }
+    close(hub.sock_fd);
+    unlink(sock_path);
+    return 0;
+}
@@ -0,0 +1,610 @@
+/*
+ * Sampling profiler for ESP firmware.
+ *
+ * Every vCPU takes a sample each time it has executed "period" guest
+ * instructions.  The sampled PC and the return addresses found by
+ * unwinding the guest stack are resolved against the symbol tables of
+ * the given ELF files and attributed to the FreeRTOS task that was
+ * running on that core.  The result is written in the folded stack
+ * format understood by flamegraph.pl and speedscope:
+ *
+ *   task;outer_function;...;inner_function count
+ *
+ * Options:
+ *   elf=PATH        symbol table to use, may be given more than once
+ *   period=N        guest instructions between samples (default 100000)
+ *   depth=N         maximum number of frames per sample (default 32,
+ *                   at most 128)
+ *   unwind=MODE     window (Xtensa register windows), fp (RISC-V frame
+ *                   pointer) or none; the default depends on the target
+ *   tcb=SYM|ADDR    current task pointer, indexed by core
+ *                   (default pxCurrentTCB, then pxCurrentTCBs)
+ *   name-offset=N   offset of pcTaskName in the TCB (default 52)
+ *   outfile=PATH    write the folded stacks here instead of the log
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define TASK_NAME_LEN 16
+#define XTENSA_NAREG 64
+#define MAX_DEPTH 128
+
+typedef enum {
+    UNWIND_NONE,
+    UNWIND_WINDOW,
+    UNWIND_FP,
+} UnwindMode;
+
+typedef struct Sym {
+    uint32_t addr;
+    uint32_t size;
+    const char *name;
+} Sym;
+
+typedef struct Vcpu {
+    uint64_t count;
+    GByteArray *buf;
+    /* Xtensa */
+    struct qemu_plugin_register *windowbase;
+    struct qemu_plugin_register *windowstart;
+    struct qemu_plugin_register *ar[XTENSA_NAREG];
+    /* RISC-V */
+    struct qemu_plugin_register *sp;
+    struct qemu_plugin_register *fp;
+} Vcpu;
+
+static struct qemu_plugin_scoreboard *vcpus;
+static uint64_t period = 100000;
+static unsigned int depth = 32;
+static UnwindMode unwind;
+static char *tcb_name;
+static uint64_t tcb_addr;
+static uint32_t name_offset = 52;
+static char *filename;
+
+/* Symbols of all ELF files, sorted by address; strings stay in files */
+static GArray *syms;
+static GPtrArray *elf_data;
+
+/* Plugins need to take care of their own locking */
+static GMutex lock;
+static GHashTable *stacks;
+static uint64_t total;
+
+static qemu_plugin_u64 count_u64(void)
+{
+    return qemu_plugin_scoreboard_u64_in_struct(vcpus, Vcpu, count);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*
+ * Just enough of ELF32 to pull the functions and objects out of the
+ * symbol table.  Both targets are little endian.
+ */
+static bool load_elf(const char *path)
+{
+    g_autoptr(GError) err = NULL;
+    gchar *data;
+    gsize len;
+    uint32_t shoff;
+    uint16_t shentsize, shnum;
+
+    if (!g_file_get_contents(path, &data, &len, &err)) {
+        fprintf(stderr, "espprof: %s\n", err->message);
+        return false;
+    }
+    g_ptr_array_add(elf_data, data);
+
+    const uint8_t *d = (const uint8_t *)data;
+    if (len < 52 || memcmp(d, "\177ELF", 4) != 0 || d[4] != 1 || d[5] != 1) {
+        fprintf(stderr, "espprof: %s is not a little endian ELF32 file\n",
+                path);
+        return false;
+    }
+    shoff = le32(d + 32);
+    shentsize = le16(d + 46);
+    shnum = le16(d + 48);
+    if (shentsize < 40 || shoff > len || shnum > (len - shoff) / shentsize) {
+        fprintf(stderr, "espprof: %s has a bad section table\n", path);
+        return false;
+    }
+
+    for (unsigned i = 0; i < shnum; i++) {
+        const uint8_t *sh = d + shoff + i * shentsize;
+        const uint8_t *strsh;
+        uint32_t off, size, entsize, link, stroff, strsize;
+
+        if (le32(sh + 4) != 2 /* SHT_SYMTAB */) {
+            continue;
+        }
+        off = le32(sh + 16);
+        size = le32(sh + 20);
+        link = le32(sh + 24);
+        entsize = le32(sh + 36);
+        if (entsize < 16 || link >= shnum || off > len || size > len - off) {
+            continue;
+        }
+        strsh = d + shoff + link * shentsize;
+        stroff = le32(strsh + 16);
+        strsize = le32(strsh + 20);
+        if (stroff > len || strsize > len - stroff ||
+            strsize == 0 || d[stroff + strsize - 1] != '\0') {
+            continue;
+        }
+
+        for (uint32_t s = 0; s + entsize <= size; s += entsize) {
+            const uint8_t *st = d + off + s;
+            uint32_t name = le32(st);
+            uint8_t type = st[12] & 0xf;
+            Sym sym;
+
+            /* STT_OBJECT and STT_FUNC */
+            if ((type != 1 && type != 2) || name == 0 || name >= strsize) {
+                continue;
+            }
+            sym.addr = le32(st + 4);
+            sym.size = le32(st + 8);
+            sym.name = data + stroff + name;
+            if (sym.addr == 0) {
+                continue;
+            }
+            g_array_append_val(syms, sym);
+        }
+    }
+    return true;
+}
+
+static gint sym_cmp(gconstpointer a, gconstpointer b)
+{
+    const Sym *sa = a, *sb = b;
+
+    if (sa->addr != sb->addr) {
+        return sa->addr < sb->addr ? -1 : 1;
+    }
+    /* Prefer the sized symbol when a label shares the address */
+    return sa->size > sb->size ? -1 : sa->size < sb->size;
+}
+
+static const Sym *sym_find(uint32_t addr)
+{
+    const Sym *base = (const Sym *)syms->data;
+    guint lo = 0, hi = syms->len;
+
+    while (lo < hi) {
+        guint mid = (lo + hi) / 2;
+        if (base[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NULL;
+    }
+    /* Step back over zero sized labels to the enclosing function */
+    for (guint i = lo; i > 0; i--) {
+        const Sym *sym = &base[i - 1];
+        if (sym->size) {
+            return addr - sym->addr < sym->size ? sym : NULL;
+        }
+        if (lo - i >= 4) {
+            break;
+        }
+    }
+    return &base[lo - 1];
+}
+
+static const Sym *sym_by_name(const char *name)
+{
+    for (guint i = 0; i < syms->len; i++) {
+        const Sym *sym = &g_array_index(syms, Sym, i);
+        if (strcmp(sym->name, name) == 0) {
+            return sym;
+        }
+    }
+    return NULL;
+}
+
+static bool read_reg(Vcpu *vcpu, struct qemu_plugin_register *reg,
+                     uint32_t *val)
+{
+    if (!reg) {
+        return false;
+    }
+    g_byte_array_set_size(vcpu->buf, 0);
+    if (qemu_plugin_read_register(reg, vcpu->buf) < 4) {
+        return false;
+    }
+    *val = le32(vcpu->buf->data);
+    return true;
+}
+
+static bool read_mem(Vcpu *vcpu, uint32_t addr, void *dst, size_t len)
+{
+    if (!qemu_plugin_read_memory_vaddr(addr, vcpu->buf, len)) {
+        return false;
+    }
+    memcpy(dst, vcpu->buf->data, len);
+    return true;
+}
+
+static bool read_word(Vcpu *vcpu, uint32_t addr, uint32_t *val)
+{
+    uint8_t b[4];
+
+    if (addr & 3 || !read_mem(vcpu, addr, b, sizeof(b))) {
+        return false;
+    }
+    *val = le32(b);
+    return true;
+}
+
+/*
+ * Walk the Xtensa windowed ABI call chain.  Frames that are still in the
+ * register file are found through WINDOWSTART; once a frame has been
+ * spilled, all its callers have been too, and each caller's a0/a1 sit in
+ * the base save area 16 bytes below the callee's stack pointer.
+ */
+static unsigned unwind_window(Vcpu *vcpu, uint32_t pc, uint32_t *frames)
+{
+    uint32_t wb, ws, a0, sp;
+    unsigned n = 0;
+    bool in_regs = true;
+
+    if (!read_reg(vcpu, vcpu->windowbase, &wb) ||
+        !read_reg(vcpu, vcpu->windowstart, &ws) ||
+        !read_reg(vcpu, vcpu->ar[(wb * 4) % XTENSA_NAREG], &a0) ||
+        !read_reg(vcpu, vcpu->ar[(wb * 4 + 1) % XTENSA_NAREG], &sp)) {
+        return 0;
+    }
+
+    while (n < depth) {
+        unsigned callinc = a0 >> 30;
+        uint32_t ret, next_sp;
+
+        if (callinc == 0 || (a0 & 0x3fffffff) == 0) {
+            break;
+        }
+        ret = (a0 & 0x3fffffff) | (pc & 0xc0000000);
+        frames[n++] = ret;
+        pc = ret;
+
+        if (in_regs) {
+            wb = (wb - callinc) % (XTENSA_NAREG / 4);
+            in_regs = ws & (1u << wb);
+        }
+        if (in_regs) {
+            if (!read_reg(vcpu, vcpu->ar[wb * 4], &a0) ||
+                !read_reg(vcpu, vcpu->ar[wb * 4 + 1], &next_sp)) {
+                break;
+            }
+        } else if (!read_word(vcpu, sp - 16, &a0) ||
+                   !read_word(vcpu, sp - 12, &next_sp)) {
+            break;
+        }
+        /* Stacks grow down; anything else is a corrupt or foreign frame */
+        if (next_sp <= sp) {
+            break;
+        }
+        sp = next_sp;
+    }
+    return n;
+}
+
+/*
+ * Walk a RISC-V -fno-omit-frame-pointer chain: the return address and the
+ * caller's frame pointer are the two words just below fp.
+ */
+static unsigned unwind_fp(Vcpu *vcpu, uint32_t *frames)
+{
+    uint32_t fp, sp, ret, next_fp;
+    unsigned n = 0;
+
+    if (!read_reg(vcpu, vcpu->fp, &fp) || !read_reg(vcpu, vcpu->sp, &sp)) {
+        return 0;
+    }
+
+    while (n < depth && fp > sp) {
+        if (!read_word(vcpu, fp - 4, &ret) ||
+            !read_word(vcpu, fp - 8, &next_fp) || ret == 0) {
+            break;
+        }
+        frames[n++] = ret;
+        if (next_fp <= fp) {
+            break;
+        }
+        sp = fp;
+        fp = next_fp;
+    }
+    return n;
+}
+
+static void append_frame(GString *s, uint32_t addr)
+{
+    const Sym *sym = syms->len ? sym_find(addr) : NULL;
+
+    if (sym) {
+        g_string_append_printf(s, ";%s", sym->name);
+    } else {
+        g_string_append_printf(s, ";0x%08" PRIx32, addr);
+    }
+}
+
+static void append_task(GString *s, Vcpu *vcpu, unsigned int vcpu_index)
+{
+    uint32_t tcb;
+    char name[TASK_NAME_LEN + 1] = "";
+
+    if (tcb_addr &&
+        read_word(vcpu, tcb_addr + vcpu_index * 4, &tcb) && tcb &&
+        read_mem(vcpu, tcb + name_offset, name, TASK_NAME_LEN)) {
+        name[TASK_NAME_LEN] = '\0';
+        /* ';' and ' ' are separators in the folded format */
+        g_strdelimit(name, "; ", '_');
+    }
+    g_string_append_printf(s, "%s", *name ? name : "[unknown]");
+    if (qemu_plugin_num_vcpus() > 1) {
+        g_string_append_printf(s, "/cpu%u", vcpu_index);
+    }
+}
+
+static void vcpu_sample(unsigned int vcpu_index, void *udata)
+{
+    Vcpu *vcpu = qemu_plugin_scoreboard_find(vcpus, vcpu_index);
+    uint32_t pc = (uintptr_t)udata;
+    uint32_t frames[MAX_DEPTH];
+    g_autoptr(GString) key = g_string_new(NULL);
+    unsigned n = 0;
+    uint64_t *count;
+
+    vcpu->count -= period;
+
+    switch (unwind) {
+    case UNWIND_WINDOW:
+        n = unwind_window(vcpu, pc, frames);
+        break;
+    case UNWIND_FP:
+        n = unwind_fp(vcpu, frames);
+        break;
+    case UNWIND_NONE:
+        break;
+    }
+
+    append_task(key, vcpu, vcpu_index);
+    /* Return addresses point after the call; resolve the call itself */
+    while (n > 0) {
+        append_frame(key, frames[--n] - 1);
+    }
+    append_frame(key, pc);
+
+    g_mutex_lock(&lock);
+    count = g_hash_table_lookup(stacks, key->str);
+    if (!count) {
+        count = g_new0(uint64_t, 1);
+        g_hash_table_insert(stacks, g_string_free(g_steal_pointer(&key),
+                                                  false), count);
+    }
+    (*count)++;
+    total++;
+    g_mutex_unlock(&lock);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    uint64_t vaddr = qemu_plugin_tb_vaddr(tb);
+
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, count_u64(),
+        qemu_plugin_tb_n_insns(tb));
+
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_sample,
+        unwind == UNWIND_NONE ? QEMU_PLUGIN_CB_NO_REGS : QEMU_PLUGIN_CB_R_REGS,
+        QEMU_PLUGIN_COND_GE, count_u64(), period,
+        (void *)(uintptr_t)(uint32_t)vaddr);
+}
+
+static void vcpu_init(qemu_plugin_id_t id, unsigned int vcpu_index)
+{
+    Vcpu *vcpu = qemu_plugin_scoreboard_find(vcpus, vcpu_index);
+    g_autoptr(GArray) regs = qemu_plugin_get_registers();
+
+    vcpu->buf = g_byte_array_new();
+
+    for (guint i = 0; i < regs->len; i++) {
+        qemu_plugin_reg_descriptor *rd =
+            &g_array_index(regs, qemu_plugin_reg_descriptor, i);
+        unsigned int ar;
+
+        if (!strcmp(rd->name, "windowbase")) {
+            vcpu->windowbase = rd->handle;
+        } else if (!strcmp(rd->name, "windowstart")) {
+            vcpu->windowstart = rd->handle;
+        } else if (sscanf(rd->name, "ar%u", &ar) == 1 && ar < XTENSA_NAREG) {
+            vcpu->ar[ar] = rd->handle;
+        } else if (!strcmp(rd->name, "sp")) {
+            vcpu->sp = rd->handle;
+        } else if (!strcmp(rd->name, "fp")) {
+            vcpu->fp = rd->handle;
+        }
+    }
+
+    if (unwind == UNWIND_WINDOW &&
+        (!vcpu->windowbase || !vcpu->windowstart ||
+         !vcpu->ar[XTENSA_NAREG - 1])) {
+        fprintf(stderr, "espprof: cpu%u has no register windows, "
+                "not unwinding\n", vcpu_index);
+        unwind = UNWIND_NONE;
+    } else if (unwind == UNWIND_FP && (!vcpu->fp || !vcpu->sp)) {
+        fprintf(stderr, "espprof: cpu%u has no frame pointer, "
+                "not unwinding\n", vcpu_index);
+        unwind = UNWIND_NONE;
+    }
+}
+
+static gint stack_cmp(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GPtrArray) keys = g_ptr_array_new();
+    g_autoptr(GString) report = g_string_new(NULL);
+    GHashTableIter iter;
+    gpointer key;
+    FILE *out = NULL;
+
+    g_mutex_lock(&lock);
+    g_hash_table_iter_init(&iter, stacks);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        g_ptr_array_add(keys, key);
+    }
+    g_ptr_array_sort(keys, stack_cmp);
+
+    for (guint i = 0; i < keys->len; i++) {
+        uint64_t *count = g_hash_table_lookup(stacks, keys->pdata[i]);
+        g_string_append_printf(report, "%s %" PRIu64 "\n",
+                               (char *)keys->pdata[i], *count);
+    }
+
+    if (filename) {
+        out = fopen(filename, "w");
+        if (!out) {
+            fprintf(stderr, "espprof: cannot write %s\n", filename);
+        }
+    }
+    if (out) {
+        fputs(report->str, out);
+        fclose(out);
+        g_string_printf(report, "espprof: %" PRIu64 " samples in %u stacks "
+                        "written to %s\n", total, keys->len, filename);
+    }
+    qemu_plugin_outs(report->str);
+    g_mutex_unlock(&lock);
+
+    for (int i = 0; i < qemu_plugin_num_vcpus(); i++) {
+        Vcpu *vcpu = qemu_plugin_scoreboard_find(vcpus, i);
+        if (vcpu->buf) {
+            g_byte_array_unref(vcpu->buf);
+        }
+    }
+    qemu_plugin_scoreboard_free(vcpus);
+    g_hash_table_unref(stacks);
+    g_array_unref(syms);
+    g_ptr_array_unref(elf_data);
+    g_free(tcb_name);
+    g_free(filename);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    syms = g_array_new(false, false, sizeof(Sym));
+    elf_data = g_ptr_array_new_with_free_func(g_free);
+
+    if (!strcmp(info->target_name, "xtensa")) {
+        unwind = UNWIND_WINDOW;
+    } else if (!strcmp(info->target_name, "riscv32")) {
+        unwind = UNWIND_FP;
+    } else {
+        unwind = UNWIND_NONE;
+    }
+
+    for (int i = 0; i < argc; i++) {
+        char *opt = argv[i];
+        g_auto(GStrv) tokens = g_strsplit(opt, "=", 2);
+        if (!tokens[1]) {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+        if (g_strcmp0(tokens[0], "elf") == 0) {
+            if (!load_elf(tokens[1])) {
+                return -1;
+            }
+        } else if (g_strcmp0(tokens[0], "period") == 0) {
+            period = g_ascii_strtoull(tokens[1], NULL, 10);
+        } else if (g_strcmp0(tokens[0], "depth") == 0) {
+            depth = g_ascii_strtoull(tokens[1], NULL, 10);
+        } else if (g_strcmp0(tokens[0], "unwind") == 0) {
+            if (g_strcmp0(tokens[1], "window") == 0) {
+                unwind = UNWIND_WINDOW;
+            } else if (g_strcmp0(tokens[1], "fp") == 0) {
+                unwind = UNWIND_FP;
+            } else if (g_strcmp0(tokens[1], "none") == 0) {
+                unwind = UNWIND_NONE;
+            } else {
+                fprintf(stderr, "unknown unwind mode: %s\n", tokens[1]);
+                return -1;
+            }
+        } else if (g_strcmp0(tokens[0], "tcb") == 0) {
+            tcb_name = g_steal_pointer(&tokens[1]);
+        } else if (g_strcmp0(tokens[0], "name-offset") == 0) {
+            name_offset = g_ascii_strtoull(tokens[1], NULL, 0);
+        } else if (g_strcmp0(tokens[0], "outfile") == 0) {
+            filename = g_steal_pointer(&tokens[1]);
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+
+    if (period == 0) {
+        fputs("period must be positive\n", stderr);
+        return -1;
+    }
+    if (depth > MAX_DEPTH) {
+        depth = MAX_DEPTH;
+    } else if (depth == 0) {
+        unwind = UNWIND_NONE;
+    }
+
+    g_array_sort(syms, sym_cmp);
+
+    if (tcb_name && g_ascii_isdigit(tcb_name[0])) {
+        tcb_addr = g_ascii_strtoull(tcb_name, NULL, 0);
+    } else {
+        const Sym *sym = NULL;
+        if (tcb_name) {
+            sym = sym_by_name(tcb_name);
+            if (!sym) {
+                fprintf(stderr, "espprof: no symbol %s\n", tcb_name);
+                return -1;
+            }
+        } else if (syms->len) {
+            sym = sym_by_name("pxCurrentTCB");
+            if (!sym) {
+                sym = sym_by_name("pxCurrentTCBs");
+            }
+        }
+        tcb_addr = sym ? sym->addr : 0;
+    }
+
+    stacks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    vcpus = qemu_plugin_scoreboard_new(sizeof(Vcpu));
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    qemu_plugin_register_vcpu_init_cb(id, vcpu_init);
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+
+    return 0;
+}
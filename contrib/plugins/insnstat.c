@@ -0,0 +1,140 @@
+/*
+ * Guest instruction count for fleet monitoring.
+ *
+ * Counts the guest instructions executed by all vCPUs and, at most once
+ * per interval, replaces the contents of a file with the running total:
+ *
+ *   insns 123456789
+ *
+ * A supervisor running many instances polls these files and turns the
+ * totals into instructions per second without talking to each QEMU.
+ *
+ * Options:
+ *   outfile=PATH    file to keep up to date (required)
+ *   interval=MS     minimum time between updates (default 1000)
+ *   period=N        guest instructions between checks of the clock
+ *                   (default 1000000)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+typedef struct {
+    uint64_t pending;
+    uint64_t total;
+} Vcpu;
+
+static struct qemu_plugin_scoreboard *vcpus;
+static char *filename;
+static uint64_t period = 1000000;
+static int64_t interval_us = 1000000;
+
+/* Plugins need to take care of their own locking */
+static GMutex lock;
+static int64_t last_write;
+
+static qemu_plugin_u64 pending_u64(void)
+{
+    return qemu_plugin_scoreboard_u64_in_struct(vcpus, Vcpu, pending);
+}
+
+static qemu_plugin_u64 total_u64(void)
+{
+    return qemu_plugin_scoreboard_u64_in_struct(vcpus, Vcpu, total);
+}
+
+static void write_total(void)
+{
+    g_autofree char *text = g_strdup_printf("insns %" PRIu64 "\n",
+                                            qemu_plugin_u64_sum(total_u64()));
+
+    /* rewritten in place and never fsync'ed, this runs on a vCPU thread */
+    g_file_set_contents_full(filename, text, -1, G_FILE_SET_CONTENTS_NONE,
+                             0666, NULL);
+}
+
+static void vcpu_check(unsigned int vcpu_index, void *udata)
+{
+    Vcpu *vcpu = qemu_plugin_scoreboard_find(vcpus, vcpu_index);
+    int64_t now = g_get_monotonic_time();
+
+    vcpu->total += vcpu->pending;
+    vcpu->pending = 0;
+
+    g_mutex_lock(&lock);
+    if (now - last_write >= interval_us) {
+        last_write = now;
+        write_total();
+    }
+    g_mutex_unlock(&lock);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, pending_u64(),
+        qemu_plugin_tb_n_insns(tb));
+
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_check, QEMU_PLUGIN_CB_NO_REGS,
+        QEMU_PLUGIN_COND_GE, pending_u64(), period, NULL);
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    for (int i = 0; i < qemu_plugin_num_vcpus(); i++) {
+        Vcpu *vcpu = qemu_plugin_scoreboard_find(vcpus, i);
+        vcpu->total += vcpu->pending;
+        vcpu->pending = 0;
+    }
+    write_total();
+
+    qemu_plugin_scoreboard_free(vcpus);
+    g_free(filename);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    for (int i = 0; i < argc; i++) {
+        char *opt = argv[i];
+        g_auto(GStrv) tokens = g_strsplit(opt, "=", 2);
+        if (!tokens[1]) {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+        if (g_strcmp0(tokens[0], "outfile") == 0) {
+            filename = g_steal_pointer(&tokens[1]);
+        } else if (g_strcmp0(tokens[0], "interval") == 0) {
+            interval_us = g_ascii_strtoull(tokens[1], NULL, 10) * 1000;
+        } else if (g_strcmp0(tokens[0], "period") == 0) {
+            period = g_ascii_strtoull(tokens[1], NULL, 10);
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+
+    if (!filename) {
+        fputs("insnstat: outfile is required\n", stderr);
+        return -1;
+    }
+    if (period == 0) {
+        fputs("period must be positive\n", stderr);
+        return -1;
+    }
+
+    vcpus = qemu_plugin_scoreboard_new(sizeof(Vcpu));
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+
+    return 0;
+}
@@ -31,6 +31,8 @@
 #include "hw/ssi/ssi.h"
 #include "migration/vmstate.h"
 #include "qemu/bitops.h"
+#include "qemu/bitmap.h"
+#include "qemu/notify.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
 #include "qemu/error-report.h"
@@ -479,12 +481,18 @@ typedef enum {
 
 #define M25P80_INTERNAL_DATA_BUFFER_SZ 16
 
+/* The image is read from the block backend on first access, in chunks */
+#define M25P80_LAZY_CHUNK_SZ (64 * KiB)
+
 struct Flash {
     SSIPeripheral parent_obj;
 
     BlockBackend *blk;
 
     uint8_t *storage;
+    /* chunks of storage read from blk so far, NULL once all are */
+    unsigned long *loaded;
+    NotifierList write_notifiers;
     uint32_t size;
     int page_size;
 
@@ -560,6 +568,57 @@ static inline Manufacturer get_man(Flash *s)
     }
 }
 
+/* Drop the bitmap once every chunk is resident so flash_load() is free */
+static void flash_loaded_update(Flash *s)
+{
+    if (bitmap_full(s->loaded, s->size / M25P80_LAZY_CHUNK_SZ)) {
+        g_free(s->loaded);
+        s->loaded = NULL;
+    }
+}
+
+static void flash_load_chunks(Flash *s, uint32_t addr, uint32_t len)
+{
+    uint32_t first = addr / M25P80_LAZY_CHUNK_SZ;
+    uint32_t last = (addr + len - 1) / M25P80_LAZY_CHUNK_SZ;
+    bool changed = false;
+
+    for (uint32_t i = first; i <= last; i++) {
+        uint8_t *chunk = s->storage + i * M25P80_LAZY_CHUNK_SZ;
+
+        if (test_bit(i, s->loaded)) {
+            continue;
+        }
+        if (blk_pread(s->blk, i * M25P80_LAZY_CHUNK_SZ, M25P80_LAZY_CHUNK_SZ,
+                      chunk, 0) < 0) {
+            error_report("M25P80: can't read %s block backend",
+                         blk_name(s->blk));
+            memset(chunk, 0xff, M25P80_LAZY_CHUNK_SZ);
+        }
+        set_bit(i, s->loaded);
+        changed = true;
+    }
+    if (changed) {
+        flash_loaded_update(s);
+    }
+}
+
+/* Make sure [addr, addr + len) of the working copy is backed by the image */
+static inline void flash_load(Flash *s, uint32_t addr, uint32_t len)
+{
+    if (s->loaded && len) {
+        flash_load_chunks(s, addr, len);
+    }
+}
+
+/* Tell the users of the working copy (e.g. a cache) that a range changed */
+static void flash_notify_write(Flash *s, uint32_t addr, uint32_t len)
+{
+    M25P80WriteRange range = { .addr = addr, .len = len };
+
+    notifier_list_notify(&s->write_notifiers, &range);
+}
+
 static void blk_sync_complete(void *opaque, int ret)
 {
     QEMUIOVector *iov = opaque;
@@ -652,52 +711,72 @@ static void flash_erase(Flash *s, int offset, FlashCMD cmd)
         qemu_log_mask(LOG_GUEST_ERROR, "M25P80: erase with write protect!\n");
         return;
     }
+    if (s->loaded) {
+        /* chunks erased as a whole don't have to be read first */
+        uint32_t first = DIV_ROUND_UP(offset, M25P80_LAZY_CHUNK_SZ);
+        uint32_t end = (offset + len) / M25P80_LAZY_CHUNK_SZ;
+
+        flash_load(s, offset, 1);
+        flash_load(s, offset + len - 1, 1);
+        if (s->loaded && end > first) {
+            bitmap_set(s->loaded, first, end - first);
+            flash_loaded_update(s);
+        }
+    }
     memset(s->storage + offset, 0xff, len);
     flash_sync_area(s, offset, len);
+    flash_notify_write(s, offset, len);
 }
 
 static inline void flash_sync_dirty(Flash *s, int64_t newpage)
 {
     if (s->dirty_page >= 0 && s->dirty_page != newpage) {
         flash_sync_page(s, s->dirty_page);
+        flash_notify_write(s, s->dirty_page * s->pi->page_size,
+                           s->pi->page_size);
         s->dirty_page = newpage;
     }
 }
 
-static inline
-void flash_write8(Flash *s, uint32_t addr, uint8_t data)
+static bool flash_block_protected(Flash *s, uint32_t addr)
 {
-    uint32_t page = addr / s->pi->page_size;
-    uint8_t prev = s->storage[s->cur_addr];
     uint32_t block_protect_value = (s->block_protect3 << 3) |
                                    (s->block_protect2 << 2) |
                                    (s->block_protect1 << 1) |
                                    (s->block_protect0 << 0);
 
-    if (!s->write_enable) {
-        qemu_log_mask(LOG_GUEST_ERROR, "M25P80: write with write protect!\n");
-        return;
-    }
-
     if (block_protect_value > 0) {
         uint32_t num_protected_sectors = 1 << (block_protect_value - 1);
         uint32_t sector = addr / s->pi->sector_size;
 
         /* top_bottom_bit == 0 means TOP */
         if (!s->top_bottom_bit) {
-            if (s->pi->n_sectors <= sector + num_protected_sectors) {
-                qemu_log_mask(LOG_GUEST_ERROR,
-                              "M25P80: write with write protect!\n");
-                return;
-            }
+            return s->pi->n_sectors <= sector + num_protected_sectors;
         } else {
-            if (sector < num_protected_sectors) {
-                qemu_log_mask(LOG_GUEST_ERROR,
-                              "M25P80: write with write protect!\n");
-                return;
-            }
+            return sector < num_protected_sectors;
         }
     }
+    return false;
+}
+
+static inline
+void flash_write8(Flash *s, uint32_t addr, uint8_t data)
+{
+    uint32_t page = addr / s->pi->page_size;
+    uint8_t prev;
+
+    flash_load(s, s->cur_addr, 1);
+    prev = s->storage[s->cur_addr];
+
+    if (!s->write_enable) {
+        qemu_log_mask(LOG_GUEST_ERROR, "M25P80: write with write protect!\n");
+        return;
+    }
+
+    if (flash_block_protected(s, addr)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "M25P80: write with write protect!\n");
+        return;
+    }
 
     if ((prev ^ data) & data) {
         trace_m25p80_programming_zero_to_one(s, addr, prev, data);
@@ -1656,6 +1735,7 @@ static uint32_t m25p80_transfer8(SSIPeripheral *ss, uint32_t tx)
         break;
 
     case STATE_READ:
+        flash_load(s, s->cur_addr, 1);
         r = s->storage[s->cur_addr];
         trace_m25p80_read_byte(s, s->cur_addr, (uint8_t)r);
         s->cur_addr = (s->cur_addr + 1) & (s->size - 1);
@@ -1738,6 +1818,7 @@ static void m25p80_realize(SSIPeripheral *ss, Error **errp)
 
     s->size = s->pi->sector_size * s->pi->n_sectors;
     s->dirty_page = -1;
+    notifier_list_init(&s->write_notifiers);
 
     if (s->blk) {
         uint64_t perm = BLK_PERM_CONSISTENT_READ |
@@ -1750,9 +1831,23 @@ static void m25p80_realize(SSIPeripheral *ss, Error **errp)
         trace_m25p80_binding(s);
         s->storage = blk_blockalign(s->blk, s->size);
 
-        if (!blk_check_size_and_read_all(s->blk, DEVICE(s),
-                                         s->storage, s->size, errp)) {
-            return;
+        if (s->size % M25P80_LAZY_CHUNK_SZ) {
+            if (!blk_check_size_and_read_all(s->blk, DEVICE(s),
+                                             s->storage, s->size, errp)) {
+                return;
+            }
+        } else {
+            int64_t blk_len = blk_getlength(s->blk);
+
+            if (blk_len != s->size) {
+                error_setg(errp, "%s device requires %" PRIu32 " bytes, "
+                           "%s block backend provides %" PRId64 " bytes",
+                           object_get_typename(OBJECT(s)), s->size,
+                           blk_name(s->blk), blk_len);
+                return;
+            }
+            /* untouched chunks are never read nor made resident */
+            s->loaded = bitmap_new(s->size / M25P80_LAZY_CHUNK_SZ);
         }
     } else {
         trace_m25p80_binding_no_bdrv(s);
@@ -1972,3 +2067,101 @@ BlockBackend *m25p80_get_blk(DeviceState *dev)
 {
     return M25P80(dev)->blk;
 }
+
+/*
+ * Whole-command access for controllers that decode flash commands in
+ * hardware, bypassing the byte-serial SSI state machine.  The chip must be
+ * deselected; the write enable latch and block protection apply exactly as
+ * for the serial READ, PP and erase commands.
+ */
+void m25p80_direct_read(DeviceState *dev, uint32_t addr, void *buf,
+                        uint32_t len)
+{
+    Flash *s = M25P80(dev);
+    uint8_t *p = buf;
+
+    addr &= s->size - 1;
+    while (len) {
+        uint32_t n = MIN(len, s->size - addr);
+
+        flash_load(s, addr, n);
+        memcpy(p, s->storage + addr, n);
+        p += n;
+        len -= n;
+        addr = 0;
+    }
+}
+
+void m25p80_direct_program(DeviceState *dev, uint32_t addr, const void *buf,
+                           uint32_t len)
+{
+    Flash *s = M25P80(dev);
+    const uint8_t *p = buf;
+
+    if (!s->write_enable) {
+        qemu_log_mask(LOG_GUEST_ERROR, "M25P80: write with write protect!\n");
+        return;
+    }
+
+    addr &= s->size - 1;
+    while (len) {
+        int64_t page = addr / s->pi->page_size;
+        uint32_t n = MIN(len, (page + 1) * s->pi->page_size - addr);
+        uint8_t *dst = s->storage + addr;
+
+        if (flash_block_protected(s, addr)) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "M25P80: write with write protect!\n");
+        } else {
+            flash_load(s, addr, n);
+            if (s->pi->flags & EEPROM) {
+                memcpy(dst, p, n);
+            } else {
+                for (uint32_t i = 0; i < n; i++) {
+                    dst[i] &= p[i];
+                }
+            }
+            flash_sync_dirty(s, page);
+            s->dirty_page = page;
+        }
+        p += n;
+        len -= n;
+        addr = (addr + n) & (s->size - 1);
+    }
+    flash_sync_dirty(s, -1);
+}
+
+void m25p80_direct_erase(DeviceState *dev, uint32_t addr, uint8_t cmd)
+{
+    Flash *s = M25P80(dev);
+
+    switch (cmd) {
+    case ERASE_4K:
+    case ERASE_32K:
+    case ERASE_SECTOR:
+        flash_erase(s, addr & (s->size - 1), cmd);
+        break;
+    case BULK_ERASE_60:
+    case BULK_ERASE:
+        flash_erase(s, 0, BULK_ERASE);
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "M25P80: direct erase cmd %x\n", cmd);
+        break;
+    }
+}
+
+DeviceState *m25p80_find_by_blk(BlockBackend *blk)
+{
+    DeviceState *dev = blk ? blk_get_attached_dev(blk) : NULL;
+
+    if (!dev || !object_dynamic_cast(OBJECT(dev), TYPE_M25P80)) {
+        return NULL;
+    }
+    return dev;
+}
+
+void m25p80_add_write_notifier(DeviceState *dev, Notifier *notifier)
+{
+    notifier_list_add(&M25P80(dev)->write_notifiers, notifier);
+}
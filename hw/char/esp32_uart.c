@@ -15,6 +15,8 @@
 #include "qemu/module.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/main-loop.h"
 #include "sysemu/sysemu.h"
 #include "chardev/char-fe.h"
 #include "hw/registerfields.h"
@@ -210,9 +212,46 @@ static void uart_write(void *opaque, hwaddr addr,
 }
 
 
+/*
+ * Reading the RX FIFO pops it and may let the chardev push more input, and
+ * every write can change the interrupt line, so those take the BQL.  The
+ * status and configuration registers polled by the console code only need
+ * the device lock.
+ */
+static uint64_t esp32_uart_mmio_read(void *opaque, hwaddr addr,
+                                     unsigned int size)
+{
+    ESP32UARTState *s = ESP32_UART(opaque);
+    ESP32UARTClass *class = ESP32_UART_GET_CLASS(opaque);
+
+    if (addr == A_UART_FIFO) {
+        BQL_LOCK_GUARD();
+        QEMU_LOCK_GUARD(&s->lock);
+        return class->uart_read(opaque, addr, size);
+    }
+
+    QEMU_LOCK_GUARD(&s->lock);
+    return class->uart_read(opaque, addr, size);
+}
+
+static void esp32_uart_mmio_write(void *opaque, hwaddr addr,
+                                  uint64_t value, unsigned int size)
+{
+    ESP32UARTState *s = ESP32_UART(opaque);
+    ESP32UARTClass *class = ESP32_UART_GET_CLASS(opaque);
+
+    BQL_LOCK_GUARD();
+    QEMU_LOCK_GUARD(&s->lock);
+    class->uart_write(opaque, addr, value, size);
+}
+
+
 static gboolean uart_transmit(void *do_not_use, GIOCondition cond, void *opaque)
 {
     ESP32UARTState *s = ESP32_UART(opaque);
+    int sent = 0;
+
+    QEMU_LOCK_GUARD(&s->lock);
 
     s->tx_watch_handle = 0;
 
@@ -227,13 +266,16 @@ static gboolean uart_transmit(void *do_not_use, GIOCondition cond, void *opaque)
         int r = qemu_chr_fe_write(&s->chr, &b, 1);
         if (r == 1) {
             fifo8_pop(&s->tx_fifo);
+            sent++;
         } else {
+            trace_esp32_uart_tx_blocked(s, fifo8_num_used(&s->tx_fifo));
             s->tx_watch_handle = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
                                                        uart_transmit, s);
             break;
         }
     }
 
+    trace_esp32_uart_tx(s, sent, fifo8_num_used(&s->tx_fifo));
     esp32_uart_update_irq(s);
 
     return FALSE;
@@ -247,6 +289,8 @@ static void uart_receive(void *opaque, const uint8_t *buf, int size)
         return;
     }
 
+    QEMU_LOCK_GUARD(&s->lock);
+
     /* If we can receive anything: cancel any pending RX timeout timer,
      * and clear the receive timeout flag.
      */
@@ -256,9 +300,11 @@ static void uart_receive(void *opaque, const uint8_t *buf, int size)
     }
 
     /* Move the data into the FIFO */
-    for (int i = 0; i < size && fifo8_num_free(&s->rx_fifo) > 0; i++) {
-        fifo8_push(&s->rx_fifo, buf[i]);
+    int accepted = 0;
+    for (; accepted < size && fifo8_num_free(&s->rx_fifo) > 0; accepted++) {
+        fifo8_push(&s->rx_fifo, buf[accepted]);
     }
+    trace_esp32_uart_rx(s, size, accepted);
 
     /* Receive throttling: some applications (in particular the ESP32 ROM bootloader)
      * may work incorrectly if the data comes in much faster than what UART baud rate
@@ -298,6 +344,7 @@ static void uart_event(void *opaque, QEMUChrEvent event)
 static void uart_throttle_timer_cb(void* opaque)
 {
     ESP32UARTState *s = ESP32_UART(opaque);
+    QEMU_LOCK_GUARD(&s->lock);
     s->throttle_rx = false;
     qemu_chr_fe_accept_input(&s->chr);
 }
@@ -305,6 +352,7 @@ static void uart_throttle_timer_cb(void* opaque)
 static void uart_rx_timeout_timer_cb(void* opaque)
 {
     ESP32UARTState *s = ESP32_UART(opaque);
+    QEMU_LOCK_GUARD(&s->lock);
     s->rxfifo_tout = true;
     esp32_uart_update_irq(s);
 }
@@ -313,6 +361,8 @@ static void esp32_uart_reset_hold(Object *obj, ResetType type)
 {
     ESP32UARTState *s = ESP32_UART(obj);
 
+    QEMU_LOCK_GUARD(&s->lock);
+
     memset(s->reg, 0, sizeof(s->reg));
     s->reg[R_UART_RXD_CNT] = 0;
     s->reg[R_UART_INT_ST] = 0;
@@ -351,16 +401,17 @@ static void esp32_uart_init(Object *obj)
 {
     ESP32UARTState *s = ESP32_UART(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
-    ESP32UARTClass *class = ESP32_UART_GET_CLASS(obj);
 
     s->uart_ops = (MemoryRegionOps) {
-        .read =  class->uart_read,
-        .write = class->uart_write,
+        .read =  esp32_uart_mmio_read,
+        .write = esp32_uart_mmio_write,
         .endianness = DEVICE_LITTLE_ENDIAN,
     };
 
+    qemu_rec_mutex_init(&s->lock);
     memory_region_init_io(&s->iomem, obj, &s->uart_ops, s,
                           TYPE_ESP32_UART, UART_REG_CNT * sizeof(uint32_t));
+    memory_region_enable_lockless_io(&s->iomem);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq);
     fifo8_create(&s->tx_fifo, UART_FIFO_LENGTH);
@@ -0,0 +1,276 @@
+/*
+ * Headless frame capture for ESP display models
+ *
+ * The display models copy what the guest draws into a host-memory panel
+ * here, independent of any QEMU console.  Copies compare against the
+ * previous content and grow a dirty rectangle only where pixels really
+ * change, so an unchanged screen costs no file output at all and a test
+ * can assert on frames without a GUI or full-surface copies per refresh.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "sysemu/sysemu.h"
+
+#include "hw/display/esp_fb_capture.h"
+
+#ifdef CONFIG_PNG
+#include <png.h>
+#endif
+
+struct EspFbCapture {
+    char *dir;
+    int64_t interval_ns;
+    void (*refresh)(void *opaque);
+    void *opaque;
+
+    uint32_t *fb;       /* xRGB8888 */
+    int width;
+    int height;
+
+    /* changed since the last frame, empty when x0 >= x1 */
+    int x0, y0, x1, y1;
+
+    unsigned frame;
+    FILE *index;
+    QEMUTimer timer;
+    Notifier exit_notifier;
+};
+
+static void capture_dirty(EspFbCapture *c, int x, int y)
+{
+    if (c->x0 >= c->x1) {
+        c->x0 = x;
+        c->y0 = y;
+        c->x1 = x + 1;
+        c->y1 = y + 1;
+        return;
+    }
+    c->x0 = MIN(c->x0, x);
+    c->y0 = MIN(c->y0, y);
+    c->x1 = MAX(c->x1, x + 1);
+    c->y1 = MAX(c->y1, y + 1);
+}
+
+static inline uint32_t rgb565_to_xrgb(uint16_t p)
+{
+    uint32_t r = (p >> 11) & 0x1f;
+    uint32_t g = (p >> 5) & 0x3f;
+    uint32_t b = p & 0x1f;
+
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return (r << 16) | (g << 8) | b;
+}
+
+void esp_fb_capture_update(EspFbCapture *c, int x, int y, int w, int h,
+                           EspFbFormat format, const void *src, int stride)
+{
+    const uint8_t *row = src;
+    int cx0, cx1, cy0, cy1;
+
+    if (!c) {
+        return;
+    }
+    cx0 = MAX(x, 0);
+    cx1 = MIN(x + w, c->width);
+    cy0 = MAX(y, 0);
+    cy1 = MIN(y + h, c->height);
+    if (cx0 >= cx1 || cy0 >= cy1) {
+        return;
+    }
+    row += (cy0 - y) * stride;
+    for (int py = cy0; py < cy1; py++, row += stride) {
+        uint32_t *dst = &c->fb[py * c->width];
+
+        for (int px = cx0; px < cx1; px++) {
+            uint32_t v;
+
+            if (format == ESP_FB_RGB565) {
+                v = rgb565_to_xrgb(((const uint16_t *)row)[px - x]);
+            } else {
+                v = ((const uint32_t *)row)[px - x] & 0xffffff;
+            }
+            if (dst[px] != v) {
+                dst[px] = v;
+                capture_dirty(c, px, py);
+            }
+        }
+    }
+}
+
+void esp_fb_capture_resize(EspFbCapture *c, int width, int height)
+{
+    if (!c || (width == c->width && height == c->height)) {
+        return;
+    }
+    g_free(c->fb);
+    c->fb = g_new0(uint32_t, width * height);
+    c->width = width;
+    c->height = height;
+    /* a new geometry is always worth a frame */
+    c->x0 = c->y0 = 0;
+    c->x1 = width;
+    c->y1 = height;
+}
+
+static void capture_row_rgb(EspFbCapture *c, int y, uint8_t *out)
+{
+    const uint32_t *p = &c->fb[y * c->width];
+
+    for (int x = 0; x < c->width; x++) {
+        *out++ = p[x] >> 16;
+        *out++ = p[x] >> 8;
+        *out++ = p[x];
+    }
+}
+
+#ifdef CONFIG_PNG
+#define CAPTURE_EXT "png"
+
+static bool capture_save(EspFbCapture *c, FILE *f, Error **errp)
+{
+    g_autofree uint8_t *buf = g_malloc(c->width * 3);
+    png_struct *png_ptr;
+    png_info *info_ptr;
+
+    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_ptr) {
+        error_setg(errp, "PNG creation failed. Unable to write struct");
+        return false;
+    }
+    info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr) {
+        error_setg(errp, "PNG creation failed. Unable to write info");
+        png_destroy_write_struct(&png_ptr, NULL);
+        return false;
+    }
+    png_init_io(png_ptr, f);
+    png_set_IHDR(png_ptr, info_ptr, c->width, c->height, 8,
+                 PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+    png_write_info(png_ptr, info_ptr);
+    for (int y = 0; y < c->height; y++) {
+        capture_row_rgb(c, y, buf);
+        png_write_row(png_ptr, buf);
+    }
+    png_write_end(png_ptr, NULL);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    return true;
+}
+
+#else /* no png support */
+#define CAPTURE_EXT "ppm"
+
+static bool capture_save(EspFbCapture *c, FILE *f, Error **errp)
+{
+    g_autofree uint8_t *buf = g_malloc(c->width * 3);
+
+    fprintf(f, "P6\n%d %d\n255\n", c->width, c->height);
+    for (int y = 0; y < c->height; y++) {
+        capture_row_rgb(c, y, buf);
+        if (fwrite(buf, 3, c->width, f) != c->width) {
+            error_setg_errno(errp, errno, "short write");
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif /* CONFIG_PNG */
+
+static void capture_write_frame(EspFbCapture *c)
+{
+    g_autofree char *name = g_strdup_printf("%06u." CAPTURE_EXT, c->frame);
+    g_autofree char *path = g_build_filename(c->dir, name, NULL);
+    Error *err = NULL;
+    FILE *f;
+
+    f = fopen(path, "wb");
+    if (!f) {
+        warn_report("esp fb capture: can't create %s: %s", path,
+                    strerror(errno));
+        return;
+    }
+    if (!capture_save(c, f, &err)) {
+        warn_report_err(err);
+    }
+    fclose(f);
+
+    fprintf(c->index, "%s,%" PRId64 ",%d,%d,%d,%d\n", name,
+            qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL),
+            c->x0, c->y0, c->x1 - c->x0, c->y1 - c->y0);
+    fflush(c->index);
+    c->frame++;
+    c->x0 = c->x1 = 0;
+}
+
+static void capture_tick(void *opaque)
+{
+    EspFbCapture *c = opaque;
+
+    if (c->refresh) {
+        c->refresh(c->opaque);
+    }
+    if (c->x0 < c->x1) {
+        capture_write_frame(c);
+    }
+    timer_mod_ns(&c->timer,
+                 qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + c->interval_ns);
+}
+
+/* Whatever was drawn after the last tick still makes it to disk */
+static void esp_fb_capture_exit(Notifier *n, void *data)
+{
+    EspFbCapture *c = container_of(n, EspFbCapture, exit_notifier);
+
+    if (c->x0 < c->x1) {
+        capture_write_frame(c);
+    }
+    fclose(c->index);
+}
+
+EspFbCapture *esp_fb_capture_new(const char *dir, uint32_t interval_ms,
+                                 void (*refresh)(void *opaque), void *opaque,
+                                 Error **errp)
+{
+    g_autofree char *index = g_build_filename(dir, "frames.csv", NULL);
+    EspFbCapture *c;
+    FILE *f;
+
+    if (!interval_ms) {
+        error_setg(errp, "capture interval must not be 0");
+        return NULL;
+    }
+    if (g_mkdir_with_parents(dir, 0777) < 0) {
+        error_setg_errno(errp, errno, "can't create capture directory %s",
+                         dir);
+        return NULL;
+    }
+    f = fopen(index, "w");
+    if (!f) {
+        error_setg_errno(errp, errno, "can't create %s", index);
+        return NULL;
+    }
+    fprintf(f, "file,time_ns,x,y,width,height\n");
+
+    c = g_new0(EspFbCapture, 1);
+    c->dir = g_strdup(dir);
+    c->interval_ns = (int64_t)interval_ms * SCALE_MS;
+    c->refresh = refresh;
+    c->opaque = opaque;
+    c->index = f;
+    timer_init_ns(&c->timer, QEMU_CLOCK_VIRTUAL, capture_tick, c);
+    timer_mod_ns(&c->timer,
+                 qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + c->interval_ns);
+    c->exit_notifier.notify = esp_fb_capture_exit;
+    qemu_add_exit_notifier(&c->exit_notifier);
+    return c;
+}
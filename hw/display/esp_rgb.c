@@ -15,6 +15,7 @@
 #include "hw/sysbus.h"
 #include "hw/irq.h"
 #include "hw/display/esp_rgb.h"
+#include "hw/qdev-properties.h"
 #include "ui/console.h"
 #include "qemu/error-report.h"
 #include "sysemu/dma.h"
@@ -48,6 +49,7 @@ static void update_rgb_surface(ESPRgbState* s){
     }
     surface->flags = QEMU_ALLOCATED_FLAG;
     dpy_gfx_replace_surface(s->con, surface);
+    esp_fb_capture_resize(s->capture, s->width, s->height);
 };
 
 static uint64_t esp_rgb_read(void *opaque, hwaddr addr, unsigned int size)
@@ -225,6 +227,10 @@ static void rgb_update(void* opaque)
             }
 
             dpy_gfx_update(s->con, s->from_x, s->from_y, width, height);
+            esp_fb_capture_update(s->capture, s->from_x, s->from_y, width, height,
+                                  bpp == BPP_16 ? ESP_FB_RGB565 : ESP_FB_XRGB8888,
+                                  data + (s->from_y * s->width + s->from_x) * bytes_per_pixel,
+                                  s->width * bytes_per_pixel);
         }
 #if RGB_WARNING
         else {
@@ -265,9 +271,26 @@ static void esp_rgb_realize(DeviceState *dev, Error **errp)
     assert(s->intram != NULL);
     /* Create an address space for internal RAM so that we can read data from it on GUI update */
     address_space_init(&s->intram_as, s->intram, "esp.rgb.intram_as");
+
+    if (s->capture_path) {
+        /* Without a display nothing calls rgb_update, so the capture does */
+        s->capture = esp_fb_capture_new(s->capture_path, s->capture_interval,
+                                        rgb_update, s, errp);
+        if (!s->capture) {
+            return;
+        }
+        esp_fb_capture_resize(s->capture, s->width, s->height);
+    }
 }
 
 
+static Property esp_rgb_properties[] = {
+    DEFINE_PROP_STRING("capture", ESPRgbState, capture_path),
+    DEFINE_PROP_UINT32("capture-interval", ESPRgbState, capture_interval, 20),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+
 static const MemoryRegionOps esp_rgb_ops = {
     .read =  esp_rgb_read,
     .write = esp_rgb_write,
@@ -329,6 +352,7 @@ static void esp_rgb_class_init(ObjectClass *klass, void *data)
 
     rc->phases.hold = esp_rgb_reset_hold;
     dc->realize = esp_rgb_realize;
+    device_class_set_props(dc, esp_rgb_properties);
 }
 
 static const TypeInfo esp_rgb_info = {
@@ -23,6 +23,7 @@
 #include "sysemu/runstate.h"
 #include "qemu/timer.h"
 #include "hw/qdev-properties.h"
+#include "hw/display/esp_fb_capture.h"
 #include <pixman.h>
 
 #define PANEL_WIDTH 240
@@ -52,6 +53,8 @@ typedef struct ConsoleState {
     int64_t time_off;
     int64_t time_on;
     QEMUTimer backlight_timer;
+    EspFbCapture *capture;
+    int32_t dirty_x0, dirty_y0, dirty_x1, dirty_y1; // panel memory written since the last capture
 
 } ConsoleState;
 
@@ -65,6 +68,8 @@ struct  St7789vState {
     qemu_irq button[2];
     qemu_irq reset;
     qemu_irq touch_sensor[4];
+    char *capture_path;
+    uint32_t capture_interval;
 };
 
 #define TYPE_ST7789V "st7789v"
@@ -155,6 +160,32 @@ static void bl_timer_cb(void *v) {
     c->time_off=0;
     timer_mod_ns(&console_state.backlight_timer, now + 100000000);
 }
+static void capture_mark(ConsoleState *c, int x0, int y0, int x1, int y1) {
+    if(c->dirty_x0>=c->dirty_x1) {
+        c->dirty_x0=x0;
+        c->dirty_y0=y0;
+        c->dirty_x1=x1;
+        c->dirty_y1=y1;
+    } else {
+        c->dirty_x0=MIN(c->dirty_x0,x0);
+        c->dirty_y0=MIN(c->dirty_y0,y0);
+        c->dirty_x1=MAX(c->dirty_x1,x1);
+        c->dirty_y1=MAX(c->dirty_y1,y1);
+    }
+}
+
+// copy the visible part of what was written to the panel memory
+static void capture_refresh(void *opaque) {
+    ConsoleState *c=&console_state;
+    int x0=MAX(c->dirty_x0,c->x_offset);
+    int y0=MAX(c->dirty_y0,c->y_offset);
+    if(c->dirty_x0>=c->dirty_x1) return;
+    esp_fb_capture_update(c->capture, x0-c->x_offset, y0-c->y_offset,
+                          c->dirty_x1-x0, c->dirty_y1-y0, ESP_FB_RGB565,
+                          &c->fb_data[y0*320+x0], 320*2);
+    c->dirty_x0=c->dirty_x1=0;
+}
+
 static void set_portrait(St7789vState *s) {
     ConsoleState *c=&console_state;
     if(s->iss3)
@@ -184,6 +215,8 @@ static void set_portrait(St7789vState *s) {
         c->skin_y_offset = SKIN_PORTRAIT_Y_OFFSET_S3;
     }
     c->skin_width = board_skin->width;
+    esp_fb_capture_resize(c->capture, c->width, c->height);
+    capture_mark(c, 0, 0, 320, 320);
     draw_skin(c);
 }
 
@@ -215,6 +248,8 @@ static void set_landscape(St7789vState *s) {
         c->skin_y_offset = SKIN_LANDSCAPE_Y_OFFSET_S3;
     }
     c->skin_width = board_skin->height;
+    esp_fb_capture_resize(c->capture, c->width, c->height);
+    capture_mark(c, 0, 0, 320, 320);
     draw_skin(c);
 }
 
@@ -270,8 +305,11 @@ static uint32_t st7789v_transfer(SSIPeripheral *dev, uint32_t data)
                         d16=(d16>>8) | (d16<<8);
                     }
                     uint32_t offset = c->y * 320 + c->x;
-                    if(offset<320*320)
+                    if(offset<320*320) {
                         c->fb_data[offset] = d16;
+                        if(c->capture && c->x<320)
+                            capture_mark(c, c->x, c->y, c->x+1, c->y+1);
+                    }
                     c->x++;
                     if (c->x > c->x_end) {
                         c->x = c->x_start;
@@ -516,6 +554,8 @@ static QemuInputHandler keyboard_handler = {
 
 static Property st7789v_properties[] = {
     DEFINE_PROP_BOOL("s3_skin",St7789vState,iss3,false),
+    DEFINE_PROP_STRING("capture",St7789vState,capture_path),
+    DEFINE_PROP_UINT32("capture-interval",St7789vState,capture_interval,20),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -541,7 +581,12 @@ static void st7789v_realize(SSIPeripheral *d, Error **errp) {
         c->lastlevel=0;
         c->lasttime=now;
         c->cmd_mode=1;
-        c->fb_data=malloc(320*320*2);
+        c->fb_data=calloc(320*320,2);
+        if(s->capture_path) {
+            c->capture=esp_fb_capture_new(s->capture_path,s->capture_interval,
+                                          capture_refresh,c,errp);
+            if(!c->capture) return;
+        }
         timer_init_ns(&c->backlight_timer,QEMU_CLOCK_VIRTUAL, bl_timer_cb,0);
         timer_mod_ns(&c->backlight_timer, now + 100000000);
         set_landscape(s);
@@ -17,6 +17,7 @@
 #include "hw/qdev-properties.h"
 #include "hw/qdev-properties-system.h"
 #include "qemu/error-report.h"
+#include "trace.h"
 
 #define GDMA_WARNING 0
 #define GDMA_DEBUG   0
@@ -297,6 +298,8 @@ bool esp_gdma_read_channel(ESPGdmaState *s, uint32_t chan, uint8_t* buffer, uint
 {
     DmaConfigState* state = &s->ch_conf[ESP_GDMA_OUT_IDX][chan];
 
+    trace_esp_gdma_out_start(chan, size);
+
     state->link &= R_GDMA_OUT_LINK_ADDR_MASK;
 
     /* Same goes for the status */
@@ -327,6 +330,7 @@ bool esp_gdma_read_channel(ESPGdmaState *s, uint32_t chan, uint8_t* buffer, uint
      * are set. Replicate the same behavior here. */
     if ( !valid || (owner_check_out && !out_list.config.owner ) ) {
         esp_gdma_set_status(&state->int_state, R_GDMA_INTERRUPT_OUT_DSCR_ERR_MASK);
+        trace_esp_gdma_out_done(chan, 0, false);
         return false;
     }
 
@@ -396,6 +400,7 @@ bool esp_gdma_read_channel(ESPGdmaState *s, uint32_t chan, uint8_t* buffer, uint
         esp_gdma_set_status(&state->int_state, R_GDMA_INTERRUPT_OUT_DONE_MASK);
     }
 
+    trace_esp_gdma_out_done(chan, consumed, !error);
     return !error;
 }
 
@@ -408,6 +413,8 @@ bool esp_gdma_write_channel(ESPGdmaState *s, uint32_t chan, uint8_t* buffer, uin
 {
     DmaConfigState* state = &s->ch_conf[ESP_GDMA_IN_IDX][chan];
 
+    trace_esp_gdma_in_start(chan, size);
+
     /* Clear the (RE)START fields, i.e., only keep the link address */
     state->link &= R_GDMA_OUT_LINK_ADDR_MASK;
 
@@ -431,6 +438,7 @@ bool esp_gdma_write_channel(ESPGdmaState *s, uint32_t chan, uint8_t* buffer, uin
 
     if ( !valid || (owner_check_in && !in_list.config.owner) ) {
         esp_gdma_set_status(&state->int_state, R_GDMA_INTERRUPT_IN_DSCR_ERR_MASK);
+        trace_esp_gdma_in_done(chan, 0, false);
         return false;
     }
 
@@ -524,6 +532,7 @@ bool esp_gdma_write_channel(ESPGdmaState *s, uint32_t chan, uint8_t* buffer, uin
         esp_gdma_set_status(&state->int_state, R_GDMA_INTERRUPT_IN_DONE_MASK);
     }
 
+    trace_esp_gdma_in_done(chan, consumed, !error);
     return !error;
 }
 
@@ -582,6 +591,8 @@ static void esp_gdma_check_and_start_mem_transfer(ESPGdmaState *s, uint32_t chan
             esp_gdma_get_restart_buffer(s, chan, ESP_GDMA_IN_IDX, &in_addr);
         }
 
+        trace_esp_gdma_mem_start(chan, out_addr, in_addr);
+
         /* Boolean to mark whether we need to check the owner for in and out buffers */
         const bool owner_check_out = FIELD_EX32(state_out->conf1, GDMA_OUT_CONF1, CHECK_OWNER);
         const bool owner_check_in  = FIELD_EX32(state_in->conf1, GDMA_IN_CONF1, CHECK_OWNER);
@@ -618,6 +629,7 @@ static void esp_gdma_check_and_start_mem_transfer(ESPGdmaState *s, uint32_t chan
 
         /* If any of the error bit has been set, return directly */
         if (error) {
+            trace_esp_gdma_mem_done(chan, 0, false);
             return;
         }
 
@@ -628,6 +640,8 @@ static void esp_gdma_check_and_start_mem_transfer(ESPGdmaState *s, uint32_t chan
         uint32_t remaining = out_list.config.length;
         /* Store the current number of bytes consumed in the "out" buffer */
         uint32_t consumed = 0;
+        /* Total number of bytes copied, only used for tracing */
+        uint32_t total = 0;
 
         bool exit_loop = false;
 
@@ -658,6 +672,7 @@ static void esp_gdma_check_and_start_mem_transfer(ESPGdmaState *s, uint32_t chan
             /* Update the number of bytes written to the "in" buffer */
             in_list.config.length += min;
             consumed += min;
+            total += min;
 
             /* Even if we reached the end of the TX descriptor, we still have to update RX descriptors
              * and registers, use `exit_loop` instead of break or return */
@@ -756,6 +771,7 @@ static void esp_gdma_check_and_start_mem_transfer(ESPGdmaState *s, uint32_t chan
                                 R_GDMA_INTERRUPT_OUT_EOF_MASK);
         }
 
+        trace_esp_gdma_mem_done(chan, total, !error);
         g_free(tmp_buffer);
     }
 }
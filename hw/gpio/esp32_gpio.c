@@ -11,6 +11,8 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/main-loop.h"
 #include "qapi/error.h"
 #include "ui/console.h"
 #include "ui/console-priv.h"
@@ -366,6 +368,7 @@ int gpio_map[N_RTC_GPIOS]={36,37,38,39,34,35,25,26,33,32,4,0,2,15,13,12,14,27};
 
 static uint64_t esp32_gpio_read(void *opaque, hwaddr addr, unsigned int size) {
     Esp32GpioState *s = ESP32_GPIO(opaque);
+    QEMU_LOCK_GUARD(&s->lock);
     uint64_t r = 0;
     switch (addr) {
         case A_GPIO_OUT:
@@ -438,6 +441,7 @@ static int get_triggering(int int_type, int oldval, int val) {
 }
 static void set_gpio(void *opaque, int n, int val) {
     Esp32GpioState *s = ESP32_GPIO(opaque);
+    QEMU_LOCK_GUARD(&s->lock);
     //printf("set_gpio %x %x\n",s->rtc_pad_cfg[1],s->rtc_ext_wakeup0);
     if(runstate_get()==RUN_STATE_SUSPENDED) {
         uint32_t wakeup_state,wakeup_conf,ext1_wakeup;
@@ -498,6 +502,10 @@ static void set_gpio(void *opaque, int n, int val) {
     }
         */
         
+    if (unlikely(s->trace) &&
+        ((n < 32 ? s->gpio_in >> n : s->gpio_in1 >> (n - 32)) & 1) != val) {
+        esp_signal_trace(s->trace, N_GPIOS + n, val);
+    }
     if (n < 32) {
         int oldval = (s->gpio_in >> n) & 1;
         int int_type = (s->gpio_pin[n] >> 7) & 7;
@@ -679,6 +687,7 @@ static const GraphicHwOps text_console_ops = {
 
 static uint64_t esp32_iomux_read(void *opaque, hwaddr addr, unsigned int size) {
     Esp32GpioState *s = ESP32_GPIO(opaque);
+    QEMU_LOCK_GUARD(&s->lock);
     int n=addr/4;
     if(n<N_GPIOS) {
 //        printf("IOMUX read %lx %x %d\n",addr, s->iomux_regs[n], size);
@@ -690,6 +699,8 @@ static uint64_t esp32_iomux_read(void *opaque, hwaddr addr, unsigned int size) {
 static void esp32_iomux_write(void *opaque, hwaddr addr, uint64_t value,
                              unsigned int size) {
     Esp32GpioState *s = ESP32_GPIO(opaque);
+    /* no side effects beyond the register itself, so the BQL isn't needed */
+    QEMU_LOCK_GUARD(&s->lock);
     int n=addr/4;
     if(n<N_GPIOS) {
         s->iomux_regs[n]=value;
@@ -701,6 +712,7 @@ static void esp32_iomux_write(void *opaque, hwaddr addr, uint64_t value,
 
 static uint64_t esp32_rtc_read(void *opaque, hwaddr addr, unsigned int size) {
     Esp32GpioState *s = ESP32_GPIO(opaque);
+    QEMU_LOCK_GUARD(&s->lock);
     uint64_t r=0;
     
     int rtc_in=0;
@@ -740,6 +752,8 @@ static uint64_t esp32_rtc_read(void *opaque, hwaddr addr, unsigned int size) {
 static void esp32_rtc_write(void *opaque, hwaddr addr, uint64_t value,
                              unsigned int size) {
     Esp32GpioState *s = ESP32_GPIO(opaque);
+    BQL_LOCK_GUARD();
+    QEMU_LOCK_GUARD(&s->lock);
 //    printf("RTC write %lx %lx\n",addr,value);
    // int rtc_in=0;
     int rtc_out=0;
@@ -809,6 +823,7 @@ static void esp32_rtc_write(void *opaque, hwaddr addr, uint64_t value,
                 if(i!=16) {
                     s->redraw=1;
                 }
+                esp_signal_trace(s->trace, i, (s->gpio_out >> i) & 1);
                 qemu_set_irq(s->gpios[i], (s->gpio_out & (1 << i)) ? 1 : 0);
             }
         }
@@ -817,6 +832,7 @@ static void esp32_rtc_write(void *opaque, hwaddr addr, uint64_t value,
         uint32_t diff = (s->gpio_out1 ^ oldvalue1);
         for (int i = 0; i < 16; i++) {
             if ((1 << i) & diff) {
+                esp_signal_trace(s->trace, i + 32, (s->gpio_out1 >> i) & 1);
                 qemu_set_irq(s->gpios[i+32], (s->gpio_out1 & (1 << i)) ? 1 : 0);
             }
         }
@@ -827,6 +843,8 @@ static void esp32_rtc_write(void *opaque, hwaddr addr, uint64_t value,
 static void esp32_gpio_write(void *opaque, hwaddr addr, uint64_t value,
                              unsigned int size) {
     Esp32GpioState *s = ESP32_GPIO(opaque);
+    BQL_LOCK_GUARD();
+    QEMU_LOCK_GUARD(&s->lock);
     int clearirq;
     uint32_t oldvalue = s->gpio_out;
     uint32_t oldvalue1 = s->gpio_out1;
@@ -940,6 +958,7 @@ static void esp32_gpio_write(void *opaque, hwaddr addr, uint64_t value,
                 if(i!=16) {
                     s->redraw=1;
                 }
+                esp_signal_trace(s->trace, i, (s->gpio_out >> i) & 1);
                 qemu_set_irq(s->gpios[i], (s->gpio_out & (1 << i)) ? 1 : 0);
             }
         }
@@ -948,6 +967,7 @@ static void esp32_gpio_write(void *opaque, hwaddr addr, uint64_t value,
         uint32_t diff = (s->gpio_out1 ^ oldvalue1);
         for (int i = 0; i < 16; i++) {
             if ((1 << i) & diff) {
+                esp_signal_trace(s->trace, i + 32, (s->gpio_out1 >> i) & 1);
                 qemu_set_irq(s->gpios[i+32], (s->gpio_out1 & (1 << i)) ? 1 : 0);
             }
         }
@@ -976,6 +996,7 @@ static const MemoryRegionOps rtc_ops = {
 
 static void esp32_gpio_reset(Object *dev, ResetType type) {
     Esp32GpioState *s = ESP32_GPIO(dev);
+    QEMU_LOCK_GUARD(&s->lock);
     for(int i=0;i<256;i++) {
         s->gpio_in_sel[i]=0x30;
     }
@@ -1012,6 +1033,7 @@ static void func_gpio(void *opaque, int n, int val) {
 	int param=((unsigned)val)>>10;
 	for(int i=0;i<N_GPIOS;i++) {
 		if((s->gpio_out_sel[i] & 0x1ff ) == func) {
+			esp_signal_trace(s->trace, i, v);
 			qemu_set_irq(s->gpios[i], v+(param<<1));
 		}
 	}
@@ -1026,6 +1048,29 @@ static void esp32_gpio_realize(DeviceState *dev, Error **errp) {
     s->con->hw_ops = &text_console_ops;
     s->con->hw = s;
     dpy_gfx_replace_surface(QEMU_CONSOLE(s->con), qemu_create_displaysurface(CONSOLE_WIDTH,CONSOLE_HEIGHT));
+
+    if (s->trace_path) {
+        EspSignalTrace *t = esp_signal_trace_new("esp32_gpio");
+        char name[16];
+
+        /* output levels first, so that signal n is the output of GPIO n */
+        for (int i = 0; i < N_GPIOS; i++) {
+            snprintf(name, sizeof(name), "gpio%d", i);
+            esp_signal_trace_add(t, name, 1);
+        }
+        for (int i = 0; i < N_GPIOS; i++) {
+            snprintf(name, sizeof(name), "gpio%d_in", i);
+            esp_signal_trace_add(t, name, 1);
+        }
+        if (!esp_signal_trace_open(t, s->trace_path, errp)) {
+            return;
+        }
+        s->trace = t;
+    }
+    if (s->stimulus_path) {
+        s->stimulus = esp_gpio_stimulus_new(s->stimulus_path, N_GPIOS,
+                                            set_gpio, s, errp);
+    }
 }
 
 
@@ -1043,6 +1088,11 @@ static void esp32_gpio_init(Object *obj) {
                           TYPE_ESP32_GPIO, 0x1000);
     memory_region_init_io(&s->iortcmem, obj, &rtc_ops, s,
                           TYPE_ESP32_GPIO, 0x100);
+    /* Polling inputs from both cores shouldn't serialize on the BQL */
+    qemu_rec_mutex_init(&s->lock);
+    memory_region_enable_lockless_io(&s->iomem);
+    memory_region_enable_lockless_io(&s->iomuxmem);
+    memory_region_enable_lockless_io(&s->iortcmem);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_mmio(sbd, &s->iomuxmem);
     sysbus_init_mmio(sbd, &s->iortcmem);
@@ -1062,6 +1112,8 @@ static Property esp32_gpio_properties[] = {
     /* The strap_mode needs to be explicitly set in the instance init, thus, set
      * the default value to 0. */
     DEFINE_PROP_UINT32("strap_mode", Esp32GpioState, strap_mode, 0),
+    DEFINE_PROP_STRING("trace", Esp32GpioState, trace_path),
+    DEFINE_PROP_STRING("stimulus", Esp32GpioState, stimulus_path),
     DEFINE_PROP_END_OF_LIST(),
 };
 
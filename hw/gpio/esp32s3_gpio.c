@@ -697,6 +697,10 @@ static void set_gpio(void *opaque, int n, int val) {
     }
 
     //printf("set_gpio %d %d\n",n,val);
+    if (unlikely(s->trace) &&
+        ((n < 32 ? s->gpio_in >> n : s->gpio_in1 >> (n - 32)) & 1) != val) {
+        esp_signal_trace(s->trace, N_GPIOS + n, val);
+    }
     if (n < 32) {
         int oldval = (s->gpio_in >> n) & 1;
         int int_type = (s->gpio_pin[n] >> 7) & 7;
@@ -799,6 +803,7 @@ static void esp32_rtc_write(void *opaque, hwaddr addr, uint64_t value,
                 if(i!=16) {
                     s->redraw=1;
                 }
+                esp_signal_trace(s->trace, i, (s->gpio_out >> i) & 1);
                 qemu_set_irq(s->gpios[i], (s->gpio_out & (1 << i)) ? 1 : 0);
             }
         }
@@ -929,6 +934,7 @@ static void ESP32S3_GPIO_write(void *opaque, hwaddr addr, uint64_t value,
         uint32_t diff = (s->gpio_out ^ oldvalue);
         for (int i = 0; i < 32; i++) {
             if ((1 << i) & diff) {
+                esp_signal_trace(s->trace, i, (s->gpio_out >> i) & 1);
                 qemu_set_irq(s->gpios[i], (s->gpio_out & (1 << i)) ? 1 : 0);
             }
         }
@@ -937,6 +943,7 @@ static void ESP32S3_GPIO_write(void *opaque, hwaddr addr, uint64_t value,
         uint32_t diff = (s->gpio_out1 ^ oldvalue1);
         for (int i = 0; i < 16; i++) {
             if ((1 << i) & diff) {
+                esp_signal_trace(s->trace, i + 32, (s->gpio_out1 >> i) & 1);
                 qemu_set_irq(s->gpios[i+32], (s->gpio_out1 & (1 << i)) ? 1 : 0);
             }
         }
@@ -950,6 +957,7 @@ static void func_gpio(void *opaque, int n, int val) {
         int param=((unsigned)val)>>10;
         for(int i=0;i<N_GPIOS;i++) {
                 if((s->gpio_out_sel[i] & 0x1ff ) == func) {
+                        esp_signal_trace(s->trace, i, v);
                         qemu_set_irq(s->gpios[i], v+(param<<1));
                 }
         }
@@ -1007,6 +1015,29 @@ static void esp32_gpio_realize(DeviceState *dev, Error **errp) {
     s->con->hw_ops = &text_console_ops;
     s->con->hw = s;
     dpy_gfx_replace_surface(QEMU_CONSOLE(s->con), qemu_create_displaysurface(CONSOLE_WIDTH,CONSOLE_HEIGHT));
+
+    if (s->trace_path) {
+        EspSignalTrace *t = esp_signal_trace_new("esp32s3_gpio");
+        char name[16];
+
+        /* output levels first, so that signal n is the output of GPIO n */
+        for (int i = 0; i < N_GPIOS; i++) {
+            snprintf(name, sizeof(name), "gpio%d", i);
+            esp_signal_trace_add(t, name, 1);
+        }
+        for (int i = 0; i < N_GPIOS; i++) {
+            snprintf(name, sizeof(name), "gpio%d_in", i);
+            esp_signal_trace_add(t, name, 1);
+        }
+        if (!esp_signal_trace_open(t, s->trace_path, errp)) {
+            return;
+        }
+        s->trace = t;
+    }
+    if (s->stimulus_path) {
+        s->stimulus = esp_gpio_stimulus_new(s->stimulus_path, N_GPIOS,
+                                            set_gpio, s, errp);
+    }
 }
 
 static void esp32s3_gpio_init(Object *obj)
@@ -1038,6 +1069,8 @@ static Property ESP32S3_GPIO_properties[] = {
     /* The strap_mode needs to be explicitly set in the instance init, thus, set
      * the default value to 0. */
     DEFINE_PROP_UINT32("strap_mode", ESP32S3GPIOState, strap_mode, 0),
+    DEFINE_PROP_STRING("trace", ESP32S3GPIOState, trace_path),
+    DEFINE_PROP_STRING("stimulus", ESP32S3GPIOState, stimulus_path),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -0,0 +1,314 @@
+/*
+ * Replay of GPIO input waveforms in virtual time
+ *
+ * The stimulus file is parsed once into an array sorted by time.  A single
+ * virtual clock timer walks the array, applies every change that is due
+ * and rearms itself for the next one, so long sequences replay at
+ * emulation speed and at the same guest instants on every run.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include <math.h>
+
+#include "hw/gpio/esp_gpio_stimulus.h"
+
+typedef struct StimulusEvent {
+    int64_t time;
+    uint32_t seq;
+    uint16_t pin;
+    uint8_t level;
+} StimulusEvent;
+
+struct EspGpioStimulus {
+    GArray *events;     /* StimulusEvent, sorted by time */
+    guint next;
+    QEMUTimer timer;
+    qemu_irq_handler set;
+    void *opaque;
+};
+
+typedef struct StimulusParser {
+    const char *path;
+    unsigned n_pins;
+    GArray *events;
+} StimulusParser;
+
+static void stimulus_add(StimulusParser *p, int64_t time, unsigned pin,
+                         unsigned level)
+{
+    StimulusEvent e = {
+        .time = time,
+        .seq = p->events->len,
+        .pin = pin,
+        .level = level,
+    };
+
+    g_array_append_val(p->events, e);
+}
+
+/* Nanoseconds per unit, 0 if the unit is unknown */
+static double stimulus_unit(const char *unit, double dflt)
+{
+    static const struct {
+        const char *name;
+        double ns;
+    } units[] = {
+        { "fs", 1e-6 }, { "ps", 1e-3 }, { "ns", 1 },
+        { "us", 1e3 }, { "ms", 1e6 }, { "s", 1e9 },
+    };
+
+    if (!*unit) {
+        return dflt;
+    }
+    for (int i = 0; i < ARRAY_SIZE(units); i++) {
+        if (!strcmp(unit, units[i].name)) {
+            return units[i].ns;
+        }
+    }
+    return 0;
+}
+
+/* "12.5ms", "1 ns" and the like */
+static bool stimulus_parse_time(const char *str, double dflt_unit, double *ns)
+{
+    g_autofree char *unit = NULL;
+    char *end;
+    double v = g_ascii_strtod(str, &end);
+    double scale;
+
+    if (end == str || v < 0) {
+        return false;
+    }
+    unit = g_strstrip(g_strdup(end));
+    scale = stimulus_unit(unit, dflt_unit);
+    if (!scale) {
+        return false;
+    }
+    *ns = v * scale;
+    return true;
+}
+
+/* "gpioN", "gpioN_in" or "N"; *input tells whether it was "gpioN_in" */
+static bool stimulus_parse_pin(StimulusParser *p, const char *name,
+                               unsigned *pin, bool *input)
+{
+    const char *end;
+
+    if (!g_ascii_strncasecmp(name, "gpio", 4)) {
+        name += 4;
+    }
+    if (qemu_strtoui(name, &end, 10, pin) < 0 ||
+        (*end && strcmp(end, "_in")) || *pin >= p->n_pins) {
+        return false;
+    }
+    *input = *end;
+    return true;
+}
+
+static bool stimulus_parse_csv(StimulusParser *p, char **lines, Error **errp)
+{
+    for (int n = 0; lines[n]; n++) {
+        char *line = g_strstrip(lines[n]);
+        g_auto(GStrv) f = NULL;
+        unsigned pin, level;
+        bool input;
+        double time;
+
+        if (!*line || *line == '#' || (n == 0 && !g_ascii_isdigit(*line))) {
+            continue;
+        }
+        f = g_strsplit(line, ",", -1);
+        if (g_strv_length(f) != 3 ||
+            !stimulus_parse_time(g_strstrip(f[0]), 1, &time) ||
+            !stimulus_parse_pin(p, g_strstrip(f[1]), &pin, &input) ||
+            qemu_strtoui(g_strstrip(f[2]), NULL, 10, &level) < 0 ||
+            level > 1) {
+            error_setg(errp, "%s:%d: expected time,pin,level", p->path, n + 1);
+            return false;
+        }
+        stimulus_add(p, llround(time), pin, level);
+    }
+    return true;
+}
+
+/* Index of the "$end" closing the section that starts at tokens[i] */
+static int stimulus_vcd_end(char **tokens, int i)
+{
+    while (tokens[i] && strcmp(tokens[i], "$end")) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Our own GPIO traces have both the output of a pin ("gpioN") and the
+ * level driven from outside ("gpioN_in"); only the latter is an input, so
+ * "gpioN" drives the pin only in files that have no "gpioN_in".
+ */
+static bool stimulus_parse_vcd(StimulusParser *p, const char *contents,
+                               Error **errp)
+{
+    g_auto(GStrv) tokens = g_strsplit_set(contents, " \t\r\n", -1);
+    /* id -> 2 * pin + input + 1 */
+    g_autoptr(GHashTable) ids = g_hash_table_new(g_str_hash, g_str_equal);
+    g_autofree bool *has_input = g_new0(bool, p->n_pins);
+    double scale = 1;
+    int64_t time = 0;
+    int i, j;
+
+    for (i = 0; tokens[i]; i++) {
+        char *tok = tokens[i];
+        gpointer var;
+
+        if (!*tok) {
+            continue;
+        }
+        if (!strcmp(tok, "$timescale")) {
+            g_autoptr(GString) ts = g_string_new(NULL);
+
+            j = stimulus_vcd_end(tokens, i);
+            for (int m = i + 1; m < j; m++) {
+                g_string_append(ts, tokens[m]);
+            }
+            if (!stimulus_parse_time(ts->str, 0, &scale)) {
+                error_setg(errp, "%s: unsupported timescale '%s'", p->path,
+                           ts->str);
+                return false;
+            }
+            i = j;
+        } else if (!strcmp(tok, "$var")) {
+            /* $var type width id name [range] $end */
+            unsigned width, n;
+            bool input;
+            char *f[4];
+            int k = 0;
+
+            j = stimulus_vcd_end(tokens, i);
+            for (int m = i + 1; m < j && k < 4; m++) {
+                if (*tokens[m]) {
+                    f[k++] = tokens[m];
+                }
+            }
+            if (k == 4 && qemu_strtoui(f[1], NULL, 10, &width) == 0 &&
+                width == 1 && stimulus_parse_pin(p, f[3], &n, &input)) {
+                g_hash_table_insert(ids, f[2],
+                                    GUINT_TO_POINTER(2 * n + input + 1));
+                has_input[n] |= input;
+            }
+            i = j;
+        } else if (!strcmp(tok, "$dumpvars") || !strcmp(tok, "$dumpall") ||
+                   !strcmp(tok, "$dumpon") || !strcmp(tok, "$dumpoff") ||
+                   !strcmp(tok, "$end")) {
+            /* value changes follow */
+        } else if (tok[0] == '$') {
+            i = stimulus_vcd_end(tokens, i);
+        } else if (tok[0] == '#') {
+            uint64_t t;
+
+            if (qemu_strtou64(tok + 1, NULL, 10, &t) < 0) {
+                error_setg(errp, "%s: invalid time '%s'", p->path, tok);
+                return false;
+            }
+            time = llround(t * scale);
+        } else if (tok[0] == 'b' || tok[0] == 'B' ||
+                   tok[0] == 'r' || tok[0] == 'R') {
+            /* vectors and reals are not pin levels, skip the identifier */
+            if (tokens[i + 1]) {
+                i++;
+            }
+        } else if ((tok[0] == '0' || tok[0] == '1') &&
+                   (var = g_hash_table_lookup(ids, tok + 1))) {
+            unsigned v = GPOINTER_TO_UINT(var) - 1;
+
+            if ((v & 1) || !has_input[v / 2]) {
+                stimulus_add(p, time, v / 2, tok[0] - '0');
+            }
+        }
+        if (!tokens[i]) {
+            break;
+        }
+    }
+    if (!g_hash_table_size(ids)) {
+        error_setg(errp, "%s: no 1-bit variable names a GPIO", p->path);
+        return false;
+    }
+    return true;
+}
+
+static gint stimulus_event_cmp(gconstpointer a, gconstpointer b)
+{
+    const StimulusEvent *x = a, *y = b;
+
+    if (x->time != y->time) {
+        return x->time < y->time ? -1 : 1;
+    }
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void esp_gpio_stimulus_fire(void *opaque)
+{
+    EspGpioStimulus *st = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    while (st->next < st->events->len) {
+        StimulusEvent *e = &g_array_index(st->events, StimulusEvent, st->next);
+
+        if (e->time > now) {
+            timer_mod_ns(&st->timer, e->time);
+            return;
+        }
+        st->set(st->opaque, e->pin, e->level);
+        st->next++;
+    }
+}
+
+EspGpioStimulus *esp_gpio_stimulus_new(const char *path, unsigned n_pins,
+                                       qemu_irq_handler set, void *opaque,
+                                       Error **errp)
+{
+    g_autofree char *contents = NULL;
+    g_autoptr(GError) err = NULL;
+    StimulusParser p = {
+        .path = path,
+        .n_pins = n_pins,
+        .events = g_array_new(false, false, sizeof(StimulusEvent)),
+    };
+    EspGpioStimulus *st;
+    bool ok;
+
+    if (!g_file_get_contents(path, &contents, NULL, &err)) {
+        error_setg(errp, "can't read GPIO stimulus: %s", err->message);
+        g_array_free(p.events, true);
+        return NULL;
+    }
+    if (g_str_has_prefix(g_strchug(contents), "$")) {
+        ok = stimulus_parse_vcd(&p, contents, errp);
+    } else {
+        g_auto(GStrv) lines = g_strsplit(contents, "\n", -1);
+
+        ok = stimulus_parse_csv(&p, lines, errp);
+    }
+    if (!ok) {
+        g_array_free(p.events, true);
+        return NULL;
+    }
+    g_array_sort(p.events, stimulus_event_cmp);
+
+    st = g_new0(EspGpioStimulus, 1);
+    st->events = p.events;
+    st->set = set;
+    st->opaque = opaque;
+    timer_init_ns(&st->timer, QEMU_CLOCK_VIRTUAL, esp_gpio_stimulus_fire, st);
+    if (st->events->len) {
+        timer_mod_ns(&st->timer,
+                     g_array_index(st->events, StimulusEvent, 0).time);
+    }
+    return st;
+}
@@ -11,7 +11,9 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "qemu/error-report.h"
+#include "qemu/main-loop.h"
 #include "qapi/error.h"
+#include "hw/core/cpu.h"
 #include "hw/sysbus.h"
 #include "hw/irq.h"
 #include "hw/registerfields.h"
@@ -25,13 +27,67 @@ static uint64_t esp32_crosscore_int_read(void *opaque, hwaddr addr, unsigned int
     return 0;
 }
 
+/* Drives the lines whose level changed since the last call; needs the BQL */
+static void esp32_crosscore_int_sync(CPUState *cpu, run_on_cpu_data data)
+{
+    Esp32CrosscoreInt *s = data.host_ptr;
+    uint32_t levels = qatomic_read(&s->levels);
+    uint32_t changed = levels ^ s->applied;
+
+    s->applied = levels;
+    for (int i = 0; changed; ++i, changed >>= 1) {
+        if (changed & 1) {
+            qemu_set_irq(s->irqs[i], (levels >> i) & 1);
+        }
+    }
+}
+
+/*
+ * FreeRTOS yields the other core with one of these on every cross-core
+ * notification, so the write is kept off the BQL: the level is updated
+ * atomically, and under MTTCG the interrupt matrix and CPU line are updated
+ * by the vCPU the interrupt is routed to, which async_run_on_cpu() kicks
+ * out of its TB or out of WAITI.  That vCPU holds the BQL anyway when it
+ * processes queued work.  With a single TCG thread there is nobody else to
+ * contend for the BQL, and the line is driven right away as before.
+ */
 static void esp32_crosscore_int_write(void *opaque, hwaddr addr,
                        uint64_t value, unsigned int size)
 {
-    Esp32CrosscoreInt *s = ESP32_CROSSCORE_INT(opaque);
+    Esp32CrosscoreInt *s = opaque;
     int index = addr / 4;
+    uint32_t bit;
+    uint32_t old;
+
     assert(index < s->n_irqs);
-    qemu_set_irq(s->irqs[index], value & 0x1);
+    bit = BIT(index);
+    if (value & 0x1) {
+        old = qatomic_fetch_or(&s->levels, bit);
+    } else {
+        old = qatomic_fetch_and(&s->levels, ~bit);
+    }
+    if (!(old & bit) == !(value & 0x1)) {
+        return;
+    }
+
+    if (qemu_tcg_mttcg_enabled() && current_cpu && !bql_locked()) {
+        CPUState *target = s->route ? s->route(s->route_opaque, index) : NULL;
+
+        async_run_on_cpu(target ?: current_cpu, esp32_crosscore_int_sync,
+                         RUN_ON_CPU_HOST_PTR(s));
+        return;
+    }
+
+    BQL_LOCK_GUARD();
+    esp32_crosscore_int_sync(current_cpu, RUN_ON_CPU_HOST_PTR(s));
+}
+
+void esp32_crosscore_int_set_route(Esp32CrosscoreInt *s,
+                                   Esp32CrosscoreRouteFn *route,
+                                   void *opaque)
+{
+    s->route = route;
+    s->route_opaque = opaque;
 }
 
 static const MemoryRegionOps esp32_crosscore_int_ops = {
@@ -45,6 +101,10 @@ static void esp32_crosscore_int_realize(DeviceState *dev, Error **errp)
     Esp32CrosscoreInt *s = ESP32_CROSSCORE_INT(dev);
     SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
 
+    if (s->n_irqs <= 0 || s->n_irqs > 32) {
+        error_setg(errp, "n_irqs must be between 1 and 32");
+        return;
+    }
     s->irqs = g_malloc0_n(s->n_irqs, sizeof(qemu_irq));
     assert(s->irqs);
     for (int i = 0; i < s->n_irqs; ++i) {
@@ -54,9 +114,25 @@ static void esp32_crosscore_int_realize(DeviceState *dev, Error **errp)
     memory_region_init_io(&s->iomem, OBJECT(dev), &esp32_crosscore_int_ops, s,
                           TYPE_ESP32_CROSSCORE_INT,
                           s->n_irqs * sizeof(uint32_t));
+    memory_region_enable_lockless_io(&s->iomem);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
+/*
+ * A reset clears the interrupt matrix and the CPU lines, so forget the
+ * levels too; otherwise a line left high would make the guest's next
+ * write of 1 look unchanged and the interrupt would never be raised.
+ * Reset runs with the BQL held, which is what guards applied.
+ */
+static void esp32_crosscore_int_reset_hold(Object *obj, ResetType type)
+{
+    Esp32CrosscoreInt *s = ESP32_CROSSCORE_INT(obj);
+
+    assert(bql_locked());
+    qatomic_set(&s->levels, 0);
+    s->applied = 0;
+}
+
 static void esp32_crosscore_int_init(Object *obj)
 {
 
@@ -70,7 +146,9 @@ static Property esp32_crosscore_int_properties[] = {
 static void esp32_crosscore_int_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
+    ResettableClass *rc = RESETTABLE_CLASS(klass);
 
+    rc->phases.hold = esp32_crosscore_int_reset_hold;
     dc->realize = esp32_crosscore_int_realize;
     device_class_set_props(dc, esp32_crosscore_int_properties);
 }
@@ -20,9 +20,11 @@
 #include "hw/boards.h"
 #include "hw/misc/esp32_reg.h"
 #include "hw/misc/esp32_dport.h"
+#include "hw/block/flash.h"
 
 #include "hw/misc/esp32_flash_enc.h"
 #include "hw/nvram/esp32_efuse.h"
+#include "trace.h"
 
 
 #define ESP32_DPORT_SIZE        (DR_REG_DPORT_APB_BASE - DR_REG_DPORT_BASE)
@@ -53,6 +55,8 @@ static inline void set_mmu_entry(Esp32CacheRegionState* crs, hwaddr base, hwaddr
 {
     uint32_t old_val = crs->mmu_table[(addr - base)/sizeof(uint32_t)];
     if (val != old_val) {
+        trace_esp32_cache_mmu_update(crs, (addr - base) / sizeof(uint32_t),
+                                     old_val & MMU_ENTRY_MASK, val & MMU_ENTRY_MASK);
         crs->mmu_table[(addr - base)/sizeof(uint32_t)] = (val & MMU_ENTRY_MASK) | ESP32_CACHE_MMU_ENTRY_CHANGED;
     }
 }
@@ -235,6 +239,55 @@ static const MemoryRegionOps esp32_dport_ops = {
     .endianness = DEVICE_LITTLE_ENDIAN,
 };
 
+static void esp32_cache_data_sync(Esp32CacheRegionState* crs);
+
+/* Program and erase only refresh the cache pages mapping the changed range */
+static void esp32_dport_flash_written(Notifier *notifier, void *data)
+{
+    Esp32DportState *s = container_of(notifier, Esp32DportState, flash_write_notifier);
+    M25P80WriteRange *range = data;
+    uint32_t first = range->addr / ESP32_CACHE_PAGE_SIZE;
+    uint32_t last = (range->addr + range->len - 1) / ESP32_CACHE_PAGE_SIZE;
+
+    for (int cpu = 0; cpu < ARRAY_SIZE(s->cache_state); ++cpu) {
+        Esp32CacheRegionState *regions[] = {
+            &s->cache_state[cpu].drom0, &s->cache_state[cpu].iram0
+        };
+        for (int r = 0; r < ARRAY_SIZE(regions); ++r) {
+            Esp32CacheRegionState *crs = regions[r];
+            bool changed = false;
+            for (int i = 0; i < ESP32_CACHE_PAGES_PER_REGION; ++i) {
+                uint32_t mmu_entry = crs->mmu_table[i] & MMU_ENTRY_MASK;
+                if (!(mmu_entry & ESP32_CACHE_MMU_INVALID_VAL) &&
+                    mmu_entry >= first && mmu_entry <= last) {
+                    crs->mmu_table[i] |= ESP32_CACHE_MMU_ENTRY_CHANGED;
+                    changed = true;
+                }
+            }
+            if (changed && crs->mem.enabled) {
+                esp32_cache_data_sync(crs);
+            }
+        }
+    }
+}
+
+static void esp32_cache_read_flash(Esp32DportState *s, uint32_t addr, void *buf, uint32_t len)
+{
+    if (!s->flash) {
+        /* the flash chip is attached after the SoC is realized */
+        s->flash = m25p80_find_by_blk(s->flash_blk);
+        if (s->flash) {
+            s->flash_write_notifier.notify = esp32_dport_flash_written;
+            m25p80_add_write_notifier(s->flash, &s->flash_write_notifier);
+        }
+    }
+    if (s->flash) {
+        m25p80_direct_read(s->flash, addr, buf, len);
+    } else {
+        blk_pread(s->flash_blk, addr, len, buf, 0);
+    }
+}
+
 static void esp32_cache_data_sync(Esp32CacheRegionState* crs)
 {
     if (crs->cache->dport->flash_blk == NULL) {
@@ -245,6 +298,8 @@ static void esp32_cache_data_sync(Esp32CacheRegionState* crs)
     bool decrypt = (flash_enc != NULL && esp32_flash_decryption_enabled(flash_enc));
 
     uint8_t* cache_data = (uint8_t*) memory_region_get_ram_ptr(&crs->mem);
+    int loaded = 0;
+    trace_esp32_cache_sync(crs);
     for (int i = 0; i < ESP32_CACHE_PAGES_PER_REGION; ++i) {
         uint32_t* cache_page = (uint32_t*) (cache_data + i * ESP32_CACHE_PAGE_SIZE);
         uint32_t mmu_entry = crs->mmu_table[i];
@@ -259,14 +314,16 @@ static void esp32_cache_data_sync(Esp32CacheRegionState* crs)
             }
         } else {
             uint32_t phys_addr = mmu_entry * ESP32_CACHE_PAGE_SIZE;
-            blk_pread(crs->cache->dport->flash_blk, phys_addr, ESP32_CACHE_PAGE_SIZE, cache_page, 0);
+            esp32_cache_read_flash(crs->cache->dport, phys_addr, cache_page, ESP32_CACHE_PAGE_SIZE);
             if (decrypt) {
                 esp32_flash_decrypt_inplace(flash_enc, phys_addr, cache_page, ESP32_CACHE_PAGE_SIZE/4);
             }
         }
         crs->mmu_table[i] &= ~ESP32_CACHE_MMU_ENTRY_CHANGED;
+        memory_region_flush_rom_device(&crs->mem, i * ESP32_CACHE_PAGE_SIZE, ESP32_CACHE_PAGE_SIZE);
+        loaded++;
     }
-    memory_region_flush_rom_device(&crs->mem, 0, ESP32_CACHE_REGION_SIZE);
+    trace_esp32_cache_sync_done(crs, loaded);
 }
 
 static void esp32_cache_invalidate_all_entries(Esp32CacheRegionState* crs)
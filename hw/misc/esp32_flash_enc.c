@@ -7,19 +7,14 @@
  * it under the terms of the GNU General Public License version 2 or
  * (at your option) any later version.
  */
-#include <gcrypt.h>
 #include "qemu/osdep.h"
 #include "hw/hw.h"
 #include "hw/sysbus.h"
 #include "qapi/error.h"
 #include "qemu/log.h"
-#include "crypto/cipher.h"
 #include "hw/misc/esp32_flash_enc.h"
 #include "hw/nvram/esp32_efuse.h"
 
-#define FLASH_ENCRYPTION_KEY_WORDS  8
-#define FLASH_ENCRYPTION_DATA_WORDS  4
-
 static void esp32_flash_encryption_op(Esp32FlashEncryptionState *s);
 
 static uint64_t esp32_flash_encryption_read(void *opaque, hwaddr addr,
@@ -88,65 +83,10 @@ bool esp32_flash_decryption_enabled(struct Esp32FlashEncryptionState *s)
     }
 }
 
-static void esp32_flash_encryption_key_tweak(struct Esp32FlashEncryptionState *s,
-                                             size_t offset, const uint32_t *in_key, uint32_t *out_key)
-{
-    uint32_t offset_5 = offset >> 5;
-    uint32_t offset_5_8 = (offset_5) & 0xf;
-    uint32_t offset_5_10 = (offset_5) & 0x3f;
-    uint32_t offset_5_12 = (offset_5) & 0xff;
-    uint32_t offset_5_14 = (offset_5) & 0x3ff;
-    uint32_t offset_5_23 = (offset_5) & 0x7ffff;
-
-    uint32_t key_tweak[FLASH_ENCRYPTION_KEY_WORDS] = {
-            (offset_5_23 >> 6) | (offset_5_23 << 13),
-            (offset_5_14 >> 3) | (offset_5_23 << 7) | (offset_5_23 << 26),
-            (offset_5_23 >> 9) | (offset_5_23 << 10) | (offset_5_14 << 29),
-            (offset_5_12 >> 4) | (offset_5_23 << 4) | (offset_5_23 << 23),
-            (offset_5_23 >> 10) | (offset_5_23 << 9) | (offset_5_12 << 28),
-            (offset_5_10 >> 3) | (offset_5_23 << 3) | (offset_5_23 << 22),
-            (offset_5_23 >> 9) | (offset_5_23 << 10) | (offset_5_10 << 29),
-            (offset_5_8) | (offset_5_23 << 4) | (offset_5_23 << 23)
-    };
-
-    for (size_t i = 0; i < FLASH_ENCRYPTION_KEY_WORDS; ++i) {
-        out_key[i] = in_key[i] ^ bswap32(key_tweak[i]);
-    }
-}
-
-static inline void reverse_key_byte_order(const uint32_t* src, uint32_t* dst)
-{
-    assert( src != dst );
-    for (size_t i = 0; i < FLASH_ENCRYPTION_KEY_WORDS; ++i) {
-        dst[i] = bswap32(src[FLASH_ENCRYPTION_KEY_WORDS - i - 1]);
-    }
-}
-
-static inline void reverse_data_byte_order(const uint32_t* src, uint32_t* dst)
-{
-    assert( src != dst );
-    for (size_t i = 0; i < FLASH_ENCRYPTION_DATA_WORDS; ++i) {
-        dst[i] = bswap32(src[FLASH_ENCRYPTION_DATA_WORDS - i - 1]);
-    }
-}
-
 static void esp32_flash_encryption_op(struct Esp32FlashEncryptionState *s)
 {
-    uint32_t tweaked_key[FLASH_ENCRYPTION_KEY_WORDS];
-    uint32_t reversed_key[FLASH_ENCRYPTION_KEY_WORDS];
-    uint32_t reversed_data[FLASH_ENCRYPTION_DATA_WORDS];
-    uint32_t encrypted_data[FLASH_ENCRYPTION_DATA_WORDS];
-
-    memset(s->encrypted_buffer, 0, sizeof(s->encrypted_buffer));
-    reverse_key_byte_order(s->efuse_key, reversed_key);
-    esp32_flash_encryption_key_tweak(s, s->address_reg, reversed_key, tweaked_key);
-    QCryptoCipher *cipher = qcrypto_cipher_new(QCRYPTO_CIPHER_ALGO_AES_256, QCRYPTO_CIPHER_MODE_ECB, (const uint8_t*) tweaked_key, FLASH_ENCRYPTION_KEY_WORDS * 4, &error_abort);
-    for (size_t total_words = 0; total_words < ARRAY_SIZE(s->buffer_reg); total_words += FLASH_ENCRYPTION_DATA_WORDS) {
-        reverse_data_byte_order(s->buffer_reg + total_words, reversed_data);
-        qcrypto_cipher_decrypt(cipher, reversed_data, encrypted_data, sizeof(s->buffer_reg), &error_abort);
-        reverse_data_byte_order(encrypted_data, s->encrypted_buffer + total_words);
-    }
-    qcrypto_cipher_free(cipher);
+    esp32_flash_cipher_encrypt(&s->cipher, s->address_reg, s->buffer_reg,
+                               s->encrypted_buffer);
 }
 
 void esp32_flash_encryption_get_result(struct Esp32FlashEncryptionState* s, uint32_t* dst, size_t dst_words)
@@ -157,45 +97,7 @@ void esp32_flash_encryption_get_result(struct Esp32FlashEncryptionState* s, uint
 
 void esp32_flash_decrypt_inplace(struct Esp32FlashEncryptionState* s, size_t flash_addr, uint32_t* data, size_t words)
 {
-    assert(flash_addr % 32 == 0);
-    assert(words % FLASH_ENCRYPTION_DATA_WORDS == 0);
-    uint32_t tweaked_key[FLASH_ENCRYPTION_KEY_WORDS];
-    uint32_t reversed_key[FLASH_ENCRYPTION_KEY_WORDS];
-    uint32_t reversed_data[FLASH_ENCRYPTION_DATA_WORDS];
-    uint32_t decrypted_data[FLASH_ENCRYPTION_DATA_WORDS];
-
-    reverse_key_byte_order(s->efuse_key, reversed_key);
-#ifdef CONFIG_GCRYPT
-    gcry_cipher_hd_t cipher;
-    gcry_error_t err = gcry_cipher_open(&cipher, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_ECB, 0);
-    if (err != GPG_ERR_NO_ERROR) {
-        fprintf(stderr, "Error initializing cipher: %s\n", gcry_strerror(err));
-        return;
-    }
-
-    for (size_t pos = 0; pos < words; pos += FLASH_ENCRYPTION_DATA_WORDS) {
-        uint32_t offset = flash_addr + pos * 4;
-        esp32_flash_encryption_key_tweak(s, offset, reversed_key, tweaked_key);
-        gcry_cipher_setkey(cipher, tweaked_key, FLASH_ENCRYPTION_KEY_WORDS * 4);
-        reverse_data_byte_order(data + pos, reversed_data);
-        gcry_cipher_encrypt(cipher, decrypted_data, sizeof(decrypted_data), reversed_data, sizeof(reversed_data));
-        reverse_data_byte_order(decrypted_data, data + pos);
-    }
-
-    gcry_cipher_close(cipher);
-#else
-    #pragma message "NOTE: Using GCRYPT is highly recommended for better performance with flash encryption"
-
-    for (size_t pos = 0; pos < words; pos += FLASH_ENCRYPTION_DATA_WORDS) {
-        uint32_t offset = flash_addr + pos * 4;
-        esp32_flash_encryption_key_tweak(s, offset, reversed_key, tweaked_key);
-        QCryptoCipher *cipher = qcrypto_cipher_new(QCRYPTO_CIPHER_ALGO_AES_256, QCRYPTO_CIPHER_MODE_ECB, (const uint8_t*) tweaked_key, FLASH_ENCRYPTION_KEY_WORDS * 4, &error_abort);
-        reverse_data_byte_order(data + pos, reversed_data);
-        qcrypto_cipher_encrypt(cipher, reversed_data, decrypted_data, sizeof(decrypted_data), &error_abort);
-        reverse_data_byte_order(decrypted_data, data + pos);
-        qcrypto_cipher_free(cipher);
-    }
-#endif
+    esp32_flash_cipher_decrypt(&s->cipher, flash_addr, data, words);
 }
 
 static void esp32_flash_encryption_on_dl_mode_change(void *opaque, int n,
@@ -239,6 +141,7 @@ static void esp32_flash_encryption_on_efuse_update(void *opaque, int n,
     }
     /* Copy the key */
     memcpy(s->efuse_key, &efuse->efuse_rd.blk1[0], sizeof(s->efuse_key));
+    esp32_flash_cipher_set_key(&s->cipher, s->efuse_key);
 }
 
 static void esp32_flash_encryption_init(Object *obj)
@@ -3,6 +3,7 @@
 #include "qemu/log.h"
 #include "hw/misc/esp32_ledc.h"
 #include "hw/irq.h"
+#include "hw/qdev-properties.h"
 #include "qapi/error.h"
 
 #define ESP32_LEDC_REGS_SIZE (A_LEDC_CONF_REG + 4)
@@ -242,6 +243,9 @@ static void esp32_ledc_write(void *opaque, hwaddr addr, uint64_t value,
             led_set_intensity(&s->led[index],
                               esp32_ledc_get_percent(s, value, addr));
             s->op_val[index] = 1;
+            esp_signal_trace(s->trace, index, 1);
+            esp_signal_trace(s->trace, ESP32_LEDC_CHANNEL_CNT + index,
+                             (value >> 4) & ((1 << 20) - 1));
             qemu_set_irq(s->func_irq,
                          (71 + index) * 2 + 1 + ((on_time / 1000) << 10));
             s->cycle[index] = 0;
@@ -279,6 +283,26 @@ static void esp32_ledc_realize(DeviceState *dev, Error **errp) {
     for (int i = 0; i < ESP32_LEDC_CHANNEL_CNT; i++) {
         qdev_realize(DEVICE(&s->led[i]), NULL, &error_fatal);
     }
+
+    if (s->trace_path) {
+        EspSignalTrace *t = esp_signal_trace_new("esp32_ledc");
+        char name[16];
+
+        /* channel outputs, then their duty values */
+        for (int i = 0; i < ESP32_LEDC_CHANNEL_CNT; i++) {
+            snprintf(name, sizeof(name), "%s%d", i < 8 ? "hs" : "ls", i % 8);
+            esp_signal_trace_add(t, name, 1);
+        }
+        for (int i = 0; i < ESP32_LEDC_CHANNEL_CNT; i++) {
+            snprintf(name, sizeof(name), "%s%d_duty", i < 8 ? "hs" : "ls",
+                     i % 8);
+            esp_signal_trace_add(t, name, 20);
+        }
+        if (!esp_signal_trace_open(t, s->trace_path, errp)) {
+            return;
+        }
+        s->trace = t;
+    }
 }
 
 static void ledc_timer_cb(void *v) {
@@ -288,6 +312,7 @@ static void ledc_timer_cb(void *v) {
     get_duty_time(s, index, &on_time, &off_time);
     if (s->op_val[index] == 0) {
         s->op_val[index] = 1;
+        esp_signal_trace(s->trace, index, 1);
         qemu_set_irq(s->func_irq,
                      (71 + index) * 2 + 1 + ((on_time / 1000) << 10));
         timer_mod_anticipate_ns(
@@ -295,6 +320,7 @@ static void ledc_timer_cb(void *v) {
             qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + on_time);
     } else {
         s->op_val[index] = 0;
+        esp_signal_trace(s->trace, index, 0);
         qemu_set_irq(s->func_irq, (71 + index) * 2 + ((off_time / 1000) << 10));
         timer_mod_anticipate_ns(
             &s->led_timer[index],
@@ -317,6 +343,8 @@ static void ledc_timer_cb(void *v) {
                 }
                 if(s->duty_reg[index]<0)
                     s->duty_reg[index]=0;
+                esp_signal_trace(s->trace, ESP32_LEDC_CHANNEL_CNT + index,
+                                 s->duty_reg[index] >> 4);
                 duty_num--;
                 if (duty_num < 0) duty_num = 0;
                 if (duty_num == 0 && (s->int_en & (1 << (index + 8)))) {
@@ -357,9 +385,15 @@ static void esp32_ledc_reset(DeviceState *obj) {
     }
 }
 
+static Property esp32_ledc_properties[] = {
+    DEFINE_PROP_STRING("trace", Esp32LEDCState, trace_path),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void esp32_ledc_class_init(ObjectClass *klass, void *data) {
     DeviceClass *dc = DEVICE_CLASS(klass);
     dc->realize = esp32_ledc_realize;
+    device_class_set_props(dc, esp32_ledc_properties);
     device_class_set_legacy_reset(dc,esp32_ledc_reset);
 }
 
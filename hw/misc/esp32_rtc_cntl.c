@@ -21,6 +21,7 @@
 #include "hw/misc/esp32_reg.h"
 #include "hw/misc/esp32_rtc_cntl.h"
 #include "sysemu/runstate.h"
+#include "trace.h"
 
 #define DEBUG 0
 
@@ -30,6 +31,7 @@ static void esp32_rtc_update_clk(Esp32RtcCntlState* s);
 static void sleep_timer_cb(void *opaque)
 {
     Esp32RtcCntlState *s = (Esp32RtcCntlState*) opaque;
+    trace_esp32_rtc_cntl_wake();
     qemu_set_irq(s->rtc_wakeup,RTC_ULP_TRIG_EN);
 }
 
@@ -187,10 +189,9 @@ static void esp32_rtc_cntl_write(void *opaque, hwaddr addr, uint64_t value,
             uint64_t sleep_ns=muldiv64(
                 sleep_time - s->time_reg, NANOSECONDS_PER_SECOND,
                 s->rtc_slowclk_freq);
-            if(DEBUG)
-                printf("Sleep %d, %d, %d, %d\n",(uint32_t)s->time_reg, (uint32_t)sleep_time, timer_en, (uint32_t)sleep_ns);
+            trace_esp32_rtc_cntl_sleep(sleep_ns, timer_en);
             if(timer_en)
-                timer_mod(&s->sleep_timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME)+sleep_ns);
+                timer_mod(&s->sleep_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT)+sleep_ns);
             s->low_power_state_reg=FIELD_DP32(s->low_power_state_reg,RTC_CNTL_LOW_POWER_ST_REG, RTC_RDY_FOR_WAKEUP,1);
          //   s->wakeup_state_reg=FIELD_DP32(s->wakeup_state_reg, RTC_CNTL_WAKEUP_STATE, WAKEUP_ENA_RTC_TIMER,0);
             qemu_system_suspend_request();
@@ -335,7 +336,12 @@ static void esp32_rtc_cntl_init(Object *obj)
     s->soc_clk = ESP32_SOC_CLK_XTAL;
     s->xtal_apb_freq = 40000000;
     s->pll_apb_freq = 80000000;
-    timer_init_ns(&s->sleep_timer, QEMU_CLOCK_REALTIME, sleep_timer_cb, s);
+    /*
+     * The CPUs are suspended while the timer runs, so QEMU_CLOCK_VIRTUAL
+     * would not advance under icount.  QEMU_CLOCK_VIRTUAL_RT keeps
+     * counting and its expiry is a record/replay checkpoint.
+     */
+    timer_init_ns(&s->sleep_timer, QEMU_CLOCK_VIRTUAL_RT, sleep_timer_cb, s);
     esp32_rtc_update_clk(s);
 }
 
@@ -27,6 +27,18 @@ static void touch_sensor_changed(void *opaque, int n, int level) {
     s->touch_sensor[n]=level;
 }
 
+/*
+ * ADC and touch readings carry a little noise.  Draw it from the guest
+ * random source so that -seed and record/replay reproduce it.
+ */
+static uint32_t sens_noise(uint32_t range)
+{
+    uint16_t v;
+
+    qemu_guest_getrandom_nofail(&v, sizeof(v));
+    return v % range;
+}
+
 static uint64_t esp32_sens_read(void *opaque, hwaddr addr, unsigned int size)
 {
     Esp32SensState *s = ESP32_SENS(opaque);
@@ -34,7 +46,7 @@ static uint64_t esp32_sens_read(void *opaque, hwaddr addr, unsigned int size)
     
     switch(addr) {
     case A_SENS_SAR_MEAS_START1:
-        r = 0x10000+2800+rand()%4;
+        r = 0x10000+2800+sens_noise(4);
         break;
     case A_SENS_SAR_I2C_CTRL:
         r = s->i2c_ctrl | (1<<8);
@@ -47,7 +59,7 @@ static uint64_t esp32_sens_read(void *opaque, hwaddr addr, unsigned int size)
         break;
     case A_SENS_SAR_TOUCH_OUT1 ... A_SENS_SAR_TOUCH_OUT1+4*4:
         n1=((addr-A_SENS_SAR_TOUCH_OUT1)/4)*2;
-        r = ((1500-s->touch_sensor[n1]+rand()%20)<<16) | (1500-s->touch_sensor[n1+1]+rand()%20);
+        r = ((1500-s->touch_sensor[n1]+sens_noise(20))<<16) | (1500-s->touch_sensor[n1+1]+sens_noise(20));
         break;
     case A_SENS_ULP_CP_SLEEP_CYC0 ... A_SENS_ULP_CP_SLEEP_CYC0+4*4:
         r = s->ulp_sleep_cyc[(addr-A_SENS_ULP_CP_SLEEP_CYC0)/4];
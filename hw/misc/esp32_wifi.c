@@ -1,6 +1,7 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
 #include "qemu/guest-random.h"
 #include "qapi/error.h"
 #include "sysemu/sysemu.h"
@@ -11,8 +12,7 @@
 #include "exec/address-spaces.h"
 #include "esp32_wlan_packet.h"
 #include "hw/qdev-properties.h"
-
-#define DEBUG(x)
+#include "trace.h"
 
 static uint64_t esp32_wifi_read(void *opaque, hwaddr addr, unsigned int size)
 {
@@ -39,7 +39,7 @@ static uint64_t esp32_wifi_read(void *opaque, hwaddr addr, unsigned int size)
             break;
     }
 
-    DEBUG(printf("esp32_wifi_read %lx=%x\n",addr,r);)
+    trace_esp32_wifi_read(addr, r);
 
     return r;
 }
@@ -51,12 +51,15 @@ static void set_interrupt(Esp32WifiState *s,int e) {
 static void esp32_wifi_write(void *opaque, hwaddr addr, uint64_t value,
                                  unsigned int size) {
     Esp32WifiState *s = ESP32_WIFI(opaque);
-    DEBUG(printf("esp32_wifi_write %lx=%lx\n",addr, value);)
+    trace_esp32_wifi_write(addr, value);
 
     if(s->iss3) {
 	switch (addr) {
         case A_WIFI_DMA_INLINK_S3:
             s->dma_inlink_address = value;
+            // the guest listens again, resume beacons
+            if (!timer_pending(s->beacon_timer))
+                timer_mod(s->beacon_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
             break;
         case A_WIFI_DMA_INT_CLR_S3:
             s->raw_interrupt &= ~value;
@@ -73,12 +76,15 @@ static void esp32_wifi_write(void *opaque, hwaddr addr, uint64_t value,
                             MEMTXATTRS_UNSPECIFIED, &item, 12);
                 address_space_read(&address_space_memory, item.address,
                             MEMTXATTRS_UNSPECIFIED, &frame, item.length);
-                DEBUG(printf("esp32_wifi_outlink %x %x %x\n",memaddr,item.length,*(uint32_t *)(s->macaddr)));
+                trace_esp32_wifi_tx(memaddr, item.length);
                 // frame from esp32 to ap
                 frame.frame_length=item.length;
                 frame.next_frame=0;
+                if (s->pcap)
+                    Esp32_WLAN_pcap_frame(s, &frame, item.length, false, 0);
                 Esp32_WLAN_handle_frame(s, &frame);
                 set_interrupt(s,0x80);
+                trace_esp32_wifi_tx_done(memaddr);
             }
     }
 
@@ -86,6 +92,9 @@ static void esp32_wifi_write(void *opaque, hwaddr addr, uint64_t value,
     switch (addr) {
         case A_WIFI_DMA_INLINK:
             s->dma_inlink_address = value;
+            // the guest listens again, resume beacons
+            if (!timer_pending(s->beacon_timer))
+                timer_mod(s->beacon_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
             break;
         case A_WIFI_DMA_INT_CLR:
             s->raw_interrupt &= ~value;
@@ -102,11 +111,15 @@ static void esp32_wifi_write(void *opaque, hwaddr addr, uint64_t value,
                             MEMTXATTRS_UNSPECIFIED, &item, 12);
                 address_space_read(&address_space_memory, item.address,
                             MEMTXATTRS_UNSPECIFIED, &frame, item.length);
+                trace_esp32_wifi_tx(memaddr, item.length);
                 // frame from esp32 to ap
                 frame.frame_length=item.length;
                 frame.next_frame=0;
+                if (s->pcap)
+                    Esp32_WLAN_pcap_frame(s, &frame, item.length, false, 0);
                 Esp32_WLAN_handle_frame(s, &frame);
                 set_interrupt(s,0x80);
+                trace_esp32_wifi_tx_done(memaddr);
             }
     }
     }
@@ -120,20 +133,27 @@ static int match_mac_address(uint8_t *a1,uint8_t *a2) {
 }
 // frame from ap to esp32
 void Esp32_sendFrame(Esp32WifiState *s, mac80211_frame *frame,int length, int signal_strength) {
-    if(s->dma_inlink_address==0) return;
+    if(s->dma_inlink_address==0) {
+        trace_esp32_wifi_rx_drop(length);
+        return;
+    }
     uint8_t *header;
+    // guest random and virtual time keep received frames identical
+    // between a recorded run and its replay
+    uint8_t jitter;
+    qemu_guest_getrandom_nofail(&jitter, sizeof(jitter));
     if(!s->iss3) {
     	header=malloc(sizeof(wifi_pkt_rx_ctrl_t)+length);
     	wifi_pkt_rx_ctrl_t *pkt=(wifi_pkt_rx_ctrl_t *)header;
     	*pkt=(wifi_pkt_rx_ctrl_t){
-    	    .rssi=(signal_strength+(rand()%10)+96),
+    	    .rssi=(signal_strength+jitter%10+96),
     	    .rate=11,
 	     	.sig_len=length,
    	     	.sig_len_copy=length,
         	.legacy_length=length,
         	.noise_floor=-97,
         	.channel=esp32_wifi_channel,
-        	.timestamp=qemu_clock_get_ns(QEMU_CLOCK_REALTIME)/1000,
+        	.timestamp=qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)/1000,
     	};
         // These 4 bits are set if the mac addresses previously stored at 0x40 and 0x48
     	// match the destination or bssid addresses in the frame
@@ -152,14 +172,14 @@ void Esp32_sendFrame(Esp32WifiState *s, mac80211_frame *frame,int length, int si
     	header=malloc(sizeof(wifi_pkt_rx_ctrl_s3_t)+length);
     	wifi_pkt_rx_ctrl_s3_t *pkt=(wifi_pkt_rx_ctrl_s3_t *)header;
     	*pkt=(wifi_pkt_rx_ctrl_s3_t){
-    	    .rssi=(signal_strength+(rand()%10)+96),
+    	    .rssi=(signal_strength+jitter%10+96),
     	    .rate=11,
 	     	.sig_len=length,
    	     	.sig_len_copy=length,
         	.legacy_length=length,
         	.noise_floor=-97,
         	.channel=esp32_wifi_channel,
-        	.timestamp=qemu_clock_get_ns(QEMU_CLOCK_REALTIME)/1000,
+        	.timestamp=qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)/1000,
     	};
         // These 4 bits are set if the mac addresses previously stored at 0x40 and 0x48
     	// match the destination or bssid addresses in the frame
@@ -175,7 +195,13 @@ void Esp32_sendFrame(Esp32WifiState *s, mac80211_frame *frame,int length, int si
     	memcpy(header+sizeof(wifi_pkt_rx_ctrl_s3_t),frame,length);
 	    length+=sizeof(wifi_pkt_rx_ctrl_s3_t);
 	}
+    if (s->pcap) {
+        // the rx control header starts with the reported RSSI
+        Esp32_WLAN_pcap_frame(s, frame, s->iss3 ? length - sizeof(wifi_pkt_rx_ctrl_s3_t) :
+                              length - sizeof(wifi_pkt_rx_ctrl_t), true, (int8_t)header[0] - 96);
+    }
     // do a DMA transfer from the hardware to esp32 memory
+    trace_esp32_wifi_rx(s->dma_inlink_address, length);
     dma_list_item item;
     address_space_read(&address_space_memory, s->dma_inlink_address, MEMTXATTRS_UNSPECIFIED, &item, 12);
     address_space_write(&address_space_memory, item.address, MEMTXATTRS_UNSPECIFIED, header, length);
@@ -207,11 +233,25 @@ static void esp32_wifi_realize(DeviceState *dev, Error **errp)
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq);
     memset(s->mem,0,sizeof(s->mem));
-    Esp32_WLAN_setup_ap(dev, s);
+    object_property_add_uint64_ptr(OBJECT(dev), "tx-frames", &s->tx_frames,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(OBJECT(dev), "tx-bytes", &s->tx_bytes,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(OBJECT(dev), "rx-frames", &s->rx_frames,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(OBJECT(dev), "rx-bytes", &s->rx_bytes,
+                                   OBJ_PROP_FLAG_READ);
+    if (!Esp32_WLAN_setup_ap(dev, s, errp))
+        return;
+    if (s->pcap_file)
+        Esp32_WLAN_pcap_open(s, s->pcap_file, errp);
 }
 
 static Property esp32_wifi_properties[] = {
     DEFINE_NIC_PROPERTIES(Esp32WifiState, conf),
+    DEFINE_PROP_BOOL("shared-medium", Esp32WifiState, shared_medium, false),
+    DEFINE_PROP_STRING("ap-file", Esp32WifiState, ap_file),
+    DEFINE_PROP_STRING("pcap", Esp32WifiState, pcap_file),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -30,18 +30,22 @@
 #include "qemu/osdep.h"
 #include "net/net.h"
 #include "qemu/timer.h"
+#include "qapi/error.h"
+#include "crypto/pbkdf.h"
 
 #include "hw/misc/esp32_wifi.h"
 #include "esp32_wlan.h"
 #include "esp32_wlan_packet.h"
 
-// 10ms between beacons
+// 10ms between beacons while the guest scans
 #define BEACON_TIME 10000000
+// beacon interval advertised to associated stations (1000 TU)
+#define BEACON_INTERVAL (1000 * 1024000LL)
 #define INTER_FRAME_TIME 5000000
 #define DEBUG 0
 #define DEBUG_DUMPFRAMES 0
 
-access_point_info access_points[]={
+static const access_point_info default_access_points[]={
     {"Open Wifi",4,-40,{0x10,0x01,0x00,0xc4,0x0a,0x51}},
     {"MasseyWifi",6,-30,{0x10,0x01,0x00,0xc4,0x0a,0x52}},
     {"Home Wifi",7,-70,{0x10,0x01,0x00,0xc4,0x0a,0x53}},
@@ -50,25 +54,139 @@ access_point_info access_points[]={
     {"MartinsWifi",12,-25,{0x10,0x01,0x00,0xc4,0x0a,0x56}}
 };
 
-int nb_aps=sizeof(access_points)/sizeof(access_point_info);
+static access_point_info *Esp32_WLAN_find_ap(Esp32WifiState *s, const uint8_t *bssid)
+{
+    for (int i = 0; i < s->nb_aps; i++) {
+        if (!memcmp(s->access_points[i].mac_address, bssid, 6)) {
+            return &s->access_points[i];
+        }
+    }
+    return NULL;
+}
+
+static void Esp32_WLAN_send_beacon(Esp32WifiState *s, access_point_info *ap)
+{
+    struct mac80211_frame *frame = Esp32_WLAN_create_beacon_frame(ap);
+
+    Esp32_WLAN_init_ap_frame(s, frame);
+    memcpy(frame->source_address, ap->mac_address, 6);
+    memcpy(frame->bssid_address, ap->mac_address, 6);
+    Esp32_WLAN_insert_frame(s, frame);
+}
 
 static void Esp32_WLAN_beacon_timer(void *opaque)
 {
-    struct mac80211_frame *frame;
     Esp32WifiState *s = (Esp32WifiState *)opaque;
+    access_point_info *ap;
+    int64_t delay = BEACON_TIME;
+
+    // without receive descriptors the guest is not listening; writing
+    // the inlink register restarts the timer
+    if (!s->dma_inlink_address)
+        return;
+
+    if (s->ap_state == Esp32_WLAN__STATE_ASSOCIATED) {
+        // only the associated AP, at its advertised interval, so the
+        // station does not detect a beacon timeout
+        ap = Esp32_WLAN_find_ap(s, s->associated_ap_macaddr);
+        if (ap && ap->channel == esp32_wifi_channel)
+            Esp32_WLAN_send_beacon(s, ap);
+        delay = BEACON_INTERVAL;
+    } else if (s->ap_state == Esp32_WLAN__STATE_STA_ASSOCIATED) {
+        delay = BEACON_INTERVAL;
+    } else {
+        // scanning: round-robin over the APs on the current channel
+        for (int i = 0; i < s->nb_aps; i++) {
+            int n = (s->beacon_ap + i) % s->nb_aps;
+            if (s->access_points[n].channel == esp32_wifi_channel) {
+                Esp32_WLAN_send_beacon(s, &s->access_points[n]);
+                s->beacon_ap = (n + 1) % s->nb_aps;
+                break;
+            }
+        }
+    }
+    timer_mod(s->beacon_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + delay);
+}
 
-    // only send a beacon if we are an access point on the same channel
-    if(s->ap_state!=Esp32_WLAN__STATE_STA_ASSOCIATED) {
-        if (access_points[s->beacon_ap].channel==esp32_wifi_channel) {
-            frame = Esp32_WLAN_create_beacon_frame(&access_points[s->beacon_ap]);
-            Esp32_WLAN_init_ap_frame(s, frame);
-            memcpy(frame->source_address, access_points[s->beacon_ap].mac_address, 6);
-            memcpy(frame->bssid_address, access_points[s->beacon_ap].mac_address, 6);
-            Esp32_WLAN_insert_frame(s, frame);
+static bool Esp32_WLAN_load_aps(Esp32WifiState *s, Error **errp)
+{
+    g_autoptr(GKeyFile) kf = g_key_file_new();
+    g_autoptr(GError) gerr = NULL;
+    g_auto(GStrv) groups = NULL;
+    gsize n;
+
+    if (!g_key_file_load_from_file(kf, s->ap_file, G_KEY_FILE_NONE, &gerr)) {
+        error_setg(errp, "esp32_wifi: cannot read %s: %s", s->ap_file, gerr->message);
+        return false;
+    }
+    groups = g_key_file_get_groups(kf, &n);
+    if (!n) {
+        error_setg(errp, "esp32_wifi: %s defines no access points", s->ap_file);
+        return false;
+    }
+    s->access_points = g_new0(access_point_info, n);
+    s->nb_aps = n;
+    for (int i = 0; i < n; i++) {
+        access_point_info *ap = &s->access_points[i];
+        const char *group = groups[i];
+        g_autofree char *ssid = g_key_file_get_string(kf, group, "ssid", NULL);
+        g_autofree char *bssid = g_key_file_get_string(kf, group, "bssid", NULL);
+        g_autofree char *security = g_key_file_get_string(kf, group, "security", NULL);
+        g_autofree char *passphrase = g_key_file_get_string(kf, group, "passphrase", NULL);
+
+        ap->ssid = g_strdup(ssid ? ssid : group);
+        ap->channel = 1;
+        ap->sigstrength = -40;
+        if (g_key_file_has_key(kf, group, "channel", NULL))
+            ap->channel = g_key_file_get_integer(kf, group, "channel", &gerr);
+        if (!gerr && g_key_file_has_key(kf, group, "rssi", NULL))
+            ap->sigstrength = g_key_file_get_integer(kf, group, "rssi", &gerr);
+        if (gerr) {
+            error_setg(errp, "esp32_wifi: AP '%s': %s", group, gerr->message);
+            goto fail;
+        }
+        if (strlen(ap->ssid) > 32 || ap->channel < 1 || ap->channel > 14) {
+            error_setg(errp, "esp32_wifi: invalid SSID or channel for AP '%s'", group);
+            goto fail;
+        }
+        if (bssid) {
+            uint8_t *m = ap->mac_address;
+            if (sscanf(bssid, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+                       &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6) {
+                error_setg(errp, "esp32_wifi: invalid bssid '%s'", bssid);
+                goto fail;
+            }
+        } else {
+            memcpy(ap->mac_address, (uint8_t[]){0x10,0x01,0x00,0xc4,0x0a,0x51+i}, 6);
+        }
+        if (!security || !strcmp(security, "open"))
+            continue;
+        if (strcmp(security, "wpa2-psk")) {
+            error_setg(errp, "esp32_wifi: unknown security '%s' for AP '%s'", security, group);
+            goto fail;
+        }
+        if (!passphrase || strlen(passphrase) < 8 || strlen(passphrase) > 63) {
+            error_setg(errp, "esp32_wifi: AP '%s' needs an 8 to 63 character passphrase", group);
+            goto fail;
+        }
+        ap->wpa2 = true;
+        if (qcrypto_pbkdf2(QCRYPTO_HASH_ALGO_SHA1,
+                           (uint8_t *)passphrase, strlen(passphrase),
+                           (const uint8_t *)ap->ssid, strlen(ap->ssid),
+                           4096, ap->pmk, sizeof(ap->pmk), errp) < 0) {
+            goto fail;
         }
-        s->beacon_ap=(s->beacon_ap+1)%nb_aps;
     }
-    timer_mod(s->beacon_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + BEACON_TIME);
+    return true;
+
+fail:
+    for (int i = 0; i < n; i++) {
+        g_free((char *)s->access_points[i].ssid);
+    }
+    g_free(s->access_points);
+    s->access_points = NULL;
+    s->nb_aps = 0;
+    return false;
 }
 
 static void Esp32_WLAN_inject_timer(void *opaque)
@@ -92,6 +210,8 @@ static void Esp32_WLAN_inject_timer(void *opaque)
         // we wait until a new packet schedules
         // us again
         s->inject_timer_running = 0;
+        // frames refused by can_receive() stay queued in the net layer
+        qemu_flush_queued_packets(qemu_get_queue(s->nic));
     }
 
 }
@@ -143,6 +263,12 @@ void Esp32_WLAN_insert_frame(Esp32WifiState *s, struct mac80211_frame *frame)
 
 }
 
+static bool Esp32_WLAN_wpa_blocked(Esp32WifiState *s)
+{
+    return s->wpa_state == Esp32_WLAN__WPA_PTK_START ||
+           s->wpa_state == Esp32_WLAN__WPA_PTK_NEGOTIATING;
+}
+
 static _Bool Esp32_WLAN_can_receive(NetClientState *ncs)
 {
     Esp32WifiState *s = qemu_get_nic_opaque(ncs);
@@ -152,6 +278,9 @@ static _Bool Esp32_WLAN_can_receive(NetClientState *ncs)
         // to the access point
         return 0;
     }
+    if (Esp32_WLAN_wpa_blocked(s)) {
+        return 0;
+    }
     if (s->inject_queue_size > Esp32_WLAN__MAX_INJECT_QUEUE_SIZE) {
         // overload, please give me some time...
         return 0;
@@ -175,6 +304,12 @@ static ssize_t Esp32_WLAN_receive(NetClientState *ncs,
     if (!s) {
         return -1;
     }
+    if (s->shared_medium && !(buf[0] & 1) && memcmp(buf, s->conf.macaddr.a, 6)) {
+        // unicast for another station on the shared medium
+        return size;
+    }
+    s->rx_frames++;
+    s->rx_bytes += size;
     /*
      * A 802.3 packet comes from the qemu network. The
      * access points turns it into a 802.11 frame and
@@ -205,9 +340,18 @@ static NetClientInfo net_info = {
     .cleanup = Esp32_WLAN_cleanup,
 };
 
-void Esp32_WLAN_setup_ap(DeviceState *dev,Esp32WifiState *s) {
+bool Esp32_WLAN_setup_ap(DeviceState *dev,Esp32WifiState *s, Error **errp) {
+
+    if (s->ap_file) {
+        if (!Esp32_WLAN_load_aps(s, errp))
+            return false;
+    } else {
+        s->access_points = g_memdup2(default_access_points, sizeof(default_access_points));
+        s->nb_aps = ARRAY_SIZE(default_access_points);
+    }
 
     s->ap_state = Esp32_WLAN__STATE_NOT_AUTHENTICATED;
+    s->wpa_state = Esp32_WLAN__WPA_IDLE;
     s->beacon_ap=0;
     memcpy(s->ap_macaddr,(uint8_t[]){0x01,0x13,0x46,0xbf,0x31,0x50},sizeof(s->ap_macaddr));
     memcpy(s->macaddr,(uint8_t[]){0x10,0x01,0x00,0xc4,0x0a,0x24},sizeof(s->macaddr));
@@ -226,7 +370,36 @@ void Esp32_WLAN_setup_ap(DeviceState *dev,Esp32WifiState *s) {
     s->inject_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, Esp32_WLAN_inject_timer, s);
 
     s->nic = qemu_new_nic(&net_info, &s->conf, object_get_typename(OBJECT(s)), dev->id, &dev->mem_reentrancy_guard, s);
-    qemu_format_nic_info_str(qemu_get_queue(s->nic), s->macaddr);
+    if (s->shared_medium) {
+        // every station needs its own address on the shared medium
+        qemu_macaddr_default_if_unset(&s->conf.macaddr);
+        qemu_format_nic_info_str(qemu_get_queue(s->nic), s->conf.macaddr.a);
+    } else {
+        qemu_format_nic_info_str(qemu_get_queue(s->nic), s->macaddr);
+    }
+    return true;
+}
+
+// every AP on the channel answers a wildcard probe or one for its SSID
+static void Esp32_WLAN_probe_responses(Esp32WifiState *s, struct mac80211_frame *frame)
+{
+    uint8_t ssid_len = frame->data_and_fcs[0] == IEEE80211_BEACON_PARAM_SSID ? frame->data_and_fcs[1] : 0;
+    const char *ssid = (char *)&frame->data_and_fcs[2];
+
+    for (int i = 0; i < s->nb_aps; i++) {
+        access_point_info *ap = &s->access_points[i];
+        struct mac80211_frame *reply;
+
+        if (ap->channel != esp32_wifi_channel ||
+            (ssid_len && (strlen(ap->ssid) != ssid_len || memcmp(ap->ssid, ssid, ssid_len))))
+            continue;
+        reply = Esp32_WLAN_create_probe_response(ap);
+        reply->signal_strength = ap->sigstrength;
+        memcpy(reply->destination_address, frame->source_address, 6);
+        memcpy(s->ap_macaddr, ap->mac_address, 6);
+        Esp32_WLAN_init_ap_frame(s, reply);
+        Esp32_WLAN_insert_frame(s, reply);
+    }
 }
 
 static void send_single_frame(Esp32WifiState *s, struct mac80211_frame *frame, struct mac80211_frame *reply) {
@@ -251,10 +424,13 @@ void Esp32_WLAN_handle_frame(Esp32WifiState *s, struct mac80211_frame *frame)
     if(DEBUG) 
         printf("-------------------------\nHandle Frame %d %d %d %d\n",frame->frame_control.type,frame->frame_control.sub_type,esp32_wifi_channel,s->ap_state);
     infoprint(frame);
-    access_point_info *ap_info=0;
-    for(int i=0;i<nb_aps;i++)
-        if(access_points[i].channel==esp32_wifi_channel)
-            ap_info=&access_points[i];
+    // frames for an AP carry its BSSID, otherwise pick one on the channel
+    access_point_info *ap_info=Esp32_WLAN_find_ap(s, frame->bssid_address);
+    if(ap_info && ap_info->channel!=esp32_wifi_channel)
+        ap_info=0;
+    for(int i=0;i<s->nb_aps && !ap_info;i++)
+        if(s->access_points[i].channel==esp32_wifi_channel)
+            ap_info=&s->access_points[i];
    
     if(frame->frame_control.type == IEEE80211_TYPE_MGT) {        
         switch(frame->frame_control.sub_type) {
@@ -311,7 +487,7 @@ void Esp32_WLAN_handle_frame(Esp32WifiState *s, struct mac80211_frame *frame)
             switch(frame->frame_control.sub_type) {
                 case IEEE80211_TYPE_MGT_SUBTYPE_PROBE_REQ:
                     DEBUG_PRINT_AP(("Received probe request!\n"));
-                    reply = Esp32_WLAN_create_probe_response(ap_info);
+                    Esp32_WLAN_probe_responses(s, frame);
                     break;
                 case IEEE80211_TYPE_MGT_SUBTYPE_AUTHENTICATION:
                     DEBUG_PRINT_AP(("Received authentication req %d!\n",s->ap_state));
@@ -328,6 +504,10 @@ void Esp32_WLAN_handle_frame(Esp32WifiState *s, struct mac80211_frame *frame)
                     if (s->ap_state == Esp32_WLAN__STATE_AUTHENTICATED) {
                         s->ap_state = Esp32_WLAN__STATE_ASSOCIATED;
                         memcpy(s->associated_ap_macaddr,s->ap_macaddr,6);
+                        if (s->shared_medium) {
+                            // deliver data frames to the station's own address
+                            memcpy(s->macaddr, frame->source_address, 6);
+                        }
                     }
                     break;
             }
@@ -336,6 +516,11 @@ void Esp32_WLAN_handle_frame(Esp32WifiState *s, struct mac80211_frame *frame)
                 memcpy(reply->destination_address, frame->source_address, 6);
                 Esp32_WLAN_init_ap_frame(s, reply);
                 Esp32_WLAN_insert_frame(s, reply);
+                if (frame->frame_control.sub_type == IEEE80211_TYPE_MGT_SUBTYPE_ASSOCIATION_REQ &&
+                    s->ap_state == Esp32_WLAN__STATE_ASSOCIATED) {
+                    // WPA2 APs follow up with the first handshake message
+                    Esp32_WLAN_wpa_start(s, ap_info);
+                }
             }
         }
     }
@@ -356,6 +541,22 @@ void Esp32_WLAN_handle_frame(Esp32WifiState *s, struct mac80211_frame *frame)
                 s->ap_state=Esp32_WLAN__STATE_STA_ASSOCIATED; 
             }
         } else if (s->ap_state == Esp32_WLAN__STATE_ASSOCIATED || s->ap_state == Esp32_WLAN__STATE_STA_ASSOCIATED) {
+            if (frame->frame_control.flags & 0x40) {
+                // protected frame: the MAC would fill in the 8-byte CCMP
+                // header and the 8-byte MIC after the payload and encrypt
+                // it, the model drops both and forwards it in clear
+                memmove(frame->data_and_fcs, frame->data_and_fcs + 8, sizeof(frame->data_and_fcs) - 8);
+                frame->frame_length -= 8 + 8;
+            }
+            if (s->ap_state == Esp32_WLAN__STATE_ASSOCIATED &&
+                frame->data_and_fcs[6] == 0x88 && frame->data_and_fcs[7] == 0x8e) {
+                Esp32_WLAN_wpa_input(s, Esp32_WLAN_find_ap(s, s->associated_ap_macaddr), frame);
+                return;
+            }
+            if (Esp32_WLAN_wpa_blocked(s)) {
+                // the port stays closed until the 4-way handshake is done
+                return;
+            }
             /*
             * The access point uses the 802.11 frame
             * and sends a 802.3 frame into the network...
@@ -371,12 +572,21 @@ void Esp32_WLAN_handle_frame(Esp32WifiState *s, struct mac80211_frame *frame)
 
             // the new originator of the packet is
             // the access point
-            if(s->ap_state == Esp32_WLAN__STATE_ASSOCIATED)
+            if (s->shared_medium)
+                memcpy(&ethernet_frame[6], s->conf.macaddr.a, 6);
+            else if(s->ap_state == Esp32_WLAN__STATE_ASSOCIATED)
                 memcpy(&ethernet_frame[6], s->ap_macaddr, 6);
             else
                 memcpy(&ethernet_frame[6], s->macaddr, 6);
 
-            if (ethernet_frame[12] == 0x08 && ethernet_frame[13] == 0x06) {
+            if (s->shared_medium) {
+                // frames to the distribution system carry the real
+                // destination in the third address
+                if (frame->frame_control.flags & 1)
+                    memcpy(&ethernet_frame[0], frame->bssid_address, 6);
+                else
+                    memcpy(&ethernet_frame[0], frame->destination_address, 6);
+            } else if (ethernet_frame[12] == 0x08 && ethernet_frame[13] == 0x06) {
                 // for arp request, we use a broadcast
                 memset(&ethernet_frame[0], 0xff, 6);
             } else {
@@ -394,11 +604,18 @@ void Esp32_WLAN_handle_frame(Esp32WifiState *s, struct mac80211_frame *frame)
                 ethernet_frame_size = sizeof(ethernet_frame);
             }
             memcpy(&ethernet_frame[14], &frame->data_and_fcs[8], ethernet_frame_size);
+            if (s->shared_medium && ethernet_frame[12] == 0x08 && ethernet_frame[13] == 0x06) {
+                // peers must answer to our address on the medium, not
+                // to the station address shared by all emulated devices
+                memcpy(&ethernet_frame[22], s->conf.macaddr.a, 6);
+            }
             // add size of ethernet header
             ethernet_frame_size += 14;
             /*
             * Send 802.3 frame
             */
+            s->tx_frames++;
+            s->tx_bytes += ethernet_frame_size;
             qemu_send_packet(qemu_get_queue(s->nic), ethernet_frame, ethernet_frame_size);
         }
     }
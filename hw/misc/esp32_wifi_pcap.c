@@ -0,0 +1,214 @@
+/*
+ * 802.11 frame capture for the ESP32 WiFi model
+ *
+ * Writes every frame exchanged between the guest and the simulated access
+ * points to a pcap file with radiotap headers.  Records are queued under a
+ * lock and written by a separate thread, so enabling the capture does not
+ * stall the vCPU on file I/O.  Timestamps follow the virtual clock.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/units.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "sysemu/rtc.h"
+#include "sysemu/sysemu.h"
+
+#include "hw/misc/esp32_wifi.h"
+#include "esp32_wlan.h"
+
+#define PCAP_MAGIC                  0xa1b2c3d4
+#define LINKTYPE_IEEE802_11_RADIOTAP 127
+
+#define RADIOTAP_FLAGS              (1 << 1)
+#define RADIOTAP_CHANNEL            (1 << 3)
+#define RADIOTAP_DBM_ANTSIGNAL      (1 << 5)
+#define RADIOTAP_F_FCS              0x10    /* frame ends with the FCS */
+#define RADIOTAP_CHAN_2GHZ          0x0080
+#define RADIOTAP_CHAN_OFDM          0x0040
+
+/* wake the writer once this much is queued, drop frames beyond the limit */
+#define PCAP_FLUSH_THRESHOLD        (64 * KiB)
+#define PCAP_MAX_PENDING            (16 * MiB)
+#define PCAP_FLUSH_INTERVAL_MS      100
+
+struct pcap_file_hdr {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct pcap_sf_pkthdr {
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+/* radiotap fields are little endian and naturally aligned */
+typedef struct QEMU_PACKED radiotap_hdr {
+    uint8_t version;
+    uint8_t pad;
+    uint16_t len;
+    uint32_t present;
+    uint8_t flags;
+    uint8_t pad1;               /* aligns the channel field */
+    uint16_t chan_freq;
+    uint16_t chan_flags;
+    int8_t antsignal;
+} radiotap_hdr;
+
+struct Esp32WifiPcap {
+    int fd;
+    int64_t start_ts;
+    QemuThread thread;
+    QemuMutex lock;
+    QemuCond cond;
+    GByteArray *pending;
+    uint64_t dropped;
+    bool stop;
+    Notifier exit_notifier;
+};
+
+static void *esp32_wifi_pcap_writer(void *opaque)
+{
+    Esp32WifiPcap *p = opaque;
+    GByteArray *buf;
+    bool stop;
+
+    qemu_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->stop && p->pending->len < PCAP_FLUSH_THRESHOLD) {
+            if (!qemu_cond_timedwait(&p->cond, &p->lock,
+                                     PCAP_FLUSH_INTERVAL_MS)) {
+                break;
+            }
+        }
+        buf = p->pending;
+        p->pending = g_byte_array_new();
+        stop = p->stop;
+        qemu_mutex_unlock(&p->lock);
+
+        if (buf->len && p->fd >= 0 &&
+            qemu_write_full(p->fd, buf->data, buf->len) != buf->len) {
+            error_report("esp32_wifi: pcap write error - stopping capture");
+            close(p->fd);
+            p->fd = -1;
+        }
+        g_byte_array_unref(buf);
+
+        qemu_mutex_lock(&p->lock);
+        if (stop) {
+            break;
+        }
+    }
+    qemu_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void esp32_wifi_pcap_exit(Notifier *n, void *data)
+{
+    Esp32WifiPcap *p = container_of(n, Esp32WifiPcap, exit_notifier);
+
+    qemu_mutex_lock(&p->lock);
+    p->stop = true;
+    qemu_cond_signal(&p->cond);
+    qemu_mutex_unlock(&p->lock);
+    qemu_thread_join(&p->thread);
+    if (p->dropped) {
+        warn_report("esp32_wifi: pcap capture dropped %" PRIu64 " frames",
+                    p->dropped);
+    }
+    if (p->fd >= 0) {
+        close(p->fd);
+    }
+}
+
+bool Esp32_WLAN_pcap_open(Esp32WifiState *s, const char *path, Error **errp)
+{
+    Esp32WifiPcap *p;
+    struct pcap_file_hdr hdr = {
+        .magic = PCAP_MAGIC,
+        .version_major = 2,
+        .version_minor = 4,
+        .snaplen = 65535,
+        .linktype = LINKTYPE_IEEE802_11_RADIOTAP,
+    };
+    struct tm tm;
+    int fd;
+
+    fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, 0644);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "esp32_wifi: can't open %s", path);
+        return false;
+    }
+    if (qemu_write_full(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        error_setg_errno(errp, errno, "esp32_wifi: pcap write error");
+        close(fd);
+        return false;
+    }
+
+    p = g_new0(Esp32WifiPcap, 1);
+    p->fd = fd;
+    qemu_get_timedate(&tm, 0);
+    p->start_ts = mktime(&tm);
+    p->pending = g_byte_array_new();
+    qemu_mutex_init(&p->lock);
+    qemu_cond_init(&p->cond);
+    qemu_thread_create(&p->thread, "esp32-wifi-pcap", esp32_wifi_pcap_writer,
+                       p, QEMU_THREAD_JOINABLE);
+    p->exit_notifier.notify = esp32_wifi_pcap_exit;
+    qemu_add_exit_notifier(&p->exit_notifier);
+    s->pcap = p;
+    return true;
+}
+
+void Esp32_WLAN_pcap_frame(Esp32WifiState *s, const void *frame, int length,
+                           bool rx, int rssi)
+{
+    Esp32WifiPcap *p = s->pcap;
+    int64_t ts = qemu_clock_get_us(QEMU_CLOCK_VIRTUAL);
+    radiotap_hdr rt = {
+        .len = cpu_to_le16(rx ? sizeof(rt) : offsetof(radiotap_hdr, antsignal)),
+        .present = cpu_to_le32(RADIOTAP_FLAGS | RADIOTAP_CHANNEL |
+                               (rx ? RADIOTAP_DBM_ANTSIGNAL : 0)),
+        /* both directions carry the 4 FCS bytes the hardware would */
+        .flags = RADIOTAP_F_FCS,
+        .chan_freq = cpu_to_le16(esp32_wifi_channel == 14 ? 2484 :
+                                 2407 + 5 * esp32_wifi_channel),
+        .chan_flags = cpu_to_le16(RADIOTAP_CHAN_2GHZ | RADIOTAP_CHAN_OFDM),
+        .antsignal = rssi,
+    };
+    struct pcap_sf_pkthdr hdr;
+
+    if (length <= 0) {
+        return;
+    }
+    hdr.tv_sec = ts / 1000000 + p->start_ts;
+    hdr.tv_usec = ts % 1000000;
+    hdr.caplen = hdr.len = le16_to_cpu(rt.len) + length;
+
+    qemu_mutex_lock(&p->lock);
+    if (p->pending->len + sizeof(hdr) + hdr.caplen > PCAP_MAX_PENDING) {
+        p->dropped++;
+    } else {
+        g_byte_array_append(p->pending, (uint8_t *)&hdr, sizeof(hdr));
+        g_byte_array_append(p->pending, (uint8_t *)&rt, le16_to_cpu(rt.len));
+        g_byte_array_append(p->pending, frame, length);
+        if (p->pending->len >= PCAP_FLUSH_THRESHOLD) {
+            qemu_cond_signal(&p->cond);
+        }
+    }
+    qemu_mutex_unlock(&p->lock);
+}
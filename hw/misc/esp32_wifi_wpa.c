@@ -0,0 +1,279 @@
+/*
+ * WPA2-PSK authenticator for the simulated ESP32 access points
+ *
+ * Runs the AP side of the IEEE 802.11i 4-way handshake (key descriptor
+ * version 2: HMAC-SHA1 MIC, AES key wrap) so that the guest's supplicant
+ * accepts a PSK network.  Data frames are still carried in the clear;
+ * the CCMP encryption done by the real MAC is not modelled.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/guest-random.h"
+#include "qapi/error.h"
+#include "crypto/cipher.h"
+#include "crypto/hmac.h"
+#include "net/net.h"
+
+#include "hw/misc/esp32_wifi.h"
+#include "esp32_wlan.h"
+#include "esp32_wlan_packet.h"
+
+#define EAPOL_VERSION           2
+#define EAPOL_TYPE_KEY          3
+#define EAPOL_KEY_TYPE_RSN      2
+
+#define KEY_INFO_VERSION_AES    0x0002
+#define KEY_INFO_PAIRWISE       0x0008
+#define KEY_INFO_INSTALL        0x0040
+#define KEY_INFO_ACK            0x0080
+#define KEY_INFO_MIC            0x0100
+#define KEY_INFO_SECURE         0x0200
+#define KEY_INFO_ENCRYPTED_DATA 0x1000
+
+#define PTK_KCK(s)              ((s)->wpa_ptk)
+#define PTK_KEK(s)              ((s)->wpa_ptk + 16)
+
+typedef struct QEMU_PACKED eapol_key_t {
+    uint8_t version;
+    uint8_t type;
+    uint8_t length[2];
+    uint8_t descriptor;
+    uint8_t key_info[2];
+    uint8_t key_length[2];
+    uint8_t replay_counter[8];
+    uint8_t nonce[32];
+    uint8_t iv[16];
+    uint8_t rsc[8];
+    uint8_t id[8];
+    uint8_t mic[16];
+    uint8_t data_length[2];
+    uint8_t data[];
+} eapol_key_t;
+
+static bool wpa_hmac_sha1(const uint8_t *key, size_t nkey,
+                          const struct iovec *iov, size_t niov, uint8_t *out)
+{
+    QCryptoHmac *hmac;
+    uint8_t digest[20], *result = digest;
+    size_t resultlen = sizeof(digest);
+    int ret;
+
+    hmac = qcrypto_hmac_new(QCRYPTO_HASH_ALGO_SHA1, key, nkey, NULL);
+    if (!hmac) {
+        return false;
+    }
+    ret = qcrypto_hmac_bytesv(hmac, iov, niov, &result, &resultlen, NULL);
+    qcrypto_hmac_free(hmac);
+    if (ret < 0) {
+        return false;
+    }
+    memcpy(out, digest, sizeof(digest));
+    return true;
+}
+
+/* PRF-384 from IEEE 802.11i 8.5.1.1, producing the CCMP pairwise keys */
+static bool wpa_derive_ptk(Esp32WifiState *s, access_point_info *ap,
+                           const uint8_t *sta_mac, const uint8_t *snonce)
+{
+    static const char label[] = "Pairwise key expansion";
+    uint8_t data[2 * 6 + 2 * 32], out[60];
+    bool ap_first = memcmp(ap->mac_address, sta_mac, 6) < 0;
+    bool anonce_first = memcmp(s->wpa_anonce, snonce, 32) < 0;
+
+    memcpy(data, ap_first ? ap->mac_address : sta_mac, 6);
+    memcpy(data + 6, ap_first ? sta_mac : ap->mac_address, 6);
+    memcpy(data + 12, anonce_first ? s->wpa_anonce : snonce, 32);
+    memcpy(data + 44, anonce_first ? snonce : s->wpa_anonce, 32);
+
+    for (uint8_t i = 0; i < 3; i++) {
+        struct iovec iov[] = {
+            { .iov_base = (void *)label, .iov_len = sizeof(label) },
+            { .iov_base = data, .iov_len = sizeof(data) },
+            { .iov_base = &i, .iov_len = 1 },
+        };
+        if (!wpa_hmac_sha1(ap->pmk, sizeof(ap->pmk), iov, ARRAY_SIZE(iov),
+                           out + 20 * i)) {
+            return false;
+        }
+    }
+    memcpy(s->wpa_ptk, out, sizeof(s->wpa_ptk));
+    return true;
+}
+
+static bool wpa_mic(Esp32WifiState *s, const uint8_t *eapol, size_t len,
+                    uint8_t *mic)
+{
+    struct iovec iov = { .iov_base = (void *)eapol, .iov_len = len };
+    uint8_t digest[20];
+
+    if (!wpa_hmac_sha1(PTK_KCK(s), 16, &iov, 1, digest)) {
+        return false;
+    }
+    memcpy(mic, digest, 16);
+    return true;
+}
+
+static bool wpa_check_mic(Esp32WifiState *s, const eapol_key_t *key, size_t len)
+{
+    g_autofree eapol_key_t *copy = g_memdup2(key, len);
+    uint8_t mic[16];
+
+    memset(copy->mic, 0, sizeof(copy->mic));
+    return wpa_mic(s, (uint8_t *)copy, len, mic) &&
+           !memcmp(mic, key->mic, sizeof(mic));
+}
+
+/* RFC 3394 AES key wrap with the KEK, for the GTK in message 3 */
+static bool wpa_aes_wrap(const uint8_t *kek, const uint8_t *in, size_t len,
+                         uint8_t *out)
+{
+    QCryptoCipher *cipher;
+    size_t n = len / 8;
+    uint8_t b[16];
+    uint64_t t;
+
+    cipher = qcrypto_cipher_new(QCRYPTO_CIPHER_ALGO_AES_128,
+                                QCRYPTO_CIPHER_MODE_ECB, kek, 16, NULL);
+    if (!cipher) {
+        return false;
+    }
+    memset(out, 0xa6, 8);
+    memcpy(out + 8, in, len);
+    for (int j = 0; j < 6; j++) {
+        for (size_t i = 1; i <= n; i++) {
+            memcpy(b, out, 8);
+            memcpy(b + 8, out + 8 * i, 8);
+            qcrypto_cipher_encrypt(cipher, b, b, sizeof(b), &error_abort);
+            t = ldq_be_p(b) ^ (n * j + i);
+            stq_be_p(out, t);
+            memcpy(out + 8 * i, b + 8, 8);
+        }
+    }
+    qcrypto_cipher_free(cipher);
+    return true;
+}
+
+static void wpa_send(Esp32WifiState *s, uint16_t key_info,
+                     const uint8_t *data, size_t data_len)
+{
+    size_t len = sizeof(eapol_key_t) + data_len;
+    g_autofree uint8_t *buf = g_malloc0(14 + len);
+    eapol_key_t *key = (eapol_key_t *)(buf + 14);
+    struct mac80211_frame *frame;
+
+    // the data packet builder only uses the ethertype of the 802.3 header
+    stw_be_p(buf + 12, 0x888e);
+    key->version = EAPOL_VERSION;
+    key->type = EAPOL_TYPE_KEY;
+    stw_be_p(key->length, len - 4);
+    key->descriptor = EAPOL_KEY_TYPE_RSN;
+    stw_be_p(key->key_info, key_info);
+    stw_be_p(key->key_length, 16);
+    stq_be_p(key->replay_counter, s->wpa_replay_counter);
+    memcpy(key->nonce, s->wpa_anonce, sizeof(key->nonce));
+    stw_be_p(key->data_length, data_len);
+    if (data_len) {
+        memcpy(key->data, data, data_len);
+    }
+    if (key_info & KEY_INFO_MIC) {
+        wpa_mic(s, (uint8_t *)key, len, key->mic);
+    }
+
+    frame = Esp32_WLAN_create_data_packet(s, buf, 14 + len);
+    Esp32_WLAN_init_ap_frame(s, frame);
+    Esp32_WLAN_insert_frame(s, frame);
+}
+
+void Esp32_WLAN_wpa_start(Esp32WifiState *s, access_point_info *ap)
+{
+    if (!ap->wpa2) {
+        s->wpa_state = Esp32_WLAN__WPA_IDLE;
+        return;
+    }
+    qemu_guest_getrandom_nofail(s->wpa_anonce, sizeof(s->wpa_anonce));
+    qemu_guest_getrandom_nofail(s->wpa_gtk, sizeof(s->wpa_gtk));
+    s->wpa_replay_counter++;
+    s->wpa_state = Esp32_WLAN__WPA_PTK_START;
+    // message 1: ANonce
+    wpa_send(s, KEY_INFO_VERSION_AES | KEY_INFO_PAIRWISE | KEY_INFO_ACK,
+             NULL, 0);
+}
+
+static void wpa_send_msg3(Esp32WifiState *s)
+{
+    static const uint8_t rsn[] = IEEE80211_RSN_CCMP_PSK;
+    uint8_t plain[2 + sizeof(rsn) + 8 + 16 + 8] = { 0 };
+    uint8_t wrapped[sizeof(plain) + 8];
+    size_t len = 0;
+
+    plain[len++] = IEEE80211_BEACON_PARAM_RSN;
+    plain[len++] = sizeof(rsn);
+    memcpy(plain + len, rsn, sizeof(rsn));
+    len += sizeof(rsn);
+    // GTK KDE, key id 1
+    memcpy(plain + len, (uint8_t[]){ 0xdd, 22, 0x00, 0x0f, 0xac, 1, 1, 0 }, 8);
+    len += 8;
+    memcpy(plain + len, s->wpa_gtk, sizeof(s->wpa_gtk));
+    len += sizeof(s->wpa_gtk);
+    // key wrap padding
+    if (len % 8) {
+        plain[len] = 0xdd;
+        len = ROUND_UP(len, 8);
+    }
+    if (!wpa_aes_wrap(PTK_KEK(s), plain, len, wrapped)) {
+        return;
+    }
+
+    s->wpa_replay_counter++;
+    s->wpa_state = Esp32_WLAN__WPA_PTK_NEGOTIATING;
+    wpa_send(s, KEY_INFO_VERSION_AES | KEY_INFO_PAIRWISE | KEY_INFO_INSTALL |
+             KEY_INFO_ACK | KEY_INFO_MIC | KEY_INFO_SECURE |
+             KEY_INFO_ENCRYPTED_DATA, wrapped, len + 8);
+}
+
+void Esp32_WLAN_wpa_input(Esp32WifiState *s, access_point_info *ap,
+                          struct mac80211_frame *frame)
+{
+    // EAPOL follows the 8 byte LLC/SNAP header
+    const eapol_key_t *key = (eapol_key_t *)&frame->data_and_fcs[8];
+    size_t len;
+    uint16_t info;
+
+    if (!ap || !ap->wpa2 || key->type != EAPOL_TYPE_KEY ||
+        key->descriptor != EAPOL_KEY_TYPE_RSN) {
+        return;
+    }
+    len = 4 + lduw_be_p(key->length);
+    if (len < sizeof(eapol_key_t) || len > sizeof(frame->data_and_fcs) - 8 ||
+        ldq_be_p(key->replay_counter) != s->wpa_replay_counter) {
+        return;
+    }
+    info = lduw_be_p(key->key_info);
+    if (!(info & KEY_INFO_MIC) || (info & KEY_INFO_ACK)) {
+        return;
+    }
+
+    if (s->wpa_state == Esp32_WLAN__WPA_PTK_START && !(info & KEY_INFO_SECURE)) {
+        // message 2: SNonce, proves the station knows the PMK
+        if (!wpa_derive_ptk(s, ap, frame->source_address, key->nonce) ||
+            !wpa_check_mic(s, key, len)) {
+            DEBUG_PRINT_AP(("WPA2: message 2 MIC mismatch\n"));
+            return;
+        }
+        wpa_send_msg3(s);
+    } else if (s->wpa_state == Esp32_WLAN__WPA_PTK_NEGOTIATING &&
+               (info & KEY_INFO_SECURE)) {
+        // message 4: the station installed the keys
+        if (!wpa_check_mic(s, key, len)) {
+            DEBUG_PRINT_AP(("WPA2: message 4 MIC mismatch\n"));
+            return;
+        }
+        s->wpa_state = Esp32_WLAN__WPA_AUTHORIZED;
+        qemu_flush_queued_packets(qemu_get_queue(s->nic));
+    }
+}
@@ -72,6 +72,14 @@
 #define IEEE80211_BEACON_PARAM_CHANNEL          0x03
 #define IEEE80211_BEACON_PARAM_EXTENDED_RATES   0x32
 #define IEEE80211_BEACON_PARAM_TIM              0x05
+#define IEEE80211_BEACON_PARAM_RSN              0x30
+
+#define IEEE80211_CAPABILITY_PRIVACY            0x0010
+
+// RSN element body: version 1, CCMP group and pairwise cipher, PSK key management
+#define IEEE80211_RSN_CCMP_PSK { 1, 0, 0x00, 0x0f, 0xac, 4, 1, 0, 0x00, 0x0f, 0xac, 4, \
+                                 1, 0, 0x00, 0x0f, 0xac, 2, 0, 0 }
+#define IEEE80211_RSN_CCMP_PSK_LEN 20
 
 
 #define IEEE80211_HEADER_SIZE               24
@@ -117,6 +125,8 @@ typedef struct access_point_info {
     int channel;
     int sigstrength;
     macaddr_t mac_address;
+    bool wpa2;          // WPA2-PSK with CCMP instead of open authentication
+    uint8_t pmk[32];    // pairwise master key derived from the passphrase
 } access_point_info;
 
 enum esp32_ap_state {
@@ -129,6 +139,14 @@ enum esp32_ap_state {
     Esp32_WLAN__STATE_STA_DHCP,
 };
 
+// 4-way handshake progress of the station associated with a WPA2 AP
+enum esp32_wpa_state {
+    Esp32_WLAN__WPA_IDLE,               // open AP or no handshake running
+    Esp32_WLAN__WPA_PTK_START,          // message 1 sent
+    Esp32_WLAN__WPA_PTK_NEGOTIATING,    // message 3 sent
+    Esp32_WLAN__WPA_AUTHORIZED,
+};
+
 #define Esp32_WLAN__MAX_INJECT_QUEUE_SIZE 20
 
 typedef struct {
@@ -90,18 +90,24 @@ static void add_ssid(mac80211_frame *frame, const char *ssid) {
     add_tag(frame,IEEE80211_BEACON_PARAM_SSID,strlen(ssid),(uint8_t *)ssid);
 }
 
+static void add_rsn(mac80211_frame *frame, access_point_info *ap) {
+    if(ap->wpa2)
+        add_tag(frame,IEEE80211_BEACON_PARAM_RSN,IEEE80211_RSN_CCMP_PSK_LEN,(uint8_t[])IEEE80211_RSN_CCMP_PSK);
+}
+
 mac80211_frame *Esp32_WLAN_create_beacon_frame(access_point_info *ap) {
     mac80211_frame *frame=new_frame(IEEE80211_TYPE_MGT,IEEE80211_TYPE_MGT_SUBTYPE_BEACON);
     frame->signal_strength=ap->sigstrength;
     memcpy(frame->destination_address,BROADCAST,6);
-    frame->beacon_info.timestamp=qemu_clock_get_ns(QEMU_CLOCK_REALTIME)/1000;
+    frame->beacon_info.timestamp=qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)/1000;
     frame->beacon_info.interval=1000;
-    frame->beacon_info.capability=1;
+    frame->beacon_info.capability=1|(ap->wpa2?IEEE80211_CAPABILITY_PRIVACY:0);
     frame->pos=12;
     add_ssid(frame,ap->ssid);
     add_rates(frame);
     add_tag(frame,IEEE80211_BEACON_PARAM_CHANNEL,1,(uint8_t[]){ap->channel});
     add_tag(frame,IEEE80211_BEACON_PARAM_TIM,4,(uint8_t[]){4,1,3,0,0});
+    add_rsn(frame,ap);
     return frame;
 }
 
@@ -187,13 +193,14 @@ mac80211_frame *Esp32_WLAN_create_ack(void) {
 
 mac80211_frame *Esp32_WLAN_create_probe_response(access_point_info *ap) {
     mac80211_frame *frame=new_frame(IEEE80211_TYPE_MGT,IEEE80211_TYPE_MGT_SUBTYPE_PROBE_RESP);
-    frame->beacon_info.timestamp=qemu_clock_get_ns(QEMU_CLOCK_REALTIME)/1000;
+    frame->beacon_info.timestamp=qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)/1000;
     frame->beacon_info.interval=1000;
-    frame->beacon_info.capability=1;
+    frame->beacon_info.capability=1|(ap->wpa2?IEEE80211_CAPABILITY_PRIVACY:0);
     frame->pos=12;
     add_ssid(frame,ap->ssid);
     add_rates(frame);
     add_tag(frame,IEEE80211_BEACON_PARAM_CHANNEL,1,(uint8_t[]){ap->channel});
+    add_rsn(frame,ap);
     return frame;
 }
 
@@ -259,7 +266,7 @@ mac80211_frame *Esp32_WLAN_create_association_response(access_point_info *ap) {
      *  - Status code (successful 0x0)
      *  - Association ID
     */
-    add_data(frame,6,(uint8_t []){33,4,0,0,1,0xc0});
+    add_data(frame,6,(uint8_t []){33|(ap->wpa2?IEEE80211_CAPABILITY_PRIVACY:0),4,0,0,1,0xc0});
     add_ssid(frame,ap->ssid);
     add_rates(frame);
     return frame;
@@ -52,5 +52,7 @@ struct mac80211_frame *Esp32_WLAN_create_ack(void);
 struct mac80211_frame *Esp32_WLAN_create_dhcp_discover(void);
 struct mac80211_frame *Esp32_WLAN_create_dhcp_request(uint8_t *ip);
 void insertCRC(mac80211_frame *frame);
+void Esp32_WLAN_wpa_start(Esp32WifiState *s, access_point_info *ap);
+void Esp32_WLAN_wpa_input(Esp32WifiState *s, access_point_info *ap, struct mac80211_frame *frame);
 
 #endif // esp32_wlan_packet_h
@@ -21,8 +21,10 @@
 #include "hw/qdev-properties.h"
 #include "hw/misc/esp32c3_cache.h"
 #include "hw/misc/esp32c3_xts_aes.h"
+#include "hw/block/flash.h"
 #include "sysemu/block-backend-io.h"
 #include "hw/misc/esp32c3_reg.h"
+#include "trace.h"
 
 
 #define CACHE_DEBUG      0
@@ -56,6 +58,50 @@ static inline uint32_t esp32c3_read_mmu_value(ESP32C3CacheState *s, hwaddr reg_a
 }
 
 
+static void esp32c3_cache_flash_written(Notifier *notifier, void *data);
+
+static void esp32c3_cache_read_flash(ESP32C3CacheState *s, uint32_t addr, void *buf, uint32_t len)
+{
+    if (!s->flash) {
+        /* the flash chip is attached after the SoC is realized */
+        s->flash = m25p80_find_by_blk(s->flash_blk);
+        if (s->flash) {
+            s->flash_write_notifier.notify = esp32c3_cache_flash_written;
+            m25p80_add_write_notifier(s->flash, &s->flash_write_notifier);
+        }
+    }
+    if (s->flash) {
+        m25p80_direct_read(s->flash, addr, buf, len);
+    } else {
+        blk_pread(s->flash_blk, addr, len, buf, 0);
+    }
+}
+
+/* Program and erase only refresh the virtual pages mapping the changed range */
+static void esp32c3_cache_flash_written(Notifier *notifier, void *data)
+{
+    ESP32C3CacheState *s = container_of(notifier, ESP32C3CacheState, flash_write_notifier);
+    ESP32C3XtsAesClass *xts_aes_class = ESP32C3_XTS_AES_GET_CLASS(s->xts_aes);
+    M25P80WriteRange *range = data;
+    uint32_t first = range->addr / ESP32C3_PAGE_SIZE;
+    uint32_t last = (range->addr + range->len - 1) / ESP32C3_PAGE_SIZE;
+
+    for (int i = 0; i < ESP32C3_MMU_TABLE_ENTRY_COUNT; i++) {
+        ESP32C3MMUEntry e = s->mmu[i];
+        if (!e.invalid && e.page_number >= first && e.page_number <= last) {
+            const uint32_t virtual_address = i * ESP32C3_PAGE_SIZE;
+            const uint32_t physical_address = e.page_number * ESP32C3_PAGE_SIZE;
+            uint8_t* cache_data = ((uint8_t*) memory_region_get_ram_ptr(&s->dcache)) + virtual_address;
+
+            esp32c3_cache_read_flash(s, physical_address, cache_data, ESP32C3_PAGE_SIZE);
+            if (xts_aes_class->is_flash_enc_enabled(s->xts_aes)) {
+                xts_aes_class->decrypt(s->xts_aes, physical_address, cache_data, ESP32C3_PAGE_SIZE);
+            }
+            memory_region_flush_rom_device(&s->dcache, virtual_address, ESP32C3_PAGE_SIZE);
+        }
+    }
+}
+
 static inline void esp32c3_write_mmu_value(ESP32C3CacheState *s, hwaddr reg_addr, uint32_t value)
 {
     ESP32C3XtsAesClass *xts_aes_class = ESP32C3_XTS_AES_GET_CLASS(s->xts_aes);
@@ -66,6 +112,7 @@ static inline void esp32c3_write_mmu_value(ESP32C3CacheState *s, hwaddr reg_addr
     /* Always keep reserved as 0 */
     e.reserved = 0;
     if (s->mmu[index].val != e.val) {
+        trace_esp32c3_cache_mmu_update(index, s->mmu[index].val, e.val);
         /* Update the cache (MemoryRegion) */
         const uint32_t virtual_address = index * ESP32C3_PAGE_SIZE;
         /* The entry contains the index of the 64KB block from the flash memory */
@@ -80,13 +127,14 @@ static inline void esp32c3_write_mmu_value(ESP32C3CacheState *s, hwaddr reg_addr
             }
         } else {
             if (s->flash_blk != NULL) {
-                blk_pread(s->flash_blk, physical_address, ESP32C3_PAGE_SIZE, cache_data, 0);
+                esp32c3_cache_read_flash(s, physical_address, cache_data, ESP32C3_PAGE_SIZE);
             }
             if (xts_aes_class->is_flash_enc_enabled(s->xts_aes)) {
                 xts_aes_class->decrypt(s->xts_aes, physical_address, cache_data, ESP32C3_PAGE_SIZE);
             }
         }
         s->mmu[index].val = e.val;
+        trace_esp32c3_cache_mmu_update_done(index);
     }
 }
 
@@ -22,9 +22,11 @@
 #include "hw/qdev-properties.h"
 #include "hw/misc/esp32s3_cache.h"
 #include "hw/misc/esp32s3_xts_aes.h"
+#include "hw/block/flash.h"
 #include "sysemu/block-backend-io.h"
 #include "hw/misc/esp32s3_reg.h"
 #include "exec/address-spaces.h"
+#include "trace.h"
 
 
 #define CACHE_DEBUG      0
@@ -83,9 +85,55 @@ static void esp32s3_mmu_invalidate_page(ESP32S3CacheState *s, hwaddr virt_addr,
 }
 
 
-static inline void esp32s3_write_mmu_value(ESP32S3CacheState *s, hwaddr reg_addr, uint32_t value)
+static void esp32s3_cache_flash_written(Notifier *notifier, void *data);
+
+/* Fill the mirror of one flash page, read through the flash chip's working copy */
+static void esp32s3_cache_load_flash_page(ESP32S3CacheState *s, uint32_t physical_address)
 {
     ESP32S3XtsAesClass *xts_aes_class = ESP32S3_XTS_AES_GET_CLASS(s->xts_aes);
+    uint8_t* cache_data = ((uint8_t*) memory_region_get_ram_ptr(&s->flash_mr)) + physical_address;
+
+    if (!s->flash) {
+        /* the flash chip is attached after the SoC is realized */
+        s->flash = m25p80_find_by_blk(s->flash_blk);
+        if (s->flash) {
+            s->flash_write_notifier.notify = esp32s3_cache_flash_written;
+            m25p80_add_write_notifier(s->flash, &s->flash_write_notifier);
+        }
+    }
+    if (s->flash) {
+        m25p80_direct_read(s->flash, physical_address, cache_data, ESP32S3_PAGE_SIZE);
+    } else {
+        blk_pread(s->flash_blk, physical_address, ESP32S3_PAGE_SIZE, cache_data, 0);
+    }
+
+    if (xts_aes_class->is_flash_enc_enabled(s->xts_aes)) {
+        xts_aes_class->decrypt(s->xts_aes, physical_address, cache_data, ESP32S3_PAGE_SIZE);
+    }
+}
+
+/* Program and erase only refresh the mapped flash pages in the changed range */
+static void esp32s3_cache_flash_written(Notifier *notifier, void *data)
+{
+    ESP32S3CacheState *s = container_of(notifier, ESP32S3CacheState, flash_write_notifier);
+    M25P80WriteRange *range = data;
+    uint32_t first = range->addr / ESP32S3_PAGE_SIZE;
+    uint32_t last = (range->addr + range->len - 1) / ESP32S3_PAGE_SIZE;
+
+    for (uint32_t page = first; page <= last; page++) {
+        for (int i = 0; i < ESP32S3_MMU_TABLE_ENTRY_COUNT; i++) {
+            ESP32S3MMUEntry e = s->mmu[i];
+            if (!e.invalid && e.type == ESP32S3_MMU_TYPE_FLASH && e.page_number == page) {
+                esp32s3_cache_load_flash_page(s, page * ESP32S3_PAGE_SIZE);
+                memory_region_flush_rom_device(&s->flash_mr, page * ESP32S3_PAGE_SIZE, ESP32S3_PAGE_SIZE);
+                break;
+            }
+        }
+    }
+}
+
+static inline void esp32s3_write_mmu_value(ESP32S3CacheState *s, hwaddr reg_addr, uint32_t value)
+{
     /* Make the assumption that the address is aligned on sizeof(uint32_t) */
     const uint32_t index = reg_addr / sizeof(uint32_t);
     /* Reserved bits shall always be 0 */
@@ -97,6 +145,7 @@ static inline void esp32s3_write_mmu_value(ESP32S3CacheState *s, hwaddr reg_addr
     info_report("[CACHE] esp32s3_write_mmu_value 0x%lx = %08x, index=%d", reg_addr, value, index);
 #endif
     if (former.val != e.val) {
+        trace_esp32s3_cache_mmu_update(index, former.val, e.val);
         /* The entry contains the index of the 64KB block from the flash memory */
         const uint32_t physical_address = e.page_number * ESP32S3_PAGE_SIZE;
         const uint32_t former_physaddr = former.page_number * ESP32S3_PAGE_SIZE;
@@ -115,15 +164,11 @@ static inline void esp32s3_write_mmu_value(ESP32S3CacheState *s, hwaddr reg_addr
             } else
              */
             if (e.type == ESP32S3_MMU_TYPE_FLASH && s->flash_blk != NULL) {
-                uint8_t* cache_data = ((uint8_t*) memory_region_get_ram_ptr(&s->flash_mr)) + physical_address;
-                blk_pread(s->flash_blk, physical_address, ESP32S3_PAGE_SIZE, cache_data, 0);
-
-                if (xts_aes_class->is_flash_enc_enabled(s->xts_aes)) {
-                    xts_aes_class->decrypt(s->xts_aes, physical_address, cache_data, ESP32S3_PAGE_SIZE);
-                }
+                esp32s3_cache_load_flash_page(s, physical_address);
             }
         }
         s->mmu[index].val = e.val;
+        trace_esp32s3_cache_mmu_update_done(index);
     }
 }
 
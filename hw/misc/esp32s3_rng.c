@@ -37,6 +37,8 @@ static void esp32s3_rng_init(Object *obj)
 
     memory_region_init_io(&s->iomem, obj, &esp32s3_rng_ops, s,
                           TYPE_ESP32S3_RNG, sizeof(uint32_t));
+    /* qemu_guest_getrandom() is thread safe; both cores can read at once */
+    memory_region_enable_lockless_io(&s->iomem);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
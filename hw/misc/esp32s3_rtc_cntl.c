@@ -21,6 +21,7 @@
 #include "hw/misc/esp32s3_reg.h"
 #include "hw/misc/esp32s3_rtc_cntl.h"
 #include "sysemu/runstate.h"
+#include "trace.h"
 
 static void esp32s3_rtc_update_cpu_stall(Esp32s3RtcCntlState* s);
 static void esp32s3_rtc_update_clk(Esp32s3RtcCntlState* s);
@@ -30,6 +31,7 @@ static void esp32s3_rtc_update_clk(Esp32s3RtcCntlState* s);
 static void sleep_timer_cb(void *opaque)
 {
     Esp32s3RtcCntlState *s = (Esp32s3RtcCntlState*) opaque;
+    trace_esp32s3_rtc_cntl_wake();
     qemu_set_irq(s->rtc_wakeup,RTC_ULP_TRIG_EN);
 }
 
@@ -190,10 +192,9 @@ static void esp32s3_rtc_cntl_write(void *opaque, hwaddr addr, uint64_t value,
             uint64_t sleep_ns=muldiv64(
                 sleep_time - s->time_reg, NANOSECONDS_PER_SECOND,
                 s->rtc_slowclk_freq);
-            if(DEBUG)
-                printf("Sleep %d, %d, %d, %d\n",(uint32_t)s->time_reg, (uint32_t)sleep_time, timer_en, (uint32_t)sleep_ns);
+            trace_esp32s3_rtc_cntl_sleep(sleep_ns, timer_en);
             if(timer_en)
-                timer_mod(&s->sleep_timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME)+sleep_ns);
+                timer_mod(&s->sleep_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT)+sleep_ns);
             s->low_power_state_reg=FIELD_DP32(s->low_power_state_reg,RTC_CNTL_LOW_POWER_ST, RTC_RDY_FOR_WAKEUP,1);
             qemu_system_suspend_request();
         }
@@ -360,7 +361,12 @@ static void esp32s3_rtc_cntl_init(Object *obj)
     s->pll_apb_freq = 80000000;
     s->low_power_state_reg = 0;//0x92d;
     s->ulp_cp_timer1 = 200<<8;
-    timer_init_ns(&s->sleep_timer, QEMU_CLOCK_REALTIME, sleep_timer_cb, s);
+    /*
+     * The CPUs are suspended while the timer runs, so QEMU_CLOCK_VIRTUAL
+     * would not advance under icount.  QEMU_CLOCK_VIRTUAL_RT keeps
+     * counting and its expiry is a record/replay checkpoint.
+     */
+    timer_init_ns(&s->sleep_timer, QEMU_CLOCK_VIRTUAL_RT, sleep_timer_cb, s);
     esp32s3_rtc_update_clk(s);
 }
 
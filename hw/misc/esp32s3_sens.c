@@ -24,6 +24,18 @@ static void touch_sensor_changed(void *opaque, int n, int level) {
     s->touch_sensor[n]=level;
 }
 
+/*
+ * ADC and touch readings carry a little noise.  Draw it from the guest
+ * random source so that -seed and record/replay reproduce it.
+ */
+static uint32_t sens_noise(uint32_t range)
+{
+    uint16_t v;
+
+    qemu_guest_getrandom_nofail(&v, sizeof(v));
+    return v % range;
+}
+
 static uint64_t esp32_sens_read(void *opaque, hwaddr addr, unsigned int size)
 {
     Esp32S3SensState *s = ESP32S3_SENS(opaque);
@@ -31,7 +43,7 @@ static uint64_t esp32_sens_read(void *opaque, hwaddr addr, unsigned int size)
 //    printf("esp32_sens_read %lx\n",addr);
     switch(addr) {
     case A_SENS_SAR_MEAS1_CTRL2_REG:
-        return 0x10000+2800+rand()%4;
+        return 0x10000+2800+sens_noise(4);
     case A_SENS_SAR_TSENS_CTRL_REG:
         return (1<<8);
     case A_SENS_SAR_TOUCH_CHN_ST_REG:
@@ -43,7 +55,7 @@ static uint64_t esp32_sens_read(void *opaque, hwaddr addr, unsigned int size)
 
     if(addr>=0xa4 && addr<0xdc) {
 	int n1=((addr-0xa4)/4);
-        return ((1500-s->touch_sensor[n1]+rand()%20));
+        return ((1500-s->touch_sensor[n1]+sens_noise(20)));
     }
     return r;
 }
@@ -11,8 +11,6 @@
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
 #include "qemu/error-report.h"
-#include "crypto/aes.h"
-#include "crypto/xts.h"
 #include "hw/misc/esp32s3_xts_aes.h"
 
 #define XTS_AES_WARNING 0
@@ -24,34 +22,8 @@
 
 #define XTS_AES_KEY_SIZE_128                    32
 #define XTS_AES_KEY_SIZE_256                    64
-#define ESP32S3_XTS_AES_DATA_UNIT_SIZE          128
 #define ESP32S3_XTS_AES_TWEAK_VALUE             0x3FFFFF80
 
-struct xts_aes_keys_ctx {
-    AES_KEY enc;
-    AES_KEY dec;
-};
-
-static void xts_aes_encrypt(const void *ctx,
-                            size_t length,
-                            uint8_t *dst,
-                            const uint8_t *src)
-{
-    const struct xts_aes_keys_ctx *aesctx = ctx;
-
-    AES_encrypt(src, dst, &aesctx->enc);
-}
-
-static void xts_aes_decrypt(const void *ctx,
-                            size_t length,
-                            uint8_t *dst,
-                            const uint8_t *src)
-{
-    const struct xts_aes_keys_ctx *aesctx = ctx;
-
-    AES_decrypt(src, dst, &aesctx->dec);
-}
-
 static bool esp32s3_xts_aes_is_ciphertext_spi_visible(ESP32S3XtsAesState *s)
 {
     return (s->state == XTS_AES_RELEASE);
@@ -147,110 +119,38 @@ static void esp32s3_xts_aes_read_ciphertext(ESP32S3XtsAesState *s, uint32_t* spi
     *spi_addr_size = 24 / 8;
 }
 
-static void esp32s3_xts_aes_encrypt(ESP32S3XtsAesState *s)
+static void esp32s3_xts_aes_set_key(ESP32S3XtsAesState *s)
 {
-    uint8_t tweak[16];
-    uint32_t linesize = esp32s3_xts_aes_get_linesize(s);
-
-    uint8_t input_plaintext[ESP32S3_XTS_AES_DATA_UNIT_SIZE];
-    uint8_t input_plaintext_reversed[ESP32S3_XTS_AES_DATA_UNIT_SIZE];
-    uint8_t output_ciphertext[ESP32S3_XTS_AES_DATA_UNIT_SIZE];
-    uint8_t output_ciphertext_reversed[ESP32S3_XTS_AES_DATA_UNIT_SIZE];
-
-    *((uint32_t *) tweak) = cpu_to_le32((s->physical_addr & ESP32S3_XTS_AES_TWEAK_VALUE) + (s->destination << 30));
-    memset(tweak + 4, 0, 12);
-
+    uint8_t efuse_key[XTS_AES_KEY_SIZE_256];
     uint32_t efuse_key_size = esp32s3_xts_aes_get_key_size(s);
 
-    uint8_t *efuse_key = g_malloc(efuse_key_size * sizeof(uint8_t));
-
-    if (efuse_key == NULL) {
-        error_report("[XTS-AES] Memory allocation for the efuse key failed");
-        return;
-    }
-
     esp32s3_xts_aes_get_key(s, efuse_key, efuse_key_size);
+    esp_xts_cipher_set_key(&s->cipher, efuse_key, efuse_key_size);
+}
 
-    struct xts_aes_keys_ctx aesdata = {};
-    struct xts_aes_keys_ctx aestweak = {};
-
-    AES_set_encrypt_key(efuse_key, efuse_key_size / 2 * 8, &aesdata.enc);
-    AES_set_decrypt_key(efuse_key, efuse_key_size / 2 * 8, &aesdata.dec);
-    AES_set_encrypt_key(efuse_key + efuse_key_size / 2, efuse_key_size / 2 * 8, &aestweak.enc);
-    AES_set_decrypt_key(efuse_key + efuse_key_size / 2, efuse_key_size / 2 * 8, &aestweak.dec);
+static void esp32s3_xts_aes_encrypt(ESP32S3XtsAesState *s)
+{
+    uint32_t linesize = esp32s3_xts_aes_get_linesize(s);
+    uint8_t unit[ESP_XTS_DATA_UNIT_SIZE] = { 0 };
 
-    memset(input_plaintext, 0, ESP32S3_XTS_AES_DATA_UNIT_SIZE);
+    esp32s3_xts_aes_set_key(s);
 
     uint32_t plaintext_offs = (s->physical_addr % (ESP32S3_XTS_AES_PLAIN_REG_CNT * 4));
-    uint32_t pad_left = s->physical_addr % ESP32S3_XTS_AES_DATA_UNIT_SIZE;
-    memcpy(input_plaintext + pad_left, ((uint8_t*)s->plaintext) + plaintext_offs, linesize);
-
-    for (int i = 0; i < ESP32S3_XTS_AES_DATA_UNIT_SIZE; i++) {
-        input_plaintext_reversed[i] = input_plaintext[ESP32S3_XTS_AES_DATA_UNIT_SIZE-i-1];
-    }
+    uint32_t pad_left = s->physical_addr % ESP_XTS_DATA_UNIT_SIZE;
+    memcpy(unit + pad_left, ((uint8_t*)s->plaintext) + plaintext_offs, linesize);
 
-    xts_encrypt(&aesdata, &aestweak,
-                xts_aes_encrypt,
-                xts_aes_decrypt,
-                tweak, ESP32S3_XTS_AES_DATA_UNIT_SIZE, output_ciphertext_reversed, input_plaintext_reversed);
-
-    for (int i = 0; i < ESP32S3_XTS_AES_DATA_UNIT_SIZE; i++) {
-        output_ciphertext[i] = output_ciphertext_reversed[ESP32S3_XTS_AES_DATA_UNIT_SIZE-i-1];
-    }
+    esp_xts_cipher_crypt(&s->cipher, s->physical_addr, ESP32S3_XTS_AES_TWEAK_VALUE,
+                         s->destination << 30, unit, sizeof(unit), true);
 
     memset(s->ciphertext, 0, ESP32S3_XTS_AES_PLAIN_REG_CNT * sizeof(uint32_t));
-    memcpy(s->ciphertext, output_ciphertext + pad_left, linesize);
-    g_free(efuse_key);
+    memcpy(s->ciphertext, unit + pad_left, linesize);
 }
 
 static void esp32s3_xts_aes_decrypt(ESP32S3XtsAesState *s, uint32_t physical_address, uint8_t *data, uint32_t size)
 {
-    uint8_t tweak[16];
-    struct xts_aes_keys_ctx aesdata = {};
-    struct xts_aes_keys_ctx aestweak = {};
-
-    uint32_t efuse_key_size = esp32s3_xts_aes_get_key_size(s);
-
-    uint8_t *efuse_key = g_malloc(efuse_key_size * sizeof(uint8_t));
-
-    if (efuse_key == NULL) {
-        error_report("[XTS-AES] Memory allocation for the efuse key failed");
-        return;
-    }
-
-    esp32s3_xts_aes_get_key(s, efuse_key, efuse_key_size);
-
-    AES_set_encrypt_key(efuse_key, efuse_key_size / 2 * 8, &aesdata.enc);
-    AES_set_decrypt_key(efuse_key, efuse_key_size / 2 * 8, &aesdata.dec);
-    AES_set_encrypt_key(efuse_key + efuse_key_size / 2, efuse_key_size / 2 * 8, &aestweak.enc);
-    AES_set_decrypt_key(efuse_key + efuse_key_size / 2, efuse_key_size / 2 * 8, &aestweak.dec);
-
-    uint8_t input_ciphertext[ESP32S3_XTS_AES_DATA_UNIT_SIZE];
-    uint8_t input_ciphertext_reversed[ESP32S3_XTS_AES_DATA_UNIT_SIZE];
-    uint8_t output_plaintext[ESP32S3_XTS_AES_DATA_UNIT_SIZE];
-    uint8_t output_plaintext_reversed[ESP32S3_XTS_AES_DATA_UNIT_SIZE];
-
-    for (int i = 0; i < size; i += ESP32S3_XTS_AES_DATA_UNIT_SIZE) {
-        *((uint32_t *) tweak) = cpu_to_le32(((physical_address + i) & ESP32S3_XTS_AES_TWEAK_VALUE) + (s->destination << 30));
-        memset(tweak + 4, 0, 12);
-
-        memcpy(input_ciphertext, data + i, ESP32S3_XTS_AES_DATA_UNIT_SIZE);
-        for (int j = 0; j < ESP32S3_XTS_AES_DATA_UNIT_SIZE; j++) {
-            input_ciphertext_reversed[j] = input_ciphertext[ESP32S3_XTS_AES_DATA_UNIT_SIZE-j-1];
-        }
-
-        xts_decrypt(&aesdata, &aestweak,
-                    xts_aes_encrypt,
-                    xts_aes_decrypt,
-                    tweak, ESP32S3_XTS_AES_DATA_UNIT_SIZE, output_plaintext_reversed, input_ciphertext_reversed);
-
-        for (int j = 0; j < ESP32S3_XTS_AES_DATA_UNIT_SIZE; j++) {
-            output_plaintext[j] = output_plaintext_reversed[ESP32S3_XTS_AES_DATA_UNIT_SIZE-j-1];
-        }
-
-        memcpy(data + i, output_plaintext, ESP32S3_XTS_AES_DATA_UNIT_SIZE);
-    }
-    g_free(efuse_key);
+    esp32s3_xts_aes_set_key(s);
+    esp_xts_cipher_crypt(&s->cipher, physical_address, ESP32S3_XTS_AES_TWEAK_VALUE,
+                         s->destination << 30, data, size, false);
 }
 
 static uint64_t esp32s3_xts_aes_read(void *opaque, hwaddr addr, unsigned int size)
@@ -0,0 +1,189 @@
+/*
+ * Flash encryption engines shared by the ESP32, ESP32-C3 and ESP32-S3
+ *
+ * The flash caches decrypt whole pages at a time, so the AES key schedules
+ * are expanded once and reused instead of per 16 or 32-byte block.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "crypto/aes.h"
+#include "crypto/xts.h"
+#include "hw/misc/esp_flash_cipher.h"
+
+#define AES_BLOCK_WORDS     (AES_BLOCK_SIZE / 4)
+
+/* Key tweak from the ESP32 Technical Reference Manual section 25.3 */
+static void esp32_flash_cipher_tweak(const uint32_t *in_key, uint32_t offset_5,
+                                     uint32_t *out_key)
+{
+    uint32_t offset_5_8 = (offset_5) & 0xf;
+    uint32_t offset_5_10 = (offset_5) & 0x3f;
+    uint32_t offset_5_12 = (offset_5) & 0xff;
+    uint32_t offset_5_14 = (offset_5) & 0x3ff;
+    uint32_t offset_5_23 = (offset_5) & 0x7ffff;
+
+    uint32_t key_tweak[ESP32_FLASH_CIPHER_KEY_WORDS] = {
+            (offset_5_23 >> 6) | (offset_5_23 << 13),
+            (offset_5_14 >> 3) | (offset_5_23 << 7) | (offset_5_23 << 26),
+            (offset_5_23 >> 9) | (offset_5_23 << 10) | (offset_5_14 << 29),
+            (offset_5_12 >> 4) | (offset_5_23 << 4) | (offset_5_23 << 23),
+            (offset_5_23 >> 10) | (offset_5_23 << 9) | (offset_5_12 << 28),
+            (offset_5_10 >> 3) | (offset_5_23 << 3) | (offset_5_23 << 22),
+            (offset_5_23 >> 9) | (offset_5_23 << 10) | (offset_5_10 << 29),
+            (offset_5_8) | (offset_5_23 << 4) | (offset_5_23 << 23)
+    };
+
+    for (size_t i = 0; i < ESP32_FLASH_CIPHER_KEY_WORDS; ++i) {
+        out_key[i] = in_key[i] ^ bswap32(key_tweak[i]);
+    }
+}
+
+/* The AES core sees each 16-byte block with its bytes reversed */
+static inline void reverse_block(const uint32_t *src, uint32_t *dst)
+{
+    for (size_t i = 0; i < AES_BLOCK_WORDS; ++i) {
+        dst[i] = bswap32(src[AES_BLOCK_WORDS - i - 1]);
+    }
+}
+
+void esp32_flash_cipher_set_key(Esp32FlashCipher *c, const uint32_t *efuse_key)
+{
+    uint32_t key[ESP32_FLASH_CIPHER_KEY_WORDS];
+
+    for (size_t i = 0; i < ESP32_FLASH_CIPHER_KEY_WORDS; ++i) {
+        key[i] = bswap32(efuse_key[ESP32_FLASH_CIPHER_KEY_WORDS - i - 1]);
+    }
+    if (memcmp(key, c->key, sizeof(key))) {
+        memcpy(c->key, key, sizeof(key));
+        g_free(c->cache);
+        c->cache = NULL;
+    }
+}
+
+static const AES_KEY *esp32_flash_cipher_lookup(Esp32FlashCipher *c,
+                                                uint32_t offset_5)
+{
+    Esp32FlashCipherEntry *e;
+    uint32_t tweaked_key[ESP32_FLASH_CIPHER_KEY_WORDS];
+
+    offset_5 &= 0x7ffff;
+    if (!c->cache) {
+        c->cache = g_new0(Esp32FlashCipherEntry, ESP32_FLASH_CIPHER_CACHE_SIZE);
+    }
+    e = &c->cache[offset_5 % ESP32_FLASH_CIPHER_CACHE_SIZE];
+    if (e->tag != offset_5 + 1) {
+        esp32_flash_cipher_tweak(c->key, offset_5, tweaked_key);
+        AES_set_encrypt_key((const uint8_t *)tweaked_key, 256, &e->enc);
+        e->tag = offset_5 + 1;
+    }
+    return &e->enc;
+}
+
+void esp32_flash_cipher_decrypt(Esp32FlashCipher *c, uint32_t flash_addr,
+                                uint32_t *data, size_t words)
+{
+    const size_t block_words = ESP32_FLASH_CIPHER_BLOCK_SIZE / 4;
+    uint32_t block[AES_BLOCK_WORDS];
+
+    assert(flash_addr % ESP32_FLASH_CIPHER_BLOCK_SIZE == 0);
+    assert(words % AES_BLOCK_WORDS == 0);
+
+    /* flash decryption runs the AES core in the encrypt direction */
+    for (size_t pos = 0; pos < words; pos += block_words) {
+        uint32_t offset_5 = (flash_addr >> 5) + pos / block_words;
+        const AES_KEY *key = esp32_flash_cipher_lookup(c, offset_5);
+        size_t end = MIN(pos + block_words, words);
+
+        for (size_t i = pos; i < end; i += AES_BLOCK_WORDS) {
+            reverse_block(data + i, block);
+            AES_encrypt((uint8_t *)block, (uint8_t *)block, key);
+            reverse_block(block, data + i);
+        }
+    }
+}
+
+void esp32_flash_cipher_encrypt(Esp32FlashCipher *c, uint32_t flash_addr,
+                                const uint32_t *in, uint32_t *out)
+{
+    uint32_t tweaked_key[ESP32_FLASH_CIPHER_KEY_WORDS];
+    uint32_t block[AES_BLOCK_WORDS];
+    AES_KEY dec;
+
+    /* one block per register write, not worth caching */
+    esp32_flash_cipher_tweak(c->key, flash_addr >> 5, tweaked_key);
+    AES_set_decrypt_key((const uint8_t *)tweaked_key, 256, &dec);
+    for (size_t i = 0; i < ESP32_FLASH_CIPHER_BLOCK_SIZE / 4;
+         i += AES_BLOCK_WORDS) {
+        reverse_block(in + i, block);
+        AES_decrypt((uint8_t *)block, (uint8_t *)block, &dec);
+        reverse_block(block, out + i);
+    }
+}
+
+static void esp_xts_aes_encrypt(const void *ctx, size_t length,
+                                uint8_t *dst, const uint8_t *src)
+{
+    const EspXtsKeys *keys = ctx;
+
+    AES_encrypt(src, dst, &keys->enc);
+}
+
+static void esp_xts_aes_decrypt(const void *ctx, size_t length,
+                                uint8_t *dst, const uint8_t *src)
+{
+    const EspXtsKeys *keys = ctx;
+
+    AES_decrypt(src, dst, &keys->dec);
+}
+
+void esp_xts_cipher_set_key(EspXtsCipher *c, const uint8_t *key,
+                            size_t key_size)
+{
+    size_t half = key_size / 2;
+
+    assert(key_size <= ESP_XTS_MAX_KEY_SIZE);
+    if (c->key_size == key_size && !memcmp(c->key, key, key_size)) {
+        return;
+    }
+    memcpy(c->key, key, key_size);
+    c->key_size = key_size;
+    AES_set_encrypt_key(key, half * 8, &c->data.enc);
+    AES_set_decrypt_key(key, half * 8, &c->data.dec);
+    AES_set_encrypt_key(key + half, half * 8, &c->tweak.enc);
+    AES_set_decrypt_key(key + half, half * 8, &c->tweak.dec);
+}
+
+void esp_xts_cipher_crypt(EspXtsCipher *c, uint32_t addr, uint32_t addr_mask,
+                          uint32_t tweak_base, uint8_t *data, size_t size,
+                          bool encrypt)
+{
+    QEMU_ALIGNED(8) uint8_t unit[ESP_XTS_DATA_UNIT_SIZE];
+    uint8_t tweak[16];
+
+    assert(c->key_size && size % ESP_XTS_DATA_UNIT_SIZE == 0);
+
+    for (size_t pos = 0; pos < size; pos += ESP_XTS_DATA_UNIT_SIZE) {
+        uint8_t *p = data + pos;
+
+        stl_le_p(tweak, ((addr + pos) & addr_mask) + tweak_base);
+        memset(tweak + 4, 0, sizeof(tweak) - 4);
+        for (int i = 0; i < ESP_XTS_DATA_UNIT_SIZE; i++) {
+            unit[i] = p[ESP_XTS_DATA_UNIT_SIZE - i - 1];
+        }
+        if (encrypt) {
+            xts_encrypt(&c->data, &c->tweak, esp_xts_aes_encrypt,
+                        esp_xts_aes_decrypt, tweak, sizeof(unit), unit, unit);
+        } else {
+            xts_decrypt(&c->data, &c->tweak, esp_xts_aes_encrypt,
+                        esp_xts_aes_decrypt, tweak, sizeof(unit), unit, unit);
+        }
+        for (int i = 0; i < ESP_XTS_DATA_UNIT_SIZE; i++) {
+            p[i] = unit[ESP_XTS_DATA_UNIT_SIZE - i - 1];
+        }
+    }
+}
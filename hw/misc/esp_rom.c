@@ -0,0 +1,76 @@
+/*
+ * ESP mask ROM images shared between emulator instances
+ *
+ * The mask ROM images in pc-bios are a few hundred KiB per core and never
+ * change, yet each instance used to hold its own anonymous copy of them.
+ * Mapping the file MAP_PRIVATE over the ROM region's host memory keeps the
+ * pages in the page cache, shared by every instance on the host; a debugger
+ * planting a breakpoint only copies the page it writes.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "hw/loader.h"
+#include "hw/misc/esp_rom.h"
+
+#ifdef CONFIG_POSIX
+static bool esp_rom_map(const char *filename, int64_t size,
+                        MemoryRegionSection *section)
+{
+    MemoryRegion *mr = section->mr;
+    size_t len = ROUND_UP(size, qemu_real_host_page_size());
+    uint8_t *host;
+    void *p;
+    int fd;
+
+    if (!memory_region_is_rom(mr) || int128_get64(section->size) < size ||
+        section->offset_within_region + len > memory_region_size(mr)) {
+        return false;
+    }
+    host = memory_region_get_ram_ptr(mr) + section->offset_within_region;
+    if (!QEMU_PTR_IS_ALIGNED(host, qemu_real_host_page_size())) {
+        return false;
+    }
+
+    fd = qemu_open(filename, O_RDONLY, NULL);
+    if (fd < 0) {
+        return false;
+    }
+    p = mmap(host, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        warn_report("esp-rom: can't map %s, copying it: %s",
+                    filename, strerror(errno));
+        return false;
+    }
+    return true;
+}
+#endif
+
+ssize_t esp_rom_map_image_as(const char *filename, hwaddr addr,
+                             uint64_t max_sz, AddressSpace *as)
+{
+#ifdef CONFIG_POSIX
+    int64_t size = get_image_size(filename);
+
+    if (size > 0 && size <= max_sz) {
+        MemoryRegionSection section = memory_region_find(as->root, addr,
+                                                         size);
+        bool mapped = false;
+
+        if (section.mr) {
+            mapped = esp_rom_map(filename, size, &section);
+            memory_region_unref(section.mr);
+        }
+        if (mapped) {
+            return size;
+        }
+    }
+#endif
+    return load_image_targphys_as(filename, addr, max_sz, as);
+}
@@ -0,0 +1,294 @@
+/*
+ * VCD traces of ESP32 pins and peripheral outputs
+ *
+ * Level changes are stamped with the virtual clock and appended to a
+ * lock-free ring owned by the traced device.  A writer thread per trace
+ * drains the ring, orders the events by time and formats them as a Value
+ * Change Dump, so the vCPU only pays for one ring store per change.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qapi/error.h"
+#include "sysemu/rtc.h"
+#include "sysemu/sysemu.h"
+
+#include "hw/misc/esp_signal_trace.h"
+
+/* 24 bytes per entry, 1.5 MiB per traced device */
+#define TRACE_RING_SIZE             (1 << 16)
+#define TRACE_FLUSH_INTERVAL_MS     100
+
+typedef struct TraceEvent {
+    int64_t time;
+    int64_t now;        /* virtual clock when recorded, bounds later events */
+    uint32_t value;
+    uint16_t signal;
+} TraceEvent;
+
+typedef struct TracePending {
+    int64_t time;
+    uint32_t seq;
+    uint32_t value;
+    uint16_t signal;
+} TracePending;
+
+typedef struct TraceSignal {
+    char *name;
+    unsigned width;
+} TraceSignal;
+
+struct EspSignalTrace {
+    /* producer side, under the BQL */
+    uint32_t head;
+    uint64_t dropped;
+    TraceEvent *ring;
+
+    /* consumer side */
+    uint32_t tail;
+    uint32_t seq;
+    int64_t last_time;
+    GArray *pending;        /* TracePending, sorted by time before output */
+    GString *out;
+    int fd;
+
+    char *scope;
+    GArray *signals;        /* TraceSignal */
+    QemuThread thread;
+    QemuSemaphore wake;
+    bool stop;
+    Notifier exit_notifier;
+};
+
+EspSignalTrace *esp_signal_trace_new(const char *scope)
+{
+    EspSignalTrace *t = g_new0(EspSignalTrace, 1);
+
+    t->scope = g_strdup(scope);
+    t->signals = g_array_new(false, false, sizeof(TraceSignal));
+    t->fd = -1;
+    return t;
+}
+
+unsigned esp_signal_trace_add(EspSignalTrace *t, const char *name,
+                              unsigned width)
+{
+    TraceSignal sig = { .name = g_strdup(name), .width = width };
+
+    assert(width >= 1 && width <= 32 && t->signals->len < UINT16_MAX);
+    g_array_append_val(t->signals, sig);
+    return t->signals->len - 1;
+}
+
+/* VCD identifiers are strings of printable characters '!' to '~' */
+static void trace_append_id(GString *s, unsigned n)
+{
+    do {
+        g_string_append_c(s, '!' + n % 94);
+        n /= 94;
+    } while (n);
+}
+
+static void trace_append_value(GString *s, const TraceSignal *sig,
+                               unsigned n, uint32_t value)
+{
+    if (sig->width == 1) {
+        g_string_append_c(s, '0' + (value & 1));
+    } else {
+        int bit = 31 - clz32(value | 1);
+
+        g_string_append_c(s, 'b');
+        for (; bit >= 0; bit--) {
+            g_string_append_c(s, '0' + ((value >> bit) & 1));
+        }
+        g_string_append_c(s, ' ');
+    }
+    trace_append_id(s, n);
+    g_string_append_c(s, '\n');
+}
+
+static gint trace_pending_cmp(gconstpointer a, gconstpointer b)
+{
+    const TracePending *x = a, *y = b;
+
+    if (x->time != y->time) {
+        return x->time < y->time ? -1 : 1;
+    }
+    return x->seq - y->seq;
+}
+
+/* Moves the ring into the pending list, returns the time bound */
+static int64_t trace_drain(EspSignalTrace *t)
+{
+    uint32_t head = qatomic_load_acquire(&t->head);
+    uint32_t tail = t->tail;
+    int64_t bound = INT64_MIN;
+    bool sorted = true;
+
+    for (; tail != head; tail++) {
+        TraceEvent *e = &t->ring[tail % TRACE_RING_SIZE];
+        TracePending p = {
+            .time = e->time,
+            .seq = t->seq++,
+            .value = e->value,
+            .signal = e->signal,
+        };
+
+        if (t->pending->len &&
+            g_array_index(t->pending, TracePending,
+                          t->pending->len - 1).time > p.time) {
+            sorted = false;
+        }
+        g_array_append_val(t->pending, p);
+        bound = e->now;
+    }
+    qatomic_store_release(&t->tail, tail);
+    if (!sorted) {
+        g_array_sort(t->pending, trace_pending_cmp);
+    }
+    return bound;
+}
+
+/* Formats the pending events up to bound, later ones may still be joined */
+static void trace_format(EspSignalTrace *t, int64_t bound)
+{
+    guint i;
+
+    for (i = 0; i < t->pending->len; i++) {
+        TracePending *p = &g_array_index(t->pending, TracePending, i);
+
+        if (p->time > bound) {
+            break;
+        }
+        if (p->time != t->last_time) {
+            g_string_append_printf(t->out, "#%" PRId64 "\n", p->time);
+            t->last_time = p->time;
+        }
+        trace_append_value(t->out,
+                           &g_array_index(t->signals, TraceSignal, p->signal),
+                           p->signal, p->value);
+    }
+    g_array_remove_range(t->pending, 0, i);
+}
+
+static void trace_write(EspSignalTrace *t)
+{
+    if (t->out->len && t->fd >= 0 &&
+        qemu_write_full(t->fd, t->out->str, t->out->len) != t->out->len) {
+        error_report("%s: VCD write error - stopping trace", t->scope);
+        close(t->fd);
+        t->fd = -1;
+    }
+    g_string_truncate(t->out, 0);
+}
+
+static void *esp_signal_trace_writer(void *opaque)
+{
+    EspSignalTrace *t = opaque;
+    bool stop;
+
+    do {
+        int64_t bound;
+
+        qemu_sem_timedwait(&t->wake, TRACE_FLUSH_INTERVAL_MS);
+        stop = qatomic_read(&t->stop);
+        bound = trace_drain(t);
+        trace_format(t, stop ? INT64_MAX : bound);
+        trace_write(t);
+    } while (!stop);
+    return NULL;
+}
+
+static void esp_signal_trace_exit(Notifier *n, void *data)
+{
+    EspSignalTrace *t = container_of(n, EspSignalTrace, exit_notifier);
+
+    /* the vCPUs are stopped, so the writer's last pass sees every event */
+    qatomic_set(&t->stop, true);
+    qemu_sem_post(&t->wake);
+    qemu_thread_join(&t->thread);
+    if (t->dropped) {
+        warn_report("%s: VCD trace dropped %" PRIu64 " events", t->scope,
+                    t->dropped);
+    }
+    if (t->fd >= 0) {
+        close(t->fd);
+    }
+}
+
+bool esp_signal_trace_open(EspSignalTrace *t, const char *path, Error **errp)
+{
+    char date[64];
+    struct tm tm;
+
+    t->fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, 0644);
+    if (t->fd < 0) {
+        error_setg_errno(errp, errno, "%s: can't open %s", t->scope, path);
+        return false;
+    }
+
+    qemu_get_timedate(&tm, 0);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+    t->out = g_string_new(NULL);
+    g_string_append_printf(t->out,
+                           "$date %s $end\n"
+                           "$version QEMU %s $end\n"
+                           "$timescale 1ns $end\n"
+                           "$scope module %s $end\n",
+                           date, QEMU_VERSION, t->scope);
+    for (unsigned i = 0; i < t->signals->len; i++) {
+        TraceSignal *sig = &g_array_index(t->signals, TraceSignal, i);
+
+        g_string_append_printf(t->out, "$var wire %u ", sig->width);
+        trace_append_id(t->out, i);
+        g_string_append_printf(t->out, " %s $end\n", sig->name);
+    }
+    g_string_append(t->out, "$upscope $end\n$enddefinitions $end\n"
+                            "#0\n$dumpvars\n");
+    for (unsigned i = 0; i < t->signals->len; i++) {
+        TraceSignal *sig = &g_array_index(t->signals, TraceSignal, i);
+
+        g_string_append(t->out, sig->width == 1 ? "x" : "bx ");
+        trace_append_id(t->out, i);
+        g_string_append_c(t->out, '\n');
+    }
+    g_string_append(t->out, "$end\n");
+    t->last_time = 0;
+    trace_write(t);
+
+    t->ring = g_new(TraceEvent, TRACE_RING_SIZE);
+    t->pending = g_array_new(false, false, sizeof(TracePending));
+    qemu_sem_init(&t->wake, 0);
+    qemu_thread_create(&t->thread, "esp-signal-trace", esp_signal_trace_writer,
+                       t, QEMU_THREAD_JOINABLE);
+    t->exit_notifier.notify = esp_signal_trace_exit;
+    qemu_add_exit_notifier(&t->exit_notifier);
+    return true;
+}
+
+void esp_signal_trace_event(EspSignalTrace *t, int64_t now, int64_t time_ns,
+                            unsigned signal, uint32_t value)
+{
+    uint32_t used = t->head - qatomic_load_acquire(&t->tail);
+    TraceEvent *e;
+
+    if (!t->ring || used >= TRACE_RING_SIZE) {
+        t->dropped++;
+        return;
+    }
+    e = &t->ring[t->head % TRACE_RING_SIZE];
+    e->time = MAX(time_ns, now);
+    e->now = now;
+    e->value = value;
+    e->signal = signal;
+    qatomic_store_release(&t->head, t->head + 1);
+    if (used == TRACE_RING_SIZE / 2) {
+        qemu_sem_post(&t->wake);
+    }
+}
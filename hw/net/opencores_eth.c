@@ -36,6 +36,7 @@
 #include "hw/net/mii.h"
 #include "hw/qdev-properties.h"
 #include "hw/sysbus.h"
+#include "exec/address-spaces.h"
 #include "net/net.h"
 #include "qemu/module.h"
 #include "net/eth.h"
@@ -374,11 +375,46 @@ static void open_eth_reset(void *opaque)
     open_eth_set_link_status(qemu_get_queue(s->nic));
 }
 
+/* Without a free descriptor frames stay queued in the net layer until the
+ * guest releases one, then they are delivered back to back.
+ */
 static bool open_eth_can_receive(NetClientState *nc)
 {
     OpenEthState *s = qemu_get_nic_opaque(nc);
 
-    return GET_REGBIT(s, MODER, RXEN) && (s->regs[TX_BD_NUM] < 0x80);
+    return GET_REGBIT(s, MODER, RXEN) && (s->regs[TX_BD_NUM] < 0x80) &&
+        (rx_desc(s)->len_flags & RXD_E);
+}
+
+/* Copy a frame followed by pad zero bytes to a guest buffer, through a
+ * direct mapping when the buffer is in RAM.
+ */
+static void open_eth_dma_write(hwaddr addr, const uint8_t *buf,
+        size_t len, size_t pad)
+{
+    static const uint8_t zero[64] = {0};
+    hwaddr plen = len + pad;
+    uint8_t *p = address_space_map(&address_space_memory, addr, &plen, true,
+                                   MEMTXATTRS_UNSPECIFIED);
+
+    if (p && plen == len + pad) {
+        memcpy(p, buf, len);
+        memset(p + len, 0, pad);
+        address_space_unmap(&address_space_memory, p, plen, true, plen);
+        return;
+    }
+    if (p) {
+        address_space_unmap(&address_space_memory, p, plen, true, 0);
+    }
+    cpu_physical_memory_write(addr, buf, len);
+    addr += len;
+    while (pad) {
+        size_t zero_sz = MIN(pad, sizeof(zero));
+
+        cpu_physical_memory_write(addr, zero, zero_sz);
+        addr += zero_sz;
+        pad -= zero_sz;
+    }
 }
 
 static ssize_t open_eth_receive(NetClientState *nc,
@@ -424,9 +460,9 @@ static ssize_t open_eth_receive(NetClientState *nc,
 #else
     {
 #endif
-        static const uint8_t zero[64] = {0};
         desc *desc = rx_desc(s);
         size_t copy_size = GET_REGBIT(s, MODER, HUGEN) ? 65536 : maxfl;
+        size_t pad = 0;
 
         if (!(desc->len_flags & RXD_E)) {
             open_eth_int_source_write(s,
@@ -454,30 +490,22 @@ static ssize_t open_eth_receive(NetClientState *nc,
         }
 #endif
 
-        cpu_physical_memory_write(desc->buf_ptr, buf, copy_size);
-
         if (GET_REGBIT(s, MODER, PAD) && copy_size < minfl) {
             if (minfl - copy_size > fcsl) {
                 fcsl = 0;
             } else {
                 fcsl -= minfl - copy_size;
             }
-            while (copy_size < minfl) {
-                size_t zero_sz = minfl - copy_size < sizeof(zero) ?
-                    minfl - copy_size : sizeof(zero);
-
-                cpu_physical_memory_write(desc->buf_ptr + copy_size,
-                        zero, zero_sz);
-                copy_size += zero_sz;
-            }
+            pad = minfl - copy_size;
         }
 
         /* There's no FCS in the frames handed to us by the QEMU, zero fill it.
          * Don't do it if the frame is cut at the MAXFL or padded with 4 or
          * more bytes to the MINFL.
          */
-        cpu_physical_memory_write(desc->buf_ptr + copy_size, zero, fcsl);
-        copy_size += fcsl;
+        pad += fcsl;
+        open_eth_dma_write(desc->buf_ptr, buf, copy_size, pad);
+        copy_size += pad;
 
         SET_FIELD(desc->len_flags, RXD_LEN, copy_size);
 
@@ -506,12 +534,16 @@ static NetClientInfo net_open_eth_info = {
     .link_status_changed = open_eth_set_link_status,
 };
 
-static void open_eth_start_xmit(OpenEthState *s, desc *tx)
+/* Send one frame, mapping the guest buffer instead of copying it when the
+ * buffer is in RAM. Returns true if the descriptor requests an interrupt.
+ */
+static bool open_eth_start_xmit(OpenEthState *s, desc *tx)
 {
-    uint8_t *buf = NULL;
-    uint8_t buffer[0x600];
+    static const uint8_t zero[64] = {0};
     unsigned len = GET_FIELD(tx->len_flags, TXD_LEN);
     unsigned tx_len = len;
+    hwaddr plen;
+    uint8_t *p;
 
     if ((tx->len_flags & TXD_PAD) &&
             tx_len < GET_REGFIELD(s, PACKETLEN, MINFL)) {
@@ -524,21 +556,28 @@ static void open_eth_start_xmit(OpenEthState *s, desc *tx)
 
     trace_open_eth_start_xmit(tx->buf_ptr, len, tx_len);
 
-    if (tx_len > sizeof(buffer)) {
-        buf = g_new(uint8_t, tx_len);
-    } else {
-        buf = buffer;
-    }
     if (len > tx_len) {
         len = tx_len;
     }
-    cpu_physical_memory_read(tx->buf_ptr, buf, len);
-    if (tx_len > len) {
-        memset(buf + len, 0, tx_len - len);
-    }
-    qemu_send_packet(qemu_get_queue(s->nic), buf, tx_len);
-    if (tx_len > sizeof(buffer)) {
-        g_free(buf);
+    plen = len;
+    p = address_space_map(&address_space_memory, tx->buf_ptr, &plen, false,
+                          MEMTXATTRS_UNSPECIFIED);
+    if (p && plen == len && tx_len - len <= sizeof(zero)) {
+        struct iovec iov[] = {
+            { .iov_base = p, .iov_len = len },
+            { .iov_base = (void *)zero, .iov_len = tx_len - len },
+        };
+
+        qemu_sendv_packet(qemu_get_queue(s->nic), iov, ARRAY_SIZE(iov));
+        address_space_unmap(&address_space_memory, p, plen, false, plen);
+    } else {
+        g_autofree uint8_t *buf = g_malloc0(tx_len);
+
+        if (p) {
+            address_space_unmap(&address_space_memory, p, plen, false, 0);
+        }
+        cpu_physical_memory_read(tx->buf_ptr, buf, len);
+        qemu_send_packet(qemu_get_queue(s->nic), buf, tx_len);
     }
 
     if (tx->len_flags & TXD_WR) {
@@ -551,19 +590,24 @@ static void open_eth_start_xmit(OpenEthState *s, desc *tx)
     }
     tx->len_flags &= ~(TXD_RD | TXD_UR |
             TXD_RTRY | TXD_RL | TXD_LC | TXD_DF | TXD_CS);
-    if (tx->len_flags & TXD_IRQ) {
-        open_eth_int_source_write(s, s->regs[INT_SOURCE] | INT_SOURCE_TXB);
-    }
-
+    return tx->len_flags & TXD_IRQ;
 }
 
+/* Drain every ready descriptor in one go, raising TXB once for the batch. */
 static void open_eth_check_start_xmit(OpenEthState *s)
 {
-    desc *tx = tx_desc(s);
-    if (GET_REGBIT(s, MODER, TXEN) && s->regs[TX_BD_NUM] > 0 &&
-            (tx->len_flags & TXD_RD) &&
-            GET_FIELD(tx->len_flags, TXD_LEN) > 4) {
-        open_eth_start_xmit(s, tx);
+    bool irq = false;
+    desc *tx;
+
+    if (!GET_REGBIT(s, MODER, TXEN) || s->regs[TX_BD_NUM] == 0) {
+        return;
+    }
+    for (tx = tx_desc(s); (tx->len_flags & TXD_RD) &&
+            GET_FIELD(tx->len_flags, TXD_LEN) > 4; tx = tx_desc(s)) {
+        irq |= open_eth_start_xmit(s, tx);
+    }
+    if (irq) {
+        open_eth_int_source_write(s, s->regs[INT_SOURCE] | INT_SOURCE_TXB);
     }
 }
 
@@ -726,7 +770,11 @@ static void open_eth_desc_write(void *opaque,
     addr &= 0x3ff;
     trace_open_eth_desc_write((uint32_t)addr, (uint32_t)val);
     memcpy((uint8_t *)s->desc + addr, &val, size);
-    open_eth_check_start_xmit(s);
+    if (addr / sizeof(desc) == s->rx_desc) {
+        open_eth_notify_can_receive(s);
+    } else {
+        open_eth_check_start_xmit(s);
+    }
 }
 
 
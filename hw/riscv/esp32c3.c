@@ -13,6 +13,7 @@
 #include "hw/qdev-properties.h"
 #include "qemu/units.h"
 #include "qemu/datadir.h"
+#include "qemu/guest-random.h"
 #include "qapi/error.h"
 #include "hw/hw.h"
 #include "hw/boards.h"
@@ -47,6 +48,7 @@
 #include "hw/misc/esp32c3_ds.h"
 #include "hw/misc/esp32c3_xts_aes.h"
 #include "hw/misc/esp32c3_jtag.h"
+#include "hw/misc/esp_rom.h"
 #include "hw/dma/esp32c3_gdma.h"
 #include "hw/display/esp_rgb.h"
 #include "hw/net/can/esp32c3_twai.h"
@@ -151,13 +153,10 @@ static uint64_t esp32c3_io_read(void *opaque, hwaddr addr, unsigned int size)
         /* Return "QEMU" as a 32-bit value */
         return 0x51454d55;
     } else if (addr + ESP32C3_IO_START_ADDR == DR_REG_SYSCON_BASE + A_SYSCON_RND_DATA_REG) {
-        /* Return a random 32-bit value */
-        static bool init = false;
-        if (!init) {
-            srand(time(NULL));
-            init = true;
-        }
-        return rand();
+        /* Return a random 32-bit value, replayable like the RNG device */
+        uint32_t value;
+        qemu_guest_getrandom_nofail(&value, sizeof(value));
+        return value;
     } else if (addr + ESP32C3_IO_START_ADDR == DR_REG_ASSIST_DEBUG_BASE + A_ASSIST_DEBUG_CORE_0_DEBUG_MODE_REG) {
         return 0;
     } else {
@@ -312,7 +311,7 @@ static void esp32c3_load_firmware(MachineState *machine)
         }
 
         /* Load ROM file at the reset address */
-        int size = load_image_targphys_as(rom_binary, ESP32C3_RESET_ADDRESS, 0x60000, CPU(&ms->soc)->as);
+        int size = esp_rom_map_image_as(rom_binary, ESP32C3_RESET_ADDRESS, 0x60000, CPU(&ms->soc)->as);
         if (size < 0) {
             error_report("Error: could not load ROM binary '%s'", rom_binary);
             exit(1);
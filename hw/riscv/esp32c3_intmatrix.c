@@ -21,6 +21,7 @@
 #include "hw/riscv/riscv_hart.h"
 #include "hw/riscv/esp32c3_intmatrix.h"
 #include "esp_cpu.h"
+#include "trace.h"
 
 #define INTMATRIX_DEBUG     0
 #define INTMATRIX_WARNING   0
@@ -32,6 +33,7 @@
 
 static void esp32c3_do_int(ESP32C3IntMatrixState *s, int line)
 {
+    trace_esp32c3_intmatrix_raise(line);
     qemu_irq_pulse(s->out_irqs[line]);
 }
 
@@ -96,6 +98,8 @@ static void esp32c3_intmatrix_irq_handler(void *opaque, int n, int level)
 
     const int line = s->irq_map[n];
 
+    trace_esp32c3_intmatrix_irq(n, line, level);
+
     /* If the line is not enable, don't do anything special, the level has been recorded already.
      * Don't do anything if the line is at the same level as before */
     if ((s->irq_enabled & BIT(line)) == 0 || former_level == level) {
@@ -113,6 +117,7 @@ static void esp32c3_intmatrix_irq_handler(void *opaque, int n, int level)
         if (s->irq_prio[line] >= s->irq_thres && esp32c3_intmatrix_can_trigger(s)) {
             esp32c3_do_int(s, line);
         } else {
+            trace_esp32c3_intmatrix_pending(line);
             SET_BIT(s->irq_pending, line);
         }
     } else if (BIT_SET(s->irq_pending, line)) {
@@ -0,0 +1,444 @@
+/*
+ * I2C and SPI sensors co-simulated by an external process
+ *
+ * The devices forward whole bus transactions to a simulator through the
+ * shared-memory rings described in esp_cosim_proto.h.  Writes are posted
+ * and reads are served from a read-ahead block fetched in one round trip,
+ * so polling a sensor at a high rate does not cost one exchange per byte.
+ * Several devices may share one ring by naming the same "shm" file.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/processor.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "exec/replay-core.h"
+#include "hw/i2c/i2c.h"
+#include "hw/ssi/ssi.h"
+#include "hw/qdev-properties.h"
+#include "hw/sensor/esp_cosim.h"
+#include "qom/object.h"
+#include <sys/mman.h>
+
+#define ESP_COSIM_I2C_READ_AHEAD    32      /* the ESP32 I2C RX FIFO size */
+#define ESP_COSIM_SPI_READ_AHEAD    64
+#define ESP_COSIM_SPINS             4096
+#define ESP_COSIM_POLL_US           10
+
+typedef struct EspCosimLink {
+    EspCosimShared *shm;
+    uint32_t seq;
+    bool offline;
+    uint32_t stalled_req_tail;      /* ring positions when it went offline */
+    uint32_t stalled_rsp_head;
+} EspCosimLink;
+
+static GHashTable *esp_cosim_links;
+
+static EspCosimLink *esp_cosim_link_get(const char *path, Error **errp)
+{
+    EspCosimLink *l;
+    void *p;
+    int fd;
+
+    if (!path) {
+        error_setg(errp, "esp-cosim: the shm property must be set");
+        return NULL;
+    }
+    if (!esp_cosim_links) {
+        esp_cosim_links = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free, NULL);
+    }
+    l = g_hash_table_lookup(esp_cosim_links, path);
+    if (l) {
+        return l;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "esp-cosim: can't open %s", path);
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(EspCosimShared)) < 0) {
+        error_setg_errno(errp, errno, "esp-cosim: can't resize %s", path);
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, sizeof(EspCosimShared), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        error_setg_errno(errp, errno, "esp-cosim: can't map %s", path);
+        return NULL;
+    }
+
+    l = g_new0(EspCosimLink, 1);
+    l->shm = p;
+    /* the simulator waits for the magic before touching the rings */
+    qatomic_set(&l->shm->magic, 0);
+    smp_wmb();
+    memset(&l->shm->req, 0, offsetof(EspCosimRing, data));
+    memset(&l->shm->rsp, 0, offsetof(EspCosimRing, data));
+    l->shm->version = cpu_to_le32(ESP_COSIM_VERSION);
+    qatomic_store_release(&l->shm->magic, cpu_to_le32(ESP_COSIM_MAGIC));
+    g_hash_table_insert(esp_cosim_links, g_strdup(path), l);
+    /* replies come from another process at host speed */
+    replay_add_blocker("esp-cosim");
+    return l;
+}
+
+/*
+ * Called while waiting for the simulator: spin first, since it normally
+ * answers within microseconds, then poll.  Returns false once the deadline
+ * has passed; the link is then treated as offline and requests are dropped
+ * until the simulator makes progress again (see esp_cosim_resumed).
+ */
+static bool esp_cosim_backoff(EspCosimLink *l, int64_t deadline, int *spins)
+{
+    if (l->offline) {
+        return false;
+    }
+    if ((*spins)++ < ESP_COSIM_SPINS) {
+        cpu_relax();
+        return true;
+    }
+    if (qemu_clock_get_ms(QEMU_CLOCK_REALTIME) >= deadline) {
+        warn_report("esp-cosim: simulator not responding");
+        l->offline = true;
+        l->stalled_req_tail = le32_to_cpu(qatomic_read(&l->shm->req.tail));
+        l->stalled_rsp_head = le32_to_cpu(qatomic_read(&l->shm->rsp.head));
+        return false;
+    }
+    g_usleep(ESP_COSIM_POLL_US);
+    return true;
+}
+
+/* True once an offline simulator has consumed a request or posted a reply */
+static bool esp_cosim_resumed(EspCosimLink *l)
+{
+    return le32_to_cpu(qatomic_load_acquire(&l->shm->req.tail)) !=
+           l->stalled_req_tail ||
+           le32_to_cpu(qatomic_load_acquire(&l->shm->rsp.head)) !=
+           l->stalled_rsp_head;
+}
+
+/* Queue a request, returns its sequence number or 0 if it was dropped */
+static uint32_t esp_cosim_send(EspCosimLink *l, uint32_t timeout_ms,
+                               EspCosimType type, uint8_t bus, uint16_t dev,
+                               uint32_t count, const uint8_t *data,
+                               uint32_t size)
+{
+    EspCosimRing *r = &l->shm->req;
+    uint32_t rec = esp_cosim_record_size(size);
+    uint32_t head = le32_to_cpu(r->head);
+    int64_t deadline = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + timeout_ms;
+    int spins = 0;
+    EspCosimMsg msg;
+
+    if (l->offline) {
+        if (!esp_cosim_resumed(l)) {
+            return 0;
+        }
+        l->offline = false;
+    }
+    while (head - le32_to_cpu(qatomic_load_acquire(&r->tail)) + rec >
+           ESP_COSIM_RING_SIZE) {
+        if (!esp_cosim_backoff(l, deadline, &spins)) {
+            return 0;
+        }
+    }
+
+    if (++l->seq == 0) {
+        l->seq = 1;
+    }
+    msg = (EspCosimMsg) {
+        .size = cpu_to_le32(size),
+        .type = type,
+        .bus = bus,
+        .dev = cpu_to_le16(dev),
+        .count = cpu_to_le32(count),
+        .seq = cpu_to_le32(l->seq),
+        .time_ns = cpu_to_le64(qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)),
+    };
+    esp_cosim_ring_write(r, head, &msg, sizeof(msg));
+    if (size) {
+        esp_cosim_ring_write(r, head + sizeof(msg), data, size);
+    }
+    qatomic_store_release(&r->head, cpu_to_le32(head + rec));
+    return l->seq;
+}
+
+/* Wait for the response to seq, returns the number of data bytes */
+static uint32_t esp_cosim_recv(EspCosimLink *l, uint32_t timeout_ms,
+                               uint32_t seq, uint8_t *buf, uint32_t max)
+{
+    EspCosimRing *r = &l->shm->rsp;
+    int64_t deadline = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + timeout_ms;
+    int spins = 0;
+    EspCosimMsg msg;
+
+    if (!seq) {
+        return 0;
+    }
+    for (;;) {
+        uint32_t tail = le32_to_cpu(r->tail);
+        uint32_t size;
+
+        while (le32_to_cpu(qatomic_load_acquire(&r->head)) == tail) {
+            if (!esp_cosim_backoff(l, deadline, &spins)) {
+                return 0;
+            }
+        }
+        l->offline = false;
+
+        esp_cosim_ring_read(r, tail, &msg, sizeof(msg));
+        size = MIN(le32_to_cpu(msg.size), ESP_COSIM_MAX_DATA);
+        if (msg.type == ESP_COSIM_RESPONSE && le32_to_cpu(msg.seq) == seq) {
+            size = MIN(size, max);
+            esp_cosim_ring_read(r, tail + sizeof(msg), buf, size);
+            qatomic_store_release(&r->tail,
+                                  cpu_to_le32(tail + esp_cosim_record_size(
+                                              le32_to_cpu(msg.size))));
+            return size;
+        }
+        /* the answer to a request that already timed out */
+        qatomic_store_release(&r->tail,
+                              cpu_to_le32(tail + esp_cosim_record_size(
+                                          le32_to_cpu(msg.size))));
+    }
+}
+
+#define ESP_COSIM_COMMON_PROPERTIES(_state)                             \
+    DEFINE_PROP_STRING("shm", _state, shm_path),                        \
+    DEFINE_PROP_UINT8("bus", _state, bus, 0),                           \
+    DEFINE_PROP_UINT32("timeout-ms", _state, timeout_ms, 1000)
+
+/* I2C */
+
+OBJECT_DECLARE_SIMPLE_TYPE(EspCosimI2CState, ESP_COSIM_I2C)
+
+struct EspCosimI2CState {
+    I2CSlave parent_obj;
+
+    char *shm_path;
+    uint8_t bus;
+    uint32_t timeout_ms;
+    EspCosimLink *link;
+
+    uint8_t wbuf[ESP_COSIM_MAX_DATA];
+    uint32_t wlen;
+    uint8_t rbuf[ESP_COSIM_I2C_READ_AHEAD];
+    uint32_t rlen;
+    uint32_t rpos;
+    bool reading;
+    bool read_requested;
+};
+
+static void esp_cosim_i2c_post(EspCosimI2CState *s, EspCosimType type,
+                               uint32_t count, const uint8_t *data,
+                               uint32_t size)
+{
+    esp_cosim_send(s->link, s->timeout_ms, type, s->bus,
+                   I2C_SLAVE(s)->address, count, data, size);
+}
+
+static void esp_cosim_i2c_flush(EspCosimI2CState *s)
+{
+    if (s->wlen) {
+        esp_cosim_i2c_post(s, ESP_COSIM_I2C_WRITE, 0, s->wbuf, s->wlen);
+        s->wlen = 0;
+    }
+    if (s->reading && s->read_requested) {
+        esp_cosim_i2c_post(s, ESP_COSIM_I2C_READ_END, s->rpos, NULL, 0);
+    }
+    s->reading = false;
+    s->read_requested = false;
+}
+
+static int esp_cosim_i2c_event(I2CSlave *i2c, enum i2c_event event)
+{
+    EspCosimI2CState *s = ESP_COSIM_I2C(i2c);
+
+    switch (event) {
+    case I2C_START_SEND:
+    case I2C_FINISH:
+        esp_cosim_i2c_flush(s);
+        break;
+    case I2C_START_RECV:
+        esp_cosim_i2c_flush(s);
+        s->reading = true;
+        s->rlen = s->rpos = 0;
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+static int esp_cosim_i2c_send(I2CSlave *i2c, uint8_t data)
+{
+    EspCosimI2CState *s = ESP_COSIM_I2C(i2c);
+
+    if (s->wlen == sizeof(s->wbuf)) {
+        esp_cosim_i2c_post(s, ESP_COSIM_I2C_WRITE, 0, s->wbuf, s->wlen);
+        s->wlen = 0;
+    }
+    s->wbuf[s->wlen++] = data;
+    return 0;
+}
+
+static uint8_t esp_cosim_i2c_recv(I2CSlave *i2c)
+{
+    EspCosimI2CState *s = ESP_COSIM_I2C(i2c);
+    uint32_t seq;
+
+    if (s->read_requested && s->rpos == sizeof(s->rbuf)) {
+        /* longer than the read-ahead, continue where the last block ended */
+        esp_cosim_i2c_post(s, ESP_COSIM_I2C_READ_END, s->rpos, NULL, 0);
+        s->read_requested = false;
+        s->rlen = s->rpos = 0;
+    }
+    if (!s->read_requested) {
+        seq = esp_cosim_send(s->link, s->timeout_ms, ESP_COSIM_I2C_READ,
+                             s->bus, i2c->address, sizeof(s->rbuf), NULL, 0);
+        s->rlen = esp_cosim_recv(s->link, s->timeout_ms, seq, s->rbuf,
+                                 sizeof(s->rbuf));
+        s->read_requested = true;
+    }
+    if (s->rpos >= s->rlen) {
+        s->rpos++;
+        return 0xff;
+    }
+    return s->rbuf[s->rpos++];
+}
+
+static void esp_cosim_i2c_realize(DeviceState *dev, Error **errp)
+{
+    EspCosimI2CState *s = ESP_COSIM_I2C(dev);
+
+    s->link = esp_cosim_link_get(s->shm_path, errp);
+}
+
+static Property esp_cosim_i2c_properties[] = {
+    ESP_COSIM_COMMON_PROPERTIES(EspCosimI2CState),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void esp_cosim_i2c_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    I2CSlaveClass *k = I2C_SLAVE_CLASS(klass);
+
+    dc->realize = esp_cosim_i2c_realize;
+    dc->desc = "I2C sensor served by an external simulator";
+    device_class_set_props(dc, esp_cosim_i2c_properties);
+    k->event = esp_cosim_i2c_event;
+    k->recv = esp_cosim_i2c_recv;
+    k->send = esp_cosim_i2c_send;
+}
+
+/* SPI */
+
+OBJECT_DECLARE_SIMPLE_TYPE(EspCosimSPIState, ESP_COSIM_SPI)
+
+struct EspCosimSPIState {
+    SSIPeripheral parent_obj;
+
+    char *shm_path;
+    uint8_t bus;
+    uint32_t timeout_ms;
+    EspCosimLink *link;
+
+    uint8_t tx[ESP_COSIM_MAX_DATA];
+    uint32_t pos;
+    uint8_t rx[ESP_COSIM_SPI_READ_AHEAD];
+    uint32_t rxlen;
+    bool requested;
+};
+
+static uint32_t esp_cosim_spi_transfer(SSIPeripheral *dev, uint32_t val)
+{
+    EspCosimSPIState *s = ESP_COSIM_SPI(dev);
+    uint8_t b = val;
+    uint8_t out = 0xff;
+    uint32_t seq;
+
+    if (!s->requested) {
+        seq = esp_cosim_send(s->link, s->timeout_ms, ESP_COSIM_SPI_XFER,
+                             s->bus, dev->cs_index, sizeof(s->rx), &b, 1);
+        s->rxlen = esp_cosim_recv(s->link, s->timeout_ms, seq, s->rx,
+                                  sizeof(s->rx));
+        s->requested = true;
+    }
+    if (s->pos < s->rxlen) {
+        out = s->rx[s->pos];
+    }
+    if (s->pos < sizeof(s->tx)) {
+        s->tx[s->pos] = b;
+    }
+    s->pos++;
+    return out;
+}
+
+static int esp_cosim_spi_set_cs(SSIPeripheral *dev, bool select)
+{
+    EspCosimSPIState *s = ESP_COSIM_SPI(dev);
+
+    if (!select && s->requested) {
+        esp_cosim_send(s->link, s->timeout_ms, ESP_COSIM_SPI_END, s->bus,
+                       dev->cs_index, 0, s->tx, MIN(s->pos, sizeof(s->tx)));
+    }
+    s->requested = false;
+    s->pos = s->rxlen = 0;
+    return 0;
+}
+
+static void esp_cosim_spi_realize(SSIPeripheral *dev, Error **errp)
+{
+    EspCosimSPIState *s = ESP_COSIM_SPI(dev);
+
+    s->link = esp_cosim_link_get(s->shm_path, errp);
+}
+
+static Property esp_cosim_spi_properties[] = {
+    ESP_COSIM_COMMON_PROPERTIES(EspCosimSPIState),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void esp_cosim_spi_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    SSIPeripheralClass *k = SSI_PERIPHERAL_CLASS(klass);
+
+    dc->desc = "SPI sensor served by an external simulator";
+    device_class_set_props(dc, esp_cosim_spi_properties);
+    k->realize = esp_cosim_spi_realize;
+    k->transfer = esp_cosim_spi_transfer;
+    k->set_cs = esp_cosim_spi_set_cs;
+    k->cs_polarity = SSI_CS_LOW;
+}
+
+static const TypeInfo esp_cosim_types[] = {
+    {
+        .name          = TYPE_ESP_COSIM_I2C,
+        .parent        = TYPE_I2C_SLAVE,
+        .instance_size = sizeof(EspCosimI2CState),
+        .class_init    = esp_cosim_i2c_class_init,
+    }, {
+        .name          = TYPE_ESP_COSIM_SPI,
+        .parent        = TYPE_SSI_PERIPHERAL,
+        .instance_size = sizeof(EspCosimSPIState),
+        .class_init    = esp_cosim_spi_class_init,
+    },
+};
+
+DEFINE_TYPES(esp_cosim_types)
@@ -24,27 +24,58 @@
 
 #define DEBUG(x) 
 
+// length of one tick: divcnt cycles of the 80 MHz APB clock or 1 MHz REF_TICK
+static int64_t rmt_ticks_ns(Esp32RmtState *s, int channel, uint32_t ticks) {
+    int divcnt=FIELD_EX32(s->conf0[channel],RMT_CONF0,DIV_CNT) ?: 256;
+    uint32_t clk=FIELD_EX32(s->conf1[channel],RMT_CONF1,REF_ALWAYS_ON) ?
+                 80000000 : 1000000;
+    return muldiv64((uint64_t)ticks*divcnt, NANOSECONDS_PER_SECOND, clk);
+}
+
+// the item is handed to the peripheral at once, the channel time advances
+// by its two durations so that interrupts come when the hardware's would
+static void rmt_item_out(Esp32RmtState *s, int channel, uint32_t item) {
+    Esp32RmtChannel *tx=&s->tx[channel];
+    for (int i = 0; i < 2; i++, item >>= 16) {
+        esp_signal_trace_at(s->trace, tx->time, channel, (item >> 15) & 1);
+        tx->time += rmt_ticks_ns(s, channel, item & 0x7fff);
+    }
+}
+
+static void rmt_tx_rearm(Esp32RmtChannel *tx) {
+    int64_t next=tx->thr_count ? MIN(tx->thr_time[0], tx->end_time) : tx->end_time;
+    if(next==INT64_MAX) {
+        timer_del(&tx->timer);
+    } else {
+        timer_mod_ns(&tx->timer, next);
+    }
+}
+
 // send txlim data values, stop if a value is 0
 // set the correct raw int for tx_end or tx_thr_event
 static void send_data(Esp32RmtState *s, int channel) {
-    DEBUG(printf("send %d %d %d %d\n",channel, s->txlim[channel], s->sent, s->blocks_unsent);)
+    DEBUG(printf("send %d %d %d %d\n",channel, s->txlim[channel], s->tx[channel].sent, s->tx[channel].blocks_unsent);)
     BusState *b = BUS(s->rmt);
     BusChild *ch = QTAILQ_FIRST(&b->children); 
     SSIPeripheral *slave = SSI_PERIPHERAL(ch->child);
     SSIPeripheralClass *ssc = SSI_PERIPHERAL_GET_CLASS(slave);
-    if(s->sent==0) {
-        s->end_marker=false;
-        s->start_time=qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    Esp32RmtChannel *tx=&s->tx[channel];
+    int64_t now=qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    if(tx->sent==0) {
+        tx->end_marker=false;
+        tx->time=now;
     }
-    if(s->blocks_unsent==0) return;
-    int interrupts=0;
-    while(s->blocks_unsent>0) {
+    if(tx->blocks_unsent==0) return;
+    // data that is refilled too late starts after an idle gap
+    tx->time=MAX(tx->time,now);
+    while(tx->blocks_unsent>0) {
         int memsize=FIELD_EX32(s->conf0[channel],RMT_CONF0,MEM_SIZE)*ESP32_RMT_BLOCK_SIZE;
         int divcnt=FIELD_EX32(s->conf0[channel],RMT_CONF0,DIV_CNT);
-        s->blocks_unsent--;
+        tx->blocks_unsent--;
         DEBUG(printf("divcnt %d\n",divcnt);)
         for (int i = 0; i < s->txlim[channel] ; i++) {    
-            int v=s->data[((i+s->sent)%memsize+channel*ESP32_RMT_BLOCK_SIZE) % ESP32_RMT_BUF_WORDS];
+            int v=s->data[((i+tx->sent)%memsize+channel*ESP32_RMT_BLOCK_SIZE) % ESP32_RMT_BUF_WORDS];
+            uint32_t item=v;
             // adjust periods based on the divider
             int d0=v&0x7fff;
             int d1=(v>>16)&0x7fff;
@@ -53,55 +84,68 @@ static void send_data(Esp32RmtState *s, int channel) {
             v=(v&0x80008000) | d0 | (d1<<16);
             if((v&0x7fff7fff)==0) { // stop sending when we see a zero period
                 DEBUG(printf("end send\n");)
-                s->end_marker=true;
-                timer_mod_anticipate_ns(&s->rmt_timer,s->start_time+1300*s->sent);
+                tx->end_marker=true;
+                esp_signal_trace_at(s->trace,tx->time,channel,0);
+                tx->end_time=tx->time;
+                rmt_tx_rearm(tx);
                 return;            
             }
+            rmt_item_out(s,channel,item);
             ssc->transfer(slave,v);
         }
-        s->sent+=s->txlim[channel];
-        interrupts++;
-        
-    }
-    if(interrupts>0) {
-        s->int_raw|=(1<<(channel+24));
-        if(s->int_en & (1<<(channel+24)))
-            qemu_irq_raise(s->irq);
-        // first block needs to generate 2 threashold interrupts so we schedule one for later.
-        if(interrupts>1) {
-            timer_mod_ns(&s->rmt_timer,qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)+20000000);
+        tx->sent+=s->txlim[channel];
+        // one threshold event when the block has been sent out
+        if(tx->thr_count<ESP32_RMT_THR_QUEUE) {
+            tx->thr_time[tx->thr_count++]=tx->time;
+        } else {
+            // the guest refilled faster than the items go out; the
+            // interrupt for the earlier block is lost
+            tx->thr_time[ESP32_RMT_THR_QUEUE-1]=tx->time;
+            tx->thr_overflows++;
+            qemu_log_mask(LOG_UNIMP, "%s: channel %d: %" PRIu64
+                          " threshold events merged\n", __func__, channel,
+                          tx->thr_overflows);
         }
     }
+    rmt_tx_rearm(tx);
 }
 
 static void esp32_rmt_timer_cb(void *opaque) {
-    Esp32RmtState *s = ESP32_RMT(opaque);
+    Esp32RmtChannel *tx = opaque;
+    Esp32RmtState *s = tx->rmt;
+    int channel = tx->index;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
-    if(s->end_marker) {
-        // set complete for any enabled channels 
-        for(int channel=0;channel<8;channel++) {
-            if(FIELD_EX32(s->conf1[channel],RMT_CONF1,TX_START)) {
-                s->int_raw|=(1<<(channel*3));
-                s->int_raw&=~(1<<(channel+24));
-                s->sent=0;
-                s->end_marker=false;
-                s->blocks_unsent=0;
-                s->conf1[channel] = FIELD_DP32(s->conf1[channel],RMT_CONF1,TX_START,0);
-                if(s->int_en & (1<<(channel*3))) {
-                    qemu_irq_raise(s->irq);
-                }
-            }
+    if(!FIELD_EX32(s->conf1[channel],RMT_CONF1,TX_START)) {
+        tx->thr_count=0;
+        tx->end_time=INT64_MAX;
+        return;
+    }
+    // set threshold irq for each block that is out
+    if(tx->thr_count && tx->thr_time[0]<=now) {
+        while(tx->thr_count && tx->thr_time[0]<=now) {
+            tx->thr_count--;
+            memmove(tx->thr_time,tx->thr_time+1,tx->thr_count*sizeof(tx->thr_time[0]));
         }
-    } else {
-        // set threashold irq
-        for(int channel=0;channel<4;channel++) {
-            if(FIELD_EX32(s->conf1[channel],RMT_CONF1,TX_START)) {
-                s->int_raw|=(1<<(channel+24));
-                if(s->int_en & (1<<(channel+24)))
-                    qemu_irq_raise(s->irq);
-            }
+        s->int_raw|=(1<<(channel+24));
+        if(s->int_en & (1<<(channel+24)))
+            qemu_irq_raise(s->irq);
+    }
+    // set complete once the end marker is reached
+    if(tx->end_time<=now) {
+        s->int_raw|=(1<<(channel*3));
+        s->int_raw&=~(1<<(channel+24));
+        tx->sent=0;
+        tx->end_marker=false;
+        tx->blocks_unsent=0;
+        s->conf1[channel] = FIELD_DP32(s->conf1[channel],RMT_CONF1,TX_START,0);
+        tx->thr_count=0;
+        tx->end_time=INT64_MAX;
+        if(s->int_en & (1<<(channel*3))) {
+            qemu_irq_raise(s->irq);
         }
     }
+    rmt_tx_rearm(tx);
 }
 
 static void send_unsent_data(Esp32RmtState *s) {
@@ -176,8 +220,8 @@ static void esp32_rmt_write(void *opaque, hwaddr addr,
         } else {
             s->conf1[channel]=value;
             if(FIELD_EX32(value,RMT_CONF1,MEM_RD_RESET)) {
-                s->sent=0;
-               // s->blocks_unsent=0;
+                s->tx[channel].sent=0;
+               // s->tx[channel].blocks_unsent=0;
             }
             if(FIELD_EX32(value,RMT_CONF1,TX_START)) {
                 send_data(s,channel);
@@ -209,7 +253,7 @@ static void esp32_rmt_write(void *opaque, hwaddr addr,
         channel=get_channel(s,data_addr);
         s->data[data_addr]=value;
         if(data_addr%(s->txlim[channel])==0)
-            s->blocks_unsent++;
+            s->tx[channel].blocks_unsent++;
         if(value==0)
             send_unsent_data(s);
         break;
@@ -230,11 +274,15 @@ static void esp32_rmt_reset(DeviceState *dev)
 {
     Esp32RmtState *s = ESP32_RMT(dev);
     s->int_raw=0;
-    s->sent=0;
     s->int_en=0;
     qemu_irq_lower(s->irq);
-    timer_del(&s->rmt_timer);
     for(int i=0;i<8;i++) {
+        timer_del(&s->tx[i].timer);
+        s->tx[i].thr_count=0;
+        s->tx[i].end_time=INT64_MAX;
+        s->tx[i].blocks_unsent=0;
+        s->tx[i].sent=0;
+        s->tx[i].end_marker=false;
         s->conf0[i]=0x01000002;
         s->conf1[i]=0;
         s->txlim[i]=0x20;
@@ -243,6 +291,21 @@ static void esp32_rmt_reset(DeviceState *dev)
 
 static void esp32_rmt_realize(DeviceState *dev, Error **errp)
 {
+    Esp32RmtState *s = ESP32_RMT(dev);
+
+    if (s->trace_path) {
+        EspSignalTrace *t = esp_signal_trace_new("esp32_rmt");
+        char name[8];
+
+        for (int i = 0; i < 8; i++) {
+            snprintf(name, sizeof(name), "ch%d", i);
+            esp_signal_trace_add(t, name, 1);
+        }
+        if (!esp_signal_trace_open(t, s->trace_path, errp)) {
+            return;
+        }
+        s->trace = t;
+    }
 }
 
 static void esp32_rmt_init(Object *obj)
@@ -254,12 +317,18 @@ static void esp32_rmt_init(Object *obj)
                           TYPE_ESP32_RMT, ESP32_RMT_REG_SIZE);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq);
-    timer_init_ns(&s->rmt_timer, QEMU_CLOCK_VIRTUAL, esp32_rmt_timer_cb, s);
+    for (int i = 0; i < ESP32_RMT_CHANNELS; i++) {
+        s->tx[i].rmt = s;
+        s->tx[i].index = i;
+        timer_init_ns(&s->tx[i].timer, QEMU_CLOCK_VIRTUAL, esp32_rmt_timer_cb,
+                      &s->tx[i]);
+    }
     s->rmt = ssi_create_bus(DEVICE(s), "rmt");
     esp32_rmt_reset((DeviceState *)s);
 }
 
 static Property esp32_rmt_properties[] = {
+    DEFINE_PROP_STRING("trace", Esp32RmtState, trace_path),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -19,8 +19,10 @@
 #include "hw/qdev-properties.h"
 #include "hw/ssi/ssi.h"
 #include "hw/ssi/esp32_spi.h"
+#include "hw/block/flash.h"
 #include "hw/misc/esp32_flash_enc.h"
 #include "exec/address-spaces.h"
+#include "trace.h"
 
 
 enum {
@@ -161,7 +163,9 @@ static void esp32_spi_write(void *opaque, hwaddr addr,
         s->pin_reg = value;
         break;
     case A_SPI_CMD:
+        trace_esp32_spi_cmd(value, s->addr_reg);
         esp32_spi_do_command(s, value);
+        trace_esp32_spi_cmd_done(value);
         break;
     case A_SPI_PERIPHERAL:
         s->peripheral_reg = value;  // transaction done
@@ -241,11 +245,84 @@ static void maybe_encrypt_data(Esp32SpiState *s)
     }
 }
 
+/* Typical program and erase times of the supported flash chips */
+#define FLASH_PP_NS     (700 * SCALE_US)
+#define FLASH_SE_NS     (45 * SCALE_MS)
+#define FLASH_BE_NS     (150 * SCALE_MS)
+#define FLASH_CE_NS     (8 * NANOSECONDS_PER_SECOND)
+
+static DeviceState *esp32_spi_direct_flash(Esp32SpiState *s)
+{
+    /* only when CS0 alone is selected */
+    if (!s->flash_fast_path ||
+        (s->pin_reg & ((1 << ESP32_SPI_CS_COUNT) - 1)) != 0x6) {
+        return NULL;
+    }
+    if (!s->flash) {
+        DeviceState *dev = ssi_get_cs(s->spi, 0);
+        if (!dev || !object_dynamic_cast(OBJECT(dev), TYPE_M25P80)) {
+            s->flash_fast_path = false;
+            return NULL;
+        }
+        s->flash = dev;
+    }
+    return s->flash;
+}
+
+/*
+ * READ, PP and the erase commands are served with one call into the flash
+ * model instead of clocking every byte through ssi_transfer().  Returns
+ * false if the command has to take the generic SSI path.
+ */
+static bool esp32_spi_flash_command(Esp32SpiState *s, uint32_t cmd_reg)
+{
+    DeviceState *flash = esp32_spi_direct_flash(s);
+    uint32_t addr = s->addr_reg & 0xffffff;
+    int64_t latency;
+
+    if (!flash || bitlen_to_bytes(FIELD_EX32(s->user1_reg, SPI_USER1, ADDR_BITLEN)) != 3) {
+        return false;
+    }
+    switch (cmd_reg) {
+    case R_SPI_CMD_READ_MASK:
+        m25p80_direct_read(flash, addr, s->data_reg,
+                           MIN(bitlen_to_bytes(s->miso_dlen_reg), sizeof(s->data_reg)));
+        return true;
+    case R_SPI_CMD_PP_MASK:
+        maybe_encrypt_data(s);
+        m25p80_direct_program(flash, addr, s->data_reg,
+                              MIN(s->addr_reg >> 24, sizeof(s->data_reg)));
+        latency = FLASH_PP_NS;
+        break;
+    case R_SPI_CMD_SE_MASK:
+        m25p80_direct_erase(flash, addr, CMD_SE);
+        latency = FLASH_SE_NS;
+        break;
+    case R_SPI_CMD_BE_MASK:
+        m25p80_direct_erase(flash, addr, CMD_BE);
+        latency = FLASH_BE_NS;
+        break;
+    case R_SPI_CMD_CE_MASK:
+        m25p80_direct_erase(flash, 0, CMD_CE);
+        latency = FLASH_CE_NS;
+        break;
+    default:
+        return false;
+    }
+    if (s->flash_latency) {
+        s->flash_busy_until = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + latency;
+    }
+    return true;
+}
+
 static void esp32_spi_do_command(Esp32SpiState* s, uint32_t cmd_reg)
 {
     Esp32SpiTransaction t = {
         .cmd_bytes = 1
     };
+    if (esp32_spi_flash_command(s, cmd_reg)) {
+        return;
+    }
     switch (cmd_reg) {
     case R_SPI_CMD_READ_MASK:
         t.cmd = CMD_READ;
@@ -386,6 +463,11 @@ static void esp32_spi_do_command(Esp32SpiState* s, uint32_t cmd_reg)
         return;
     }
     esp32_spi_transaction(s, &t);
+    if (t.cmd == CMD_RDSR && t.cmd_bytes && t.data_rx_bytes &&
+        qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) < s->flash_busy_until) {
+        /* write in progress */
+        *(uint8_t *)t.data |= 1;
+    }
 }
 
 
@@ -404,6 +486,7 @@ static void esp32_spi_reset_hold(Object *obj, ResetType type)
     s->user2_reg = FIELD_DP32(0, SPI_USER2, COMMAND_BITLEN, 4);
     s->user2_reg = FIELD_DP32(s->user2_reg, SPI_USER2, COMMAND_VALUE, 0);
     s->status_reg = 0;
+    s->flash_busy_until = 0;
 }
 
 static void esp32_spi_realize(DeviceState *dev, Error **errp)
@@ -427,6 +510,8 @@ static void esp32_spi_init(Object *obj)
 
 static Property esp32_spi_properties[] = {
     DEFINE_PROP_BOOL("xfer_32_bits",Esp32SpiState,xfer_32_bits,false),
+    DEFINE_PROP_BOOL("flash_fast_path",Esp32SpiState,flash_fast_path,true),
+    DEFINE_PROP_BOOL("flash_latency",Esp32SpiState,flash_latency,false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -20,6 +20,7 @@
 #include "hw/ssi/ssi.h"
 #include "hw/ssi/esp32s3_spi.h"
 #include "qemu/error-report.h"
+#include "trace.h"
 
 #define SPI1_DEBUG      0
 #define SPI1_WARNING    0
@@ -393,11 +394,13 @@ static void esp32s3_spi_write(void *opaque, hwaddr addr,
 
     switch (addr) {
         case A_SPI_MEM_CMD:
+            trace_esp32s3_spi_cmd(wvalue, s->mem_addr);
             if(wvalue & R_SPI_MEM_CMD_USR_MASK) {
                 esp32s3_spi_begin_transaction(s);
             } else {
                 esp32s3_spi_special_command(s, wvalue);
             }
+            trace_esp32s3_spi_cmd_done(wvalue);
             break;
         case A_SPI_MEM_ADDR:
             s->mem_addr = wvalue;
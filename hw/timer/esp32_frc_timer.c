@@ -46,7 +46,7 @@ static void esp32_frc_timer_update_alarm(Esp32FrcTimerState *s, uint64_t ticks_a
     uint64_t ticks_to_alarm = ticks_alarm - ticks_now;
     uint64_t ns_to_alarm = esp32_frc_timer_count_to_ns(s, ticks_to_alarm);
     trace_esp32_frc_timer_update_alarm(ns_now, ticks_now, ticks_alarm, ns_to_alarm);
-    timer_mod_anticipate_ns(&s->alarm_timer, ns_now + ns_to_alarm);
+    esp_deadline_timer_mod(&s->alarm_timer, ns_now + ns_to_alarm);
 }
 
 static void esp32_frc_timer_cb(void *opaque)
@@ -79,7 +79,7 @@ static void esp32_frc_timer_update_config(Esp32FrcTimerState *s,
     s->ns_base = ns_now;
 
     if (!enable) {
-        timer_del(&s->alarm_timer);
+        esp_deadline_timer_del(&s->alarm_timer);
     } else {
         esp32_frc_timer_update_alarm(s, s->alarm_reg, count_now, ns_now);
     }
@@ -208,7 +208,7 @@ static void esp32_frc_timer_init(Object *obj)
                         obj);
 
 
-    timer_init_ns(&s->alarm_timer, QEMU_CLOCK_VIRTUAL, esp32_frc_timer_cb, s);
+    esp_deadline_timer_init(&s->alarm_timer, esp32_frc_timer_cb, s);
 
     s->apb_freq = 80000000;
     s->count_mask = UINT32_MAX;
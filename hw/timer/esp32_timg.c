@@ -11,6 +11,8 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/main-loop.h"
 #include "qapi/error.h"
 #include "qapi/visitor.h"
 #include "hw/hw.h"
@@ -64,6 +66,8 @@ static uint64_t esp32_timg_read(void *opaque, hwaddr addr, unsigned int size)
 {
     Esp32TimgState *s = ESP32_TIMG(opaque);
     Esp32TimgTimerState *ts = NULL;
+
+    QEMU_LOCK_GUARD(&s->lock);
     if (addr <= A_TIMG_T0LOAD) {
         ts = &s->t0;
     } else if (addr <= A_TIMG_T1LOAD) {
@@ -150,10 +154,8 @@ static uint64_t esp32_timg_read(void *opaque, hwaddr addr, unsigned int size)
     return r;
 }
 
-static void esp32_timg_write(void *opaque, hwaddr addr,
-                       uint64_t value, unsigned int size)
+static void esp32_timg_do_write(Esp32TimgState *s, hwaddr addr, uint64_t value)
 {
-    Esp32TimgState *s = ESP32_TIMG(opaque);
     Esp32TimgTimerState *ts = NULL;
 //    printf("esp32_timg_write %lx %lx\n",addr,value);
     if (addr <= A_TIMG_T0LOAD) {
@@ -259,6 +261,28 @@ static void esp32_timg_write(void *opaque, hwaddr addr,
     }
 }
 
+static void esp32_timg_write(void *opaque, hwaddr addr,
+                       uint64_t value, unsigned int size)
+{
+    Esp32TimgState *s = ESP32_TIMG(opaque);
+
+    /*
+     * The guest latches a counter before every read of it, and latching
+     * only touches this device.  Other writes move timers and interrupt
+     * lines, which need the BQL.
+     */
+    if (addr == A_TIMG_T0UPDATE || addr == A_TIMG_T1UPDATE ||
+        addr == A_TIMG_LACTUPDATE) {
+        QEMU_LOCK_GUARD(&s->lock);
+        esp32_timg_do_write(s, addr, value);
+        return;
+    }
+
+    BQL_LOCK_GUARD();
+    QEMU_LOCK_GUARD(&s->lock);
+    esp32_timg_do_write(s, addr, value);
+}
+
 static const MemoryRegionOps esp32_timg_ops = {
     .read =  esp32_timg_read,
     .write = esp32_timg_write,
@@ -267,7 +291,7 @@ static const MemoryRegionOps esp32_timg_ops = {
 
 static void esp32_timg_timer_reset(Esp32TimgTimerState* ts)
 {
-    timer_del(&ts->alarm_timer);
+    esp_deadline_timer_del(&ts->alarm_timer);
     
     ts->config_reg = R_TIMG_T0CONFIG_INCREASE_MASK
         | R_TIMG_T0CONFIG_AUTORELOAD_MASK
@@ -283,7 +307,7 @@ static void esp32_timg_wdt_reset(Esp32TimgWdtState* ws)
 {
 
 //    printf("esp32_timg_wdt_reset\n");
-    timer_del(&ws->stage_timer);
+    esp_deadline_timer_del(&ws->stage_timer);
   //  Esp32TimgState *s = ws->parent;
   //  qemu_irq_lower(s->wdt_sys_reset_req);
   //  qemu_irq_lower(s->wdt_cpu_reset_req);
@@ -320,6 +344,8 @@ static void esp32_timg_wdt_reset(Esp32TimgWdtState* ws)
 static void esp32_timg_reset_hold(Object *obj, ResetType type)
 {
     Esp32TimgState *s = ESP32_TIMG(obj);
+
+    QEMU_LOCK_GUARD(&s->lock);
     s->rtc_cal_max = 1;
     s->rtc_cal_clk_sel = ESP32_TIMG_CAL_8MD256;
     s->rtc_cal_ready = 0;
@@ -337,6 +363,7 @@ static void esp32_timg_set_apb_freq(Object *obj, Visitor *v,
                                   Error **errp)
 {
     Esp32TimgState *s = ESP32_TIMG(opaque);
+    QEMU_LOCK_GUARD(&s->lock);
     visit_type_uint32(v, name, &s->apb_freq_hz, errp);
     TIMG_DEBUG_LOG("%s: TG%d apb_freq_hz=%d\n", __func__, s->id, s->apb_freq_hz);
 }
@@ -362,6 +389,8 @@ static void esp32_timg_timer_cb(void *opaque)
     Esp32TimgState *s = ts->parent;
     uint64_t ns_now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
+    QEMU_LOCK_GUARD(&s->lock);
+
     TIMG_DEBUG_LOG("%s: TG%d ns=0x%lx\n", __func__, s->id, ns_now);
     uint32_t int_mask = 1 << (ts->int_type);
 
@@ -384,7 +413,7 @@ static void esp32_timg_timer_cb(void *opaque)
         esp32_timg_timer_reload(ts, ns_now);
     } else {
         /* ignore overflow modulo 64 bits */
-        timer_del(&ts->alarm_timer);
+        esp_deadline_timer_del(&ts->alarm_timer);
     }
 }
 
@@ -467,7 +496,7 @@ static void esp32_timg_timer_update_config(Esp32TimgTimerState *ts)
 
 static void esp32_timg_timer_reload(Esp32TimgTimerState *ts, uint64_t ns_now)
 {
-    timer_del(&ts->alarm_timer);
+    esp_deadline_timer_del(&ts->alarm_timer);
 
     ts->ns_base = ns_now;
     ts->count_base = ts->load_val;
@@ -481,7 +510,7 @@ static void esp32_timg_timer_reload(Esp32TimgTimerState *ts, uint64_t ns_now)
 static void esp32_timg_timer_update_alarm(Esp32TimgTimerState *ts, uint64_t ns_now)
 {
     if (!ts->en || !ts->alarm) {
-        timer_del(&ts->alarm_timer);
+        esp_deadline_timer_del(&ts->alarm_timer);
         return;
     }
 
@@ -503,7 +532,7 @@ static void esp32_timg_timer_update_alarm(Esp32TimgTimerState *ts, uint64_t ns_n
     TIMG_DEBUG_LOG("%s: TG%d count_to_alarm=0x%lx ns_to_alarm=0x%lx\n", __func__, ts->parent->id,
                  count_to_alarm, ns_to_alarm);
 
-    timer_mod_ns(&ts->alarm_timer, ns_now + ns_to_alarm);
+    esp_deadline_timer_mod(&ts->alarm_timer, ns_now + ns_to_alarm);
 }
 
 static bool esp32_timg_wdt_protected(Esp32TimgWdtState *ws)
@@ -566,7 +595,7 @@ static void esp32_timg_wdt_feed(Esp32TimgWdtState *ws)
 
 static void esp32_timg_wdt_arm(Esp32TimgWdtState *ws, uint64_t ns_now)
 {
-    timer_del(&ws->stage_timer);
+    esp_deadline_timer_del(&ws->stage_timer);
 
     if (ws->parent->wdt_disable || !(ws->en || (ws->flashboot_en && ws->parent->flash_boot_mode))) {
         return;
@@ -578,13 +607,14 @@ static void esp32_timg_wdt_arm(Esp32TimgWdtState *ws, uint64_t ns_now)
     uint64_t ns_to_timeout = muldiv64(count_to_timeout, 1000 * ws->prescale, ws->parent->apb_freq_hz / 1000000);
     TIMG_DEBUG_LOG("%s: TG%d ns=0x%08lx stage %d count=0x%08x count_to_timeout=0x%08x ns_to_timeout=0x%08lx\n",
                    __func__, ws->parent->id, ns_now, ws->cur_stage, cur_count, count_to_timeout, ns_to_timeout);
-    timer_mod_anticipate_ns(&ws->stage_timer, ns_now + ns_to_timeout);
+    esp_deadline_timer_mod(&ws->stage_timer, ns_now + ns_to_timeout);
 }
 
 static void esp32_timg_wdt_cb(void *opaque)
 {
     Esp32TimgWdtState *ws = (Esp32TimgWdtState*) opaque;
     Esp32TimgState *s = ws->parent;
+    QEMU_LOCK_GUARD(&s->lock);
     Esp32TimgWdtStageMode mode = ws->mode[ws->cur_stage];
 //    printf("%s: TG%d stage %d timeout mode %d\n", __func__, s->id, ws->cur_stage, mode);
 
@@ -625,7 +655,7 @@ static void esp32_timg_realize(DeviceState *dev, Error **errp)
 
 static void esp32_timg_timer_init(Esp32TimgState *s, Esp32TimgTimerState *ts, Esp32TimgInterruptType int_type) {
     ts->parent = s;
-    timer_init_ns(&ts->alarm_timer, QEMU_CLOCK_VIRTUAL, esp32_timg_timer_cb, ts);
+    esp_deadline_timer_init(&ts->alarm_timer, esp32_timg_timer_cb, ts);
     ts->int_type = int_type;
 }
 
@@ -636,6 +666,8 @@ static void esp32_timg_init(Object *obj)
 
     memory_region_init_io(&s->iomem, obj, &esp32_timg_ops, s,
                           TYPE_ESP32_TIMG, TIMG_REGFILE_SIZE);
+    memory_region_enable_lockless_io(&s->iomem);
+    qemu_mutex_init(&s->lock);
     sysbus_init_mmio(sbd, &s->iomem);
     qdev_init_gpio_out_named(DEVICE(sbd), s->irqs, SYSBUS_DEVICE_GPIO_IRQ, 2*TIMG_INT_MAX);
 
@@ -654,7 +686,7 @@ static void esp32_timg_init(Object *obj)
     esp32_timg_timer_init(s, &s->lact, TIMG_LACT_INT);
 
     s->wdt.parent = s;
-    timer_init_ns(&s->wdt.stage_timer, QEMU_CLOCK_VIRTUAL, esp32_timg_wdt_cb, &s->wdt);
+    esp_deadline_timer_init(&s->wdt.stage_timer, esp32_timg_wdt_cb, &s->wdt);
     qdev_init_gpio_out_named(DEVICE(sbd), &s->wdt_cpu_reset_req, ESP32_TIMG_WDT_CPU_RESET_GPIO, 1);
     qdev_init_gpio_out_named(DEVICE(sbd), &s->wdt_sys_reset_req, ESP32_TIMG_WDT_SYS_RESET_GPIO, 1);
 }
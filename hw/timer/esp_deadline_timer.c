@@ -0,0 +1,58 @@
+/*
+ * Deadline timers for ESP timer peripherals
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "hw/timer/esp_deadline_timer.h"
+#include "trace.h"
+
+static void esp_deadline_timer_cb(void *opaque)
+{
+    EspDeadlineTimer *t = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    if (t->deadline < 0) {
+        return;
+    }
+    if (now < t->deadline) {
+        /* the deadline moved out since the timer was armed */
+        trace_esp_deadline_timer_defer(t, t->deadline - now);
+        timer_mod_ns(&t->timer, t->deadline);
+        return;
+    }
+    t->deadline = -1;
+    t->cb(t->opaque);
+}
+
+void esp_deadline_timer_init(EspDeadlineTimer *t, QEMUTimerCB *cb,
+                             void *opaque)
+{
+    timer_init_ns(&t->timer, QEMU_CLOCK_VIRTUAL, esp_deadline_timer_cb, t);
+    t->deadline = -1;
+    t->cb = cb;
+    t->opaque = opaque;
+}
+
+void esp_deadline_timer_mod(EspDeadlineTimer *t, int64_t deadline_ns)
+{
+    t->deadline = MAX(deadline_ns, 0);
+    /* a wakeup at or before the deadline will find it and move on */
+    if (timer_pending(&t->timer) &&
+        timer_expire_time_ns(&t->timer) <= t->deadline) {
+        return;
+    }
+    timer_mod_ns(&t->timer, t->deadline);
+}
+
+void esp_deadline_timer_del(EspDeadlineTimer *t)
+{
+    /*
+     * Leave the timer armed: the guest usually sets a new deadline right
+     * away (reload, feed) and then needs no timer operation at all.
+     */
+    t->deadline = -1;
+}
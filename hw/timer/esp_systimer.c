@@ -11,6 +11,8 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/main-loop.h"
 #include "qapi/error.h"
 #include "qapi/visitor.h"
 #include "hw/hw.h"
@@ -92,7 +94,7 @@ static void esp_systimer_notify(ESPSysTimerComp* comparator)
         }
 
         comparator->expire_time = adjusted_target_ns;
-        timer_mod_ns(&comparator->qtimer, adjusted_target_ns);
+        esp_deadline_timer_mod(&comparator->qtimer, adjusted_target_ns);
     }
 }
 
@@ -116,7 +118,7 @@ static void esp_systimer_comparator_reprogram(ESPSysTimerComp* comparator)
     /* If the counter we have to compare it to is not enabled, do not program any timer */
     if (!counter->enabled) {
         /* "Disable" the timer */
-        timer_del(&comparator->qtimer);
+        esp_deadline_timer_del(&comparator->qtimer);
         return;
     }
 
@@ -130,7 +132,7 @@ static void esp_systimer_comparator_reprogram(ESPSysTimerComp* comparator)
     const bool overflow_valid = alarm < count_val && count_val - alarm >= ((1ULL << 51) - 1);
 
     if (!comparator->period_mode && !overflow_valid && alarm <= count_val) {
-        timer_del(&comparator->qtimer);
+        esp_deadline_timer_del(&comparator->qtimer);
         esp_systimer_notify(comparator);
         return;
     }
@@ -150,11 +152,14 @@ static void esp_systimer_comparator_reprogram(ESPSysTimerComp* comparator)
     const int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
     const int64_t target_ns = now + TICKS_TO_NS(diff);
     comparator->expire_time = target_ns;
-    timer_mod_ns(&comparator->qtimer, target_ns);
+    esp_deadline_timer_mod(&comparator->qtimer, target_ns);
 }
 
 
 static void esp_systimer_comparator_reprogram_all(ESPSysTimerState* s) {
+    BQL_LOCK_GUARD();
+    QEMU_LOCK_GUARD(&s->lock);
+
     /* If one of the comparator is enabled and depends on the current timer, reprogram it */
     for (int i = 0; i < ESP_SYSTIMER_COMP_COUNT; i++) {
         if (s->comparators[i].enabled) {
@@ -178,6 +183,7 @@ static uint64_t esp_systimer_read(void *opaque, hwaddr addr, unsigned int size)
     ESPSysTimerState *s = ESP_SYSTIMER(opaque);
     uint64_t r = 0;
 
+    QEMU_LOCK_GUARD(&s->lock);
     switch (addr) {
         case A_SYSTIMER_CONF:
             r = s->conf;
@@ -418,7 +424,7 @@ static void esp_systimer_conf_set(ESPSysTimerState *s, uint64_t value)
         if (s->comparators[i].enabled) {
             esp_systimer_comparator_reprogram(&s->comparators[i]);
         } else {
-            timer_del(&s->comparators[i].qtimer);
+            esp_deadline_timer_del(&s->comparators[i].qtimer);
         }
     }
 
@@ -427,12 +433,9 @@ static void esp_systimer_conf_set(ESPSysTimerState *s, uint64_t value)
 }
 
 
-static void esp_systimer_write(void *opaque, hwaddr addr,
-                                   uint64_t value, unsigned int size)
+static void esp_systimer_do_write(ESPSysTimerState *s, hwaddr addr,
+                                  uint64_t value)
 {
-    ESPSysTimerState *s = ESP_SYSTIMER(opaque);
-    (void) s;
-
     switch(addr) {
         case A_SYSTIMER_CONF:
             esp_systimer_conf_set(s, value);
@@ -553,9 +556,33 @@ static void esp_systimer_write(void *opaque, hwaddr addr,
 }
 
 
+static void esp_systimer_write(void *opaque, hwaddr addr,
+                                   uint64_t value, unsigned int size)
+{
+    ESPSysTimerState *s = ESP_SYSTIMER(opaque);
+
+    /*
+     * esp_timer requests a counter snapshot before every read of it.  That
+     * only touches the counter, so it doesn't need the BQL; the rest may
+     * move comparator timers and interrupt lines.
+     */
+    if (addr == A_SYSTIMER_UNIT0_OP || addr == A_SYSTIMER_UNIT1_OP) {
+        QEMU_LOCK_GUARD(&s->lock);
+        esp_systimer_do_write(s, addr, value);
+        return;
+    }
+
+    BQL_LOCK_GUARD();
+    QEMU_LOCK_GUARD(&s->lock);
+    esp_systimer_do_write(s, addr, value);
+}
+
+
 static void esp_systimer_cb(void* opaque)
 {
     ESPSysTimerComp* comparator = (ESPSysTimerComp*) opaque;
+
+    QEMU_LOCK_GUARD(&comparator->systimer->lock);
     esp_systimer_notify(comparator);
 }
 
@@ -576,14 +603,16 @@ static void esp_systimer_default_conf(ESPSysTimerState *s)
 static void esp_systimer_reset_hold(Object *obj, ResetType type)
 {
     ESPSysTimerState *s = ESP_SYSTIMER(obj);
+
+    QEMU_LOCK_GUARD(&s->lock);
     for (int i = 0; i < ESP_SYSTIMER_COMP_COUNT; i++) {
         ESPSysTimerComp* comp = &s->comparators[i];
-        QEMUTimer qtimer = comp->qtimer;
         qemu_irq irq = comp->irq;
 
         /* Disable all the timers/irq first */
-        timer_del(&comp->qtimer);
+        esp_deadline_timer_del(&comp->qtimer);
         qemu_irq_lower(comp->irq);
+        EspDeadlineTimer qtimer = comp->qtimer;
 
         /* Reset the data of the comparator */
         memset(comp, 0, sizeof(ESPSysTimerComp));
@@ -610,12 +639,14 @@ static void esp_systimer_init(Object *obj)
 
     memory_region_init_io(&s->iomem, obj, &class->systimer_ops, s,
                           TYPE_ESP_SYSTIMER, ESP_SYSTIMER_IO_SIZE);
+    memory_region_enable_lockless_io(&s->iomem);
+    qemu_mutex_init(&s->lock);
     sysbus_init_mmio(sbd, &s->iomem);
 
     for (uint64_t i = 0; i < ESP_SYSTIMER_COMP_COUNT; i++) {
         s->comparators[i].systimer = s;
         sysbus_init_irq(sbd, &s->comparators[i].irq);
-        timer_init_ns(&s->comparators[i].qtimer, QEMU_CLOCK_VIRTUAL, esp_systimer_cb, &s->comparators[i]);
+        esp_deadline_timer_init(&s->comparators[i].qtimer, esp_systimer_cb, &s->comparators[i]);
     }
     esp_systimer_default_conf(s);
 }
@@ -53,7 +53,7 @@ static int64_t esp_virtual_counter_update(ESPVirtualCounter *counter)
     return counter->value;
 }
 
-static inline QEMUTimer* esp_virtual_counter_get_timer(ESPVirtualCounter *counter)
+static inline EspDeadlineTimer* esp_virtual_counter_get_timer(ESPVirtualCounter *counter)
 {
     return &counter->timer;
 }
@@ -65,7 +65,7 @@ static void esp_virtual_counter_alarm_in_ticks(ESPVirtualCounter *counter, int64
     /* This function will reschedule the clock if it was already scheduled */
     counter->base = now;
     counter->value = 0;
-    timer_mod_ns(&counter->timer, now + delay_ns);
+    esp_deadline_timer_mod(&counter->timer, now + delay_ns);
 }
 
 /**
@@ -80,7 +80,7 @@ static void esp_virtual_counter_reenabled(ESPVirtualCounter *counter)
 
 static void esp_virtual_counter_reset(ESPVirtualCounter* counter)
 {
-    timer_del(&counter->timer);
+    esp_deadline_timer_del(&counter->timer);
     counter->base = 0;
     counter->value = 0;
     counter->frequency = ESP_APB_CLK; // Hz
@@ -234,7 +234,7 @@ static void esp_wdt_update_stage(ESPWdtState* wdt, int index, uint32_t value, bo
              * stage is smaller than the current value. It will be restarted (not resumed) when fed.
              * Just like the real hardware, keep the "enable" bit to 1, moreover it is required for feeding.
              */
-            timer_del(&wdt->counter.timer);
+            esp_deadline_timer_del(&wdt->counter.timer);
         } else {
             /* The new alarm is set to happen in `diff` ticks, reschedule the alarm */
             esp_virtual_counter_alarm_in_ticks(&wdt->counter, diff);
@@ -294,7 +294,7 @@ static void esp_wdt_update_config(ESPWdtState* wdt, uint32_t value)
         } else {
             wdt->config0 &= ~R_TIMG_WDTCONFIG0_EN_MASK;
             /* Disable the timer! */
-            timer_del(&wdt->counter.timer);
+            esp_deadline_timer_del(&wdt->counter.timer);
         }
     }
 }
@@ -321,7 +321,7 @@ static void esp_t0_cb(void* opaque)
     ESPT0State* t = (ESPT0State*) opaque;
 
     /* Disable the alarm timer */
-    timer_del(&t->counter.timer);
+    esp_deadline_timer_del(&t->counter.timer);
     esp_virtual_counter_reenabled(&t->counter);
 
     /* In practice, the counter is bigger than the requested value, this is due to the fact
@@ -442,7 +442,7 @@ static void esp_t0_config_update(ESPT0State* t0, uint32_t value)
         if (value & R_TIMG_T0CONFIG_ALARM_EN_MASK) {
             esp_t0_alarm_update(t0);
         } else {
-            timer_del(&t0->counter.timer);
+            esp_deadline_timer_del(&t0->counter.timer);
         }
     }
 
@@ -462,7 +462,7 @@ static void esp_t0_config_update(ESPT0State* t0, uint32_t value)
         } else {
             /* In theory, we should update the counter before disabling its timer, but in practice, we
              * already did that at the beginning of this function. Thus, the base time is correct. */
-            timer_del(&t0->counter.timer);
+            esp_deadline_timer_del(&t0->counter.timer);
         }
     }
 }
@@ -806,16 +806,16 @@ static void esp_timg_init(Object *obj)
     s->wdt.wkey = ESP_WDT_DEFAULT_WKEY;
     qdev_init_gpio_out_named(DEVICE(sbd), &s->wdt.reset_irq, ESP_WDT_IRQ_RESET, 1);
     qdev_init_gpio_out_named(DEVICE(sbd), &s->wdt.interrupt_irq, ESP_WDT_IRQ_INTERRUPT, 1);
-    timer_init_ns(esp_virtual_counter_get_timer(&s->wdt.counter), QEMU_CLOCK_VIRTUAL, esp_wdt_cb, &s->wdt);
+    esp_deadline_timer_init(esp_virtual_counter_get_timer(&s->wdt.counter), esp_wdt_cb, &s->wdt);
 
     /* Timer T0 initialization */
     qdev_init_gpio_out_named(DEVICE(sbd), &s->t0.interrupt_irq, ESP_T0_IRQ_INTERRUPT, 1);
-    timer_init_ns(esp_virtual_counter_get_timer(&s->t0.counter), QEMU_CLOCK_VIRTUAL, esp_t0_cb, &s->t0);
+    esp_deadline_timer_init(esp_virtual_counter_get_timer(&s->t0.counter), esp_t0_cb, &s->t0);
 
     /* Only initialize the timer T1 interrupt if the target supports it */
     if (klass->m_has_t1) {
         qdev_init_gpio_out_named(DEVICE(sbd), &s->t1.interrupt_irq, ESP_T1_IRQ_INTERRUPT, 1);
-        timer_init_ns(esp_virtual_counter_get_timer(&s->t1.counter), QEMU_CLOCK_VIRTUAL, esp_t0_cb, &s->t1);
+        esp_deadline_timer_init(esp_virtual_counter_get_timer(&s->t1.counter), esp_t0_cb, &s->t1);
     }
 
     /* Set the initial values for the internal fields */
@@ -28,7 +28,10 @@
 #include "hw/misc/ssi_psram.h"
 #include "hw/sd/dwc_sdmmc.h"
 #include "hw/misc/servo.h"
+#include "hw/misc/esp_rom.h"
+#include "hw/sensor/esp_cosim.h"
 #include "core-esp32/core-isa.h"
+#include "qemu/cutils.h"
 #include "qemu/datadir.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/reset.h"
@@ -317,6 +320,11 @@ static void esp32_soc_add_unimp_device(MemoryRegion *dest, const char* name, hwa
     g_free(name_apb);
 }
 
+static CPUState *esp32_crosscore_route(void *opaque, int n)
+{
+    return esp32_intmatrix_source_cpu(opaque, ETS_FROM_CPU_INTR0_SOURCE + n);
+}
+
 /*
 static void split_irq_from_named(DeviceState *src, const char* outname, int n,
                                  qemu_irq out1, qemu_irq out2) {
@@ -468,6 +476,8 @@ static void esp32_soc_realize(DeviceState *dev, Error **errp)
         assert(target);
         sysbus_connect_irq(SYS_BUS_DEVICE(&s->crosscore_int), index, target);
     }
+    esp32_crosscore_int_set_route(&s->crosscore_int, esp32_crosscore_route,
+                                  &s->intmatrix);
 
     qdev_realize(DEVICE(&s->rsa), &s->periph_bus, &error_fatal);
     esp32_soc_add_periph_device(sys_mem, &s->rsa, DR_REG_RSA_BASE);
@@ -885,6 +895,9 @@ struct Esp32MachineState {
 
     Esp32SocState esp32;
     DeviceState *flash_dev;
+    char *cosim_shm;
+    char *cosim_i2c;
+    char *cosim_spi;
 };
 #define TYPE_ESP32_MACHINE MACHINE_TYPE_NAME("esp32")
 
@@ -946,6 +959,63 @@ static void esp32_machine_init_i2c(Esp32SocState *s)
     i2c_slave_create_simple(i2c_bus, "mpu6050", 0x68);
 }
 
+/* Sensors served by an external simulator, see hw/sensor/esp_cosim.c.
+ * cosim-i2c lists 7-bit addresses on I2C0, cosim-spi lists HOST.CS pairs
+ * on SPI2/SPI3, both separated by colons.
+ */
+static void esp32_machine_init_cosim(Esp32MachineState *ms)
+{
+    Esp32SocState *ss = &ms->esp32;
+    g_auto(GStrv) i2c = NULL, spi = NULL;
+
+    if (!ms->cosim_i2c && !ms->cosim_spi) {
+        return;
+    }
+    if (!ms->cosim_shm) {
+        error_report("esp32: cosim-i2c and cosim-spi need cosim-shm");
+        exit(1);
+    }
+
+    i2c = g_strsplit(ms->cosim_i2c ?: "", ":", -1);
+    for (char **p = i2c; *p && **p; p++) {
+        I2CBus *bus = I2C_BUS(qdev_get_child_bus(DEVICE(&ss->i2c[0]), "i2c"));
+        unsigned int addr;
+        I2CSlave *dev;
+
+        if (qemu_strtoui(*p, NULL, 0, &addr) < 0 || addr > 0x7f) {
+            error_report("esp32: invalid cosim-i2c address '%s'", *p);
+            exit(1);
+        }
+        dev = i2c_slave_new(TYPE_ESP_COSIM_I2C, addr);
+        qdev_prop_set_string(DEVICE(dev), "shm", ms->cosim_shm);
+        qdev_prop_set_uint8(DEVICE(dev), "bus", 0);
+        i2c_slave_realize_and_unref(dev, bus, &error_fatal);
+    }
+
+    spi = g_strsplit(ms->cosim_spi ?: "", ":", -1);
+    for (char **p = spi; *p && **p; p++) {
+        unsigned int host, cs;
+        const char *end;
+        DeviceState *dev;
+
+        if (qemu_strtoui(*p, &end, 10, &host) < 0 || *end != '.' ||
+            qemu_strtoui(end + 1, NULL, 10, &cs) < 0 ||
+            host < 2 || host > 3 || cs >= ESP32_SPI_CS_COUNT) {
+            error_report("esp32: invalid cosim-spi device '%s'", *p);
+            exit(1);
+        }
+        dev = qdev_new(TYPE_ESP_COSIM_SPI);
+        qdev_prop_set_string(dev, "shm", ms->cosim_shm);
+        qdev_prop_set_uint8(dev, "bus", host);
+        qdev_prop_set_uint8(dev, "cs", cs);
+        qdev_realize_and_unref(dev, BUS(ss->spi[host].spi), &error_fatal);
+        qdev_connect_gpio_out_named(DEVICE(&ss->spi[host]), SSI_GPIO_CS, cs,
+                                    qdev_get_gpio_in_named(dev, SSI_GPIO_CS, 0));
+        /* the display shortcut sends 32-bit words without chip select */
+        ss->spi[host].xfer_32_bits = false;
+    }
+}
+
 static void esp32_machine_init_openeth(Esp32SocState *ss)
 {
     SysBusDevice *sbd;
@@ -1030,6 +1100,8 @@ static void esp32_machine_init(MachineState *machine)
 
     esp32_machine_init_i2c(ss);
 
+    esp32_machine_init_cosim(ms);
+
     esp32_machine_init_openeth(ss);
 
     esp32_machine_init_sd(ss);
@@ -1087,7 +1159,7 @@ static void esp32_machine_init(MachineState *machine)
             exit(1);
         }
 
-        int size = load_image_targphys_as(rom_binary, esp32_memmap[ESP32_MEMREGION_IROM].base, esp32_memmap[ESP32_MEMREGION_IROM].size, CPU(&ss->cpu[0])->as);
+        int size = esp_rom_map_image_as(rom_binary, esp32_memmap[ESP32_MEMREGION_IROM].base, esp32_memmap[ESP32_MEMREGION_IROM].size, CPU(&ss->cpu[0])->as);
         if (size < 0) {
             error_report("Error: could not load ROM binary '%s'", rom_binary);
             exit(1);
@@ -1100,7 +1172,7 @@ static void esp32_machine_init(MachineState *machine)
             exit(1);
         }
 
-        size = load_image_targphys_as(rom_binary, esp32_memmap[ESP32_MEMREGION_IROM].base, esp32_memmap[ESP32_MEMREGION_IROM].size, CPU(&ss->cpu[1])->as);
+        size = esp_rom_map_image_as(rom_binary, esp32_memmap[ESP32_MEMREGION_IROM].base, esp32_memmap[ESP32_MEMREGION_IROM].size, CPU(&ss->cpu[1])->as);
         if (size < 0) {
             error_report("Error: could not load ROM binary '%s'", rom_binary);
             exit(1);
@@ -1126,6 +1198,23 @@ static ram_addr_t esp32_fixup_ram_size(ram_addr_t requested_size)
     return size;
 }
 
+#define ESP32_MACHINE_STR_PROP(field)                                     \
+static char *esp32_machine_get_##field(Object *obj, Error **errp)         \
+{                                                                         \
+    return g_strdup(ESP32_MACHINE(obj)->field);                           \
+}                                                                         \
+static void esp32_machine_set_##field(Object *obj, const char *value,     \
+                                      Error **errp)                       \
+{                                                                         \
+    Esp32MachineState *ms = ESP32_MACHINE(obj);                           \
+    g_free(ms->field);                                                    \
+    ms->field = g_strdup(value);                                          \
+}
+
+ESP32_MACHINE_STR_PROP(cosim_shm)
+ESP32_MACHINE_STR_PROP(cosim_i2c)
+ESP32_MACHINE_STR_PROP(cosim_spi)
+
 /* Initialize machine type */
 static void esp32_machine_class_init(ObjectClass *oc, void *data)
 {
@@ -1137,6 +1226,19 @@ static void esp32_machine_class_init(ObjectClass *oc, void *data)
     mc->default_cpus = 2;
     mc->default_ram_size = 0;
     mc->fixup_ram_size = esp32_fixup_ram_size;
+
+    object_class_property_add_str(oc, "cosim-shm", esp32_machine_get_cosim_shm,
+                                  esp32_machine_set_cosim_shm);
+    object_class_property_set_description(oc, "cosim-shm",
+        "Shared-memory file of the sensor simulator");
+    object_class_property_add_str(oc, "cosim-i2c", esp32_machine_get_cosim_i2c,
+                                  esp32_machine_set_cosim_i2c);
+    object_class_property_set_description(oc, "cosim-i2c",
+        "I2C0 addresses served by the simulator, e.g. 0x40:0x76");
+    object_class_property_add_str(oc, "cosim-spi", esp32_machine_get_cosim_spi,
+                                  esp32_machine_set_cosim_spi);
+    object_class_property_set_description(oc, "cosim-spi",
+        "SPI host.cs pairs served by the simulator, e.g. 3.1");
 }
 
 static const TypeInfo esp32_info = {
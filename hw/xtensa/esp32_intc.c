@@ -17,6 +17,7 @@
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
 #include "hw/xtensa/esp32_intc.h"
+#include "trace.h"
 
 #define INTMATRIX_UNINT_VALUE   6
 
@@ -31,15 +32,25 @@ static void esp32_intmatrix_irq_handler(void *opaque, int n, int level)
         if (s->outputs[i] == NULL) {
             continue;
         }
-        int out_index = IRQ_MAP(i, n);
-        for (int int_index = 0; int_index < s->cpu[i]->env.config->nextint; ++int_index) {
-            if (s->cpu[i]->env.config->extint[int_index] == out_index) {
- //               printf("esp32_intmatrix_irq_handler %x %x %x\n",n,out_index,level);
-                qemu_set_irq(s->outputs[i][int_index], level);
-                break;
-            }
+        int int_index = s->extint_index[i][IRQ_MAP(i, n)];
+        if (int_index >= 0) {
+            trace_esp32_intmatrix_irq(i, n, int_index, level);
+            qemu_set_irq(s->outputs[i][int_index], level);
+        }
+    }
+}
+
+CPUState *esp32_intmatrix_source_cpu(Esp32IntMatrixState *s, int source)
+{
+    for (int i = 0; i < ESP32_CPU_COUNT; ++i) {
+        if (s->outputs[i] == NULL) {
+            continue;
+        }
+        if (s->extint_index[i][qatomic_read(&IRQ_MAP(i, source))] >= 0) {
+            return CPU(s->cpu[i]);
         }
     }
+    return NULL;
 }
 
 static inline uint8_t *get_map_entry(Esp32IntMatrixState *s, hwaddr addr) {
@@ -72,7 +83,7 @@ static void esp32_intmatrix_write(void *opaque, hwaddr addr, uint64_t value,
         s->irq_raw[source_index] = si;
     }
     if (map_entry != NULL) {
-        *map_entry = value & 0x1f;
+        qatomic_set(map_entry, value & 0x1f);
     }
     if (value != INTMATRIX_UNINT_VALUE && s->irq_raw[source_index]) {
         esp32_intmatrix_irq_handler(s, source_index, 1);
@@ -104,9 +115,17 @@ static void esp32_intmatrix_reset_hold(Object *dev, ResetType type) {
 static void esp32_intmatrix_realize(DeviceState *dev, Error **errp) {
     Esp32IntMatrixState *s = ESP32_INTMATRIX(dev);
 
+    memset(s->extint_index, -1, sizeof(s->extint_index));
     for (int i = 0; i < ESP32_CPU_COUNT; ++i) {
         if (s->cpu[i]) {
+            const XtensaConfig *config = s->cpu[i]->env.config;
+
             s->outputs[i] = xtensa_get_extints(&s->cpu[i]->env);
+            /* Backwards, so the first line wins if two share a number */
+            for (int int_index = config->nextint - 1; int_index >= 0;
+                 --int_index) {
+                s->extint_index[i][config->extint[int_index]] = int_index;
+            }
         }
     }
     esp32_intmatrix_reset_hold(OBJECT(dev), RESET_TYPE_COLD);
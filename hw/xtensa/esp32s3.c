@@ -12,6 +12,7 @@
 #include "qemu/log.h"
 #include "qemu/error-report.h"
 #include "qemu/units.h"
+#include "qemu/guest-random.h"
 #include "qapi/error.h"
 #include "qemu/memalign.h"
 #include "hw/hw.h"
@@ -83,6 +84,7 @@
 #include "cpu_esp32s3.h"
 
 #include "hw/misc/esp32c3_jtag.h"
+#include "hw/misc/esp_rom.h"
 
 #include "hw/xtensa/ulp_cpu.h"
 //#include "hw/display/esp_rgb.h"
@@ -589,13 +591,10 @@ static uint64_t esp32s3_io_read(void *opaque, hwaddr addr, unsigned int size)
         // Return "QEMU" as a 32-bit value 
         return 0x51454d55;
     } else if (addr + ESP32S3_IO_START_ADDR == DR_REG_SYSCON_BASE + A_SYSCON_RND_DATA_REG) {
-        // Return a random 32-bit value 
-        static bool init = false;
-        if (!init) {
-            srand(time(NULL));
-            init = true;
-        }
-        return rand();
+        // Return a random 32-bit value, replayable like the RNG device
+        uint32_t value;
+        qemu_guest_getrandom_nofail(&value, sizeof(value));
+        return value;
     } else if (addr + ESP32S3_IO_START_ADDR == DR_REG_ASSIST_DEBUG_BASE + A_ASSIST_DEBUG_CORE_0_DEBUG_MODE_REG) {
         return 0;
     } else {
@@ -1244,7 +1243,7 @@ static void esp32s3_machine_init(MachineState *machine)
             exit(1);
         }
 
-        int size = load_image_targphys_as(rom_binary, esp32s3_memmap[ESP32S3_MEMREGION_IROM].base, esp32s3_memmap[ESP32S3_MEMREGION_IROM].size, CPU(&ss->cpu[0])->as);
+        int size = esp_rom_map_image_as(rom_binary, esp32s3_memmap[ESP32S3_MEMREGION_IROM].base, esp32s3_memmap[ESP32S3_MEMREGION_IROM].size, CPU(&ss->cpu[0])->as);
         if (size < 0) {
             error_report("Error: could not load ROM binary '%s'", rom_binary);
             exit(1);
@@ -1259,7 +1258,7 @@ static void esp32s3_machine_init(MachineState *machine)
                 exit(1);
             }
 
-            size = load_image_targphys_as(rom_binary, esp32s3_memmap[ESP32S3_MEMREGION_IROM].base, esp32s3_memmap[ESP32S3_MEMREGION_IROM].size, CPU(&ss->cpu[1])->as);
+            size = esp_rom_map_image_as(rom_binary, esp32s3_memmap[ESP32S3_MEMREGION_IROM].base, esp32s3_memmap[ESP32S3_MEMREGION_IROM].size, CPU(&ss->cpu[1])->as);
             if (size < 0) {
                 error_report("Error: could not load ROM binary '%s'", rom_binary);
                 exit(1);
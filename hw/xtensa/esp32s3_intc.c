@@ -18,6 +18,7 @@
 #include "hw/qdev-properties.h"
 #include "hw/misc/esp32s3_reg.h"
 #include "hw/xtensa/esp32s3_intc.h"
+#include "trace.h"
 
 #define INTMATRIX_UNINT_VALUE   6
 
@@ -37,6 +38,7 @@ static void esp32s3_intmatrix_irq_handler(void *opaque, int n, int level)
         int out_index = IRQ_MAP(i, n);
         for (int int_index = 0; int_index < s->cpu[i]->env.config->nextint; ++int_index) {
             if (s->cpu[i]->env.config->extint[int_index] == out_index) {
+                trace_esp32s3_intmatrix_irq(i, n, int_index, level);
                 qemu_set_irq(s->outputs[i][int_index], level);
                 break;
             }
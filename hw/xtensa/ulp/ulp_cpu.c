@@ -352,7 +352,7 @@ static void start_timer(ULPCPUState *env) {
     else v64=((int64_t)val*1e6)/150;
     if(DEBUG)
         printf("Timer restart in %dns\n",(int)v64);                    
-    timer_mod(&env->ulp_timer,qemu_clock_get_ns(QEMU_CLOCK_REALTIME)+v64);
+    timer_mod(&env->ulp_timer,qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT)+v64);
 }
 
 static void ulp_timer_cb(void *v) {
@@ -413,7 +413,8 @@ static void ulp_cpu_realize(DeviceState *dev, Error **errp)
     qdev_init_gpio_in_named(dev, ulp_timer_start, ULP_TIMER_GPIO, 1);
     qdev_init_gpio_out_named(dev, &s->rtc_wakeup, ULP_WAKEUP_GPIO, 1);
     qdev_init_gpio_in_named(dev, set_ulp_pc, ULP_SET_PC_GPIO, 1);
-    timer_init_ns(&s->ulp_timer, QEMU_CLOCK_REALTIME, ulp_timer_cb,
+    // keeps running while the main CPUs sleep, and is replay-checkpointed
+    timer_init_ns(&s->ulp_timer, QEMU_CLOCK_VIRTUAL_RT, ulp_timer_cb,
                       (void *)cs);
 //    cpu_reset(cs);
 }
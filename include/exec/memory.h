@@ -799,6 +799,9 @@ struct MemoryRegion {
 
     /* For devices designed to perform re-entrant IO into their own IO MRs */
     bool disable_reentrancy_guard;
+
+    /* Accessors do their own locking; dispatch without the BQL */
+    bool lockless_io;
 };
 
 struct IOMMUMemoryRegion {
@@ -2244,6 +2247,21 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_enable_lockless_io: Dispatch accesses without the BQL.
+ *
+ * Accesses from vCPU threads are normally dispatched with the Big QEMU Lock
+ * held.  Devices whose accessors protect their own state, with a private
+ * lock or with atomics, can opt out so that vCPUs touching them under MTTCG
+ * do not serialize on the BQL.  The accessors may then run concurrently on
+ * several threads, so the per-device re-entrancy guard is disabled too.
+ * Anything the accessors call that still needs the BQL (qemu_set_irq(),
+ * timers, the rest of the device) must take it explicitly.
+ *
+ * @mr: the memory region to be updated.
+ */
+void memory_region_enable_lockless_io(MemoryRegion *mr);
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
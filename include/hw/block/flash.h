@@ -66,6 +66,19 @@ uint32_t nand_getbuswidth(DeviceState *dev);
 
 #define TYPE_M25P80 "m25p80-generic"
 
+/* Range of the flash passed to write notifiers after a program or erase */
+typedef struct M25P80WriteRange {
+    uint32_t addr;
+    uint32_t len;
+} M25P80WriteRange;
+
 BlockBackend *m25p80_get_blk(DeviceState *dev);
+DeviceState *m25p80_find_by_blk(BlockBackend *blk);
+void m25p80_add_write_notifier(DeviceState *dev, Notifier *notifier);
+void m25p80_direct_read(DeviceState *dev, uint32_t addr, void *buf,
+                        uint32_t len);
+void m25p80_direct_program(DeviceState *dev, uint32_t addr, const void *buf,
+                           uint32_t len);
+void m25p80_direct_erase(DeviceState *dev, uint32_t addr, uint8_t cmd);
 
 #endif
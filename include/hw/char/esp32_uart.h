@@ -1,6 +1,7 @@
 #pragma once
 
 #include "qemu/fifo8.h"
+#include "qemu/thread.h"
 #include "hw/sysbus.h"
 #include "chardev/char-fe.h"
 #include "hw/hw.h"
@@ -81,6 +82,13 @@ typedef struct ESPUARTState {
     SysBusDevice parent_obj;
 
     MemoryRegion iomem;
+    /*
+     * Register reads other than the RX FIFO run without the BQL and only
+     * take this lock; everything that changes the state below holds the
+     * BQL and then this lock.  Recursive, because the chardev may call
+     * back into the device while a register access holds it.
+     */
+    QemuRecMutex lock;
     CharBackend chr;
     qemu_irq irq;
     QEMUTimer throttle_timer;
@@ -108,7 +116,11 @@ typedef struct ESPUARTState {
 typedef struct ESPUARTClass {
     SysBusDeviceClass parent_class;
 
-    /* Virtual attributes/methods */
+    /*
+     * Virtual attributes/methods, called with the lock held.  Writes and
+     * RX FIFO reads also hold the BQL; other reads run without it, so
+     * uart_read must not touch anything the BQL protects for those.
+     */
     void (*uart_write)(void *opaque, hwaddr addr, uint64_t value, unsigned int size);
     uint64_t (*uart_read)(void *opaque, hwaddr addr, unsigned int size);
 } ESP32UARTClass;
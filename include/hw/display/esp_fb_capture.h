@@ -0,0 +1,38 @@
+/*
+ * Headless frame capture for ESP display models
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#pragma once
+
+typedef struct EspFbCapture EspFbCapture;
+
+typedef enum EspFbFormat {
+    ESP_FB_RGB565,      /* host-endian uint16_t */
+    ESP_FB_XRGB8888,    /* host-endian uint32_t */
+} EspFbFormat;
+
+/*
+ * Keeps a copy of the panel in host memory and, every interval_ms of
+ * virtual time, writes it to dir as a numbered PNG (PPM without libpng)
+ * if any pixel changed since the previous frame.  dir/frames.csv lists
+ * the frames with their virtual time and the changed rectangle.
+ *
+ * refresh(opaque) runs before each check so that devices which only copy
+ * guest pixels on display refresh can do so without a display.
+ */
+EspFbCapture *esp_fb_capture_new(const char *dir, uint32_t interval_ms,
+                                 void (*refresh)(void *opaque), void *opaque,
+                                 Error **errp);
+
+/* Changes the panel size; the content is cleared to black */
+void esp_fb_capture_resize(EspFbCapture *c, int width, int height);
+
+/*
+ * Copies a w x h rectangle to (x, y) of the panel; src points at its top
+ * left pixel and stride is in bytes.  Parts outside the panel are ignored.
+ */
+void esp_fb_capture_update(EspFbCapture *c, int x, int y, int w, int h,
+                           EspFbFormat format, const void *src, int stride);
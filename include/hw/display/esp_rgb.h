@@ -2,6 +2,7 @@
 
 #include "hw/hw.h"
 #include "hw/registerfields.h"
+#include "hw/display/esp_fb_capture.h"
 
 
 #define TYPE_ESP_RGB "display.esp.rgb"
@@ -47,6 +48,11 @@ typedef struct ESPRgbState {
 
     /* BPP */
     BppEnum bpp;
+
+    /* Headless capture of what the guest draws */
+    char *capture_path;
+    uint32_t capture_interval;
+    EspFbCapture *capture;
 } ESPRgbState;
 
 #define ESP_RGB_IO_SIZE (A_RGB_BPP_VALUE + 4)
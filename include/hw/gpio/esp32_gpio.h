@@ -1,10 +1,13 @@
 #pragma once
 
+#include "qemu/thread.h"
 #include "hw/sysbus.h"
 #include "hw/hw.h"
 #include "hw/registerfields.h"
 #include "ui/console.h"
 #include "ui/console-priv.h"
+#include "hw/gpio/esp_gpio_stimulus.h"
+#include "hw/misc/esp_signal_trace.h"
 
 
 #define TYPE_ESP32_GPIO "esp32.gpio"
@@ -101,6 +104,13 @@ typedef struct Esp32GpioState {
     MemoryRegion iomem;
     MemoryRegion iomuxmem;
     MemoryRegion iortcmem;
+    /*
+     * Register reads run without the BQL and only take this lock; changes
+     * to the pin state hold the BQL and then this lock.  IO_MUX writes only
+     * store the pad configuration and take just this lock.  Recursive
+     * because an output line may be wired back to one of our inputs.
+     */
+    QemuRecMutex lock;
     qemu_irq irq;
     uint32_t gpio_out;
     uint32_t gpio_out1;
@@ -133,6 +143,10 @@ typedef struct Esp32GpioState {
     uint32_t *data;
     uint32_t redraw;
     qemu_irq rtc_wakeup;
+    char *trace_path;
+    EspSignalTrace *trace;
+    char *stimulus_path;
+    EspGpioStimulus *stimulus;
 } Esp32GpioState;
 
 typedef struct Esp32GpioClass {
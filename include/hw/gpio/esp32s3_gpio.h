@@ -3,6 +3,8 @@
 #include "hw/sysbus.h"
 #include "hw/hw.h"
 #include "hw/registerfields.h"
+#include "hw/gpio/esp_gpio_stimulus.h"
+#include "hw/misc/esp_signal_trace.h"
 
 #define TYPE_ESP32S3_GPIO "esp32s3.gpio"
 #define ESP32S3_GPIO(obj)           OBJECT_CHECK(ESP32S3GPIOState, (obj), TYPE_ESP32S3_GPIO)
@@ -49,6 +51,10 @@ typedef struct ESP32S3State {
     uint32_t *data;
     uint32_t redraw;
     qemu_irq rtc_wakeup;
+    char *trace_path;
+    EspSignalTrace *trace;
+    char *stimulus_path;
+    EspGpioStimulus *stimulus;
 } ESP32S3GPIOState;
 
 typedef struct ESP32S3GPIOClass {
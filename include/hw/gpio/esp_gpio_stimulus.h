@@ -0,0 +1,25 @@
+/*
+ * Replay of GPIO input waveforms in virtual time
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#pragma once
+
+#include "hw/irq.h"
+
+typedef struct EspGpioStimulus EspGpioStimulus;
+
+/*
+ * Loads a stimulus file and schedules its level changes on the virtual
+ * clock, calling set(opaque, pin, level) for each of them.  The file is
+ * either a VCD, whose 1-bit variables are named "gpioN", "gpioN_in" or
+ * "N", or CSV lines of "time,pin,level"; CSV times are nanoseconds unless
+ * suffixed with ns, us, ms or s.  Times are absolute virtual time.  When a
+ * VCD has "gpioN_in", its "gpioN" is taken to be the recorded output and
+ * ignored, so a GPIO trace replays only its inputs.
+ */
+EspGpioStimulus *esp_gpio_stimulus_new(const char *path, unsigned n_pins,
+                                       qemu_irq_handler set, void *opaque,
+                                       Error **errp);
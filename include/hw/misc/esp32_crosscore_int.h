@@ -9,9 +9,29 @@
 #define TYPE_ESP32_CROSSCORE_INT "misc.esp32.crosscoreint"
 #define ESP32_CROSSCORE_INT(obj) OBJECT_CHECK(Esp32CrosscoreInt, (obj), TYPE_ESP32_CROSSCORE_INT)
 
+/*
+ * Returns the vCPU that crosscore interrupt @n is delivered to, or NULL.
+ * Called without the BQL.
+ */
+typedef CPUState *Esp32CrosscoreRouteFn(void *opaque, int n);
+
 typedef struct Esp32CrosscoreInt {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
     int n_irqs;
     qemu_irq *irqs;
+    /* Levels written by the guest, updated without the BQL */
+    uint32_t levels;
+    /* Levels driven on irqs, under the BQL */
+    uint32_t applied;
+    Esp32CrosscoreRouteFn *route;
+    void *route_opaque;
 } Esp32CrosscoreInt;
+
+/*
+ * Lets the crosscore interrupt queue the update of a line straight on the
+ * vCPU that will take it, instead of waiting for the BQL on the writer.
+ */
+void esp32_crosscore_int_set_route(Esp32CrosscoreInt *s,
+                                   Esp32CrosscoreRouteFn *route,
+                                   void *opaque);
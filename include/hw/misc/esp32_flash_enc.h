@@ -3,6 +3,7 @@
 #include "hw/hw.h"
 #include "hw/sysbus.h"
 #include "hw/registerfields.h"
+#include "hw/misc/esp_flash_cipher.h"
 
 #define TYPE_ESP32_FLASH_ENCRYPTION "misc.esp32.flash_encryption"
 #define ESP32_FLASH_ENCRYPTION(obj) OBJECT_CHECK(Esp32FlashEncryptionState, (obj), TYPE_ESP32_FLASH_ENCRYPTION)
@@ -29,7 +30,7 @@ typedef struct Esp32FlashEncryptionState {
     bool dl_mode_enc_disabled;
     bool dl_mode_dec_disabled;
     uint32_t efuse_key[8];
-
+    Esp32FlashCipher cipher;
 } Esp32FlashEncryptionState;
 
 /* returns NULL unless there is exactly one device */
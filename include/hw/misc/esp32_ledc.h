@@ -4,6 +4,7 @@
 #include "hw/sysbus.h"
 #include "hw/registerfields.h"
 #include "hw/misc/led.h"
+#include "hw/misc/esp_signal_trace.h"
 #include "qemu/timer.h"
 
 #define TYPE_ESP32_LEDC "misc.esp32.ledc"
@@ -29,6 +30,8 @@ typedef struct Esp32LEDCState {
     qemu_irq irq;
     uint32_t int_raw;
     uint32_t int_en;
+    char *trace_path;
+    EspSignalTrace *trace;
 } Esp32LEDCState;
 
 REG32(LEDC_CONF_REG, 0x190)
@@ -20,6 +20,8 @@ typedef struct dma_list_item {
     uint32_t next;
 } QEMU_PACKED dma_list_item;
 
+typedef struct Esp32WifiPcap Esp32WifiPcap;
+
 typedef struct Esp32WifiState {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -34,6 +36,29 @@ typedef struct Esp32WifiState {
     unsigned int inject_sequence_number;
     int beacon_ap;
     bool iss3;
+    /* forward frames with the NIC MAC to a medium shared with other stations */
+    bool shared_medium;
+    /* access point inventory, from ap-file or the built-in defaults */
+    char *ap_file;
+    struct access_point_info *access_points;
+    int nb_aps;
+
+    /* WPA2-PSK authenticator state for the associated station */
+    int wpa_state;
+    uint64_t wpa_replay_counter;
+    uint8_t wpa_anonce[32];
+    uint8_t wpa_ptk[48];
+    uint8_t wpa_gtk[16];
+
+    /* radiotap capture of all frames to and from the guest */
+    char *pcap_file;
+    Esp32WifiPcap *pcap;
+
+    /* 802.3 traffic exchanged with the netdev, read-only QOM properties */
+    uint64_t tx_frames;
+    uint64_t tx_bytes;
+    uint64_t rx_frames;
+    uint64_t rx_bytes;
 
     hwaddr receive_queue_address;
     uint32_t receive_queue_count;
@@ -53,8 +78,11 @@ typedef struct Esp32WifiState {
 
 
 void Esp32_WLAN_handle_frame(Esp32WifiState *s, struct mac80211_frame *frame);
-void Esp32_WLAN_setup_ap(DeviceState *dev,Esp32WifiState *s);
+bool Esp32_WLAN_setup_ap(DeviceState *dev,Esp32WifiState *s, Error **errp);
 void Esp32_sendFrame(Esp32WifiState *s, struct mac80211_frame *frame,int length, int signal_strength);
+bool Esp32_WLAN_pcap_open(Esp32WifiState *s, const char *path, Error **errp);
+void Esp32_WLAN_pcap_frame(Esp32WifiState *s, const void *frame, int length,
+                           bool rx, int rssi);
 
 REG32(WIFI_DMA_IN_STATUS, 0x84);
 REG32(WIFI_DMA_INLINK, 0x88);
@@ -69,6 +69,9 @@ _Static_assert(sizeof(ESP32C3MMUEntry) == sizeof(uint32_t), "MMU Entry size must
 typedef struct {
     SysBusDevice parent;
     BlockBackend *flash_blk;
+    /* flash chip sharing its working copy with the cache, if any */
+    DeviceState *flash;
+    Notifier flash_write_notifier;
     MemoryRegion iomem;
 
     bool         icache_enable;
@@ -15,6 +15,7 @@
 #include "hw/sysbus.h"
 #include "hw/registerfields.h"
 #include "hw/nvram/esp32c3_efuse.h"
+#include "hw/misc/esp_flash_cipher.h"
 #include "hw/riscv/esp32c3_clk.h"
 
 #define TYPE_ESP32C3_XTS_AES "misc.esp32c3.xts_aes"
@@ -48,6 +49,7 @@ typedef struct ESP32C3XtsAesState {
 
     ESP32C3ClockState *clock;
     ESPEfuseState *efuse;
+    EspXtsCipher cipher;
 } ESP32C3XtsAesState;
 
 typedef struct ESP32C3XtsAesClass {
@@ -108,6 +108,9 @@ typedef struct {
     AddressSpace flash_as;
     /* Since there is no way to get a MemoryRegion out of a block device, use this memory region as a RO mirror */
     MemoryRegion flash_mr;
+    /* flash chip sharing its working copy with the cache, if any */
+    DeviceState *flash;
+    Notifier flash_write_notifier;
     /* Define an address space for the PSRAM, if not NULL */
     AddressSpace psram_as;
 
@@ -15,6 +15,7 @@
 #include "hw/sysbus.h"
 #include "hw/registerfields.h"
 #include "hw/nvram/esp32s3_efuse.h"
+#include "hw/misc/esp_flash_cipher.h"
 #include "hw/xtensa/esp32s3_clk.h"
 
 #define TYPE_ESP32S3_XTS_AES "misc.esp32s3.xts_aes"
@@ -48,6 +49,7 @@ typedef struct ESP32S3XtsAesState {
 
     ESP32S3ClockState *clock;
     ESPEfuseState *efuse;
+    EspXtsCipher cipher;
 } ESP32S3XtsAesState;
 
 typedef struct ESP32S3XtsAesClass {
@@ -0,0 +1,69 @@
+/*
+ * Flash encryption engines shared by the ESP32, ESP32-C3 and ESP32-S3
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#pragma once
+
+#include "crypto/aes.h"
+
+#define ESP32_FLASH_CIPHER_KEY_WORDS    8
+#define ESP32_FLASH_CIPHER_BLOCK_SIZE   32
+#define ESP32_FLASH_CIPHER_CACHE_SIZE   4096
+
+#define ESP_XTS_DATA_UNIT_SIZE          128
+#define ESP_XTS_MAX_KEY_SIZE            64
+
+typedef struct Esp32FlashCipherEntry {
+    uint32_t tag;       /* tweak class + 1, 0 while unused */
+    AES_KEY enc;
+} Esp32FlashCipherEntry;
+
+/*
+ * ESP32 flash encryption: AES-256 with the key tweaked by bits 5..23 of the
+ * flash address.  The expanded key of each 32-byte block is kept in a
+ * direct-mapped cache, so decrypting a cache page expands each key once.
+ */
+typedef struct Esp32FlashCipher {
+    uint32_t key[ESP32_FLASH_CIPHER_KEY_WORDS];  /* byte order of the AES core */
+    Esp32FlashCipherEntry *cache;
+} Esp32FlashCipher;
+
+/* Drops the cached schedules if the efuse key differs from the current one */
+void esp32_flash_cipher_set_key(Esp32FlashCipher *c, const uint32_t *efuse_key);
+/* Decrypts flash contents read from flash_addr, which must be 32-byte aligned */
+void esp32_flash_cipher_decrypt(Esp32FlashCipher *c, uint32_t flash_addr,
+                                uint32_t *data, size_t words);
+/* Encrypts one 32-byte block as it is to be written to flash_addr */
+void esp32_flash_cipher_encrypt(Esp32FlashCipher *c, uint32_t flash_addr,
+                                const uint32_t *in, uint32_t *out);
+
+typedef struct EspXtsKeys {
+    AES_KEY enc;
+    AES_KEY dec;
+} EspXtsKeys;
+
+/*
+ * ESP32-C3/S3 flash encryption: XTS-AES over 128-byte data units, with the
+ * bytes of each unit reversed.  The key schedules are expanded only when
+ * the efuse key changes.
+ */
+typedef struct EspXtsCipher {
+    uint8_t key[ESP_XTS_MAX_KEY_SIZE];
+    size_t key_size;    /* 0 until a key has been set */
+    EspXtsKeys data;
+    EspXtsKeys tweak;
+} EspXtsCipher;
+
+/* key_size is 32 for XTS-AES-128 and 64 for XTS-AES-256 */
+void esp_xts_cipher_set_key(EspXtsCipher *c, const uint8_t *key,
+                            size_t key_size);
+/*
+ * Processes size bytes in place, a multiple of the data unit size.  The tweak
+ * of each unit is (addr & addr_mask) + tweak_base, addr advancing per unit.
+ */
+void esp_xts_cipher_crypt(EspXtsCipher *c, uint32_t addr, uint32_t addr_mask,
+                          uint32_t tweak_base, uint8_t *data, size_t size,
+                          bool encrypt);
@@ -0,0 +1,21 @@
+/*
+ * ESP mask ROM images shared between emulator instances
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#pragma once
+
+#include "exec/memory.h"
+
+/*
+ * Like load_image_targphys_as(), but when the image lands in a single ROM
+ * region at a page aligned offset, the ROM's host pages are replaced by a
+ * private mapping of the file instead of being filled with a copy.  Every
+ * instance started from the same pc-bios file then reads the ROM from the
+ * host page cache.  Falls back to the copy on hosts without mmap or when
+ * the layout does not allow the mapping.  Returns the image size, or -1.
+ */
+ssize_t esp_rom_map_image_as(const char *filename, hwaddr addr,
+                             uint64_t max_sz, AddressSpace *as);
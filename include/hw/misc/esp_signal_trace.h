@@ -0,0 +1,52 @@
+/*
+ * VCD traces of ESP32 pins and peripheral outputs
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#pragma once
+
+#include "qemu/timer.h"
+
+typedef struct EspSignalTrace EspSignalTrace;
+
+/*
+ * A device declares its signals with esp_signal_trace_add() and then opens
+ * the file.  Events go to a single-producer ring that a background thread
+ * drains into the VCD file; producers must run under the BQL, which holds
+ * for MMIO handlers, timers and qemu_irq callbacks.
+ */
+EspSignalTrace *esp_signal_trace_new(const char *scope);
+/* Returns the signal index to record with, width is in bits (1..32) */
+unsigned esp_signal_trace_add(EspSignalTrace *t, const char *name,
+                              unsigned width);
+bool esp_signal_trace_open(EspSignalTrace *t, const char *path, Error **errp);
+
+void esp_signal_trace_event(EspSignalTrace *t, int64_t now, int64_t time_ns,
+                            unsigned signal, uint32_t value);
+
+/*
+ * Records that signal changes to value at time_ns, which may lie in the
+ * future of the virtual clock (e.g. for waveforms that a peripheral emits
+ * in one go) but not in its past.
+ */
+static inline void esp_signal_trace_at(EspSignalTrace *t, int64_t time_ns,
+                                       unsigned signal, uint32_t value)
+{
+    if (unlikely(t)) {
+        esp_signal_trace_event(t, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL),
+                               time_ns, signal, value);
+    }
+}
+
+/* Records a change at the current virtual time, a no-op without a trace */
+static inline void esp_signal_trace(EspSignalTrace *t, unsigned signal,
+                                    uint32_t value)
+{
+    if (unlikely(t)) {
+        int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+        esp_signal_trace_event(t, now, now, signal, value);
+    }
+}
@@ -0,0 +1,17 @@
+/*
+ * I2C and SPI sensors co-simulated by an external process
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+#ifndef HW_SENSOR_ESP_COSIM_H
+#define HW_SENSOR_ESP_COSIM_H
+
+#include "hw/sensor/esp_cosim_proto.h"
+
+#define TYPE_ESP_COSIM_I2C "esp-cosim-i2c"
+#define TYPE_ESP_COSIM_SPI "esp-cosim-spi"
+
+#endif
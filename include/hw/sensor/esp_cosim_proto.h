@@ -0,0 +1,102 @@
+/*
+ * Shared-memory protocol between the esp-cosim devices and a sensor simulator
+ *
+ * QEMU creates the file named by the "shm" property and maps one
+ * EspCosimShared into it.  Two single-producer rings carry 8-byte aligned
+ * records: requests from QEMU to the simulator and responses back.  Writes
+ * are posted; only reads wait for a response, so a sensor poll costs one
+ * round trip no matter how many bytes it moves.  Every request carries the
+ * QEMU_CLOCK_VIRTUAL time at which the guest issued it.
+ *
+ * All fields are little endian.  Ring positions are free-running byte
+ * counters; a producer publishes a record by storing head with release
+ * semantics, a consumer frees it by storing tail.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+#ifndef HW_SENSOR_ESP_COSIM_PROTO_H
+#define HW_SENSOR_ESP_COSIM_PROTO_H
+
+#define ESP_COSIM_MAGIC         0x4d534345  /* "ECSM" */
+#define ESP_COSIM_VERSION       1
+#define ESP_COSIM_RING_SIZE     (64 * 1024)
+#define ESP_COSIM_MAX_DATA      1024
+
+typedef enum EspCosimType {
+    /* posted, data holds the bytes of one write transaction */
+    ESP_COSIM_I2C_WRITE = 1,
+    /* answered with up to count bytes of read data */
+    ESP_COSIM_I2C_READ = 2,
+    /* posted after a read, count is the number of bytes the guest took */
+    ESP_COSIM_I2C_READ_END = 3,
+    /*
+     * Sent at the first byte after chip select, data holds that byte.
+     * Answered with count bytes: what the device shifts out on MISO during
+     * this and the following bytes of the transaction.
+     */
+    ESP_COSIM_SPI_XFER = 4,
+    /* posted at chip deselect, data holds every byte the host shifted out */
+    ESP_COSIM_SPI_END = 5,
+    /* simulator to QEMU, seq matches the request */
+    ESP_COSIM_RESPONSE = 6,
+} EspCosimType;
+
+typedef struct EspCosimMsg {
+    uint32_t size;          /* bytes in data[] */
+    uint8_t type;           /* EspCosimType */
+    uint8_t bus;            /* I2C controller or SPI host index */
+    uint16_t dev;           /* 7-bit I2C address or SPI chip select */
+    uint32_t count;
+    uint32_t seq;
+    uint64_t time_ns;       /* virtual time of the request */
+    uint8_t data[];
+} EspCosimMsg;
+
+typedef struct EspCosimRing {
+    uint32_t head;          /* written by the producer */
+    uint32_t pad0[15];
+    uint32_t tail;          /* written by the consumer */
+    uint32_t pad1[15];
+    uint8_t data[ESP_COSIM_RING_SIZE];
+} EspCosimRing;
+
+typedef struct EspCosimShared {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pad[14];
+    EspCosimRing req;       /* QEMU to simulator */
+    EspCosimRing rsp;       /* simulator to QEMU */
+} EspCosimShared;
+
+static inline uint32_t esp_cosim_record_size(uint32_t data_size)
+{
+    return (sizeof(EspCosimMsg) + data_size + 7) & ~7u;
+}
+
+/* Copy len bytes in or out of a ring at free-running position pos */
+static inline void esp_cosim_ring_write(EspCosimRing *r, uint32_t pos,
+                                        const void *buf, uint32_t len)
+{
+    uint32_t off = pos % ESP_COSIM_RING_SIZE;
+    uint32_t first = len < ESP_COSIM_RING_SIZE - off ?
+                     len : ESP_COSIM_RING_SIZE - off;
+
+    memcpy(r->data + off, buf, first);
+    memcpy(r->data, (const uint8_t *)buf + first, len - first);
+}
+
+static inline void esp_cosim_ring_read(const EspCosimRing *r, uint32_t pos,
+                                       void *buf, uint32_t len)
+{
+    uint32_t off = pos % ESP_COSIM_RING_SIZE;
+    uint32_t first = len < ESP_COSIM_RING_SIZE - off ?
+                     len : ESP_COSIM_RING_SIZE - off;
+
+    memcpy(buf, r->data + off, first);
+    memcpy((uint8_t *)buf + first, r->data, len - first);
+}
+
+#endif
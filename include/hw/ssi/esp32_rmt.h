@@ -3,6 +3,7 @@
 #include "hw/hw.h"
 #include "hw/registerfields.h"
 #include "hw/ssi/ssi.h"
+#include "hw/misc/esp_signal_trace.h"
 
 #define TYPE_ESP32_RMT "ssi.esp32.rmt"
 #define ESP32_RMT(obj) OBJECT_CHECK(Esp32RmtState, (obj), TYPE_ESP32_RMT)
@@ -10,24 +11,40 @@
 #define ESP32_RMT_BUF_WORDS     512
 #define ESP32_RMT_BLOCK_SIZE    64
 
+#define ESP32_RMT_CHANNELS      8
+#define ESP32_RMT_THR_QUEUE     8
+
+/* Transmit timing of one channel */
+typedef struct Esp32RmtChannel {
+    struct Esp32RmtState *rmt;
+    int index;
+    QEMUTimer timer;
+    int64_t time;       /* when the items handed to the peripheral end */
+    int64_t end_time;   /* INT64_MAX until an end marker is reached */
+    int64_t thr_time[ESP32_RMT_THR_QUEUE];
+    unsigned thr_count;
+    uint64_t thr_overflows;     /* threshold events merged into the last */
+    uint32_t blocks_unsent;
+    int sent;
+    bool end_marker;
+} Esp32RmtChannel;
+
 typedef struct Esp32RmtState {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
     qemu_irq irq;
     int num_cs;
     SSIBus *rmt;
-    long start_time;
     uint32_t conf0[8];
     uint32_t conf1[8];
     uint32_t int_raw;
     uint32_t int_en;
     uint32_t txlim[8];
     uint32_t apb_conf;
-    uint32_t blocks_unsent;
-    int sent;
-    bool end_marker;
     uint32_t data[ESP32_RMT_BUF_WORDS];
-    QEMUTimer rmt_timer;
+    Esp32RmtChannel tx[ESP32_RMT_CHANNELS];
+    char *trace_path;
+    EspSignalTrace *trace;
 } Esp32RmtState;
 
 
@@ -37,6 +54,7 @@ REG32(RMT_CH0CONF0, 0x20)
 REG32(RMT_CH0CONF1, 0x24)
     FIELD(RMT_CONF1,MEM_RD_RESET,3,1);
     FIELD(RMT_CONF1,TX_START,0,1);
+    FIELD(RMT_CONF1,REF_ALWAYS_ON,17,1);
 REG32(RMT_INT_RAW, 0xa0)
 REG32(RMT_INT_ST, 0xa4)
 REG32(RMT_INT_ENA, 0xa8)
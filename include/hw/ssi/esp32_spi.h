@@ -21,6 +21,11 @@ typedef struct Esp32SpiState {
     qemu_irq dma_irq;
     QEMUTimer spi_timer;
     bool xfer_32_bits;
+    /* serve flash commands on CS0 directly from the flash model */
+    bool flash_fast_path;
+    bool flash_latency;
+    DeviceState *flash;
+    int64_t flash_busy_until;
     uint32_t addr_reg;
     uint32_t ctrl_reg;
     uint32_t status_reg;
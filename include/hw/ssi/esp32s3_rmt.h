@@ -3,6 +3,7 @@
 #include "hw/hw.h"
 #include "hw/registerfields.h"
 #include "hw/ssi/ssi.h"
+#include "hw/misc/esp_signal_trace.h"
 
 #define TYPE_ESP32S3_RMT "ssi.esp32s3.rmt"
 #define ESP32S3_RMT(obj) OBJECT_CHECK(Esp32S3RmtState, (obj), TYPE_ESP32S3_RMT)
@@ -10,23 +11,39 @@
 #define ESP32S3_RMT_BUF_WORDS     384
 #define ESP32S3_RMT_BLOCK_SIZE    48
 
+#define ESP32S3_RMT_CHANNELS      4
+#define ESP32S3_RMT_THR_QUEUE     8
+
+/* Transmit timing of one channel */
+typedef struct Esp32S3RmtChannel {
+    struct Esp32S3RmtState *rmt;
+    int index;
+    QEMUTimer timer;
+    int64_t time;       /* when the items handed to the peripheral end */
+    int64_t end_time;   /* INT64_MAX until an end marker is reached */
+    int64_t thr_time[ESP32S3_RMT_THR_QUEUE];
+    unsigned thr_count;
+    uint64_t thr_overflows;     /* threshold events merged into the last */
+    uint32_t blocks_unsent;
+    int sent;
+    bool end_marker;
+} Esp32S3RmtChannel;
+
 typedef struct Esp32S3RmtState {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
     qemu_irq irq;
     int num_cs;
     SSIBus *rmt;
-    long start_time;
     uint32_t conf0[4];
     uint32_t int_raw;
     uint32_t int_en;
     uint32_t txlim[4];
     uint32_t apb_conf;
-    uint32_t blocks_unsent;
-    int sent;
-    bool end_marker;
     uint32_t data[ESP32S3_RMT_BUF_WORDS];
-    QEMUTimer rmt_timer;
+    Esp32S3RmtChannel tx[ESP32S3_RMT_CHANNELS];
+    char *trace_path;
+    EspSignalTrace *trace;
 } Esp32S3RmtState;
 
 
@@ -57,6 +74,8 @@ REG32(RMT_CH1_TX_LIM,0xa4)
 REG32(RMT_CH2_TX_LIM,0xa8)
 REG32(RMT_CH3_TX_LIM,0xac)
 REG32(RMT_SYS_CONF,0xc0)
+    FIELD(RMT_SYS_CONF,SCLK_DIV_NUM,4,8);
+    FIELD(RMT_SYS_CONF,SCLK_SEL,24,2);
 
 
 
@@ -4,6 +4,7 @@
 #include "hw/registerfields.h"
 #include "hw/sysbus.h"
 #include "hw/misc/esp32_reg.h"
+#include "hw/timer/esp_deadline_timer.h"
 
 #define TYPE_ESP32_FRC_TIMER "timer.esp32.frc"
 #define ESP32_FRC_TIMER(obj) OBJECT_CHECK(Esp32FrcTimerState, (obj), TYPE_ESP32_FRC_TIMER)
@@ -14,7 +15,7 @@ typedef struct Esp32FrcTimerState {
 
     MemoryRegion iomem;
     qemu_irq irq;
-    QEMUTimer alarm_timer;
+    EspDeadlineTimer alarm_timer;
 
     /* properties */
     uint32_t apb_freq;
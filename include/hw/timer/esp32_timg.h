@@ -1,7 +1,9 @@
 #pragma once
 
+#include "qemu/thread.h"
 #include "hw/hw.h"
 #include "hw/registerfields.h"
+#include "hw/timer/esp_deadline_timer.h"
 
 #define TYPE_ESP32_TIMG "timer.esp32.timg"
 #define ESP32_TIMG(obj) OBJECT_CHECK(Esp32TimgState, (obj), TYPE_ESP32_TIMG)
@@ -40,7 +42,7 @@ typedef struct Esp32TimgTimerState {
     uint64_t last_val;
     uint64_t ns_base;
     Esp32TimgInterruptType int_type;
-    QEMUTimer alarm_timer;
+    EspDeadlineTimer alarm_timer;
 } Esp32TimgTimerState;
 
 typedef enum Esp32TimgWdtStageMode {
@@ -65,13 +67,18 @@ typedef struct Esp32TimgWdtState {
     uint64_t ns_base;
     int cur_stage;
     uint32_t protect_reg;
-    QEMUTimer stage_timer;
+    EspDeadlineTimer stage_timer;
 } Esp32TimgWdtState;
 
 typedef struct Esp32TimgState {
     SysBusDevice parent_obj;
 
     MemoryRegion iomem;
+    /*
+     * Guards the state below against register reads, which run without the
+     * BQL.  Anything that changes it holds the BQL and then this lock.
+     */
+    QemuMutex lock;
     int id;
     qemu_irq irqs[2*TIMG_INT_MAX];
     qemu_irq wdt_cpu_reset_req;
@@ -0,0 +1,43 @@
+/*
+ * Deadline timers for ESP timer peripherals
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#pragma once
+
+#include "qemu/timer.h"
+
+/*
+ * A QEMUTimer that is only re-armed when its deadline moves earlier.
+ *
+ * Watchdog feeds and comparator updates nearly always push the deadline
+ * further out.  Doing that with timer_mod() costs a timer list update and,
+ * when the timer is the next to expire, a main loop wakeup to recompute
+ * the poll timeout, every time the guest feeds.  Here a later deadline is
+ * only recorded; the underlying timer still fires at the old time and is
+ * then moved to the recorded deadline, so a watchdog fed every millisecond
+ * costs one host timer operation per timeout period instead of one per
+ * feed.  cb runs exactly when the current deadline is reached.
+ */
+typedef struct EspDeadlineTimer {
+    QEMUTimer timer;
+    int64_t deadline;   /* -1 when stopped */
+    QEMUTimerCB *cb;
+    void *opaque;
+} EspDeadlineTimer;
+
+void esp_deadline_timer_init(EspDeadlineTimer *t, QEMUTimerCB *cb,
+                             void *opaque);
+
+/* Runs cb at deadline_ns of QEMU_CLOCK_VIRTUAL, replacing any earlier one */
+void esp_deadline_timer_mod(EspDeadlineTimer *t, int64_t deadline_ns);
+
+/* Cancels the deadline; the underlying timer may still wake up once */
+void esp_deadline_timer_del(EspDeadlineTimer *t);
+
+static inline bool esp_deadline_timer_pending(EspDeadlineTimer *t)
+{
+    return t->deadline >= 0;
+}
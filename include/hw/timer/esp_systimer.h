@@ -9,8 +9,10 @@
  */
 #pragma once
 
+#include "qemu/thread.h"
 #include "hw/hw.h"
 #include "hw/registerfields.h"
+#include "hw/timer/esp_deadline_timer.h"
 
 
 #define TYPE_ESP_SYSTIMER           "esp.systimer"
@@ -96,7 +98,7 @@ typedef struct {
     /* Index of the counter that is linked to the comparator */
     uint32_t counter;
     /* The easiest way to implement timeout is by using one timer per comparator */
-    QEMUTimer qtimer;
+    EspDeadlineTimer qtimer;
     uint64_t expire_time;
     qemu_irq irq;
     int cur_irq_level;
@@ -108,6 +110,8 @@ typedef struct {
 struct ESPSysTimerState {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
+    /* Register reads run without the BQL; writers take the BQL, then this */
+    QemuMutex lock;
     /* Mirror of the comparators and counters state, only used to speed up
      * reading of A_SYSTIMER_CONF register  */
     uint32_t conf;
@@ -13,6 +13,7 @@
 #include "hw/registerfields.h"
 #include "hw/sysbus.h"
 #include "qemu/timer.h"
+#include "hw/timer/esp_deadline_timer.h"
 
 
 #define TYPE_ESP_TIMG               "timer.esp.timg"
@@ -81,7 +82,7 @@ typedef enum {
 
 
 typedef struct ESPVirtualCounter {
-    QEMUTimer timer;
+    EspDeadlineTimer timer;
     /* Timer current value in ticks */
     uint64_t value;
     /* Time when the value was last updated */
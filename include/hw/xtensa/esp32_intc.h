@@ -35,7 +35,15 @@ typedef struct Esp32IntMatrixState {
     qemu_irq *outputs[ESP32_CPU_COUNT];
     uint8_t irq_map[ESP32_CPU_COUNT][ESP32_INT_MATRIX_INPUTS];
     uint8_t irq_raw[ESP32_INT_MATRIX_INPUTS];
+    /* CPU interrupt number to external interrupt line index, or -1 */
+    int8_t extint_index[ESP32_CPU_COUNT][MAX_NINTERRUPT];
     /* properties */
     XtensaCPU *cpu[ESP32_CPU_COUNT];
 } Esp32IntMatrixState;
 
+/*
+ * Returns the CPU that @source is currently routed to, or NULL if no core
+ * takes it as an external interrupt.  Safe to call without the BQL.
+ */
+CPUState *esp32_intmatrix_source_cpu(Esp32IntMatrixState *s, int source);
+
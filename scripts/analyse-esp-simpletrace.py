@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+#
+# Latency histograms for the ESP device trace events
+#
+# Reads a trace file written by the "simple" trace backend and reports,
+# per device, how long each traced operation took on the host:
+#
+#   foo / foo_done, foo_start / foo_done   command, DMA, MMU update
+#   foo_sleep / foo_wake                   RTC light and deep sleep
+#   esp32c3_intmatrix_pending / _raise     deferred interrupts
+#
+# Start and end records are matched on their first argument when both
+# events have the same first argument (a DMA channel, a descriptor), and
+# otherwise on the event alone.  Events that are neither get a histogram
+# of the time between consecutive records, e.g. interrupt or UART rates.
+#
+# Usage:
+#   qemu-system-xtensa -trace 'esp*' -trace file=esp.trace ...
+#   scripts/analyse-esp-simpletrace.py build/trace-events-all esp.trace
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+
+import argparse
+import json
+import re
+
+import simpletrace
+
+DEVICE_EVENT = re.compile(r"^(esp32\w*|esp_gdma|esp_deadline_timer)_")
+
+# end event -> start event, for pairs that do not follow a naming rule
+PAIRS = {
+    "esp32c3_intmatrix_raise": "esp32c3_intmatrix_pending",
+}
+
+
+def start_of(name, names):
+    """Return the start event closed by @name, or None."""
+    if name in PAIRS:
+        return PAIRS[name]
+    if name.endswith("_done"):
+        base = name[:-len("_done")]
+        for start in (base + "_start", base):
+            if start in names:
+                return start
+    if name.endswith("_wake"):
+        start = name[:-len("_wake")] + "_sleep"
+        if start in names:
+            return start
+    return None
+
+
+def device_of(name):
+    parts = name.split("_")
+    return "_".join(parts[:2])
+
+
+def bucket(ns):
+    """Power of two bucket of a duration, in nanoseconds."""
+    return max(ns, 1).bit_length() - 1
+
+
+def fmt_ns(ns):
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if ns >= scale:
+            return f"{ns / scale:.1f}{unit}"
+    return f"{ns:.0f}ns"
+
+
+class Series:
+    def __init__(self):
+        self.samples = []
+
+    def add(self, ns):
+        self.samples.append(ns)
+
+    def summary(self):
+        s = sorted(self.samples)
+        n = len(s)
+        return {
+            "count": n,
+            "min_ns": s[0],
+            "p50_ns": s[n // 2],
+            "p90_ns": s[min(n - 1, n * 9 // 10)],
+            "p99_ns": s[min(n - 1, n * 99 // 100)],
+            "max_ns": s[-1],
+            "total_ns": sum(s),
+        }
+
+    def histogram(self):
+        counts = {}
+        for ns in self.samples:
+            b = bucket(ns)
+            counts[b] = counts.get(b, 0) + 1
+        return [(1 << b, counts[b]) for b in sorted(counts)]
+
+
+class EspLatencyAnalyzer(simpletrace.Analyzer2):
+    "Pair ESP start and end trace records and collect their latency."
+
+    def __init__(self, events, only):
+        names = {e.name for e in events if DEVICE_EVENT.match(e.name)}
+        self.only = only
+        self.ends = {}
+        self.starts = set()
+        self.keyed = {}
+        by_name = {e.name: e for e in events}
+        for name in names:
+            start = start_of(name, names)
+            if start is None:
+                continue
+            self.ends[name] = start
+            self.starts.add(start)
+            s_args = by_name[start].args.names()
+            e_args = by_name[name].args.names()
+            self.keyed[start] = bool(s_args and e_args and
+                                     s_args[0] == e_args[0])
+        self.open = {}
+        self.last = {}
+        self.series = {}
+        self.unmatched = {}
+        self.dropped = 0
+
+    def _series(self, name, kind, key):
+        if name.endswith("_start"):
+            name = name[:-len("_start")]
+        label = name if key is None else f"{name}[{key:#x}]"
+        return self.series.setdefault((name, kind, label), Series())
+
+    def catchall(self, *rec_args, event, timestamp_ns, **kwargs):
+        name = event.name
+        if name == "Dropped_Event":
+            self.dropped += rec_args[0] if rec_args else 1
+            return
+        if not DEVICE_EVENT.match(name):
+            return
+        if self.only and not name.startswith(self.only):
+            return
+
+        if name in self.ends:
+            start = self.ends[name]
+            key = rec_args[0] if self.keyed[start] else None
+            begun = self.open.pop((start, key), None)
+            if begun is None:
+                self.unmatched[name] = self.unmatched.get(name, 0) + 1
+                return
+            self._series(start, "latency", key).add(timestamp_ns - begun)
+        elif name in self.starts:
+            key = rec_args[0] if self.keyed[name] else None
+            self.open[(name, key)] = timestamp_ns
+        else:
+            previous = self.last.get(name)
+            self.last[name] = timestamp_ns
+            if previous is not None:
+                self._series(name, "interval", None).add(timestamp_ns -
+                                                          previous)
+
+
+def report(analyzer, width):
+    devices = {}
+    for (name, kind, label), series in sorted(analyzer.series.items()):
+        devices.setdefault(device_of(name), []).append((kind, label, series))
+
+    for device, rows in devices.items():
+        print(f"== {device}")
+        for kind, label, series in rows:
+            s = series.summary()
+            print(f"  {label} {kind}: n={s['count']} "
+                  f"min {fmt_ns(s['min_ns'])} p50 {fmt_ns(s['p50_ns'])} "
+                  f"p90 {fmt_ns(s['p90_ns'])} p99 {fmt_ns(s['p99_ns'])} "
+                  f"max {fmt_ns(s['max_ns'])}")
+            hist = series.histogram()
+            peak = max(count for _, count in hist)
+            for low, count in hist:
+                bar = "#" * max(1, count * width // peak)
+                print(f"    {'>= ' + fmt_ns(low):>10} {count:8} {bar}")
+        print()
+
+    for name, count in sorted(analyzer.unmatched.items()):
+        print(f"{name}: {count} records without a start")
+    if analyzer.open:
+        print(f"{len(analyzer.open)} operations still open at the end")
+    if analyzer.dropped:
+        print(f"{analyzer.dropped} records dropped by the trace buffer; "
+              "some pairs may be missing")
+
+
+def get_args():
+    parser = argparse.ArgumentParser(description="ESP device latency "
+                                     "histograms from a simple trace")
+    parser.add_argument("--device", "-d", default="",
+                        help="only events starting with this prefix")
+    parser.add_argument("--json", help="also write the summaries here")
+    parser.add_argument("--width", type=int, default=40,
+                        help="width of the histogram bars")
+    parser.add_argument("events", help="trace-events-all of the build")
+    parser.add_argument("tracefile", help="trace file to read")
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    args = get_args()
+
+    with open(args.events) as f:
+        events = simpletrace.read_events(f, args.events)
+    analyzer = EspLatencyAnalyzer(events, args.device)
+    simpletrace.process(events, args.tracefile, analyzer)
+    report(analyzer, args.width)
+
+    if args.json:
+        out = {label: dict(kind=kind, **series.summary(),
+                           histogram=series.histogram())
+               for (name, kind, label), series in analyzer.series.items()}
+        with open(args.json, "w") as f:
+            json.dump(out, f, indent=2, sort_keys=True)
+            f.write("\n")
@@ -0,0 +1,281 @@
+#!/usr/bin/env python3
+#
+# Run a fleet of emulated ESP devices on one host
+#
+# Starts one QEMU process per device from the same flash image, pins each
+# to a host core, and reports per instance and in aggregate:
+#
+#   host CPU use        from /proc/PID/stat
+#   guest MIPS          from the insnstat plugin, if --plugin is given
+#   RSS and PSS         from /proc/PID/smaps_rollup
+#   WiFi throughput     from the esp32_wifi tx-bytes/rx-bytes properties
+#
+# Instances share what can be shared between processes: the mask ROM is
+# mapped from pc-bios and the flash image is opened with snapshot=on, so
+# both stay in the host page cache once.  Translated code is per process.
+#
+# Usage:
+#   scripts/esp-fleet.py --image flash.bin --instances 64 --cores 0-15 \
+#       --plugin build/contrib/plugins/libinsnstat.so --wifi -- -icount auto
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+
+import argparse
+import json
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+CLK_TCK = os.sysconf("SC_CLK_TCK")
+
+
+def parse_cpus(text):
+    """Parse a CPU list such as "0-3,8"."""
+    cpus = []
+    for part in text.split(","):
+        low, _, high = part.partition("-")
+        cpus.extend(range(int(low), int(high or low) + 1))
+    return cpus
+
+
+class QMP:
+    "Just enough of a QMP client to read properties."
+
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.settimeout(2)
+        self.sock.connect(path)
+        self.file = self.sock.makefile("rw")
+        self._read()
+        self.command("qmp_capabilities")
+
+    def _read(self):
+        while True:
+            msg = json.loads(self.file.readline())
+            if "event" not in msg:
+                return msg
+
+    def command(self, name, **args):
+        self.file.write(json.dumps({"execute": name, "arguments": args}))
+        self.file.flush()
+        msg = self._read()
+        if "error" in msg:
+            raise OSError(msg["error"]["desc"])
+        return msg["return"]
+
+    def close(self):
+        self.sock.close()
+
+
+class Instance:
+    def __init__(self, args, index, cpu, workdir):
+        self.index = index
+        self.cpu = cpu
+        self.dir = os.path.join(workdir, f"i{index}")
+        os.makedirs(self.dir)
+        self.qmp_path = os.path.join(self.dir, "qmp.sock")
+        self.insn_path = os.path.join(self.dir, "insns")
+        self.qmp = None
+        self.last = None
+
+        cmd = [
+            args.qemu,
+            "-M", args.machine,
+            "-accel", "tcg,thread=single",
+            "-display", "none",
+            "-monitor", "none",
+            "-no-reboot",
+            "-serial", f"file:{os.path.join(self.dir, 'serial.log')}",
+            "-qmp", f"unix:{self.qmp_path},server=on,wait=off",
+            "-drive", f"file={args.image},if=mtd,format=raw,snapshot=on",
+        ]
+        if args.plugin:
+            cmd += ["-plugin",
+                    f"{args.plugin},outfile={self.insn_path},"
+                    f"interval={int(args.interval * 1000)}"]
+        if args.wifi:
+            cmd += ["-nic", f"user,model=esp32_wifi,net={args.wifi_net}"]
+        cmd += args.qemu_args
+
+        def pin():
+            if cpu is not None:
+                os.sched_setaffinity(0, {cpu})
+
+        self.stderr = open(os.path.join(self.dir, "stderr.log"), "w")
+        self.proc = subprocess.Popen(cmd, stdin=subprocess.DEVNULL,
+                                     stdout=subprocess.DEVNULL,
+                                     stderr=self.stderr, preexec_fn=pin)
+
+    def _cpu_seconds(self):
+        with open(f"/proc/{self.proc.pid}/stat") as f:
+            fields = f.read().rsplit(")", 1)[1].split()
+        return (int(fields[11]) + int(fields[12])) / CLK_TCK
+
+    def _memory(self):
+        mem = {}
+        with open(f"/proc/{self.proc.pid}/smaps_rollup") as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) == 3 and parts[0] in ("Rss:", "Pss:"):
+                    mem[parts[0][:-1].lower()] = int(parts[1])
+        return mem
+
+    def _insns(self):
+        try:
+            with open(self.insn_path) as f:
+                return int(f.read().split()[1])
+        except (OSError, IndexError, ValueError):
+            return None
+
+    def _net(self):
+        try:
+            if self.qmp is None:
+                self.qmp = QMP(self.qmp_path)
+            return (self.qmp.command("qom-get", path="wifi",
+                                     property="tx-bytes"),
+                    self.qmp.command("qom-get", path="wifi",
+                                     property="rx-bytes"))
+        except (OSError, ValueError):
+            if self.qmp:
+                self.qmp.close()
+            self.qmp = None
+            return None
+
+    def sample(self, wifi):
+        """Returns the rates since the previous sample, or None."""
+        if self.proc.poll() is not None:
+            return None
+        now = time.monotonic()
+        cur = {"time": now, "cpu": self._cpu_seconds(),
+               "insns": self._insns(), "net": self._net() if wifi else None}
+        prev, self.last = self.last, cur
+        out = {"instance": self.index, "host_cpu": self.cpu}
+        out.update(self._memory())
+        if prev is None:
+            return out
+        dt = now - prev["time"]
+        out["cpu_pct"] = 100 * (cur["cpu"] - prev["cpu"]) / dt
+        if cur["insns"] is not None and prev["insns"] is not None:
+            out["mips"] = (cur["insns"] - prev["insns"]) / dt / 1e6
+        if cur["net"] and prev["net"]:
+            out["tx_kbps"] = (cur["net"][0] - prev["net"][0]) * 8 / dt / 1e3
+            out["rx_kbps"] = (cur["net"][1] - prev["net"][1]) * 8 / dt / 1e3
+        return out
+
+    def stop(self):
+        if self.qmp:
+            self.qmp.close()
+        if self.proc.poll() is None:
+            self.proc.send_signal(signal.SIGTERM)
+            try:
+                self.proc.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                self.proc.kill()
+                self.proc.wait()
+        self.stderr.close()
+
+
+def aggregate(samples, cores):
+    total = {"instances": len(samples), "cores": cores,
+             "devices_per_core": len(samples) / cores}
+    for key in ("cpu_pct", "mips", "rss", "pss", "tx_kbps", "rx_kbps"):
+        values = [s[key] for s in samples if key in s]
+        if values:
+            total[f"total_{key}"] = sum(values)
+            total[f"mean_{key}"] = sum(values) / len(values)
+    return total
+
+
+def show(total, samples, verbose):
+    line = (f"{total['instances']:4} running on {total['cores']} cores "
+            f"({total['devices_per_core']:.1f}/core)")
+    if "total_cpu_pct" in total:
+        line += f"  cpu {total['total_cpu_pct']:6.0f}%"
+    if "total_mips" in total:
+        line += (f"  {total['total_mips']:8.1f} MIPS "
+                 f"({total['mean_mips']:.1f}/dev)")
+    if "mean_pss" in total:
+        line += f"  pss {total['mean_pss'] / 1024:6.1f} MiB/dev"
+    if "total_tx_kbps" in total:
+        line += (f"  net tx {total['total_tx_kbps']:.0f} "
+                 f"rx {total['total_rx_kbps']:.0f} kbit/s")
+    print(line, flush=True)
+    if verbose:
+        for s in samples:
+            print("  " + " ".join(f"{k}={v:.1f}" if isinstance(v, float)
+                                  else f"{k}={v}" for k, v in s.items()))
+
+
+def get_args():
+    parser = argparse.ArgumentParser(description="Run and monitor many ESP "
+                                     "machines on one host")
+    parser.add_argument("--qemu", default="build/qemu-system-xtensa")
+    parser.add_argument("--machine", "-M", default="esp32")
+    parser.add_argument("--image", required=True, help="flash image")
+    parser.add_argument("--instances", "-n", type=int, default=8)
+    parser.add_argument("--cores", help="host CPUs to pin to, e.g. 0-7; "
+                        "instances are spread round robin")
+    parser.add_argument("--plugin", help="path of libinsnstat.so")
+    parser.add_argument("--wifi", action="store_true",
+                        help="attach esp32_wifi to a user network")
+    parser.add_argument("--wifi-net", default="192.168.4.0/24")
+    parser.add_argument("--interval", type=float, default=5,
+                        help="seconds between samples")
+    parser.add_argument("--duration", type=float, default=0,
+                        help="stop after this many seconds (default: ^C)")
+    parser.add_argument("--workdir", help="keep logs and sockets here")
+    parser.add_argument("--json", help="append one JSON line per sample")
+    parser.add_argument("--verbose", "-v", action="store_true")
+    parser.add_argument("qemu_args", nargs="*",
+                        help="extra QEMU arguments, after --")
+    return parser.parse_args()
+
+
+def main():
+    args = get_args()
+    cpus = parse_cpus(args.cores) if args.cores else None
+    workdir = args.workdir or tempfile.mkdtemp(prefix="esp-fleet-")
+    os.makedirs(workdir, exist_ok=True)
+
+    instances = []
+    out = open(args.json, "a") if args.json else None
+    start = time.monotonic()
+    try:
+        for i in range(args.instances):
+            cpu = cpus[i % len(cpus)] if cpus else None
+            instances.append(Instance(args, i, cpu, workdir))
+        while not args.duration or time.monotonic() - start < args.duration:
+            time.sleep(args.interval)
+            samples = [s for s in (i.sample(args.wifi) for i in instances)
+                       if s is not None]
+            if not samples:
+                print("all instances have exited", file=sys.stderr)
+                return 1
+            total = aggregate(samples,
+                              len(cpus) if cpus else os.cpu_count())
+            show(total, samples, args.verbose)
+            if out:
+                json.dump({"time": time.monotonic() - start, "total": total,
+                           "instances": samples}, out)
+                out.write("\n")
+                out.flush()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for i in instances:
+            i.stop()
+        if out:
+            out.close()
+        if not args.workdir:
+            shutil.rmtree(workdir, ignore_errors=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -49,57 +49,61 @@ DEF_HELPER_3(wsr_dbreakc, void, env, i32, i32)
 DEF_HELPER_2(wur_fpu2k_fcr, void, env, i32)
 DEF_HELPER_FLAGS_1(abs_s, TCG_CALL_NO_RWG_SE, f32, f32)
 DEF_HELPER_FLAGS_1(neg_s, TCG_CALL_NO_RWG_SE, f32, f32)
-DEF_HELPER_3(fpu2k_add_s, f32, env, f32, f32)
-DEF_HELPER_3(fpu2k_sub_s, f32, env, f32, f32)
-DEF_HELPER_3(fpu2k_mul_s, f32, env, f32, f32)
-DEF_HELPER_4(fpu2k_madd_s, f32, env, f32, f32, f32)
-DEF_HELPER_4(fpu2k_msub_s, f32, env, f32, f32, f32)
-DEF_HELPER_4(ftoi_s, i32, env, f32, i32, i32)
-DEF_HELPER_4(ftoui_s, i32, env, f32, i32, i32)
-DEF_HELPER_3(itof_s, f32, env, i32, i32)
-DEF_HELPER_3(uitof_s, f32, env, i32, i32)
-DEF_HELPER_2(cvtd_s, f64, env, f32)
-
-DEF_HELPER_3(un_s,  i32, env, f32, f32)
-DEF_HELPER_3(oeq_s, i32, env, f32, f32)
-DEF_HELPER_3(ueq_s, i32, env, f32, f32)
-DEF_HELPER_3(olt_s, i32, env, f32, f32)
-DEF_HELPER_3(ult_s, i32, env, f32, f32)
-DEF_HELPER_3(ole_s, i32, env, f32, f32)
-DEF_HELPER_3(ule_s, i32, env, f32, f32)
+/*
+ * The arithmetic, conversion and compare helpers only touch env->fp_status,
+ * which is not a TCG global, so the register globals stay live across them.
+ */
+DEF_HELPER_FLAGS_3(fpu2k_add_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_3(fpu2k_sub_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_3(fpu2k_mul_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_4(fpu2k_madd_s, TCG_CALL_NO_RWG, f32, env, f32, f32, f32)
+DEF_HELPER_FLAGS_4(fpu2k_msub_s, TCG_CALL_NO_RWG, f32, env, f32, f32, f32)
+DEF_HELPER_FLAGS_4(ftoi_s, TCG_CALL_NO_RWG, i32, env, f32, i32, i32)
+DEF_HELPER_FLAGS_4(ftoui_s, TCG_CALL_NO_RWG, i32, env, f32, i32, i32)
+DEF_HELPER_FLAGS_3(itof_s, TCG_CALL_NO_RWG, f32, env, i32, i32)
+DEF_HELPER_FLAGS_3(uitof_s, TCG_CALL_NO_RWG, f32, env, i32, i32)
+DEF_HELPER_FLAGS_2(cvtd_s, TCG_CALL_NO_RWG, f64, env, f32)
+
+DEF_HELPER_FLAGS_3(un_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(oeq_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(ueq_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(olt_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(ult_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(ole_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(ule_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
 
 DEF_HELPER_2(wur_fpu_fcr, void, env, i32)
 DEF_HELPER_1(rur_fpu_fsr, i32, env)
 DEF_HELPER_2(wur_fpu_fsr, void, env, i32)
 DEF_HELPER_FLAGS_1(abs_d, TCG_CALL_NO_RWG_SE, f64, f64)
 DEF_HELPER_FLAGS_1(neg_d, TCG_CALL_NO_RWG_SE, f64, f64)
-DEF_HELPER_3(add_d, f64, env, f64, f64)
-DEF_HELPER_3(add_s, f32, env, f32, f32)
-DEF_HELPER_3(sub_d, f64, env, f64, f64)
-DEF_HELPER_3(sub_s, f32, env, f32, f32)
-DEF_HELPER_3(mul_d, f64, env, f64, f64)
-DEF_HELPER_3(mul_s, f32, env, f32, f32)
-DEF_HELPER_4(madd_d, f64, env, f64, f64, f64)
-DEF_HELPER_4(madd_s, f32, env, f32, f32, f32)
-DEF_HELPER_4(msub_d, f64, env, f64, f64, f64)
-DEF_HELPER_4(msub_s, f32, env, f32, f32, f32)
-DEF_HELPER_3(mkdadj_d, f64, env, f64, f64)
-DEF_HELPER_3(mkdadj_s, f32, env, f32, f32)
-DEF_HELPER_2(mksadj_d, f64, env, f64)
-DEF_HELPER_2(mksadj_s, f32, env, f32)
-DEF_HELPER_4(ftoi_d, i32, env, f64, i32, i32)
-DEF_HELPER_4(ftoui_d, i32, env, f64, i32, i32)
-DEF_HELPER_3(itof_d, f64, env, i32, i32)
-DEF_HELPER_3(uitof_d, f64, env, i32, i32)
-DEF_HELPER_2(cvts_d, f32, env, f64)
-
-DEF_HELPER_3(un_d,  i32, env, f64, f64)
-DEF_HELPER_3(oeq_d, i32, env, f64, f64)
-DEF_HELPER_3(ueq_d, i32, env, f64, f64)
-DEF_HELPER_3(olt_d, i32, env, f64, f64)
-DEF_HELPER_3(ult_d, i32, env, f64, f64)
-DEF_HELPER_3(ole_d, i32, env, f64, f64)
-DEF_HELPER_3(ule_d, i32, env, f64, f64)
+DEF_HELPER_FLAGS_3(add_d, TCG_CALL_NO_RWG, f64, env, f64, f64)
+DEF_HELPER_FLAGS_3(add_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_3(sub_d, TCG_CALL_NO_RWG, f64, env, f64, f64)
+DEF_HELPER_FLAGS_3(sub_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_3(mul_d, TCG_CALL_NO_RWG, f64, env, f64, f64)
+DEF_HELPER_FLAGS_3(mul_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_4(madd_d, TCG_CALL_NO_RWG, f64, env, f64, f64, f64)
+DEF_HELPER_FLAGS_4(madd_s, TCG_CALL_NO_RWG, f32, env, f32, f32, f32)
+DEF_HELPER_FLAGS_4(msub_d, TCG_CALL_NO_RWG, f64, env, f64, f64, f64)
+DEF_HELPER_FLAGS_4(msub_s, TCG_CALL_NO_RWG, f32, env, f32, f32, f32)
+DEF_HELPER_FLAGS_3(mkdadj_d, TCG_CALL_NO_RWG, f64, env, f64, f64)
+DEF_HELPER_FLAGS_3(mkdadj_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_2(mksadj_d, TCG_CALL_NO_RWG, f64, env, f64)
+DEF_HELPER_FLAGS_2(mksadj_s, TCG_CALL_NO_RWG, f32, env, f32)
+DEF_HELPER_FLAGS_4(ftoi_d, TCG_CALL_NO_RWG, i32, env, f64, i32, i32)
+DEF_HELPER_FLAGS_4(ftoui_d, TCG_CALL_NO_RWG, i32, env, f64, i32, i32)
+DEF_HELPER_FLAGS_3(itof_d, TCG_CALL_NO_RWG, f64, env, i32, i32)
+DEF_HELPER_FLAGS_3(uitof_d, TCG_CALL_NO_RWG, f64, env, i32, i32)
+DEF_HELPER_FLAGS_2(cvts_d, TCG_CALL_NO_RWG, f32, env, f64)
+
+DEF_HELPER_FLAGS_3(un_d, TCG_CALL_NO_RWG, i32, env, f64, f64)
+DEF_HELPER_FLAGS_3(oeq_d, TCG_CALL_NO_RWG, i32, env, f64, f64)
+DEF_HELPER_FLAGS_3(ueq_d, TCG_CALL_NO_RWG, i32, env, f64, f64)
+DEF_HELPER_FLAGS_3(olt_d, TCG_CALL_NO_RWG, i32, env, f64, f64)
+DEF_HELPER_FLAGS_3(ult_d, TCG_CALL_NO_RWG, i32, env, f64, f64)
+DEF_HELPER_FLAGS_3(ole_d, TCG_CALL_NO_RWG, i32, env, f64, f64)
+DEF_HELPER_FLAGS_3(ule_d, TCG_CALL_NO_RWG, i32, env, f64, f64)
 
 DEF_HELPER_2(rer, i32, env, i32)
 DEF_HELPER_3(wer, void, env, i32, i32)
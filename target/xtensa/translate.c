@@ -328,6 +328,20 @@ static bool gen_check_cpenable(DisasContext *dc, uint32_t cp_mask)
     return true;
 }
 
+/*
+ * Jump slots 0 and 1 chain directly to the next TB.  The other targets are
+ * found at run time: JUMP_SLOT_LOOKUP does that without leaving generated
+ * code, JUMP_SLOT_EXIT returns to the main loop, which is needed when the
+ * instruction changed the memory map or the TB flags.
+ *
+ * XTENSA_OP_CHECK_INTERRUPTS alone (rfe, rfi, rfwo, rfwu, ...) does not
+ * need JUMP_SLOT_EXIT: the check_interrupts helper raises the pending
+ * interrupt with cpu_interrupt(), which sets icount_decr, so the TB that
+ * lookup_and_goto_ptr enters next exits at once and the interrupt is taken.
+ */
+#define JUMP_SLOT_LOOKUP -1
+#define JUMP_SLOT_EXIT -2
+
 static int gen_postprocess(DisasContext *dc, int slot);
 
 static void gen_jump_slot(DisasContext *dc, TCGv dest, int slot)
@@ -342,6 +356,8 @@ static void gen_jump_slot(DisasContext *dc, TCGv dest, int slot)
     if (slot >= 0) {
         tcg_gen_goto_tb(slot);
         tcg_gen_exit_tb(dc->base.tb, slot);
+    } else if (slot == JUMP_SLOT_LOOKUP) {
+        tcg_gen_lookup_and_goto_ptr();
     } else {
         tcg_gen_exit_tb(NULL, 0);
     }
@@ -350,12 +366,21 @@ static void gen_jump_slot(DisasContext *dc, TCGv dest, int slot)
 
 static void gen_jump(DisasContext *dc, TCGv dest)
 {
-    gen_jump_slot(dc, dest, -1);
+    gen_jump_slot(dc, dest, JUMP_SLOT_LOOKUP);
+}
+
+/* The slot for a jump that can't be chained, given the one requested */
+static int indirect_jump_slot(int slot)
+{
+    return slot == JUMP_SLOT_EXIT ? JUMP_SLOT_EXIT : JUMP_SLOT_LOOKUP;
 }
 
 static int adjust_jump_slot(DisasContext *dc, uint32_t dest, int slot)
 {
-    return translator_use_goto_tb(&dc->base, dest) ? slot : -1;
+    if (slot >= 0 && !translator_use_goto_tb(&dc->base, dest)) {
+        return JUMP_SLOT_LOOKUP;
+    }
+    return slot;
 }
 
 static void gen_jumpi(DisasContext *dc, uint32_t dest, int slot)
@@ -384,10 +409,10 @@ static bool gen_check_loop_end(DisasContext *dc, int slot)
         if (dc->lbeg_off) {
             gen_jumpi(dc, dc->base.pc_next - dc->lbeg_off, slot);
         } else {
-            gen_jump(dc, cpu_SR[LBEG]);
+            gen_jump_slot(dc, cpu_SR[LBEG], indirect_jump_slot(slot));
         }
         gen_set_label(label);
-        gen_jumpi(dc, dc->base.pc_next, -1);
+        gen_jumpi(dc, dc->base.pc_next, indirect_jump_slot(slot));
         return true;
     }
     return false;
@@ -554,7 +579,7 @@ static int gen_postprocess(DisasContext *dc, int slot)
         gen_helper_sync_windowbase(tcg_env);
     }
     if (op_flags & XTENSA_OP_EXIT_TB_M1) {
-        slot = -1;
+        slot = JUMP_SLOT_EXIT;
     }
     return slot;
 }
@@ -1078,7 +1103,7 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
         dc->op_flags = 0;
         if (op_flags & XTENSA_OP_EXIT_TB_M1) {
             /* Change in mmu index, memory mapping or tb->flags; exit tb */
-            gen_jumpi_check_loop_end(dc, -1);
+            gen_jumpi_check_loop_end(dc, JUMP_SLOT_EXIT);
         } else if (op_flags & XTENSA_OP_EXIT_TB_0) {
             gen_jumpi_check_loop_end(dc, 0);
         } else {
@@ -1452,7 +1477,7 @@ static void translate_callxw(DisasContext *dc, const OpcodeArg arg[],
     TCGv_i32 tmp = tcg_temp_new_i32();
 
     tcg_gen_mov_i32(tmp, arg[0].in);
-    gen_callw_slot(dc, par[0], tmp, -1);
+    gen_callw_slot(dc, par[0], tmp, JUMP_SLOT_LOOKUP);
 }
 
 static void translate_clamps(DisasContext *dc, const OpcodeArg arg[],
@@ -0,0 +1,753 @@
+/*
+ * ESP peripheral model microbenchmarks
+ *
+ * Drives the device models of the esp32, esp32s3 and esp32c3 machines
+ * through qtest and measures operations per second and the latency
+ * distribution of the hot paths firmware leans on: SPI flash, the crypto
+ * accelerators, GDMA, UART transmit, WiFi frame injection and the
+ * interrupt matrix.
+ *
+ * Every operation includes the qtest round trips of its register accesses,
+ * so the numbers are meant to be compared between builds on the same host,
+ * not against hardware.  Set ESP_BENCH_JSON to a file name to have one JSON
+ * object per result appended to it.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/units.h"
+#include "qemu/timer.h"
+#include "libqtest.h"
+
+typedef struct EspChip {
+    const char *machine;
+    bool esp32;             /* original ESP32 register layout */
+    uint32_t dram;          /* scratch area for descriptors and buffers */
+    uint32_t uart;
+    uint32_t spi1;
+    uint32_t spi_user1;
+    uint32_t spi_miso_dlen;
+    uint32_t spi_w0;
+    uint32_t sha;
+    uint32_t aes;
+    uint32_t rsa;
+    uint32_t gdma;          /* 0 if there is none */
+    uint32_t gdma_in;       /* channel 0 IN registers */
+    uint32_t gdma_out;      /* channel 0 OUT registers */
+    uint32_t gdma_link;     /* LINK offset within a direction */
+    uint32_t gdma_int_raw;
+    uint32_t gdma_int_clr;
+    uint32_t intr_map;      /* map entry of the FROM_CPU_INTR0 source */
+    uint32_t intr_line;     /* CPU interrupt it is routed to */
+    uint32_t intr_trigger;  /* register raising FROM_CPU_INTR0 */
+    uint32_t intr_riscv;    /* line enable/priority block, 0 on Xtensa */
+} EspChip;
+
+static const EspChip chips[] = {
+    {
+        .machine = "esp32",
+        .esp32 = true,
+        .dram = 0x3ffb0000,
+        .uart = 0x3ff40000,
+        .spi1 = 0x3ff42000,
+        .spi_user1 = 0x20,
+        .spi_miso_dlen = 0x2c,
+        .spi_w0 = 0x80,
+        .sha = 0x3ff03000,
+        .aes = 0x3ff01000,
+        .rsa = 0x3ff02000,
+        .intr_map = 0x3ff00104 + 24 * 4,
+        .intr_line = 2,
+        .intr_trigger = 0x3ff000dc,
+    }, {
+        .machine = "esp32s3",
+        .dram = 0x3fca0000,
+        .uart = 0x60000000,
+        .spi1 = 0x60002000,
+        .spi_user1 = 0x1c,
+        .spi_miso_dlen = 0x28,
+        .spi_w0 = 0x58,
+        .sha = 0x6003b000,
+        .aes = 0x6003a000,
+        .rsa = 0x6003c000,
+        .gdma = 0x6003f000,
+        .gdma_in = 0x00,
+        .gdma_out = 0x60,
+        .gdma_link = 0x20,
+        .gdma_int_raw = 0x08,
+        .gdma_int_clr = 0x14,
+        .intr_map = 0x600c2000 + 78 * 4,
+        .intr_line = 2,
+        .intr_trigger = 0x600c0030,
+    }, {
+        .machine = "esp32c3",
+        .dram = 0x3fca0000,
+        .uart = 0x60000000,
+        .spi1 = 0x60002000,
+        .spi_user1 = 0x1c,
+        .spi_miso_dlen = 0x28,
+        .spi_w0 = 0x58,
+        .sha = 0x6003b000,
+        .aes = 0x6003a000,
+        .rsa = 0x6003c000,
+        .gdma = 0x6003f000,
+        .gdma_in = 0x70,
+        .gdma_out = 0xd0,
+        .gdma_link = 0x10,
+        .gdma_int_raw = 0x00,
+        .gdma_int_clr = 0x0c,
+        .intr_map = 0x600c2000 + 50 * 4,
+        .intr_line = 1,
+        .intr_trigger = 0x600c0028,
+        .intr_riscv = 0x600c2000,
+    },
+};
+
+/* Samples of one benchmark; latencies in ns */
+typedef struct EspBench {
+    const EspChip *chip;
+    const char *name;
+    size_t bytes_per_op;
+    int64_t *lat;
+    int n;
+    int64_t start;
+} EspBench;
+
+static int ops(int n)
+{
+    return g_test_thorough() ? n * 10 : n;
+}
+
+static void bench_init(EspBench *b, const EspChip *chip, const char *name,
+                       int n, size_t bytes_per_op)
+{
+    b->chip = chip;
+    b->name = name;
+    b->bytes_per_op = bytes_per_op;
+    b->lat = g_new(int64_t, n);
+    b->n = 0;
+}
+
+static inline void bench_start(EspBench *b)
+{
+    b->start = get_clock();
+}
+
+static inline void bench_stop(EspBench *b)
+{
+    b->lat[b->n++] = get_clock() - b->start;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void bench_report(EspBench *b)
+{
+    const char *json = g_getenv("ESP_BENCH_JSON");
+    int64_t total = 0;
+    double ops_per_sec, mean_us, p50_us, p99_us, max_us;
+
+    g_assert(b->n > 0);
+    for (int i = 0; i < b->n; i++) {
+        total += b->lat[i];
+    }
+    qsort(b->lat, b->n, sizeof(*b->lat), cmp_int64);
+    ops_per_sec = b->n * 1e9 / MAX(total, 1);
+    mean_us = total / 1e3 / b->n;
+    p50_us = b->lat[b->n / 2] / 1e3;
+    p99_us = b->lat[(b->n - 1) * 99 / 100] / 1e3;
+    max_us = b->lat[b->n - 1] / 1e3;
+
+    g_test_message("%s/%s: %d ops, %.0f ops/s, mean %.1f us, "
+                   "p50 %.1f us, p99 %.1f us, max %.1f us",
+                   b->chip->machine, b->name, b->n, ops_per_sec,
+                   mean_us, p50_us, p99_us, max_us);
+    if (b->bytes_per_op) {
+        g_test_message("%s/%s: %.2f MB/s", b->chip->machine, b->name,
+                       ops_per_sec * b->bytes_per_op / MiB);
+    }
+
+    if (json && *json) {
+        FILE *f = fopen(json, "a");
+
+        g_assert(f);
+        fprintf(f, "{\"machine\": \"%s\", \"bench\": \"%s\", \"ops\": %d, "
+                "\"ops_per_sec\": %.1f, \"bytes_per_op\": %zu, "
+                "\"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, "
+                "\"max_us\": %.3f}\n",
+                b->chip->machine, b->name, b->n, ops_per_sec,
+                b->bytes_per_op, mean_us, p50_us, p99_us, max_us);
+        fclose(f);
+    }
+    g_free(b->lat);
+}
+
+/* SPI flash through the SPI1 command register */
+
+#define SPI_CMD             0x00
+#define SPI_ADDR            0x04
+#define SPI_CMD_READ        BIT(31)
+#define SPI_CMD_WREN        BIT(30)
+#define SPI_CMD_PP          BIT(25)
+#define SPI_CMD_SE          BIT(24)
+
+#define FLASH_SIZE          (4 * MiB)
+#define FLASH_AREA          (1 * MiB)   /* part the benchmarks walk over */
+
+static QTestState *flash_init(const EspChip *chip, char **image)
+{
+    QTestState *qts;
+    g_autofree uint8_t *content = g_malloc(FLASH_SIZE);
+    int fd;
+
+    /* an erased chip, with something recognisable at offset 0 */
+    memset(content, 0xff, FLASH_SIZE);
+    memset(content, 0xa5, 64);
+    fd = g_file_open_tmp("esp-bench-flash-XXXXXX", image, NULL);
+    g_assert(fd >= 0);
+    g_assert(write(fd, content, FLASH_SIZE) == FLASH_SIZE);
+    close(fd);
+
+    qts = qtest_initf("-machine %s -drive file=%s,if=mtd,format=raw",
+                      chip->machine, *image);
+    /* 24-bit addresses */
+    qtest_writel(qts, chip->spi1 + chip->spi_user1, 23u << 26);
+    return qts;
+}
+
+static void flash_cmd(QTestState *qts, const EspChip *chip, uint32_t cmd)
+{
+    qtest_writel(qts, chip->spi1 + SPI_CMD, cmd);
+    while (qtest_readl(qts, chip->spi1 + SPI_CMD) & cmd) {
+        /* the models finish synchronously, this is for completeness */
+    }
+}
+
+static void flash_fini(QTestState *qts, char *image)
+{
+    qtest_quit(qts);
+    unlink(image);
+    g_free(image);
+}
+
+static void bench_flash_read(const void *data)
+{
+    const EspChip *chip = data;
+    uint8_t buf[64];
+    EspBench b;
+    char *image;
+    QTestState *qts = flash_init(chip, &image);
+
+    bench_init(&b, chip, "spi-flash-read-64", ops(20000), sizeof(buf));
+    qtest_writel(qts, chip->spi1 + chip->spi_miso_dlen, sizeof(buf) * 8 - 1);
+    for (int i = 0; i < ops(20000); i++) {
+        bench_start(&b);
+        qtest_writel(qts, chip->spi1 + SPI_ADDR,
+                     (i * sizeof(buf)) % FLASH_AREA);
+        flash_cmd(qts, chip, SPI_CMD_READ);
+        qtest_memread(qts, chip->spi1 + chip->spi_w0, buf, sizeof(buf));
+        bench_stop(&b);
+    }
+    qtest_writel(qts, chip->spi1 + SPI_ADDR, 0);
+    flash_cmd(qts, chip, SPI_CMD_READ);
+    qtest_memread(qts, chip->spi1 + chip->spi_w0, buf, sizeof(buf));
+    g_assert_cmphex(buf[0], ==, 0xa5);
+    g_assert_cmphex(buf[sizeof(buf) - 1], ==, 0xa5);
+    bench_report(&b);
+    flash_fini(qts, image);
+}
+
+static void bench_flash_program(const void *data)
+{
+    const EspChip *chip = data;
+    uint8_t buf[32], check[32];
+    EspBench b;
+    char *image;
+    QTestState *qts = flash_init(chip, &image);
+
+    memset(buf, 0x5a, sizeof(buf));
+    bench_init(&b, chip, "spi-flash-program-32", ops(10000), sizeof(buf));
+    for (int i = 0; i < ops(10000); i++) {
+        bench_start(&b);
+        flash_cmd(qts, chip, SPI_CMD_WREN);
+        qtest_memwrite(qts, chip->spi1 + chip->spi_w0, buf, sizeof(buf));
+        qtest_writel(qts, chip->spi1 + SPI_ADDR,
+                     sizeof(buf) << 24 | (i * sizeof(buf)) % FLASH_AREA);
+        flash_cmd(qts, chip, SPI_CMD_PP);
+        bench_stop(&b);
+    }
+
+    /* past the preset bytes, so the page started out erased */
+    qtest_writel(qts, chip->spi1 + chip->spi_miso_dlen, sizeof(check) * 8 - 1);
+    qtest_writel(qts, chip->spi1 + SPI_ADDR, 2 * sizeof(buf));
+    flash_cmd(qts, chip, SPI_CMD_READ);
+    qtest_memread(qts, chip->spi1 + chip->spi_w0, check, sizeof(check));
+    g_assert(memcmp(buf, check, sizeof(buf)) == 0);
+    bench_report(&b);
+    flash_fini(qts, image);
+}
+
+static void bench_flash_erase(const void *data)
+{
+    const EspChip *chip = data;
+    EspBench b;
+    char *image;
+    QTestState *qts = flash_init(chip, &image);
+
+    bench_init(&b, chip, "spi-flash-erase-4k", ops(2000), 4 * KiB);
+    for (int i = 0; i < ops(2000); i++) {
+        bench_start(&b);
+        flash_cmd(qts, chip, SPI_CMD_WREN);
+        qtest_writel(qts, chip->spi1 + SPI_ADDR, (i * 4 * KiB) % FLASH_AREA);
+        flash_cmd(qts, chip, SPI_CMD_SE);
+        bench_stop(&b);
+    }
+    bench_report(&b);
+    flash_fini(qts, image);
+}
+
+/* SHA-256, one 64-byte block per operation */
+
+#define ESP32_SHA256_START      0x90
+#define ESP32_SHA256_CONTINUE   0x94
+#define ESP32_SHA256_LOAD       0x98
+#define ESP32_SHA256_BUSY       0x9c
+
+#define SHA_MODE                0x00
+#define SHA_MODE_SHA256         2
+#define SHA_START               0x10
+#define SHA_CONTINUE            0x14
+#define SHA_BUSY                0x18
+#define SHA_H_MEM               0x40
+#define SHA_M_MEM               0x80
+
+static void sha_block(QTestState *qts, const EspChip *chip,
+                      const uint32_t *block, bool first)
+{
+    if (chip->esp32) {
+        qtest_memwrite(qts, chip->sha, block, 64);
+        qtest_writel(qts, chip->sha + (first ? ESP32_SHA256_START
+                                             : ESP32_SHA256_CONTINUE), 1);
+        while (qtest_readl(qts, chip->sha + ESP32_SHA256_BUSY)) {
+        }
+    } else {
+        qtest_memwrite(qts, chip->sha + SHA_M_MEM, block, 64);
+        qtest_writel(qts, chip->sha + (first ? SHA_START : SHA_CONTINUE), 1);
+        while (qtest_readl(qts, chip->sha + SHA_BUSY)) {
+        }
+    }
+}
+
+/* First digest word of SHA-256("abc"), as the accelerator reports it */
+static uint32_t sha_abc(QTestState *qts, const EspChip *chip)
+{
+    uint32_t block[16] = { 0 };
+
+    if (chip->esp32) {
+        /* the ESP32 text registers hold big-endian words */
+        block[0] = cpu_to_le32(0x61626380);
+        block[15] = cpu_to_le32(24);
+        sha_block(qts, chip, block, true);
+        qtest_writel(qts, chip->sha + ESP32_SHA256_LOAD, 1);
+        return qtest_readl(qts, chip->sha);
+    }
+    block[0] = cpu_to_le32(0x80636261);
+    block[15] = cpu_to_le32(0x18000000);
+    sha_block(qts, chip, block, true);
+    return bswap32(qtest_readl(qts, chip->sha + SHA_H_MEM));
+}
+
+static void bench_sha256(const void *data)
+{
+    const EspChip *chip = data;
+    QTestState *qts = qtest_initf("-machine %s", chip->machine);
+    uint32_t block[16];
+    EspBench b;
+
+    if (!chip->esp32) {
+        qtest_writel(qts, chip->sha + SHA_MODE, SHA_MODE_SHA256);
+    }
+    g_assert_cmphex(sha_abc(qts, chip), ==, 0xba7816bf);
+
+    for (int i = 0; i < ARRAY_SIZE(block); i++) {
+        block[i] = g_test_rand_int();
+    }
+    bench_init(&b, chip, "sha256-block", ops(20000), sizeof(block));
+    for (int i = 0; i < ops(20000); i++) {
+        bench_start(&b);
+        sha_block(qts, chip, block, i == 0);
+        bench_stop(&b);
+    }
+    bench_report(&b);
+    qtest_quit(qts);
+}
+
+/* AES-128 encryption, one 16-byte block per operation */
+
+#define ESP32_AES_START         0x00
+#define ESP32_AES_IDLE          0x04
+#define ESP32_AES_MODE          0x08
+#define ESP32_AES_KEY           0x10
+#define ESP32_AES_TEXT          0x30
+
+#define AES_KEY                 0x00
+#define AES_TEXT_IN             0x20
+#define AES_TEXT_OUT            0x30
+#define AES_MODE                0x40
+#define AES_TRIGGER             0x48
+#define AES_STATE               0x4c
+#define AES_DMA_ENA             0x90
+
+static void bench_aes128(const void *data)
+{
+    const EspChip *chip = data;
+    QTestState *qts = qtest_initf("-machine %s", chip->machine);
+    uint8_t key[16], in[16], out[16];
+    EspBench b;
+
+    for (int i = 0; i < sizeof(key); i++) {
+        key[i] = i;
+        in[i] = i * 0x11;
+    }
+    if (chip->esp32) {
+        qtest_memwrite(qts, chip->aes + ESP32_AES_KEY, key, sizeof(key));
+        qtest_writel(qts, chip->aes + ESP32_AES_MODE, 0);
+    } else {
+        qtest_memwrite(qts, chip->aes + AES_KEY, key, sizeof(key));
+        qtest_writel(qts, chip->aes + AES_MODE, 0);
+        qtest_writel(qts, chip->aes + AES_DMA_ENA, 0);
+    }
+
+    bench_init(&b, chip, "aes128-block", ops(20000), sizeof(in));
+    for (int i = 0; i < ops(20000); i++) {
+        bench_start(&b);
+        if (chip->esp32) {
+            qtest_memwrite(qts, chip->aes + ESP32_AES_TEXT, in, sizeof(in));
+            qtest_writel(qts, chip->aes + ESP32_AES_START, 1);
+            while (!qtest_readl(qts, chip->aes + ESP32_AES_IDLE)) {
+            }
+            qtest_memread(qts, chip->aes + ESP32_AES_TEXT, out, sizeof(out));
+        } else {
+            qtest_memwrite(qts, chip->aes + AES_TEXT_IN, in, sizeof(in));
+            qtest_writel(qts, chip->aes + AES_TRIGGER, 1);
+            while (qtest_readl(qts, chip->aes + AES_STATE)) {
+            }
+            qtest_memread(qts, chip->aes + AES_TEXT_OUT, out, sizeof(out));
+        }
+        bench_stop(&b);
+    }
+    g_assert(memcmp(in, out, sizeof(in)) != 0);
+    bench_report(&b);
+    qtest_quit(qts);
+}
+
+/* RSA-2048 modular exponentiation with a full-length exponent */
+
+#define RSA_M_MEM               0x000
+#define RSA_Z_MEM               0x200
+#define RSA_Y_MEM               0x400
+#define RSA_X_MEM               0x600
+
+#define ESP32_RSA_M_DASH        0x800
+#define ESP32_RSA_MODEXP_MODE   0x804
+#define ESP32_RSA_MODEXP_START  0x808
+#define ESP32_RSA_INTERRUPT     0x814
+#define ESP32_RSA_CLEAN         0x818
+
+#define RSA_M_PRIME             0x800
+#define RSA_MODE                0x804
+#define RSA_CLEAN               0x808
+#define RSA_MODEXP_START        0x80c
+#define RSA_IDLE                0x818
+#define RSA_CLEAR_INTERRUPT     0x81c
+
+#define RSA_WORDS               (2048 / 32)
+
+static void bench_rsa2048(const void *data)
+{
+    const EspChip *chip = data;
+    QTestState *qts = qtest_initf("-machine %s", chip->machine);
+    uint32_t m[RSA_WORDS], x[RSA_WORDS], y[RSA_WORDS], z[RSA_WORDS];
+    EspBench b;
+
+    /* odd modulus with the top bit set, base below it */
+    for (int i = 0; i < RSA_WORDS; i++) {
+        m[i] = cpu_to_le32(g_test_rand_int() | (i == RSA_WORDS - 1 ? BIT(31) : 0)
+                           | (i == 0 ? 1 : 0));
+        x[i] = cpu_to_le32(i == RSA_WORDS - 1 ? 0 : g_test_rand_int());
+        y[i] = cpu_to_le32(g_test_rand_int() | (i == RSA_WORDS - 1 ? BIT(31) : 0));
+    }
+
+    if (chip->esp32) {
+        while (!qtest_readl(qts, chip->rsa + ESP32_RSA_CLEAN)) {
+        }
+        qtest_writel(qts, chip->rsa + ESP32_RSA_MODEXP_MODE,
+                     RSA_WORDS / 16 - 1);
+        /* the model computes M' itself */
+        qtest_writel(qts, chip->rsa + ESP32_RSA_M_DASH, 0);
+    } else {
+        while (!qtest_readl(qts, chip->rsa + RSA_CLEAN)) {
+        }
+        qtest_writel(qts, chip->rsa + RSA_MODE, RSA_WORDS - 1);
+        qtest_writel(qts, chip->rsa + RSA_M_PRIME, 0);
+    }
+
+    bench_init(&b, chip, "rsa2048-modexp", ops(100), 0);
+    for (int i = 0; i < ops(100); i++) {
+        bench_start(&b);
+        qtest_memwrite(qts, chip->rsa + RSA_M_MEM, m, sizeof(m));
+        qtest_memwrite(qts, chip->rsa + RSA_X_MEM, x, sizeof(x));
+        qtest_memwrite(qts, chip->rsa + RSA_Y_MEM, y, sizeof(y));
+        if (chip->esp32) {
+            qtest_writel(qts, chip->rsa + ESP32_RSA_MODEXP_START, 1);
+            while (!qtest_readl(qts, chip->rsa + ESP32_RSA_INTERRUPT)) {
+            }
+            qtest_writel(qts, chip->rsa + ESP32_RSA_INTERRUPT, 1);
+        } else {
+            qtest_writel(qts, chip->rsa + RSA_MODEXP_START, 1);
+            while (!qtest_readl(qts, chip->rsa + RSA_IDLE)) {
+            }
+            qtest_writel(qts, chip->rsa + RSA_CLEAR_INTERRUPT, 1);
+        }
+        qtest_memread(qts, chip->rsa + RSA_Z_MEM, z, sizeof(z));
+        bench_stop(&b);
+    }
+    g_assert(!buffer_is_zero(z, sizeof(z)));
+    bench_report(&b);
+    qtest_quit(qts);
+}
+
+/* GDMA memory-to-memory transfers on channel 0 */
+
+#define GDMA_CONF0              0x00
+#define GDMA_IN_MEM_TRANS_EN    BIT(4)
+#define GDMA_IN_LINK_START      BIT(22)
+#define GDMA_OUT_LINK_START     BIT(21)
+#define GDMA_IN_SUC_EOF         BIT(1)
+
+#define GDMA_DESC_OWNER         BIT(31)
+#define GDMA_DESC_SUC_EOF       BIT(30)
+
+#define GDMA_XFER_SIZE          4000
+
+static void bench_gdma(const void *data)
+{
+    const EspChip *chip = data;
+    QTestState *qts = qtest_initf("-machine %s", chip->machine);
+    const uint32_t out_desc = chip->dram;
+    const uint32_t in_desc = chip->dram + 0x10;
+    const uint32_t src = chip->dram + 0x1000;
+    const uint32_t dst = chip->dram + 0x2000;
+    g_autofree uint8_t *buf = g_malloc(GDMA_XFER_SIZE);
+    g_autofree uint8_t *check = g_malloc(GDMA_XFER_SIZE);
+    EspBench b;
+
+    for (int i = 0; i < GDMA_XFER_SIZE; i++) {
+        buf[i] = g_test_rand_int();
+    }
+    qtest_memwrite(qts, src, buf, GDMA_XFER_SIZE);
+
+    qtest_writel(qts, out_desc, GDMA_DESC_OWNER | GDMA_DESC_SUC_EOF |
+                 GDMA_XFER_SIZE << 12 | GDMA_XFER_SIZE);
+    qtest_writel(qts, out_desc + 4, src);
+    qtest_writel(qts, out_desc + 8, 0);
+    qtest_writel(qts, in_desc, GDMA_DESC_OWNER | GDMA_XFER_SIZE);
+    qtest_writel(qts, in_desc + 4, dst);
+    qtest_writel(qts, in_desc + 8, 0);
+    qtest_writel(qts, chip->gdma + chip->gdma_in + GDMA_CONF0,
+                 GDMA_IN_MEM_TRANS_EN);
+
+    bench_init(&b, chip, "gdma-mem2mem-4000", ops(20000), GDMA_XFER_SIZE);
+    for (int i = 0; i < ops(20000); i++) {
+        bench_start(&b);
+        qtest_writel(qts, chip->gdma + chip->gdma_out + chip->gdma_link,
+                     GDMA_OUT_LINK_START | (out_desc & 0xfffff));
+        qtest_writel(qts, chip->gdma + chip->gdma_in + chip->gdma_link,
+                     GDMA_IN_LINK_START | (in_desc & 0xfffff));
+        while (!(qtest_readl(qts, chip->gdma + chip->gdma_int_raw) &
+                 GDMA_IN_SUC_EOF)) {
+        }
+        qtest_writel(qts, chip->gdma + chip->gdma_int_clr, GDMA_IN_SUC_EOF);
+        bench_stop(&b);
+    }
+    qtest_memread(qts, dst, check, GDMA_XFER_SIZE);
+    g_assert(memcmp(buf, check, GDMA_XFER_SIZE) == 0);
+    bench_report(&b);
+    qtest_quit(qts);
+}
+
+/* UART0 transmit into a null backend, one FIFO write per byte */
+
+#define UART_FIFO               0x00
+#define UART_STATUS             0x1c
+
+static void bench_uart_tx(const void *data)
+{
+    const EspChip *chip = data;
+    QTestState *qts = qtest_initf("-machine %s -serial null", chip->machine);
+    EspBench b;
+
+    bench_init(&b, chip, "uart-tx-byte", ops(50000), 1);
+    for (int i = 0; i < ops(50000); i++) {
+        bench_start(&b);
+        qtest_writel(qts, chip->uart + UART_FIFO, 'a' + i % 26);
+        bench_stop(&b);
+    }
+    /* TXFIFO_CNT: everything went out */
+    g_assert_cmpuint((qtest_readl(qts, chip->uart + UART_STATUS) >> 16) & 0xff,
+                     ==, 0);
+    bench_report(&b);
+    qtest_quit(qts);
+}
+
+/*
+ * WiFi frame injection: every probe request sent through the outlink makes
+ * the emulated access points queue a probe response, and frames reach the
+ * guest through the inlink descriptor one inter-frame time apart.  Beacons
+ * share the same path.  An operation is one delivered frame.
+ */
+
+#define ESP32_ANA_WIFI_CHANNEL  (0x3ff4e000 + 196)
+#define ESP32_WIFI              0x3ff73000
+#define WIFI_DMA_INLINK         0x88
+#define WIFI_DMA_INT_STATUS     0xc48
+#define WIFI_DMA_INT_CLR        0xc4c
+#define WIFI_DMA_OUTLINK        0xd20
+#define WIFI_INT_RX             0x1000024
+#define WIFI_INT_TX             0x80
+
+static void bench_wifi_inject(const void *data)
+{
+    const EspChip *chip = data;
+    QTestState *qts = qtest_initf("-machine %s "
+                                  "-netdev hubport,id=wifi,hubid=0 "
+                                  "-net nic,model=esp32_wifi,netdev=wifi",
+                                  chip->machine);
+    const uint32_t out_desc = chip->dram;
+    const uint32_t in_desc = chip->dram + 0x10;
+    const uint32_t tx_buf = chip->dram + 0x1000;
+    const uint32_t rx_buf = chip->dram + 0x2000;
+    /* broadcast probe request with a wildcard SSID, FCS left zero */
+    static const uint8_t probe[30] = {
+        0x40, 0x00, 0x00, 0x00,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x00, 0x00,
+        0x00, 0x00,
+    };
+    EspBench b;
+
+    /* channel 6 has a single default access point */
+    qtest_writel(qts, ESP32_ANA_WIFI_CHANNEL, 74);
+
+    qtest_memwrite(qts, tx_buf, probe, sizeof(probe));
+    qtest_writel(qts, out_desc, GDMA_DESC_OWNER | GDMA_DESC_SUC_EOF |
+                 sizeof(probe) << 12 | sizeof(probe));
+    qtest_writel(qts, out_desc + 4, tx_buf);
+    qtest_writel(qts, out_desc + 8, 0);
+    /* a single receive descriptor linked to itself */
+    qtest_writel(qts, in_desc, GDMA_DESC_OWNER | 1600);
+    qtest_writel(qts, in_desc + 4, rx_buf);
+    qtest_writel(qts, in_desc + 8, in_desc);
+    qtest_writel(qts, ESP32_WIFI + WIFI_DMA_INLINK, in_desc);
+
+    bench_init(&b, chip, "wifi-inject-frame", ops(5000), 0);
+    for (int i = 0; i < ops(5000); i++) {
+        bench_start(&b);
+        qtest_writel(qts, ESP32_WIFI + WIFI_DMA_OUTLINK,
+                     0x80000000 | (out_desc & 0xfffff));
+        while (!(qtest_readl(qts, ESP32_WIFI + WIFI_DMA_INT_STATUS) &
+                 WIFI_INT_RX)) {
+            qtest_clock_step_next(qts);
+        }
+        qtest_writel(qts, ESP32_WIFI + WIFI_DMA_INT_CLR,
+                     WIFI_INT_RX | WIFI_INT_TX);
+        bench_stop(&b);
+    }
+    bench_report(&b);
+    qtest_quit(qts);
+}
+
+/*
+ * Interrupt matrix: raise and lower the FROM_CPU_INTR0 source with it
+ * routed to a CPU interrupt.  qtest does not run the CPU, so this times the
+ * source -> matrix -> CPU line propagation that every device interrupt
+ * goes through.
+ */
+
+#define INTR_RISCV_ENABLE       0x104
+#define INTR_RISCV_PRIO(line)   (0x118 + ((line) - 1) * 4)
+#define INTR_RISCV_THRESH       0x194
+
+static void bench_intmatrix(const void *data)
+{
+    const EspChip *chip = data;
+    QTestState *qts = qtest_initf("-machine %s", chip->machine);
+    EspBench b;
+
+    qtest_writel(qts, chip->intr_map, chip->intr_line);
+    g_assert_cmpuint(qtest_readl(qts, chip->intr_map), ==, chip->intr_line);
+    if (chip->intr_riscv) {
+        qtest_writel(qts, chip->intr_riscv + INTR_RISCV_PRIO(chip->intr_line), 1);
+        qtest_writel(qts, chip->intr_riscv + INTR_RISCV_THRESH, 1);
+        qtest_writel(qts, chip->intr_riscv + INTR_RISCV_ENABLE,
+                     BIT(chip->intr_line));
+    }
+
+    bench_init(&b, chip, "intmatrix-raise-lower", ops(50000), 0);
+    for (int i = 0; i < ops(50000); i++) {
+        bench_start(&b);
+        qtest_writel(qts, chip->intr_trigger, 1);
+        qtest_writel(qts, chip->intr_trigger, 0);
+        bench_stop(&b);
+    }
+    bench_report(&b);
+    qtest_quit(qts);
+}
+
+static void add_bench(const EspChip *chip, const char *name,
+                      GTestDataFunc fn)
+{
+    g_autofree char *path = g_strdup_printf("/esp-periph/%s/%s",
+                                            chip->machine, name);
+
+    qtest_add_data_func(path, chip, fn);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    for (int i = 0; i < ARRAY_SIZE(chips); i++) {
+        const EspChip *chip = &chips[i];
+
+        if (!qtest_has_machine(chip->machine)) {
+            continue;
+        }
+        add_bench(chip, "spi-flash-read", bench_flash_read);
+        add_bench(chip, "spi-flash-program", bench_flash_program);
+        add_bench(chip, "spi-flash-erase", bench_flash_erase);
+        add_bench(chip, "sha256", bench_sha256);
+        add_bench(chip, "aes128", bench_aes128);
+        add_bench(chip, "rsa2048", bench_rsa2048);
+        if (chip->gdma) {
+            add_bench(chip, "gdma", bench_gdma);
+        }
+        add_bench(chip, "uart-tx", bench_uart_tx);
+        if (chip->esp32) {
+            add_bench(chip, "wifi-inject", bench_wifi_inject);
+        }
+        add_bench(chip, "intmatrix", bench_intmatrix);
+    }
+
+    return g_test_run();
+}
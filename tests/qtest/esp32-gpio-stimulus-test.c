@@ -0,0 +1,124 @@
+/*
+ * QTest testcase for the ESP32 GPIO trace and stimulus properties
+ *
+ * A trace recorded with the "trace" property is fed back in through the
+ * "stimulus" property, and only the levels that were driven from outside
+ * must reach the inputs again.
+ *
+ * Copyright (c) 2026 Toit contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "libqtest.h"
+
+#define GPIO_BASE       0x3ff44000
+#define GPIO_OUT        (GPIO_BASE + 0x04)
+#define GPIO_IN         (GPIO_BASE + 0x3c)
+
+#define GPIO_PATH       "/machine/soc/gpio"
+#define GPIO_IN_NAME    "esp32_gpios_in"
+
+#define OUT_PIN         2
+#define IN_PIN          4
+
+static QTestState *gpio_start(const char *property, const char *path)
+{
+    return qtest_initf("-machine esp32 "
+                       "-global driver=esp32.gpio,property=%s,value=%s",
+                       property, path);
+}
+
+/*
+ * Drives OUT_PIN as an output from time 0 and pulses IN_PIN from the
+ * outside between 1 ms and 3 ms.
+ */
+static void gpio_record(const char *path)
+{
+    QTestState *qts = gpio_start("trace", path);
+
+    qtest_writel(qts, GPIO_OUT, BIT(OUT_PIN));
+    qtest_clock_step(qts, 1 * SCALE_MS);
+    qtest_set_irq_in(qts, GPIO_PATH, GPIO_IN_NAME, IN_PIN, 1);
+    qtest_clock_step(qts, 2 * SCALE_MS);
+    qtest_set_irq_in(qts, GPIO_PATH, GPIO_IN_NAME, IN_PIN, 0);
+    qtest_clock_step(qts, 1 * SCALE_MS);
+    /* the trace is complete once QEMU has exited */
+    qtest_quit(qts);
+}
+
+static void test_trace_round_trip(void)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *contents = NULL;
+    g_autofree char *out_var = g_strdup_printf(" gpio%d $end", OUT_PIN);
+    g_autofree char *in_var = g_strdup_printf(" gpio%d_in $end", IN_PIN);
+    QTestState *qts;
+    int fd;
+
+    fd = g_file_open_tmp("esp32-gpio-XXXXXX.vcd", &path, NULL);
+    g_assert(fd >= 0);
+    close(fd);
+
+    gpio_record(path);
+    g_assert(g_file_get_contents(path, &contents, NULL, NULL));
+    g_assert(strstr(contents, out_var));
+    g_assert(strstr(contents, in_var));
+
+    qts = gpio_start("stimulus", path);
+    qtest_clock_step(qts, 500 * SCALE_US);
+    g_assert_cmphex(qtest_readl(qts, GPIO_IN) & BIT(OUT_PIN), ==, 0);
+    g_assert_cmphex(qtest_readl(qts, GPIO_IN) & BIT(IN_PIN), ==, 0);
+    qtest_clock_step(qts, 1 * SCALE_MS);
+    g_assert_cmphex(qtest_readl(qts, GPIO_IN) & BIT(OUT_PIN), ==, 0);
+    g_assert_cmphex(qtest_readl(qts, GPIO_IN) & BIT(IN_PIN), ==, BIT(IN_PIN));
+    qtest_clock_step(qts, 2 * SCALE_MS);
+    g_assert_cmphex(qtest_readl(qts, GPIO_IN) & BIT(IN_PIN), ==, 0);
+    qtest_quit(qts);
+
+    unlink(path);
+}
+
+/* A hand-written VCD without "_in" variables drives the pins it names */
+static void test_plain_vcd(void)
+{
+    static const char vcd[] =
+        "$timescale 1us $end\n"
+        "$var wire 1 ! gpio5 $end\n"
+        "$enddefinitions $end\n"
+        "#0\n0!\n"
+        "#100\n1!\n";
+    g_autofree char *path = NULL;
+    QTestState *qts;
+    int fd;
+
+    fd = g_file_open_tmp("esp32-gpio-XXXXXX.vcd", &path, NULL);
+    g_assert(fd >= 0);
+    g_assert(qemu_write_full(fd, vcd, strlen(vcd)) == strlen(vcd));
+    close(fd);
+
+    qts = gpio_start("stimulus", path);
+    qtest_clock_step(qts, 50 * SCALE_US);
+    g_assert_cmphex(qtest_readl(qts, GPIO_IN) & BIT(5), ==, 0);
+    qtest_clock_step(qts, 100 * SCALE_US);
+    g_assert_cmphex(qtest_readl(qts, GPIO_IN) & BIT(5), ==, BIT(5));
+    qtest_quit(qts);
+
+    unlink(path);
+}
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (!qtest_has_machine("esp32")) {
+        g_test_skip("esp32 machine not available");
+        return g_test_run();
+    }
+    qtest_add_func("/esp32-gpio/stimulus/trace-round-trip",
+                   test_trace_round_trip);
+    qtest_add_func("/esp32-gpio/stimulus/plain-vcd", test_plain_vcd);
+    return g_test_run();
+}
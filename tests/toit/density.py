@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2026 Toit contributors.
+# Use of this source code is governed by an MIT-style license that can be
+# found in the LICENSE file.
+
+"""Boots several copies of a Toit flash image and reports their memory.
+
+All instances run at once, as they do on a busy CI host.  Once every guest
+has printed the pass marker, the host memory of each QEMU process is read
+from /proc.  The resident set counts pages shared with the other instances
+in full, so the proportional set size (PSS) is what bounds how many
+instances fit on a host.  Mappings of the pc-bios ROM images are reported
+separately, to show that they are shared rather than copied.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import threading
+import time
+
+ROM_SUFFIX = ("-rom.bin", "_rom.bin", "-rom-app.bin")
+
+
+def rollup(pid):
+    """Returns the smaps_rollup fields of pid in KiB."""
+    fields = {}
+    with open(f"/proc/{pid}/smaps_rollup") as f:
+        for line in f:
+            parts = line.split()
+            if len(parts) == 3 and parts[2] == "kB":
+                fields[parts[0].rstrip(":")] = int(parts[1])
+    with open(f"/proc/{pid}/status") as f:
+        for line in f:
+            if line.startswith("VmHWM:"):
+                fields["VmHWM"] = int(line.split()[1])
+    return fields
+
+
+def rom_mappings(pid):
+    """Returns the Rss and Pss of the ROM file mappings of pid in KiB."""
+    rss = pss = 0
+    rom = False
+    with open(f"/proc/{pid}/smaps") as f:
+        for line in f:
+            parts = line.split()
+            if not parts:
+                continue
+            if "-" in parts[0] and not parts[0].endswith(":"):
+                rom = len(parts) >= 6 and parts[-1].endswith(ROM_SUFFIX)
+            elif rom and parts[0] == "Rss:":
+                rss += int(parts[1])
+            elif rom and parts[0] == "Pss:":
+                pss += int(parts[1])
+    return rss, pss
+
+
+class Instance:
+    def __init__(self, args, index):
+        cmd = [
+            args.qemu,
+            "-M", args.machine,
+            "-accel", "tcg,thread=single",
+            "-nographic",
+            "-no-reboot",
+            # snapshot=on lets every instance open the same image.
+            "-drive", f"file={args.image},if=mtd,format=raw,snapshot=on",
+            "-global",
+            f"driver={args.wdt_driver},property=wdt_disable,value=true",
+        ]
+        self.index = index
+        self.passed = False
+        self.qemu = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT,
+                                     stdin=subprocess.DEVNULL)
+        self.thread = threading.Thread(target=self.reader, args=(args,),
+                                       daemon=True)
+        self.thread.start()
+
+    def reader(self, args):
+        for raw in self.qemu.stdout:
+            if raw.decode("utf-8", "replace").rstrip() == args.pass_marker:
+                self.passed = True
+
+    def stop(self):
+        self.qemu.kill()
+        self.qemu.wait()
+        self.thread.join(timeout=1)
+
+
+def run(args):
+    instances = [Instance(args, i) for i in range(args.instances)]
+    deadline = time.monotonic() + args.timeout
+    try:
+        while time.monotonic() < deadline:
+            if all(i.passed or i.qemu.poll() is not None for i in instances):
+                break
+            time.sleep(0.1)
+        time.sleep(args.settle)
+        samples = []
+        for i in instances:
+            if i.qemu.poll() is not None:
+                continue
+            fields = rollup(i.qemu.pid)
+            rom_rss, rom_pss = rom_mappings(i.qemu.pid)
+            samples.append({
+                "passed": i.passed,
+                "rss_kb": fields.get("Rss"),
+                "pss_kb": fields.get("Pss"),
+                "pss_anon_kb": fields.get("Pss_Anon"),
+                "pss_file_kb": fields.get("Pss_File"),
+                "peak_rss_kb": fields.get("VmHWM"),
+                "rom_rss_kb": rom_rss,
+                "rom_pss_kb": rom_pss,
+            })
+    finally:
+        for i in instances:
+            i.stop()
+    return samples
+
+
+def summarize(args, samples):
+    def mean(key):
+        values = [s[key] for s in samples if s[key] is not None]
+        return sum(values) / len(values) if values else None
+
+    result = {
+        "machine": args.machine,
+        "instances": args.instances,
+        "running": len(samples),
+        "passed": sum(s["passed"] for s in samples),
+    }
+    for key in ("rss_kb", "pss_kb", "pss_anon_kb", "pss_file_kb",
+                "peak_rss_kb", "rom_rss_kb", "rom_pss_kb"):
+        result[f"mean_{key}"] = mean(key)
+    pss = result["mean_pss_kb"]
+    result["total_pss_mb"] = pss * len(samples) / 1024 if pss else None
+    result["instances_per_gib"] = 1024 * 1024 / pss if pss else None
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--qemu", required=True)
+    parser.add_argument("--machine", required=True)
+    parser.add_argument("--wdt-driver", required=True)
+    parser.add_argument("--image", required=True)
+    parser.add_argument("--pass-marker", required=True)
+    parser.add_argument("--instances", type=int, default=8)
+    parser.add_argument("--timeout", type=float, default=120)
+    parser.add_argument("--settle", type=float, default=2,
+                        help="seconds to wait after the last guest passed")
+    parser.add_argument("--output", help="write the results as JSON here")
+    args = parser.parse_args()
+
+    if not os.path.exists("/proc/self/smaps_rollup"):
+        print("density.py needs Linux 4.14 or later.", file=sys.stderr)
+        return 2
+
+    samples = run(args)
+    result = summarize(args, samples)
+    result["samples"] = samples
+    text = json.dumps(result, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+    print(text)
+
+    if result["passed"] != args.instances:
+        print(f"{result['passed']} of {args.instances} instances reached "
+              f"'{args.pass_marker}'.", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
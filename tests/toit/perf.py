@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2026 Toit contributors.
+# Use of this source code is governed by an MIT-style license that can be
+# found in the LICENSE file.
+
+"""Boots a Toit flash image in QEMU and measures it from the host.
+
+Every line the guest prints on the UART is stamped with the host monotonic
+clock, taken relative to the moment QEMU was started.  QEMU's own messages
+on stderr are kept apart so that they never count as guest output.  The results are written as JSON
+and compared against a stored baseline; a metric that is worse than its
+baseline by more than the allowed percentage fails the run.
+"""
+
+import argparse
+import http.server
+import json
+import os
+import re
+import subprocess
+import sys
+import threading
+import time
+
+# name -> (unit, True if larger is better)
+METRICS = {
+    "first_uart_ms": ("ms", False),
+    "wifi_associated_ms": ("ms", False),
+    "dhcp_ms": ("ms", False),
+    "http_mb_per_s": ("MB/s", True),
+    "peak_rss_mb": ("MB", False),
+}
+
+DEFAULT_THRESHOLDS = {
+    "first_uart_ms": 25,
+    "wifi_associated_ms": 25,
+    "dhcp_ms": 50,
+    "http_mb_per_s": 20,
+    "peak_rss_mb": 15,
+}
+
+# The Toit WiFi service and ESP-IDF both log association and the DHCP
+# lease; whichever the envelope keeps is good enough.
+ASSOCIATED = re.compile(r"\[wifi\] INFO: connected|wifi:connected with")
+LEASED = re.compile(r"dynamically assigned through dhcp|sta ip:")
+
+
+class Payload(http.server.BaseHTTPRequestHandler):
+    size = 0
+
+    def do_GET(self):
+        self.send_response(200)
+        self.send_header("Content-Length", str(self.size))
+        self.end_headers()
+        chunk = bytes(65536)
+        left = self.size
+        while left > 0:
+            self.wfile.write(chunk[:left])
+            left -= len(chunk)
+
+    def log_message(self, format, *args):
+        pass
+
+
+def peak_rss_mb(pid):
+    try:
+        with open(f"/proc/{pid}/status") as f:
+            for line in f:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1]) / 1024
+    except OSError:
+        pass
+    return None
+
+
+def run(args):
+    server = None
+    if args.wifi:
+        Payload.size = args.payload_bytes
+        server = http.server.ThreadingHTTPServer(("127.0.0.1", args.port),
+                                                 Payload)
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    cmd = [
+        args.qemu,
+        "-M", args.machine,
+        "-accel", "tcg,thread=single",
+        "-nographic",
+        "-no-reboot",
+        "-drive", f"file={args.image},if=mtd,format=raw",
+        "-global", f"driver={args.wdt_driver},property=wdt_disable,value=true",
+    ]
+    if args.wifi:
+        cmd += ["-nic", "user,model=esp32_wifi,net=192.168.4.0/24"]
+
+    lines = []
+    errors = []
+    start = time.monotonic()
+    # -nographic puts the UART on stdout; warnings go to stderr.
+    qemu = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                            stderr=subprocess.PIPE, stdin=subprocess.DEVNULL)
+
+    def reader(stream, out):
+        for raw in stream:
+            stamp = (time.monotonic() - start) * 1000
+            out.append((stamp, raw.decode("utf-8", "replace").rstrip()))
+
+    threads = [
+        threading.Thread(target=reader, args=(qemu.stdout, lines),
+                         daemon=True),
+        threading.Thread(target=reader, args=(qemu.stderr, errors),
+                         daemon=True),
+    ]
+    for thread in threads:
+        thread.start()
+
+    passed = False
+    rss = None
+    deadline = start + args.timeout
+    while time.monotonic() < deadline and qemu.poll() is None:
+        if any(line == args.pass_marker for _, line in lines):
+            passed = True
+            break
+        time.sleep(0.1)
+    # VmHWM is the high-water mark, so reading it once at the end suffices.
+    rss = peak_rss_mb(qemu.pid)
+    qemu.kill()
+    qemu.wait()
+    for thread in threads:
+        thread.join(timeout=1)
+    if server:
+        server.shutdown()
+
+    def first(match):
+        for stamp, line in lines:
+            if match(line):
+                return stamp
+        return None
+
+    metrics = dict.fromkeys(METRICS)
+    metrics["first_uart_ms"] = lines[0][0] if lines else None
+    metrics["peak_rss_mb"] = rss
+    if args.wifi:
+        associated = first(ASSOCIATED.search)
+        leased = first(LEASED.search)
+        connected = first(lambda l: l.startswith("TOIT-QEMU-PERF: connected"))
+        http_start = first(lambda l: l == "TOIT-QEMU-PERF: http start")
+        http_done = None
+        for stamp, line in lines:
+            m = re.match(r"TOIT-QEMU-PERF: http done (\d+)$", line)
+            if m:
+                http_done, received = stamp, int(m.group(1))
+        metrics["wifi_associated_ms"] = associated
+        if associated is not None:
+            end = leased if leased is not None else connected
+            if end is not None:
+                metrics["dhcp_ms"] = end - associated
+        if http_start is not None and http_done is not None:
+            metrics["http_mb_per_s"] = \
+                received / ((http_done - http_start) / 1000) / 1e6
+
+    for stamp, line in lines:
+        print(f"[{stamp:9.1f}] {line}")
+    for stamp, line in errors:
+        print(f"[{stamp:9.1f}] qemu: {line}", file=sys.stderr)
+    return passed, metrics
+
+
+def compare(target, metrics, baseline, overrides):
+    thresholds = dict(DEFAULT_THRESHOLDS)
+    thresholds.update(baseline.get("thresholds", {}))
+    thresholds.update(overrides)
+    reference = baseline.get("targets", {}).get(target)
+    if not reference:
+        print(f"No baseline for {target}; nothing to compare.")
+        return True
+
+    ok = True
+    for name, (unit, larger_is_better) in METRICS.items():
+        value, base = metrics.get(name), reference.get(name)
+        if value is None or base is None:
+            continue
+        change = (value - base) / base * 100 if base else 0
+        worse = -change if larger_is_better else change
+        verdict = "ok"
+        if worse > thresholds[name]:
+            verdict = "REGRESSION"
+            ok = False
+        print(f"{name:20} {value:10.2f} {unit:5} baseline {base:10.2f} "
+              f"({change:+.1f}%, limit {thresholds[name]}%) {verdict}")
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--target", required=True)
+    parser.add_argument("--qemu", required=True)
+    parser.add_argument("--machine", required=True)
+    parser.add_argument("--wdt-driver", required=True)
+    parser.add_argument("--image", required=True)
+    parser.add_argument("--pass-marker", required=True)
+    parser.add_argument("--wifi", action="store_true")
+    parser.add_argument("--port", type=int, default=18082)
+    parser.add_argument("--payload-bytes", type=int, default=1024 * 1024)
+    parser.add_argument("--timeout", type=float, default=60)
+    parser.add_argument("--output", help="write the results as JSON here")
+    parser.add_argument("--baseline", help="baseline JSON to compare with")
+    parser.add_argument("--update-baseline", action="store_true",
+                        help="store the results in the baseline instead")
+    parser.add_argument("--threshold", action="append", default=[],
+                        metavar="METRIC=PERCENT",
+                        help="override the allowed regression of a metric")
+    args = parser.parse_args()
+
+    overrides = {}
+    for item in args.threshold:
+        name, _, pct = item.partition("=")
+        if name not in METRICS:
+            parser.error(f"unknown metric {name}")
+        overrides[name] = float(pct)
+
+    passed, metrics = run(args)
+    result = {"target": args.target, "machine": args.machine,
+              "metrics": metrics}
+    text = json.dumps(result, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+    print(text)
+
+    if not passed:
+        print(f"{args.target} did not reach '{args.pass_marker}'.",
+              file=sys.stderr)
+        return 1
+
+    if not args.baseline:
+        return 0
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    if args.update_baseline:
+        baseline.setdefault("thresholds", dict(DEFAULT_THRESHOLDS))
+        baseline.setdefault("targets", {})[args.target] = metrics
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print(f"Updated {args.target} in {args.baseline}.")
+        return 0
+    return 0 if compare(args.target, metrics, baseline, overrides) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+
+# Copyright (C) 2026 Toit contributors.
+# Use of this source code is governed by an MIT-style license that can be
+# found in the LICENSE file.
+
+# Boots DENSITY_INSTANCES copies of the boot container on TARGET at once and
+# reports the resident and proportional memory of each QEMU process as JSON.
+
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+TARGET="${1:-}"
+TOIT="${TOIT:-toit}"
+QEMU_TIMEOUT_TICKS="${QEMU_TIMEOUT_TICKS:-1200}"
+DENSITY_INSTANCES="${DENSITY_INSTANCES:-8}"
+DENSITY_OUTPUT="${DENSITY_OUTPUT:-density-${TARGET}.json}"
+
+case "${TARGET}" in
+  esp32|esp32s3)
+    QEMU="${QEMU_SYSTEM_XTENSA:-${ROOT_DIR}/build/qemu-system-xtensa}"
+    ENVELOPE="${TOIT_WIFI_ENVELOPE:-}"
+    ENVELOPE_VAR="TOIT_WIFI_ENVELOPE"
+    ;;
+  esp32c3)
+    QEMU="${QEMU_SYSTEM_RISCV32:-${ROOT_DIR}/build/qemu-system-riscv32}"
+    ENVELOPE="${TOIT_C3_ENVELOPE:-}"
+    ENVELOPE_VAR="TOIT_C3_ENVELOPE"
+    ;;
+  *)
+    echo "Usage: $0 {esp32|esp32s3|esp32c3}" >&2
+    exit 2
+    ;;
+esac
+
+if [[ ! -x "${QEMU}" ]]; then
+  echo "QEMU is not executable: ${QEMU}" >&2
+  exit 2
+fi
+
+if [[ -z "${ENVELOPE}" || ! -f "${ENVELOPE}" ]]; then
+  echo "Set ${ENVELOPE_VAR} to a current ${TARGET} envelope." >&2
+  exit 2
+fi
+
+TEMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TEMP_DIR}"' EXIT
+
+"${TOIT}" compile -Werror -s \
+  -o "${TEMP_DIR}/boot.snapshot" \
+  "${ROOT_DIR}/tests/toit/boot.toit"
+"${TOIT}" tool snapshot-to-image -m32 --format=binary \
+  -o "${TEMP_DIR}/boot.image" \
+  "${TEMP_DIR}/boot.snapshot"
+"${TOIT}" tool firmware --envelope="${ENVELOPE}" container install \
+  --output="${TEMP_DIR}/boot.envelope" \
+  boot-test "${TEMP_DIR}/boot.image"
+"${TOIT}" tool firmware --envelope="${TEMP_DIR}/boot.envelope" extract \
+  --format=image \
+  --output="${TEMP_DIR}/boot.bin"
+
+python3 "${ROOT_DIR}/tests/toit/density.py" \
+  --qemu "${QEMU}" \
+  --machine "${TARGET}" \
+  --wdt-driver "timer.${TARGET}.timg" \
+  --image "${TEMP_DIR}/boot.bin" \
+  --pass-marker "TOIT-QEMU-BOOT: PASS" \
+  --instances "${DENSITY_INSTANCES}" \
+  --timeout "$((QEMU_TIMEOUT_TICKS / 10))" \
+  --output "${DENSITY_OUTPUT}"
@@ -0,0 +1,142 @@
+#!/usr/bin/env bash
+
+# Copyright (C) 2026 Toit contributors.
+# Use of this source code is governed by an MIT-style license that can be
+# found in the LICENSE file.
+
+# Measures TCP throughput through the open_eth NIC: the guest streams
+# BENCH_BYTES to a local sink, which then streams the same amount back.
+
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+TARGET="${1:-}"
+TOIT_ETH_ENVELOPE="${TOIT_ETH_ENVELOPE:-}"
+TOIT="${TOIT:-toit}"
+HOST_BENCH_PORT="${HOST_BENCH_PORT:-18081}"
+QEMU_TIMEOUT_TICKS="${QEMU_TIMEOUT_TICKS:-1200}"
+BENCH_BYTES=$((4 * 1024 * 1024))
+
+case "${TARGET}" in
+  esp32)
+    QEMU="${QEMU_SYSTEM_XTENSA:-${ROOT_DIR}/build/qemu-system-xtensa}"
+    MACHINE="esp32"
+    WDT_DRIVER="timer.esp32.timg"
+    ;;
+  esp32c3)
+    QEMU="${QEMU_SYSTEM_RISCV32:-${ROOT_DIR}/build/qemu-system-riscv32}"
+    MACHINE="esp32c3"
+    WDT_DRIVER="timer.esp32c3.timg"
+    ;;
+  *)
+    echo "Usage: $0 {esp32|esp32c3}" >&2
+    exit 2
+    ;;
+esac
+
+if [[ ! -x "${QEMU}" ]]; then
+  echo "QEMU is not executable: ${QEMU}" >&2
+  exit 2
+fi
+
+if [[ ! "${HOST_BENCH_PORT}" =~ ^[0-9]+$ ]]; then
+  echo "HOST_BENCH_PORT must be a port number." >&2
+  exit 2
+fi
+
+if [[ -z "${TOIT_ETH_ENVELOPE}" || ! -f "${TOIT_ETH_ENVELOPE}" ]]; then
+  echo "Set TOIT_ETH_ENVELOPE to a current ${TARGET} Ethernet envelope." >&2
+  exit 2
+fi
+
+TEMP_DIR="$(mktemp -d)"
+SINK_PID=""
+QEMU_PID=""
+
+cleanup() {
+  if [[ -n "${QEMU_PID}" ]]; then
+    kill "${QEMU_PID}" 2>/dev/null || true
+    wait "${QEMU_PID}" 2>/dev/null || true
+  fi
+  if [[ -n "${SINK_PID}" ]]; then
+    kill "${SINK_PID}" 2>/dev/null || true
+    wait "${SINK_PID}" 2>/dev/null || true
+  fi
+  rm -rf "${TEMP_DIR}"
+}
+trap cleanup EXIT
+
+# The guest connects to the sink's port, so build it into the program.
+sed "s/^PORT ::= .*/PORT ::= ${HOST_BENCH_PORT}/" \
+  "${ROOT_DIR}/tests/toit/ethernet-bench.toit" >"${TEMP_DIR}/ethernet-bench.toit"
+"${TOIT}" compile -Werror -s \
+  -o "${TEMP_DIR}/bench.snapshot" \
+  "${TEMP_DIR}/ethernet-bench.toit"
+"${TOIT}" tool snapshot-to-image -m32 --format=binary \
+  -o "${TEMP_DIR}/bench.image" \
+  "${TEMP_DIR}/bench.snapshot"
+"${TOIT}" tool firmware --envelope="${TOIT_ETH_ENVELOPE}" container install \
+  --output="${TEMP_DIR}/bench.envelope" \
+  ethernet-bench "${TEMP_DIR}/bench.image"
+"${TOIT}" tool firmware --envelope="${TEMP_DIR}/bench.envelope" extract \
+  --format=image \
+  --output="${TEMP_DIR}/bench.bin"
+
+# Host side of the transfer, timed with the host clock.
+python3 - "${HOST_BENCH_PORT}" "${BENCH_BYTES}" >"${TEMP_DIR}/sink.log" 2>&1 <<'PY' &
+import socket, sys, time
+
+port, size = int(sys.argv[1]), int(sys.argv[2])
+srv = socket.create_server(("127.0.0.1", port))
+print("listening", flush=True)
+conn, _ = srv.accept()
+start, received = time.monotonic(), 0
+while data := conn.recv(65536):
+    received += len(data)
+rx = time.monotonic() - start
+start, chunk, sent = time.monotonic(), bytes(65536), 0
+while sent < size:
+    sent += conn.send(chunk[:size - sent])
+conn.close()
+tx = time.monotonic() - start
+print(f"guest->host {received} bytes {received / rx / 1e6:.2f} MB/s")
+print(f"host->guest {sent} bytes {sent / tx / 1e6:.2f} MB/s", flush=True)
+PY
+SINK_PID="$!"
+
+for _ in {1..50}; do
+  grep -q '^listening' "${TEMP_DIR}/sink.log" && break
+  sleep 0.1
+done
+
+"${QEMU}" \
+  -M "${MACHINE}" \
+  -accel tcg,thread=single \
+  -nographic \
+  -no-reboot \
+  -drive "file=${TEMP_DIR}/bench.bin,if=mtd,format=raw" \
+  -global "driver=${WDT_DRIVER},property=wdt_disable,value=true" \
+  -nic "user,model=open_eth,net=192.168.4.0/24" \
+  >"${TEMP_DIR}/qemu.log" 2>&1 &
+QEMU_PID="$!"
+
+PASSED=false
+for ((tick = 0; tick < QEMU_TIMEOUT_TICKS; tick++)); do
+  if grep -q '^TOIT-QEMU-ETH: PASS' "${TEMP_DIR}/qemu.log" &&
+      grep -q '^host->guest' "${TEMP_DIR}/sink.log"; then
+    PASSED=true
+    break
+  fi
+  if ! kill -0 "${QEMU_PID}" 2>/dev/null; then
+    break
+  fi
+  sleep 0.1
+done
+
+cat "${TEMP_DIR}/qemu.log"
+cat "${TEMP_DIR}/sink.log"
+
+if [[ "${PASSED}" != true ]]; then
+  echo "${TARGET} Ethernet benchmark failed." >&2
+  exit 1
+fi
@@ -0,0 +1,94 @@
+#!/usr/bin/env bash
+
+# Copyright (C) 2026 Toit contributors.
+# Use of this source code is governed by an MIT-style license that can be
+# found in the LICENSE file.
+
+# Boots a Toit container on TARGET and records boot, WiFi, DHCP, HTTP and
+# host memory figures as JSON, then compares them with perf-baseline.json.
+# Set PERF_UPDATE_BASELINE=1 to store the results as the new baseline.
+
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+TARGET="${1:-}"
+TOIT="${TOIT:-toit}"
+HOST_PERF_PORT="${HOST_PERF_PORT:-18082}"
+QEMU_TIMEOUT_TICKS="${QEMU_TIMEOUT_TICKS:-600}"
+PERF_BASELINE="${PERF_BASELINE:-${ROOT_DIR}/tests/toit/perf-baseline.json}"
+PERF_OUTPUT="${PERF_OUTPUT:-perf-${TARGET}.json}"
+PERF_UPDATE_BASELINE="${PERF_UPDATE_BASELINE:-}"
+
+case "${TARGET}" in
+  esp32|esp32s3)
+    QEMU="${QEMU_SYSTEM_XTENSA:-${ROOT_DIR}/build/qemu-system-xtensa}"
+    ENVELOPE="${TOIT_WIFI_ENVELOPE:-}"
+    ENVELOPE_VAR="TOIT_WIFI_ENVELOPE"
+    PROGRAM="perf"
+    PASS_MARKER="TOIT-QEMU-PERF: PASS"
+    EXTRA_ARGS=(--wifi --port "${HOST_PERF_PORT}")
+    ;;
+  esp32c3)
+    # The C3 machine has no WiFi model, so only boot and memory are measured.
+    QEMU="${QEMU_SYSTEM_RISCV32:-${ROOT_DIR}/build/qemu-system-riscv32}"
+    ENVELOPE="${TOIT_C3_ENVELOPE:-}"
+    ENVELOPE_VAR="TOIT_C3_ENVELOPE"
+    PROGRAM="boot"
+    PASS_MARKER="TOIT-QEMU-BOOT: PASS"
+    EXTRA_ARGS=()
+    ;;
+  *)
+    echo "Usage: $0 {esp32|esp32s3|esp32c3}" >&2
+    exit 2
+    ;;
+esac
+
+if [[ ! -x "${QEMU}" ]]; then
+  echo "QEMU is not executable: ${QEMU}" >&2
+  exit 2
+fi
+
+if [[ ! "${HOST_PERF_PORT}" =~ ^[0-9]+$ ]]; then
+  echo "HOST_PERF_PORT must be a port number." >&2
+  exit 2
+fi
+
+if [[ -z "${ENVELOPE}" || ! -f "${ENVELOPE}" ]]; then
+  echo "Set ${ENVELOPE_VAR} to a current ${TARGET} envelope." >&2
+  exit 2
+fi
+
+if [[ -n "${PERF_UPDATE_BASELINE}" ]]; then
+  EXTRA_ARGS+=(--update-baseline)
+fi
+
+TEMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TEMP_DIR}"' EXIT
+
+# The guest connects to the HTTP server's port, so build it into the program.
+sed "s/^PORT ::= .*/PORT ::= ${HOST_PERF_PORT}/" \
+  "${ROOT_DIR}/tests/toit/${PROGRAM}.toit" >"${TEMP_DIR}/${PROGRAM}.toit"
+"${TOIT}" compile -Werror -s \
+  -o "${TEMP_DIR}/${PROGRAM}.snapshot" \
+  "${TEMP_DIR}/${PROGRAM}.toit"
+"${TOIT}" tool snapshot-to-image -m32 --format=binary \
+  -o "${TEMP_DIR}/${PROGRAM}.image" \
+  "${TEMP_DIR}/${PROGRAM}.snapshot"
+"${TOIT}" tool firmware --envelope="${ENVELOPE}" container install \
+  --output="${TEMP_DIR}/${PROGRAM}.envelope" \
+  "${PROGRAM}-test" "${TEMP_DIR}/${PROGRAM}.image"
+"${TOIT}" tool firmware --envelope="${TEMP_DIR}/${PROGRAM}.envelope" extract \
+  --format=image \
+  --output="${TEMP_DIR}/${PROGRAM}.bin"
+
+python3 "${ROOT_DIR}/tests/toit/perf.py" \
+  --target "${TARGET}" \
+  --qemu "${QEMU}" \
+  --machine "${TARGET}" \
+  --wdt-driver "timer.${TARGET}.timg" \
+  --image "${TEMP_DIR}/${PROGRAM}.bin" \
+  --pass-marker "${PASS_MARKER}" \
+  --timeout "$((QEMU_TIMEOUT_TICKS / 10))" \
+  --output "${PERF_OUTPUT}" \
+  --baseline "${PERF_BASELINE}" \
+  ${EXTRA_ARGS[@]+"${EXTRA_ARGS[@]}"}